@@ -4,6 +4,15 @@ const builtin = @import("builtin");
 const Step = std.Build.Step;
 
 fn addCaptureLib(b: *std.Build, compile: *Step.Compile) void {
+    if (compile.rootModuleTarget().os.tag == .linux) {
+        compile.linkLibC();
+        compile.linkSystemLibrary("X11");
+        compile.linkSystemLibrary("Xext");
+        compile.linkSystemLibrary("Xdamage");
+        compile.linkSystemLibrary("Xfixes");
+        return;
+    }
+
     compile.addIncludePath(std.Build.path(b, "native"));
     compile.addObjectFile(std.Build.path(b, "native/screencap.o"));
 }
@@ -20,6 +29,7 @@ fn addImgLib(b: *std.Build, compile: *Step.Compile) void {
 }
 
 fn addMacosDeps(b: *std.Build, compile: *Step.Compile) void {
+    if (compile.rootModuleTarget().os.tag != .macos) return;
     const objc = b.dependency("zig-objc", .{});
     compile.root_module.addImport("objc", objc.module("objc"));
     compile.linkSystemLibrary("objc");
@@ -46,6 +56,8 @@ pub fn build(b: *std.Build) void {
     const optimize = b.standardOptimizeOption(.{});
 
     const timerModule = b.addModule("timer", .{ .root_source_file = .{ .path = "src/timer.zig" } });
+    const resampleModule = b.addModule("resample", .{ .root_source_file = .{ .path = "src/util/resample.zig" } });
+    const pixelModule = b.addModule("pixel", .{ .root_source_file = .{ .path = "src/util/pixel.zig" } });
 
     // quantization library
     const quantizeLib = b.addStaticLibrary(.{
@@ -55,6 +67,7 @@ pub fn build(b: *std.Build) void {
         .optimize = optimize,
     });
     addImport(quantizeLib, "timer", timerModule);
+    addImport(quantizeLib, "pixel", pixelModule);
     const quantizeModule = &quantizeLib.root_module;
 
     // zgif library
@@ -66,8 +79,20 @@ pub fn build(b: *std.Build) void {
     });
     addCGif(b, zgifLibrary);
     addImport(zgifLibrary, "quantize", quantizeModule);
+    addImport(zgifLibrary, "resample", resampleModule);
     const zgifModule = &zgifLibrary.root_module;
 
+    // zpng library
+    const zpngLibrary = b.addStaticLibrary(.{
+        .name = "zpng",
+        .root_source_file = .{ .path = "src/png/png.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    addImport(zpngLibrary, "zgif", zgifModule);
+    addImport(zpngLibrary, "quantize", quantizeModule);
+    addImport(zpngLibrary, "pixel", pixelModule);
+
     const library = b.addStaticLibrary(.{
         .name = "frametap",
         // In this case the main source file is merely a path, however, in more
@@ -78,6 +103,9 @@ pub fn build(b: *std.Build) void {
     });
 
     addImport(library, "zgif", zgifModule);
+    addImport(library, "zpng", &zpngLibrary.root_module);
+    addImport(library, "resample", resampleModule);
+    addImport(library, "pixel", pixelModule);
     addCaptureLib(b, library);
     b.installArtifact(library);
 
@@ -119,10 +147,30 @@ pub fn build(b: *std.Build) void {
         reduce_colors_exe.root_module.addImport("clap", clap.module("clap"));
 
         addImgLib(b, reduce_colors_exe); // add stb for parsing PNG, etc.
+        reduce_colors_exe.linkLibC();
         addImport(reduce_colors_exe, "quantize", quantizeModule);
+        addImport(reduce_colors_exe, "zpng", &zpngLibrary.root_module);
+        addImport(reduce_colors_exe, "resample", resampleModule);
+        addImport(reduce_colors_exe, "pixel", pixelModule);
         b.installArtifact(reduce_colors_exe);
     }
 
+    {
+        const gif_optimize_exe = b.addExecutable(.{
+            .name = "gif-optimize",
+            .root_source_file = .{ .path = "src/tools/gif-optimize.zig" },
+            .target = target,
+            .optimize = std.builtin.OptimizeMode.ReleaseFast,
+        });
+
+        const clap = b.dependency("clap", .{});
+        gif_optimize_exe.root_module.addImport("clap", clap.module("clap"));
+
+        gif_optimize_exe.linkLibC(); // cgif
+        addImport(gif_optimize_exe, "zgif", zgifModule);
+        b.installArtifact(gif_optimize_exe);
+    }
+
     {
         const benchmark_exe = b.addExecutable(.{
             .name = "benchmark",
@@ -135,6 +183,44 @@ pub fn build(b: *std.Build) void {
         b.installArtifact(benchmark_exe);
     }
 
+    {
+        const lzw_benchmark_exe = b.addExecutable(.{
+            .name = "lzw-benchmark",
+            .root_source_file = .{ .path = "src/gif/lzw-benchmark.zig" },
+            .target = target,
+            .optimize = std.builtin.OptimizeMode.ReleaseFast,
+        });
+
+        addCGif(b, lzw_benchmark_exe);
+        lzw_benchmark_exe.linkLibC();
+        addImport(lzw_benchmark_exe, "quantize", quantizeModule);
+        b.installArtifact(lzw_benchmark_exe);
+    }
+
+    {
+        const palette_order_benchmark_exe = b.addExecutable(.{
+            .name = "palette-order-benchmark",
+            .root_source_file = .{ .path = "src/gif/palette-order-benchmark.zig" },
+            .target = target,
+            .optimize = std.builtin.OptimizeMode.ReleaseFast,
+        });
+
+        addImport(palette_order_benchmark_exe, "quantize", quantizeModule);
+        b.installArtifact(palette_order_benchmark_exe);
+    }
+
+    {
+        const pixel_benchmark_exe = b.addExecutable(.{
+            .name = "pixel-benchmark",
+            .root_source_file = .{ .path = "src/util/pixel-benchmark.zig" },
+            .target = target,
+            .optimize = std.builtin.OptimizeMode.ReleaseFast,
+        });
+
+        addImport(pixel_benchmark_exe, "pixel", pixelModule);
+        b.installArtifact(pixel_benchmark_exe);
+    }
+
     // TODO: re-add the C library
     // {
     //     const dll = b.addSharedLibrary(.{
@@ -164,9 +250,90 @@ pub fn build(b: *std.Build) void {
 
     const run_main_tests = b.addRunArtifact(main_tests);
 
+    const zgif_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/gif/gif.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    addCGif(b, zgif_tests);
+    zgif_tests.linkLibC();
+    addImport(zgif_tests, "quantize", quantizeModule);
+    addImport(zgif_tests, "resample", resampleModule);
+
+    const run_zgif_tests = b.addRunArtifact(zgif_tests);
+
+    const quantize_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/quantize/quantize.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    addImport(quantize_tests, "timer", timerModule);
+    addImport(quantize_tests, "pixel", pixelModule);
+
+    const run_quantize_tests = b.addRunArtifact(quantize_tests);
+
+    const zpng_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/png/png.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    zpng_tests.linkLibC();
+    addImport(zpng_tests, "zgif", zgifModule);
+    addImport(zpng_tests, "quantize", quantizeModule);
+    addImport(zpng_tests, "pixel", pixelModule);
+
+    const run_zpng_tests = b.addRunArtifact(zpng_tests);
+
+    // The capture backends. On Linux, the X11 tests need a server in $DISPLAY (Xvfb will do),
+    // and are skipped without one.
+    const frametap_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/lib/core.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+    addImport(frametap_tests, "zgif", zgifModule);
+    addImport(frametap_tests, "zpng", &zpngLibrary.root_module);
+    addImport(frametap_tests, "resample", resampleModule);
+    addImport(frametap_tests, "pixel", pixelModule);
+    addCaptureLib(b, frametap_tests);
+    addMacosDeps(b, frametap_tests);
+
+    const run_frametap_tests = b.addRunArtifact(frametap_tests);
+
+    const resample_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/util/resample.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+
+    const run_resample_tests = b.addRunArtifact(resample_tests);
+
+    const pixel_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/util/pixel.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+
+    const run_pixel_tests = b.addRunArtifact(pixel_tests);
+
+    const ring_tests = b.addTest(.{
+        .root_source_file = .{ .path = "src/util/ring.zig" },
+        .target = target,
+        .optimize = optimize,
+    });
+
+    const run_ring_tests = b.addRunArtifact(ring_tests);
+
     // This creates a build step. It will be visible in the `zig build --help` menu,
     // and can be selected like this: `zig build test`
     // This will evaluate the `test` step rather than the default, which is "install".
     const test_step = b.step("test", "Run library tests");
     test_step.dependOn(&run_main_tests.step);
+    test_step.dependOn(&run_zgif_tests.step);
+    test_step.dependOn(&run_quantize_tests.step);
+    test_step.dependOn(&run_zpng_tests.step);
+    test_step.dependOn(&run_resample_tests.step);
+    test_step.dependOn(&run_pixel_tests.step);
+    test_step.dependOn(&run_ring_tests.step);
+    if (target.result.os.tag == .linux) test_step.dependOn(&run_frametap_tests.step);
 }
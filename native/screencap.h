@@ -9,7 +9,7 @@
  */
 typedef struct {
   /**
-   * Color data for a single frame for the frame in RGBA format.
+   * Color data for a single frame, 4 bytes per pixel in BGRA order.
    * This buffer is (width * height * 4) bytes long.
    */
   uint8_t *rgba_buf;
@@ -63,6 +63,15 @@ typedef struct FrameProcessor {
   void *other_data;
 } FrameProcessor;
 
+// Hands out the buffers that captured frames are copied into, and takes them back
+// once a frame has been processed, so that they can be reused instead of allocated
+// for every frame. `acquire` may return NULL, in which case the frame is dropped.
+typedef struct BufferAllocator {
+  uint8_t *(*acquire)(size_t size, void *ctx);
+  void (*release)(uint8_t *buf, void *ctx);
+  void *ctx;
+} BufferAllocator;
+
 /**
  * Allocates a new ScreenCapture object.
  */
@@ -79,6 +88,12 @@ void init_capture(ScreenCapture *sc);
  */
 void set_on_frame_handler(ScreenCapture *sc, FrameProcessor processor);
 
+/**
+ * Take the buffers of captured frames from `allocator`, instead of malloc.
+ * Must be called before the capture starts.
+ */
+void set_buffer_allocator(ScreenCapture *sc, BufferAllocator allocator);
+
 /**
  * Set the region of the screen to capture.
  * If this function isn't called, the entire screen is captured by default.
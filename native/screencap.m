@@ -4,6 +4,8 @@
 #include <ScreenCaptureKit/ScreenCaptureKit.h>
 
 void add_frame(ScreenCapture *sc, CMTime time, ImageData image);
+uint8_t *acquire_buffer(ScreenCapture *sc, size_t size);
+void release_buffer(ScreenCapture *sc, uint8_t *buf);
 
 @implementation OutputProcessor
 
@@ -68,15 +70,17 @@ void add_frame(ScreenCapture *sc, CMTime time, ImageData image);
     outHeight = height;
   }
 
-  uint8_t *outputBuf = malloc(outWidth * outHeight * 4);
-  assert(outputBuf != nil);
+  uint8_t *outputBuf = acquire_buffer(self.sc, outWidth * outHeight * 4);
+  if (outputBuf == nil) {
+    CVPixelBufferUnlockBaseAddress(pixelBuffer, kCVPixelBufferLock_ReadOnly);
+    CFRelease(sampleBuffer);
+    return;
+  }
 
+  // Rows may be padded, so they are copied one at a time.
   for (size_t i = 0; i < outHeight; i++) {
-    for (size_t j = 0; j < outWidth; j++) {
-      size_t const inIdx = ((i + y) * width + (j + x)) * 4;
-      size_t const outIdx = (i * outWidth + j) * 4;
-      memcpy(outputBuf + outIdx, baseAddress + inIdx, 4);
-    }
+    memcpy(outputBuf + i * outWidth * 4,
+           baseAddress + (i + y) * bytesPerRow + x * 4, outWidth * 4);
   }
 
   // If the user provided a callback function to process the frame, call it.
@@ -89,7 +93,7 @@ void add_frame(ScreenCapture *sc, CMTime time, ImageData image);
     CMTime timeOfCapture = CMSampleBufferGetPresentationTimeStamp(sampleBuffer);
     add_frame(self.sc, timeOfCapture, image);
   } else {
-    free(outputBuf);
+    release_buffer(self.sc, outputBuf);
   }
 
   // Unlock the pixel buffer
@@ -106,6 +110,7 @@ ScreenCapture *alloc_capture() {
 void init_capture(ScreenCapture *sc) {
   sc->region = nil; // capture entire screen by default.
   sc->has_frame_processor = false;
+  sc->has_buffer_allocator = false;
   sc->should_stop_capture = false;
   sc->displayID = CGMainDisplayID();
   sc->display = nil;
@@ -130,7 +135,7 @@ void add_frame(ScreenCapture *sc, CMTime time, ImageData image) {
         .duration_in_ms = CMTimeGetSeconds(duration) * 1000,
     };
     sc->frame_processor.process_fn(frame, sc->frame_processor.other_data);
-    deinit_imagedata(&frame.image);
+    release_buffer(sc, frame.image.rgba_buf);
   }
 
   sc->capture_time = time;
@@ -142,6 +147,26 @@ void set_on_frame_handler(ScreenCapture *sc, FrameProcessor processor) {
   sc->has_frame_processor = true;
 }
 
+void set_buffer_allocator(ScreenCapture *sc, BufferAllocator allocator) {
+  sc->buffer_allocator = allocator;
+  sc->has_buffer_allocator = true;
+}
+
+uint8_t *acquire_buffer(ScreenCapture *sc, size_t size) {
+  if (sc->has_buffer_allocator) {
+    return sc->buffer_allocator.acquire(size, sc->buffer_allocator.ctx);
+  }
+  return malloc(size);
+}
+
+void release_buffer(ScreenCapture *sc, uint8_t *buf) {
+  if (sc->has_buffer_allocator) {
+    sc->buffer_allocator.release(buf, sc->buffer_allocator.ctx);
+  } else {
+    free(buf);
+  }
+}
+
 void set_capture_region(ScreenCapture *sc, CaptureRect rect) {
   sc->region = malloc(sizeof(CaptureRect));
   memcpy(sc->region, &rect, sizeof(CaptureRect));
@@ -351,31 +376,15 @@ ImageData grab_screen(ScreenCapture *sc, const CaptureRect *rect) {
   // TODO: handle this case.
   assert(pixelData != NULL);
 
-  // TODO: is it possible to directly get RGBA data?
-  // The format will be BGRA, but we want RGBA.
-  uint8_t *outputBuf = malloc(bufferLength);
-  for (size_t i = 0; i < bufferLength; i += bytesPerPixel) {
-    uint8_t b = pixelData[i];
-    uint8_t g = pixelData[i + 1];
-    uint8_t r = pixelData[i + 2];
-    uint8_t a = pixelData[i + 3];
-
-    outputBuf[i] = r;
-    outputBuf[i + 1] = g;
-    outputBuf[i + 2] = b;
-    outputBuf[i + 3] = a;
-  }
-
-  // Now, bitmapData contains the image in RGBA format
-  // Construct the Frame object
+  // The pixels are BGRA, like the frames of a recording.
+  // The caller swaps the channels while copying them out.
   ImageData frame;
-  frame.rgba_buf = outputBuf;
+  frame.rgba_buf = pixelData;
   frame.width = width;
   frame.height = height;
 
   CGContextRelease(context);
   CGImageRelease(image);
-  free(pixelData);
 
   return frame;
 }
@@ -421,4 +430,10 @@ void deinit_capture(ScreenCapture *sc) {
   if (sc->region != nil) {
     free(sc->region);
   }
+
+  // The last frame is held back until the next one gives its duration.
+  if (CMTimeCompare(sc->capture_time, kCMTimeZero) != 0) {
+    release_buffer(sc, sc->current_frame_image.rgba_buf);
+    sc->capture_time = kCMTimeZero;
+  }
 }
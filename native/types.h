@@ -26,6 +26,8 @@ struct ScreenCapture {
   bool should_stop_capture;
   FrameProcessor frame_processor;
   bool has_frame_processor;
+  BufferAllocator buffer_allocator;
+  bool has_buffer_allocator;
 
   // The time at which the most recent frame is captured.
   CMTime capture_time;
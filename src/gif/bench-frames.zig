@@ -0,0 +1,65 @@
+const std = @import("std");
+
+// Input frames shared by the GIF benchmarks.
+
+/// Generate frames that look like a terminal: dark text on a light background,
+/// scrolling up by one line every few frames.
+pub fn generateFrames(allocator: std.mem.Allocator, width: usize, height: usize, nframes: usize) ![][]u8 {
+    const frames = try allocator.alloc([]u8, nframes);
+    var gen = std.rand.DefaultPrng.init(42);
+
+    const line_height = 16;
+    const glyph_width = 8;
+    const nlines = height / line_height + nframes;
+
+    // Each line of "text" is a list of glyph shapes, stored as a 8x16 bitmap per glyph.
+    const text = try allocator.alloc(u128, nlines * (width / glyph_width));
+    defer allocator.free(text);
+    for (text) |*glyph| {
+        glyph.* = if (gen.random().uintLessThan(u8, 5) == 0) 0 else gen.random().int(u128);
+    }
+
+    for (0..nframes) |f| {
+        const frame = try allocator.alloc(u8, width * height * 4);
+        const scroll = f / 4;
+        for (0..height) |y| {
+            const line = y / line_height + scroll;
+            for (0..width) |x| {
+                const glyph = text[line * (width / glyph_width) + x / glyph_width];
+                const bit: u7 = @intCast((y % line_height) * glyph_width + x % glyph_width);
+                const on = ((glyph >> bit) & 1) == 1;
+                const px = frame[(y * width + x) * 4 ..][0..4];
+                px.* = if (on) .{ 40, 30, 20, 255 } else .{ 235, 240, 245, 255 };
+            }
+        }
+        frames[f] = frame;
+    }
+
+    return frames;
+}
+
+/// Split a raw dump of BGRA frames into individual frames.
+pub fn loadFrames(allocator: std.mem.Allocator, path: []const u8, width: usize, height: usize) ![][]u8 {
+    const data = try std.fs.cwd().readFileAlloc(allocator, path, std.math.maxInt(usize));
+    defer allocator.free(data);
+
+    const frame_size = width * height * 4;
+    const frames = try allocator.alloc([]u8, data.len / frame_size);
+    for (0.., frames) |i, *frame| {
+        frame.* = try allocator.dupe(u8, data[i * frame_size ..][0..frame_size]);
+    }
+    return frames;
+}
+
+pub fn freeFrames(allocator: std.mem.Allocator, frames: [][]u8) void {
+    for (frames) |frame| allocator.free(frame);
+    allocator.free(frames);
+}
+
+/// Parse a resolution like "800x600".
+pub fn parseResolution(arg: []const u8) !struct { usize, usize } {
+    var dims = std.mem.splitScalar(u8, arg, 'x');
+    const width = try std.fmt.parseInt(usize, dims.next() orelse return error.bad_resolution, 10);
+    const height = try std.fmt.parseInt(usize, dims.next() orelse return error.bad_resolution, 10);
+    return .{ width, height };
+}
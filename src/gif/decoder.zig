@@ -0,0 +1,528 @@
+const std = @import("std");
+const lzw = @import("lzw.zig");
+const writer = @import("writer.zig");
+const gif = @import("gif.zig");
+
+const Disposal = writer.Disposal;
+const GifFrame = gif.GifFrame;
+
+// Decodes a GIF file into full canvas BGRA frames.
+//
+// Decoding happens in three passes:
+// 1. The file is scanned once, recording where every frame's image data starts,
+//    without decompressing anything.
+// 2. Every frame's image data is its own LZW stream, so all frames are decompressed
+//    to indices in parallel.
+// 3. Frames are composited onto the canvas. A frame usually depends on the canvas left
+//    behind by the frames before it, but one that covers the whole canvas with opaque
+//    pixels doesn't (and neither does a frame that follows a full canvas clear).
+//    Such frames start a new run of frames, and runs are composited in parallel.
+
+pub const DecodeError = error{
+    not_a_gif,
+    truncated_gif,
+    invalid_gif,
+};
+
+pub const DecodeOptions = struct {
+    /// Number of worker threads. 0 spawns one per CPU core.
+    n_jobs: usize = 0,
+};
+
+/// Every frame of a GIF, as it is displayed.
+pub const DecodedGif = struct {
+    const Self = @This();
+
+    allocator: std.mem.Allocator,
+    width: usize,
+    height: usize,
+    /// Number of times the animation repeats, 0 for forever.
+    loop_count: u16 = 0,
+    /// The full canvas (BGRA) after every frame was drawn, and the frame's delay.
+    /// Pixels that were never drawn are transparent black.
+    frames: []GifFrame,
+
+    pub fn deinit(self: *const Self) void {
+        for (self.frames) |frame| self.allocator.free(frame.bgra_buf);
+        self.allocator.free(self.frames);
+    }
+};
+
+/// A frame as it is stored in the file.
+const RawFrame = struct {
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+    /// RGBRGB...
+    palette: []const u8,
+    transparent_index: ?u8,
+    disposal: Disposal,
+    delay_cs: u16,
+    interlaced: bool,
+    /// Starts at the image data's minimum code size.
+    data: []const u8,
+
+    /// Set by the decompression pass.
+    indices: []u8 = &[_]u8{},
+    err: ?anyerror = null,
+
+    fn coversCanvas(self: *const RawFrame, width: usize, height: usize) bool {
+        return self.x == 0 and self.y == 0 and self.width >= width and self.height >= height;
+    }
+};
+
+/// Reads the blocks of a GIF file one after the other.
+const Parser = struct {
+    data: []const u8,
+    pos: usize = 0,
+
+    fn bytes(self: *Parser, n: usize) DecodeError![]const u8 {
+        if (self.pos + n > self.data.len) return DecodeError.truncated_gif;
+        defer self.pos += n;
+        return self.data[self.pos..][0..n];
+    }
+
+    fn byte(self: *Parser) DecodeError!u8 {
+        return (try self.bytes(1))[0];
+    }
+
+    fn int(self: *Parser) DecodeError!u16 {
+        return std.mem.readInt(u16, (try self.bytes(2))[0..2], .little);
+    }
+
+    /// Skip data sub-blocks up to and including the terminator.
+    fn skipSubBlocks(self: *Parser) DecodeError!void {
+        while (true) {
+            const len = try self.byte();
+            if (len == 0) return;
+            _ = try self.bytes(len);
+        }
+    }
+
+    /// A color table with the 3 bit size field `size_field`.
+    fn colorTable(self: *Parser, size_field: u8) DecodeError![]const u8 {
+        const ncolors = @as(usize, 2) << @intCast(size_field & 0b111);
+        return self.bytes(ncolors * 3);
+    }
+};
+
+/// Decode every frame of the GIF in `data`.
+/// The allocator must be thread safe, frames are decoded on worker threads.
+pub fn decode(allocator: std.mem.Allocator, data: []const u8, options: DecodeOptions) !DecodedGif {
+    var parser = Parser{ .data = data };
+    const signature = try parser.bytes(6);
+    if (!std.mem.eql(u8, signature, "GIF89a") and !std.mem.eql(u8, signature, "GIF87a")) {
+        return DecodeError.not_a_gif;
+    }
+
+    const width: usize = try parser.int();
+    const height: usize = try parser.int();
+    const screen_flags = try parser.byte();
+    _ = try parser.bytes(2); // background color index, pixel aspect ratio
+    const global_palette: ?[]const u8 = if (screen_flags & 0x80 != 0)
+        try parser.colorTable(screen_flags)
+    else
+        null;
+
+    var raw_frames = std.ArrayList(RawFrame).init(allocator);
+    defer raw_frames.deinit();
+    var loop_count: u16 = 0;
+
+    // The graphic control extension applies to the next image only.
+    var disposal = Disposal.unspecified;
+    var delay_cs: u16 = 0;
+    var transparent_index: ?u8 = null;
+
+    // Some encoders leave out the trailer.
+    while (parser.pos < data.len) {
+        switch (try parser.byte()) {
+            0x21 => {
+                const label = try parser.byte();
+                if (label == 0xF9) {
+                    const block = try parser.bytes(try parser.byte());
+                    if (block.len < 4) return DecodeError.invalid_gif;
+                    const disposal_field = (block[0] >> 2) & 0b111;
+                    disposal = if (disposal_field <= 3) @enumFromInt(disposal_field) else .unspecified;
+                    delay_cs = std.mem.readInt(u16, block[1..3], .little);
+                    transparent_index = if (block[0] & 1 != 0) block[3] else null;
+                } else if (label == 0xFF) {
+                    const app = try parser.bytes(try parser.byte());
+                    if (std.mem.eql(u8, app, "NETSCAPE2.0")) {
+                        const sub = try parser.bytes(try parser.byte());
+                        if (sub.len >= 3 and sub[0] == 1) {
+                            loop_count = std.mem.readInt(u16, sub[1..3], .little);
+                        }
+                    }
+                }
+                try parser.skipSubBlocks();
+            },
+            0x2C => {
+                const x = try parser.int();
+                const y = try parser.int();
+                const frame_width = try parser.int();
+                const frame_height = try parser.int();
+                const flags = try parser.byte();
+                const palette = if (flags & 0x80 != 0)
+                    try parser.colorTable(flags)
+                else
+                    global_palette orelse return DecodeError.invalid_gif;
+
+                const start = parser.pos;
+                _ = try parser.byte(); // minimum code size
+                try parser.skipSubBlocks();
+
+                try raw_frames.append(.{
+                    .x = x,
+                    .y = y,
+                    .width = frame_width,
+                    .height = frame_height,
+                    .palette = palette,
+                    .transparent_index = transparent_index,
+                    .disposal = disposal,
+                    .delay_cs = delay_cs,
+                    .interlaced = flags & 0x40 != 0,
+                    .data = data[start..parser.pos],
+                });
+
+                disposal = .unspecified;
+                delay_cs = 0;
+                transparent_index = null;
+            },
+            0x3B => break,
+            else => return DecodeError.invalid_gif,
+        }
+    }
+
+    const raw = raw_frames.items;
+    defer for (raw) |frame| allocator.free(frame.indices);
+
+    var pool: std.Thread.Pool = undefined;
+    try pool.init(.{
+        .allocator = allocator,
+        .n_jobs = if (options.n_jobs == 0) null else @intCast(options.n_jobs),
+    });
+    defer pool.deinit();
+
+    var wait_group = std.Thread.WaitGroup{};
+    for (raw) |*frame| {
+        wait_group.start();
+        // If no job could be queued, decompress the frame on this thread instead.
+        pool.spawn(decompressFrame, .{ allocator, frame, &wait_group }) catch
+            decompressFrame(allocator, frame, &wait_group);
+    }
+    pool.waitAndWork(&wait_group);
+    for (raw) |frame| {
+        if (frame.err) |err| return err;
+    }
+
+    const frames = try allocator.alloc(GifFrame, raw.len);
+    var nallocated: usize = 0;
+    errdefer {
+        for (frames[0..nallocated]) |frame| allocator.free(frame.bgra_buf);
+        allocator.free(frames);
+    }
+    for (frames, raw) |*frame, raw_frame| {
+        frame.* = .{
+            .bgra_buf = try allocator.alloc(u8, width * height * 4),
+            .duration_ms = @as(u64, raw_frame.delay_cs) * 10,
+        };
+        nallocated += 1;
+    }
+
+    const canvas = Canvas{ .width = width, .height = height };
+    var run_start: usize = 0;
+    wait_group.reset();
+    const errors = try allocator.alloc(?anyerror, raw.len);
+    defer allocator.free(errors);
+    @memset(errors, null);
+
+    for (1..raw.len + 1) |i| {
+        if (i < raw.len and !startsRun(raw, i, width, height)) continue;
+        const args = .{
+            allocator,
+            canvas,
+            raw[run_start..i],
+            frames[run_start..i],
+            &errors[run_start],
+            &wait_group,
+        };
+        wait_group.start();
+        pool.spawn(compositeRun, args) catch @call(.auto, compositeRun, args);
+        run_start = i;
+    }
+    pool.waitAndWork(&wait_group);
+    for (errors) |maybe_err| {
+        if (maybe_err) |err| return err;
+    }
+
+    return .{
+        .allocator = allocator,
+        .width = width,
+        .height = height,
+        .loop_count = loop_count,
+        .frames = frames,
+    };
+}
+
+/// Whether frame `i` can be composited without knowing what the frames before it drew.
+fn startsRun(raw: []const RawFrame, i: usize, width: usize, height: usize) bool {
+    const frame = &raw[i];
+    // A frame disposed with `previous` puts back what was there before it, which its run
+    // would have to start with.
+    if (frame.transparent_index == null and frame.disposal != .previous and
+        frame.coversCanvas(width, height)) return true;
+
+    const prev = &raw[i - 1];
+    return prev.disposal == .background and prev.coversCanvas(width, height);
+}
+
+/// Runs on a worker thread.
+fn decompressFrame(allocator: std.mem.Allocator, frame: *RawFrame, wait_group: *std.Thread.WaitGroup) void {
+    defer wait_group.finish();
+    frame.indices = decompress(allocator, frame) catch |err| {
+        frame.err = err;
+        return;
+    };
+}
+
+fn decompress(allocator: std.mem.Allocator, frame: *const RawFrame) ![]u8 {
+    const indices = try allocator.alloc(u8, frame.width * frame.height);
+    errdefer allocator.free(indices);
+    // Streams that end early leave the rest of the frame at index 0.
+    @memset(indices, 0);
+    _ = try lzw.decode(allocator, frame.data, indices);
+
+    if (frame.interlaced) {
+        const rows = try allocator.alloc(u8, indices.len);
+        defer allocator.free(rows);
+        @memcpy(rows, indices);
+        deinterlace(rows, indices, frame.width, frame.height);
+    }
+    return indices;
+}
+
+/// Interlaced images store every 8th row starting at 0, then every 8th row starting at 4,
+/// every 4th row starting at 2, and finally every 2nd row starting at 1.
+fn deinterlace(src: []const u8, dst: []u8, width: usize, height: usize) void {
+    const passes = [_]struct { start: usize, step: usize }{
+        .{ .start = 0, .step = 8 },
+        .{ .start = 4, .step = 8 },
+        .{ .start = 2, .step = 4 },
+        .{ .start = 1, .step = 2 },
+    };
+
+    var src_row: usize = 0;
+    for (passes) |pass| {
+        var y = pass.start;
+        while (y < height) : (y += pass.step) {
+            @memcpy(dst[y * width ..][0..width], src[src_row * width ..][0..width]);
+            src_row += 1;
+        }
+    }
+}
+
+const Canvas = struct {
+    width: usize,
+    height: usize,
+};
+
+/// Runs on a worker thread.
+/// Draw a run of frames, the first of which doesn't depend on earlier frames,
+/// and copy the canvas into `frames` after each one.
+fn compositeRun(
+    allocator: std.mem.Allocator,
+    canvas: Canvas,
+    raw: []const RawFrame,
+    frames: []GifFrame,
+    err: *?anyerror,
+    wait_group: *std.Thread.WaitGroup,
+) void {
+    defer wait_group.finish();
+
+    const pixels = allocator.alloc(u8, canvas.width * canvas.height * 4) catch |e| {
+        err.* = e;
+        return;
+    };
+    defer allocator.free(pixels);
+    @memset(pixels, 0);
+
+    // Copy of the canvas under the current frame, for frames disposed with `previous`.
+    var saved: ?[]u8 = null;
+    defer if (saved) |s| allocator.free(s);
+
+    for (raw, frames) |*frame, out| {
+        if (frame.disposal == .previous) {
+            if (saved == null) {
+                saved = allocator.alloc(u8, pixels.len) catch |e| {
+                    err.* = e;
+                    return;
+                };
+            }
+            @memcpy(saved.?, pixels);
+        }
+
+        draw(pixels, canvas, frame);
+        @memcpy(@constCast(out.bgra_buf), pixels);
+
+        switch (frame.disposal) {
+            .background => clear(pixels, canvas, frame),
+            .previous => @memcpy(pixels, saved.?),
+            .unspecified, .keep => {},
+        }
+    }
+}
+
+/// The part of `frame` that lies on the canvas, as ranges of canvas coordinates.
+fn visibleRange(canvas: Canvas, frame: *const RawFrame) struct { x_end: usize, y_end: usize } {
+    return .{
+        .x_end = @min(frame.x + frame.width, canvas.width),
+        .y_end = @min(frame.y + frame.height, canvas.height),
+    };
+}
+
+fn draw(pixels: []u8, canvas: Canvas, frame: *const RawFrame) void {
+    const range = visibleRange(canvas, frame);
+    const ncolors = frame.palette.len / 3;
+
+    var y = frame.y;
+    while (y < range.y_end) : (y += 1) {
+        const row = frame.indices[(y - frame.y) * frame.width ..][0..frame.width];
+        var x = frame.x;
+        while (x < range.x_end) : (x += 1) {
+            const index = row[x - frame.x];
+            if (index >= ncolors) continue;
+            if (frame.transparent_index) |trans_index| {
+                if (index == trans_index) continue;
+            }
+
+            const rgb = frame.palette[@as(usize, index) * 3 ..][0..3];
+            pixels[(y * canvas.width + x) * 4 ..][0..4].* = .{ rgb[2], rgb[1], rgb[0], 255 };
+        }
+    }
+}
+
+fn clear(pixels: []u8, canvas: Canvas, frame: *const RawFrame) void {
+    const range = visibleRange(canvas, frame);
+    var y = frame.y;
+    while (y < range.y_end) : (y += 1) {
+        if (frame.x >= range.x_end) break;
+        @memset(pixels[(y * canvas.width + frame.x) * 4 .. (y * canvas.width + range.x_end) * 4], 0);
+    }
+}
+
+const t = std.testing;
+const SinkWriter = @import("sink.zig").SinkWriter;
+
+test "deinterlace" {
+    // Rows in the order they are stored.
+    const src = [_]u8{ 0, 8, 4, 2, 6, 1, 3, 5, 7, 9 };
+    var dst: [10]u8 = undefined;
+    deinterlace(&src, &dst, 1, 10);
+    try t.expectEqualSlices(u8, &[_]u8{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }, &dst);
+}
+
+test "decode – composites frames written by GifWriter" {
+    const allocator = t.allocator;
+    const width = 4;
+    const height = 3;
+    const T = 3;
+    const palette = [_]u8{ 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0 };
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+    const sink_writer = try allocator.create(SinkWriter);
+    defer allocator.destroy(sink_writer);
+    sink_writer.* = try SinkWriter.init(.{ .memory = &out });
+
+    var gif_writer = writer.GifWriter.init(allocator, sink_writer, width, height);
+    defer gif_writer.deinit();
+    try gif_writer.writeHeader(&palette, 0);
+
+    const frame_indices = [_][width * height]u8{
+        .{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+        // Cropped to the 2x2 square in the middle.
+        .{ T, T, T, T, T, 2, 0, T, T, 1, 2, T },
+        .{ 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1 },
+    };
+    for (frame_indices, 0..) |*indices, i| {
+        try gif_writer.writeFrame(indices, .{
+            .delay_cs = @intCast(5 * (i + 1)),
+            .transparent_index = if (i == 1) T else null,
+        });
+    }
+    try gif_writer.writeTrailer();
+    try sink_writer.flush();
+
+    const decoded = try decode(allocator, out.items, .{ .n_jobs = 2 });
+    defer decoded.deinit();
+
+    try t.expectEqual(width, decoded.width);
+    try t.expectEqual(height, decoded.height);
+    try t.expectEqual(3, decoded.frames.len);
+    try t.expectEqual(100, decoded.frames[1].duration_ms);
+
+    const expected = [_][width * height]u8{
+        frame_indices[0],
+        .{ 0, 0, 0, 0, 1, 2, 0, 1, 2, 1, 2, 2 },
+        frame_indices[2],
+    };
+    for (decoded.frames, expected) |frame, indices| {
+        for (indices, 0..) |index, i| {
+            const rgb = palette[@as(usize, index) * 3 ..][0..3];
+            try t.expectEqualSlices(u8, &[_]u8{ rgb[2], rgb[1], rgb[0], 255 }, frame.bgra_buf[i * 4 ..][0..4]);
+        }
+    }
+
+    try t.expectError(DecodeError.not_a_gif, decode(allocator, "\x89PNG\r\n\x1a\n", .{}));
+}
+
+test "decode – an opaque frame disposed with previous restores the frame before it" {
+    const allocator = t.allocator;
+    const width = 3;
+    const height = 2;
+    const T = 3;
+    const palette = [_]u8{ 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0 };
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+    const sink_writer = try allocator.create(SinkWriter);
+    defer allocator.destroy(sink_writer);
+    sink_writer.* = try SinkWriter.init(.{ .memory = &out });
+
+    var gif_writer = writer.GifWriter.init(allocator, sink_writer, width, height);
+    defer gif_writer.deinit();
+    try gif_writer.writeHeader(&palette, 0);
+
+    const frame_indices = [_][width * height]u8{
+        .{ 0, 0, 0, 1, 1, 1 },
+        // Covers the whole canvas, then leaves the first frame behind.
+        .{ 2, 2, 2, 2, 2, 2 },
+        .{ T, T, T, T, 2, T },
+    };
+    const disposals = [_]writer.Disposal{ .keep, .previous, .keep };
+    for (frame_indices, disposals, 0..) |*indices, disposal, i| {
+        try gif_writer.writeFrame(indices, .{
+            .delay_cs = 5,
+            .transparent_index = if (i == 2) T else null,
+            .disposal = disposal,
+        });
+    }
+    try gif_writer.writeTrailer();
+    try sink_writer.flush();
+
+    const decoded = try decode(allocator, out.items, .{ .n_jobs = 2 });
+    defer decoded.deinit();
+
+    const expected = [_][width * height]u8{
+        frame_indices[0],
+        frame_indices[1],
+        .{ 0, 0, 0, 1, 2, 1 },
+    };
+    for (decoded.frames, expected) |frame, indices| {
+        for (indices, 0..) |index, i| {
+            const rgb = palette[@as(usize, index) * 3 ..][0..3];
+            try t.expectEqualSlices(u8, &[_]u8{ rgb[2], rgb[1], rgb[0], 255 }, frame.bgra_buf[i * 4 ..][0..4]);
+        }
+    }
+}
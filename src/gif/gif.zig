@@ -1,6 +1,12 @@
 const std = @import("std");
 const cgif = @cImport(@cInclude("cgif.h"));
 const quant = @import("quantize");
+const sink = @import("sink.zig");
+const writer = @import("writer.zig");
+const parallel = @import("parallel.zig");
+const rate_control = @import("rate-control.zig");
+pub const lzw = @import("lzw.zig");
+pub const decoder = @import("decoder.zig");
 
 const Allocator = std.mem.Allocator;
 
@@ -15,19 +21,120 @@ const GifError = error{
     cgif_unknown_error,
 
     gif_uninitialized,
+    unsupported_config,
 
     unknown_error_pls_report_bug,
 };
 
+pub const Sink = sink.Sink;
+pub const SinkWriter = sink.SinkWriter;
+const GifWriter = writer.GifWriter;
+pub const ParallelConfig = parallel.ParallelConfig;
+const ParallelEncoder = parallel.ParallelEncoder;
+pub const RateControlConfig = rate_control.RateControlConfig;
+pub const RateStats = rate_control.RateStats;
+const RateController = rate_control.RateController;
+const multi = @import("multi.zig");
+pub const MultiGif = multi.MultiGif;
+pub const MultiGifConfig = multi.MultiGifConfig;
+pub const RenditionConfig = multi.RenditionConfig;
+
+/// The library that LZW-compresses frames and writes the GIF file.
+pub const Encoder = enum {
+    /// Our own encoder in `lzw.zig` and `writer.zig`.
+    native,
+    /// The vendored cgif library.
+    cgif,
+};
+
 pub const GifFrame = struct {
     bgra_buf: []const u8,
     duration_ms: u64,
+    /// Bytes from the start of one row to the next, when the frame is a view into
+    /// a larger image. 0 means the rows are packed, `width * 4` bytes apart.
+    row_stride: usize = 0,
+};
+
+/// A packed copy of a frame of `width` by `height` pixels.
+pub fn packedCopy(allocator: std.mem.Allocator, frame: GifFrame, width: usize, height: usize) ![]u8 {
+    if (frame.row_stride == 0) return allocator.dupe(u8, frame.bgra_buf);
+    const row_len = width * 4;
+    const copy = try allocator.alloc(u8, row_len * height);
+    for (0..height) |y| {
+        @memcpy(copy[y * row_len ..][0..row_len], frame.bgra_buf[y * frame.row_stride ..][0..row_len]);
+    }
+    return copy;
+}
+
+pub const HybridPaletteConfig = struct {
+    /// Largest fraction of pixels whose (coarse) color may differ from the frame that
+    /// the current palette was built from, before a new palette is built.
+    max_drift: f32 = 0.1,
+};
+
+/// How often palettes were reused in hybrid palette or palette lag mode.
+pub const PaletteStats = struct {
+    frames: usize = 0,
+    palettes_built: usize = 0,
+    /// Histogram distance between the last frame and the palette's source frame.
+    last_drift: f32 = 0,
+
+    /// Fraction of frames that were mapped to an existing palette.
+    pub fn reuseRate(self: PaletteStats) f32 {
+        if (self.frames == 0) return 0;
+        const reused: f32 = @floatFromInt(self.frames - self.palettes_built);
+        return reused / @as(f32, @floatFromInt(self.frames));
+    }
 };
 
 pub const GifConfig = struct {
     use_dithering: bool = true,
     use_local_palette: bool = true,
-    path: [:0]const u8,
+    /// With a global palette, frames are kept in memory until this many bytes of them
+    /// pile up, and quantized together when the GIF is closed. Past that, the palette
+    /// is built from the frames kept so far, and every later frame is mapped to it as it
+    /// is added, so that memory doesn't grow with the length of the recording.
+    /// Colors that only show up later are then matched approximately.
+    max_global_bytes: usize = 256 * 1024 * 1024,
+    /// How palette entries are sorted after quantization.
+    palette_order: quant.PaletteOrder = .none,
+    /// Reuse the current palette for as long as the colors on screen stay about the same,
+    /// and only build a new one on scene changes. Only used with local palettes.
+    /// With the native encoder, the first palette becomes the global color table,
+    /// and frames that use it don't store a table of their own.
+    hybrid_palette: ?HybridPaletteConfig = null,
+    /// Map every frame to a palette built from an earlier frame (usually the previous one),
+    /// while a background thread builds the next palette from the current frame.
+    /// Takes palette building off the critical path of live capture, at the cost
+    /// of colors that appear on screen being matched approximately for a frame.
+    /// Only used with local palettes, and takes precedence over `hybrid_palette`.
+    /// The allocator passed to `Gif.init` must then be thread safe.
+    palette_lag: bool = false,
+    /// Reserve one palette entry as a transparent color, and emit it for every pixel
+    /// that would look the same as what's already displayed from the previous frames.
+    /// Unchanged areas then turn into long runs of one index, which LZW compresses well.
+    use_transparency: bool = true,
+    /// Where the encoded GIF is written to.
+    sink: Sink,
+    /// Number of times viewers repeat the animation, 0 loops forever.
+    loop_count: u16 = 0,
+    encoder: Encoder = .native,
+    /// Options for the native LZW encoder, ignored by cgif.
+    lzw: lzw.Options = .{},
+    /// Trade quality for size, like gifsicle's `--lossy`: the LZW encoder may replace a pixel
+    /// with a palette color up to this far away (RGB distance) if that yields longer strings.
+    /// 0 is lossless. Around 10-30 is hard to notice on screen recordings.
+    /// Only supported by the native encoder.
+    lossy: u16 = 0,
+    /// If set, frames are LZW-compressed on a pool of worker threads, and written
+    /// to the sink in order. Only supported by the native encoder.
+    /// The allocator passed to `Gif.init` must then be thread safe.
+    parallel: ?ParallelConfig = null,
+    /// Keep the output within a size budget by lowering quality and dropping frames
+    /// as needed. See `rate-control.zig`. Only supported with local palettes, and by
+    /// the native encoder: CGIF holds back every frame until the next one,
+    /// so the output size it reports is always a frame behind.
+    rate_control: ?RateControlConfig = null,
     width: usize,
     height: usize,
 };
@@ -40,24 +147,103 @@ pub const Gif = struct {
     cgif_config: *cgif.CGIF_Config,
     cgif_frame_config: *cgif.CGIF_FrameConfig,
     gif: ?*cgif.CGIF,
-    path: [:0]const u8,
+    /// Set if the GIF is written by the native encoder instead of CGIF.
+    native: ?GifWriter = null,
+    /// All encoded bytes go through this writer.
+    sink_writer: *SinkWriter,
+    /// Set if frames are compressed in parallel.
+    parallel: ?*ParallelEncoder = null,
+    /// With a global palette, frames are copied here until the palette is built.
+    global_frames: std.ArrayList(GifFrame),
+    /// Size of the pixels in `global_frames`.
+    global_bytes: usize = 0,
+    /// Set if the output is kept within a size budget.
+    rate: ?RateController = null,
+    /// Time of frames dropped by rate control, added to the next frame that is kept.
+    dropped_ms: u64 = 0,
+    /// In hybrid palette or palette lag mode, the palette that frames are currently mapped to.
+    /// With a global palette, set once `max_global_bytes` was exceeded.
+    shared_palette: ?quant.Palette = null,
+    /// Builds palettes in the background in palette lag mode.
+    palette_builder: ?*quant.PaletteBuilder = null,
+    /// Scratch space for counting the colors of a frame in palette lag mode.
+    color_counts: ?*[quant.color_array_size]u32 = null,
+    /// The number of colors `shared_palette` was asked for.
+    shared_palette_ncolors: u16 = 0,
+    /// Whether `shared_palette` is the GIF's global color table.
+    shared_palette_is_global: bool = false,
+    /// Copy of the global color table written in hybrid palette mode.
+    global_table: ?[]u8 = null,
+    palette_stats: PaletteStats = .{},
 
     config: GifConfig,
 
+    /// The composited image (RGBRGB...) that a GIF viewer would be displaying
+    /// after the most recently added frame.
+    /// `null` if transparency optimization is disabled.
+    canvas: ?[]u8 = null,
+    /// Number of frames added to the GIF so far.
+    nframes: usize = 0,
+
     pub fn init(allocator: Allocator, config: GifConfig) !Self {
+        if (config.parallel != null and config.encoder != .native) {
+            return GifError.unsupported_config;
+        }
+        // cgif would write the frames losslessly.
+        if (config.lossy > 0 and config.encoder != .native) {
+            return GifError.unsupported_config;
+        }
+        if (config.rate_control != null and (config.encoder != .native or !config.use_local_palette)) {
+            return GifError.unsupported_config;
+        }
+
+        const sink_writer = try allocator.create(SinkWriter);
+        errdefer allocator.destroy(sink_writer);
+        sink_writer.* = SinkWriter.init(config.sink) catch return GifError.gif_open_failed;
+        errdefer sink_writer.deinit();
+
         // Configure CGIF's config object
         const cgif_config = try allocator.create(cgif.CGIF_Config);
-        initCGifConfig(cgif_config, config.path, config.width, config.height);
+        errdefer allocator.destroy(cgif_config);
+        initCGifConfig(cgif_config, sink_writer, config.width, config.height);
         cgif_config.attrFlags = cgif.CGIF_ATTR_IS_ANIMATED;
+        cgif_config.numLoops = config.loop_count;
 
         const cgif_frame_config = try allocator.create(cgif.CGIF_FrameConfig);
+        errdefer allocator.destroy(cgif_frame_config);
         initFrameConfig(cgif_frame_config);
-        cgif_frame_config.genFlags =
-            // cgif.CGIF_FRAME_GEN_USE_TRANSPARENCY | // TODO: set transIndex
-            cgif.CGIF_FRAME_GEN_USE_DIFF_WINDOW;
+        // We don't let CGIF search for a free palette entry to use as transparency.
+        // With a full palette it will not find one, so the quantizer reserves
+        // a slot for us instead, and `addFrame` emits transparent pixels itself.
+        cgif_frame_config.genFlags = cgif.CGIF_FRAME_GEN_USE_DIFF_WINDOW;
+
+        var canvas: ?[]u8 = null;
+        if (config.use_transparency) {
+            canvas = try allocator.alloc(u8, config.width * config.height * 3);
+        }
+        errdefer if (canvas) |buf| allocator.free(buf);
 
+        var native: ?GifWriter = null;
+        errdefer if (native) |*gif_writer| gif_writer.deinit();
         var gif: ?*cgif.CGIF = null;
-        if (config.use_local_palette) {
+        errdefer if (gif) |g| {
+            _ = cgif.cgif_close(g);
+        };
+        if (config.encoder == .native) {
+            native = GifWriter.init(allocator, sink_writer, config.width, config.height);
+            // Rate control drops frames ahead of the cap, going by the average frame size.
+            // The writer drops those that turn out larger than that.
+            if (config.rate_control) |rc| {
+                if (rc.max_total_bytes) |max_total| {
+                    native.?.byte_limit = max_total -| rate_control.closing_bytes;
+                }
+            }
+            // With a global palette, the header is written once the palette is known.
+            // In hybrid palette mode, the first frame's palette is the global one.
+            if (config.use_local_palette and (config.hybrid_palette == null or config.palette_lag)) {
+                native.?.writeHeader(null, config.loop_count) catch return GifError.gif_write_failed;
+            }
+        } else if (config.use_local_palette) {
             cgif_config.attrFlags |= @intCast(cgif.CGIF_ATTR_NO_GLOBAL_TABLE);
             cgif_frame_config.attrFlags |= @intCast(cgif.CGIF_FRAME_ATTR_USE_LOCAL_TABLE);
 
@@ -69,17 +255,38 @@ pub const Gif = struct {
             };
         }
 
+        var palette_builder: ?*quant.PaletteBuilder = null;
+        var color_counts: ?*[quant.color_array_size]u32 = null;
+        if (config.palette_lag and config.use_local_palette) {
+            palette_builder = try quant.PaletteBuilder.init(allocator);
+            color_counts = try allocator.create([quant.color_array_size]u32);
+        }
+        errdefer if (palette_builder) |builder| builder.deinit();
+        errdefer if (color_counts) |counts| allocator.destroy(counts);
+
+        var parallel_encoder: ?*ParallelEncoder = null;
+        if (config.parallel) |parallel_config| {
+            parallel_encoder = try ParallelEncoder.init(allocator, parallel_config);
+        }
+
         return .{
             .allocator = allocator,
             .cgif_config = cgif_config,
             .cgif_frame_config = cgif_frame_config,
             .gif = gif,
-            .path = config.path,
+            .native = native,
+            .sink_writer = sink_writer,
+            .parallel = parallel_encoder,
+            .global_frames = std.ArrayList(GifFrame).init(allocator),
+            .rate = if (config.rate_control) |rc| RateController.init(rc) else null,
+            .palette_builder = palette_builder,
+            .color_counts = color_counts,
             .config = config,
+            .canvas = canvas,
         };
     }
 
-    pub fn addFrames(self: *Self, frames: [][]const u8) !void {
+    pub fn addFrames(self: *Self, frames: []const GifFrame) !void {
         for (frames) |frame| {
             try self.addFrame(frame);
         }
@@ -87,33 +294,297 @@ pub const Gif = struct {
 
     pub fn addFrame(self: *Self, frame: GifFrame) !void {
         if (!self.config.use_local_palette) {
-            std.debug.panic("Unimplemented!", .{});
+            if (self.shared_palette) |*palette| {
+                return self.encodeWithGlobalTable(frame, palette);
+            }
+
+            // A global palette can only be computed once all frames have been seen.
+            {
+                const bgra_buf = try packedCopy(self.allocator, frame, self.config.width, self.config.height);
+                errdefer self.allocator.free(bgra_buf);
+                try self.global_frames.append(.{ .bgra_buf = bgra_buf, .duration_ms = frame.duration_ms });
+                self.global_bytes += bgra_buf.len;
+            }
+            if (self.global_bytes > self.config.max_global_bytes) {
+                try self.streamGlobalFrames();
+            }
+            return;
+        }
+
+        if (self.gif == null and self.native == null) {
+            return GifError.gif_uninitialized;
+        }
+
+        var ncolors: u16 = 256;
+        var use_dithering = self.config.use_dithering;
+        var lossy = self.config.lossy;
+        if (self.rate) |*rate| {
+            switch (rate.nextFrame(frame.duration_ms, try self.rateBytes(rate))) {
+                .drop => {
+                    self.dropped_ms += frame.duration_ms;
+                    return;
+                },
+                .encode => |settings| {
+                    ncolors = settings.ncolors;
+                    use_dithering = use_dithering and settings.use_dithering;
+                    lossy = @max(lossy, settings.lossy);
+                },
+            }
+        }
+
+        const duration_ms = frame.duration_ms + self.dropped_ms;
+        self.dropped_ms = 0;
+
+        const quant_config = quant.QuantizerConfig{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = use_dithering,
+            .ncolors = ncolors,
+            .reserve_transparent_index = self.canvas != null,
+            .row_stride = frame.row_stride,
+        };
+
+        var quantized: quant.QuantizedImage = undefined;
+        var local_palette = true;
+        if (self.palette_builder) |builder| {
+            quantized = try self.quantizeWithLaggingPalette(frame.bgra_buf, builder, quant_config);
+        } else if (self.config.hybrid_palette) |hybrid| {
+            quantized = try self.quantizeWithSharedPalette(frame.bgra_buf, hybrid, quant_config);
+            local_palette = !self.shared_palette_is_global;
+        } else {
+            quantized = try quant.quantizeImage(quant_config, frame.bgra_buf, quant.Quantize.median_cut);
+            quant.reorderImage(&quantized, self.config.palette_order);
+        }
+
+        try self.encodeQuantized(&quantized, .{
+            .delay_cs = delayCs(duration_ms),
+            .lossy = lossy,
+            .local_palette = local_palette,
+            .owned = true,
+        });
+    }
+
+    /// Add a frame that is mapped to an existing `palette`, instead of one built for it.
+    /// Lets several GIFs share the cost of building palettes (see `multi.zig`).
+    /// The palette needs a reserved transparent slot if and only if transparency is enabled.
+    /// Only supported with local palettes. Hybrid palettes, palette lag and rate control are bypassed.
+    pub fn addFrameWithPalette(self: *Self, frame: GifFrame, palette: *const quant.Palette) !void {
+        if (!self.config.use_local_palette or
+            (self.canvas != null) != (palette.transparent_index != null))
+        {
+            return GifError.unsupported_config;
+        }
+
+        if (self.gif == null and self.native == null) {
+            return GifError.gif_uninitialized;
+        }
+
+        if (self.native) |*native| {
+            // The header waits for the first palette in hybrid palette mode.
+            if (!native.wrote_header) {
+                native.writeHeader(null, self.config.loop_count) catch return GifError.gif_write_failed;
+            }
+        }
+
+        const quant_config = quant.QuantizerConfig{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = self.config.use_dithering,
+            .ncolors = @intCast(palette.ncolors()),
+            .reserve_transparent_index = self.canvas != null,
+            .row_stride = frame.row_stride,
+        };
+
+        var quantized = try quant.mapToPalette(quant_config, palette, frame.bgra_buf);
+        quant.reorderImage(&quantized, self.config.palette_order);
+        try self.encodeQuantized(&quantized, .{
+            .delay_cs = delayCs(frame.duration_ms),
+            .lossy = self.config.lossy,
+            .local_palette = true,
+            .owned = true,
+        });
+    }
+
+    /// Map a frame to the shared palette, or build a new shared palette from it
+    /// if its colors have drifted too far from the frame the palette was built from.
+    fn quantizeWithSharedPalette(
+        self: *Self,
+        bgra_buf: []const u8,
+        hybrid: HybridPaletteConfig,
+        quant_config: quant.QuantizerConfig,
+    ) !quant.QuantizedImage {
+        self.palette_stats.frames += 1;
+
+        if (self.shared_palette) |*shared| {
+            const histogram = quant.Histogram.fromImage(quant_config, bgra_buf);
+            const drift = shared.histogram.distance(&histogram);
+            self.palette_stats.last_drift = drift;
+            if (drift <= hybrid.max_drift and self.shared_palette_ncolors == quant_config.ncolors) {
+                return quant.mapToPalette(quant_config, shared, bgra_buf);
+            }
+
+            shared.deinit(self.allocator);
+            self.shared_palette = null;
+            self.shared_palette_is_global = false;
+        }
+
+        var palette = try quant.buildPalette(quant_config, bgra_buf, quant.Quantize.median_cut);
+        errdefer palette.deinit(self.allocator);
+
+        var quantized = try quant.mapToPalette(quant_config, &palette, bgra_buf);
+        quant.reorderPalette(&palette, self.config.palette_order, quantized.image_buffer);
+        @memcpy(quantized.color_table, palette.color_table);
+
+        if (self.native) |*native| {
+            if (!native.wrote_header) {
+                errdefer quantized.deinit(self.allocator);
+                const global_table = try self.allocator.dupe(u8, palette.color_table);
+                self.global_table = global_table;
+                native.writeHeader(global_table, self.config.loop_count) catch return GifError.gif_write_failed;
+                self.shared_palette_is_global = true;
+            }
+        }
+
+        self.shared_palette = palette;
+        self.shared_palette_ncolors = quant_config.ncolors;
+        self.palette_stats.palettes_built += 1;
+        return quantized;
+    }
+
+    /// Map a frame to the newest palette the builder has finished, and ask it to
+    /// build the next palette from this frame.
+    fn quantizeWithLaggingPalette(
+        self: *Self,
+        bgra_buf: []const u8,
+        builder: *quant.PaletteBuilder,
+        quant_config: quant.QuantizerConfig,
+    ) !quant.QuantizedImage {
+        self.palette_stats.frames += 1;
+
+        const counts = self.color_counts orelse unreachable;
+        quant.countImageColors(quant_config, bgra_buf, counts);
+        builder.request(quant_config, counts);
+
+        // The first frame has nothing to lag behind, so it waits for its own palette.
+        const next = if (self.shared_palette == null) try builder.wait() else try builder.take();
+        if (next) |palette| {
+            if (self.shared_palette) |old| old.deinit(self.allocator);
+            self.shared_palette = palette;
+            self.palette_stats.palettes_built += 1;
+        }
+
+        var quantized = try quant.mapToPalette(quant_config, &self.shared_palette.?, bgra_buf);
+        quant.reorderImage(&quantized, self.config.palette_order);
+        return quantized;
+    }
+
+    /// How often palettes were reused in hybrid palette or palette lag mode.
+    pub fn paletteStats(self: *const Self) PaletteStats {
+        return self.palette_stats;
+    }
+
+    /// Size of the output so far, as rate control sees it. Frames that the parallel encoder
+    /// hasn't written yet count with their compressed size, or with the average size
+    /// of a frame while they're still being compressed. Close to `max_total_bytes`, they're
+    /// written out first, so that the cap holds as it does with serial encoding.
+    fn rateBytes(self: *Self, rate: *const RateController) GifError!usize {
+        // Once the writer drops frames, every later frame is dropped too.
+        if (self.native.?.dropped_frames > 0) return rate.config.max_total_bytes.?;
+        const encoder = self.parallel orelse return self.sink_writer.bytes_written;
+        const estimate = self.sink_writer.bytes_written + encoder.pendingBytes(rate.avg_frame_bytes);
+        if (rate.config.max_total_bytes) |max_total| {
+            // Frames in flight can easily be twice the average, e.g. after a scene change.
+            // Until one frame has been written, there is no average to go by.
+            const margin = 2 * rate.avg_frame_bytes * (encoder.inFlight() + 1);
+            if (rate.avg_frame_bytes == 0 or estimate + margin >= max_total) {
+                encoder.finish(&self.native.?) catch return GifError.gif_write_failed;
+                return self.sink_writer.bytes_written;
+            }
+        }
+        return estimate;
+    }
+
+    /// The decisions made by rate control so far, if it is enabled.
+    pub fn rateStats(self: *const Self) ?RateStats {
+        var stats = (self.rate orelse return null).stats;
+        // Until `close`, the frames that the writer dropped are only counted there.
+        if (self.native) |native| stats.addOverBudget(native.dropped_frames);
+        return stats;
+    }
+
+    const FrameEncoding = struct {
+        delay_cs: u16,
+        lossy: u16,
+        /// Whether the frame stores its own color table, instead of using the global one.
+        local_palette: bool,
+        /// Whether the quantized image is freed once the encoder is done with it.
+        owned: bool,
+    };
+
+    /// Make the pixels that are already on screen transparent, and hand the frame to the encoder.
+    fn encodeQuantized(
+        self: *Self,
+        quantized: *quant.QuantizedImage,
+        encoding: FrameEncoding,
+    ) GifError!void {
+        const owned = encoding.owned;
+        var owns_quantized = owned;
+        // CGIF keeps its own copy of the frame until the next one is added.
+        defer if (owns_quantized) quantized.deinit(self.allocator);
+
+        if (self.canvas) |canvas| {
+            const trans_index = quantized.transparent_index orelse unreachable;
+            // The first frame has nothing underneath it, so it must be drawn in full.
+            reuseCanvasPixels(canvas, quantized, trans_index, self.nframes > 0);
+        }
+
+        if (self.native) |*native| {
+            const options = writer.FrameOptions{
+                .delay_cs = encoding.delay_cs,
+                .local_palette = if (encoding.local_palette) quantized.color_table else null,
+                .transparent_index = quantized.transparent_index,
+                .lzw = self.config.lzw,
+                .lossy = encoding.lossy,
+            };
+
+            if (self.parallel) |encoder| {
+                // The encoder takes over the quantized image, and frees it after compressing it.
+                owns_quantized = false;
+                encoder.submit(native, .{
+                    .indices = quantized.image_buffer,
+                    .width = self.config.width,
+                    .height = self.config.height,
+                    .ncolors = quantized.color_table.len / 3,
+                    .palette = quantized.color_table,
+                }, options, if (owned) quantized.* else null) catch return GifError.gif_write_failed;
+            } else {
+                native.writeFrame(quantized.image_buffer, options) catch return GifError.gif_write_failed;
+            }
+        } else {
+            try self.addCGifFrame(quantized, encoding.delay_cs);
         }
 
+        self.nframes += 1;
+    }
+
+    /// Hand a quantized frame over to CGIF.
+    fn addCGifFrame(self: *Self, quantized: *const quant.QuantizedImage, delay_cs: u16) !void {
         const gif = self.gif orelse return GifError.gif_uninitialized;
 
-        const quantized = try quant.quantizeBgraImage(
-            self.allocator,
-            frame.bgra_buf,
-            self.config.width,
-            self.config.height,
-            quant.Quantize.median_cut,
-            self.config.use_dithering,
-        );
-
-        // CGIF uses units of 0.01s for frame delay.
-        const duration = @as(f64, @floatFromInt(frame.duration_ms)) / 10.0;
-        const duration_int: u64 = @intFromFloat(@round(duration));
-
-        // std.debug.print("Adding frame with duration: {} {}\n", .{
-        //     duration_int,
-        //     frame.duration_ms,
-        // });
-        //
-        self.cgif_frame_config.delay = @truncate(duration_int);
+        self.cgif_frame_config.attrFlags &= ~@as(u32, @intCast(cgif.CGIF_FRAME_ATTR_HAS_SET_TRANS));
+        if (quantized.transparent_index) |trans_index| {
+            self.cgif_frame_config.transIndex = trans_index;
+            self.cgif_frame_config.attrFlags |= @intCast(cgif.CGIF_FRAME_ATTR_HAS_SET_TRANS);
+        }
+
+        self.cgif_frame_config.delay = delay_cs;
         self.cgif_frame_config.pImageData = quantized.image_buffer.ptr;
-        self.cgif_frame_config.pLocalPalette = quantized.color_table.ptr;
-        self.cgif_frame_config.numLocalPaletteEntries = @intCast(quantized.color_table.len / 3);
+        if (self.config.use_local_palette) {
+            self.cgif_frame_config.pLocalPalette = quantized.color_table.ptr;
+            self.cgif_frame_config.numLocalPaletteEntries = @intCast(quantized.color_table.len / 3);
+        }
 
         const err_code = cgif.cgif_addframe(gif, self.cgif_frame_config);
         if (err_code != 0) {
@@ -121,16 +592,191 @@ pub const Gif = struct {
         }
     }
 
+    /// Quantize all buffered frames to one color table, write the GIF's header with it,
+    /// and encode the frames. The returned frames must outlive the encoder.
+    fn encodeWithGlobalPalette(self: *Self) GifError!quant.QuantizedFrames {
+        const frames = self.global_frames.items;
+        if (frames.len == 0) {
+            return GifError.gif_uninitialized;
+        }
+
+        const bgra_bufs = self.allocator.alloc([]const u8, frames.len) catch
+            return GifError.malloc_failed;
+        defer self.allocator.free(bgra_bufs);
+        for (frames, bgra_bufs) |frame, *buf| {
+            buf.* = frame.bgra_buf;
+        }
+
+        var quantized = quant.quantizeFrames(.{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = self.config.use_dithering,
+            .reserve_transparent_index = self.canvas != null,
+        }, bgra_bufs, quant.Quantize.median_cut) catch return GifError.malloc_failed;
+        quant.reorderFrames(&quantized, self.config.palette_order);
+        errdefer {
+            if (self.parallel) |encoder| encoder.discard();
+            quantized.deinit();
+        }
+
+        // The source frames aren't needed anymore, so free them before compressing.
+        for (frames) |*frame| {
+            self.allocator.free(frame.bgra_buf);
+            frame.bgra_buf = &[_]u8{};
+        }
+
+        if (self.native) |*native| {
+            native.writeHeader(quantized.color_table, self.config.loop_count) catch return GifError.gif_write_failed;
+        } else {
+            self.cgif_config.pGlobalPalette = quantized.color_table.ptr;
+            self.cgif_config.numGlobalPaletteEntries = @intCast(quantized.color_table.len / 3);
+            self.gif = cgif.cgif_newgif(self.cgif_config) orelse return GifError.gif_make_failed;
+        }
+
+        for (frames, quantized.frames) |frame, indices| {
+            var image = quant.QuantizedImage.init(quantized.color_table, indices);
+            image.transparent_index = quantized.transparent_index;
+            try self.encodeQuantized(&image, .{
+                .delay_cs = delayCs(frame.duration_ms),
+                .lossy = self.config.lossy,
+                .local_palette = false,
+                .owned = false,
+            });
+        }
+
+        self.global_frames.clearRetainingCapacity();
+        return quantized;
+    }
+
+    fn globalQuantConfig(self: *const Self, row_stride: usize) quant.QuantizerConfig {
+        return .{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = self.config.use_dithering,
+            .reserve_transparent_index = self.canvas != null,
+            .row_stride = row_stride,
+        };
+    }
+
+    /// Build the global palette from the color counts of the frames kept so far, write
+    /// the header with it, and encode those frames. Later frames are mapped to the palette
+    /// as they are added, with `encodeWithGlobalTable`.
+    fn streamGlobalFrames(self: *Self) !void {
+        const frames = self.global_frames.items;
+        const quant_config = self.globalQuantConfig(0);
+
+        const counts = try self.allocator.create([quant.color_array_size]u32);
+        defer self.allocator.destroy(counts);
+        const total = try self.allocator.create([quant.color_array_size]u32);
+        defer self.allocator.destroy(total);
+        @memset(total, 0);
+        for (frames) |frame| {
+            quant.countImageColors(quant_config, frame.bgra_buf, counts);
+            for (total, counts) |*sum, count| sum.* +|= count;
+        }
+
+        var first = blk: {
+            var palette = try quant.buildPaletteFromCounts(quant_config, total);
+            errdefer palette.deinit(self.allocator);
+            var quantized = try quant.mapToPalette(quant_config, &palette, frames[0].bgra_buf);
+            errdefer quantized.deinit(self.allocator);
+            // Like in hybrid palette mode, the first frame decides the order of the palette.
+            quant.reorderPalette(&palette, self.config.palette_order, quantized.image_buffer);
+            @memcpy(quantized.color_table, palette.color_table);
+
+            const global_table = try self.allocator.dupe(u8, palette.color_table);
+            self.global_table = global_table;
+            if (self.native) |*native| {
+                native.writeHeader(global_table, self.config.loop_count) catch return GifError.gif_write_failed;
+            } else {
+                self.cgif_config.pGlobalPalette = global_table.ptr;
+                self.cgif_config.numGlobalPaletteEntries = @intCast(global_table.len / 3);
+                self.gif = cgif.cgif_newgif(self.cgif_config) orelse return GifError.gif_make_failed;
+            }
+
+            self.shared_palette = palette;
+            self.shared_palette_is_global = true;
+            break :blk quantized;
+        };
+
+        try self.encodeQuantized(&first, .{
+            .delay_cs = delayCs(frames[0].duration_ms),
+            .lossy = self.config.lossy,
+            .local_palette = false,
+            .owned = true,
+        });
+        for (frames, 0..) |*frame, i| {
+            if (i > 0) try self.encodeWithGlobalTable(frame.*, &self.shared_palette.?);
+            self.allocator.free(frame.bgra_buf);
+            frame.bgra_buf = &[_]u8{};
+        }
+
+        self.global_frames.clearRetainingCapacity();
+        self.global_bytes = 0;
+    }
+
+    /// Map a frame to the global palette once it's built, and encode it.
+    fn encodeWithGlobalTable(self: *Self, frame: GifFrame, palette: *const quant.Palette) !void {
+        var quantized = try quant.mapToPalette(self.globalQuantConfig(frame.row_stride), palette, frame.bgra_buf);
+        try self.encodeQuantized(&quantized, .{
+            .delay_cs = delayCs(frame.duration_ms),
+            .lossy = self.config.lossy,
+            .local_palette = false,
+            .owned = true,
+        });
+    }
+
     pub fn close(self: *Self) GifError!void {
+        // With a global palette, frames are encoded here and point into these until the end.
+        var global: ?quant.QuantizedFrames = null;
+        defer if (global) |frames| frames.deinit();
+        // Runs first: workers must be done with the frames before they're freed.
+        defer if (self.parallel) |encoder| encoder.discard();
+        if (!self.config.use_local_palette and self.shared_palette == null) {
+            global = try self.encodeWithGlobalPalette();
+        }
+
+        if (self.native) |*native| {
+            defer {
+                native.deinit();
+                self.native = null;
+            }
+            if (self.parallel) |encoder| {
+                encoder.finish(native) catch return GifError.gif_write_failed;
+            }
+            if (self.rate) |*rate| rate.stats.addOverBudget(native.dropped_frames);
+            self.dropped_ms += native.dropped_cs * 10;
+            // `byte_limit` kept room for the idle frame below.
+            native.byte_limit = null;
+            if (self.dropped_ms > 0 and self.nframes > 0) {
+                // Frames dropped at the end have no later frame to add their time to.
+                writeIdleFrame(native, self.dropped_ms) catch return GifError.gif_write_failed;
+                self.dropped_ms = 0;
+            }
+            if (!native.wrote_header) {
+                // Hybrid palette mode without a single frame.
+                native.writeHeader(null, self.config.loop_count) catch return GifError.gif_write_failed;
+            }
+            native.writeTrailer() catch return GifError.gif_write_failed;
+            self.sink_writer.close() catch return GifError.gif_write_failed;
+            return;
+        }
+
         if (self.gif == null) {
             return GifError.gif_uninitialized;
         }
 
         const err_code = cgif.cgif_close(self.gif);
         self.gif = null;
+        // Close the file whether CGIF managed to finish the GIF or not.
+        const closed = self.sink_writer.close();
         if (err_code != 0) {
             return cgifError(err_code);
         }
+
+        closed catch return GifError.gif_write_failed;
     }
 
     /// Convert a CGIF error to a GifError.
@@ -146,29 +792,395 @@ pub const Gif = struct {
         };
     }
 
-    pub fn deinit(self: *const Self) void {
+    pub fn deinit(self: *Self) void {
+        if (self.parallel) |encoder| {
+            encoder.deinit();
+        }
+        if (self.palette_builder) |builder| {
+            builder.deinit();
+        }
+        if (self.color_counts) |counts| {
+            self.allocator.destroy(counts);
+        }
+        if (self.native) |*native| {
+            native.deinit();
+        }
+        for (self.global_frames.items) |frame| {
+            self.allocator.free(frame.bgra_buf);
+        }
+        self.global_frames.deinit();
+        if (self.shared_palette) |shared| {
+            shared.deinit(self.allocator);
+        }
+        if (self.global_table) |table| {
+            self.allocator.free(table);
+        }
         self.allocator.destroy(self.cgif_config);
         self.allocator.destroy(self.cgif_frame_config);
+        // Only does something if `close` wasn't called, or failed before closing the sink.
+        self.sink_writer.deinit();
+        self.allocator.destroy(self.sink_writer);
+        if (self.canvas) |canvas| {
+            self.allocator.free(canvas);
+        }
     }
 };
 
+/// Convert a frame duration to the GIF's unit of 0.01s.
+fn delayCs(duration_ms: u64) u16 {
+    const duration = @as(f64, @floatFromInt(duration_ms)) / 10.0;
+    const duration_int: u64 = @intFromFloat(@round(duration));
+    return @truncate(duration_int);
+}
+
+/// Write a frame that changes nothing, so that the frames before it stay on screen
+/// for another `duration_ms`. It's a single transparent pixel.
+fn writeIdleFrame(native: *GifWriter, duration_ms: u64) !void {
+    const buf = &native.frame_buf;
+    buf.clearRetainingCapacity();
+    try writer.encodeFrame(buf, .{ .indices = &[_]u8{0}, .width = 1, .height = 1, .ncolors = 2 }, .{
+        .delay_cs = delayCs(duration_ms),
+        .local_palette = &[_]u8{0} ** 6,
+        .transparent_index = 0,
+    });
+    try native.writeEncodedFrame(buf.items, delayCs(duration_ms));
+}
+
+/// Replace every pixel of `image` whose color is already displayed on the canvas with
+/// `trans_index`, and paint all other pixels onto the canvas.
+/// If `can_reuse` is false, the whole image is painted and no pixel is made transparent.
+fn reuseCanvasPixels(
+    canvas: []u8,
+    image: *const quant.QuantizedImage,
+    trans_index: u8,
+    can_reuse: bool,
+) void {
+    const color_table = image.color_table;
+    for (0.., image.image_buffer) |i, *index| {
+        const ct_index = @as(usize, index.*) * 3;
+        const rgb = color_table[ct_index..][0..3];
+        const shown = canvas[i * 3 ..][0..3];
+
+        if (can_reuse and std.mem.eql(u8, rgb, shown)) {
+            index.* = trans_index;
+        } else {
+            @memcpy(shown, rgb);
+        }
+    }
+}
+
+test "reuseCanvasPixels" {
+    var color_table = [_]u8{
+        10, 20, 30,
+        40, 50, 60,
+        0,  0,  0, // transparent
+    };
+
+    var canvas: [4 * 3]u8 = undefined;
+
+    var first = [_]u8{ 0, 0, 1, 1 };
+    reuseCanvasPixels(&canvas, &quant.QuantizedImage.init(&color_table, &first), 2, false);
+    try std.testing.expectEqualDeep([_]u8{ 0, 0, 1, 1 }, first);
+
+    var second = [_]u8{ 0, 1, 1, 0 };
+    reuseCanvasPixels(&canvas, &quant.QuantizedImage.init(&color_table, &second), 2, true);
+    try std.testing.expectEqualDeep([_]u8{ 2, 1, 2, 0 }, second);
+    try std.testing.expectEqualDeep([_]u8{
+        10, 20, 30,
+        40, 50, 60,
+        40, 50, 60,
+        10, 20, 30,
+    }, canvas);
+}
+
+test "Gif – parallel encoding writes the same file as serial encoding" {
+    const allocator = std.testing.allocator;
+    const width = 32;
+    const height = 16;
+
+    var frames: [6][width * height * 4]u8 = undefined;
+    var gen = std.rand.DefaultPrng.init(3);
+    for (&frames) |*frame| {
+        for (frame) |*byte| byte.* = gen.random().int(u8) & 0xC0;
+    }
+
+    var outputs = [_]std.ArrayList(u8){
+        std.ArrayList(u8).init(allocator),
+        std.ArrayList(u8).init(allocator),
+    };
+    defer for (&outputs) |*out| out.deinit();
+
+    for (&outputs, [_]?ParallelConfig{ null, .{ .n_jobs = 2 } }) |*out, parallel_config| {
+        var gif = try Gif.init(allocator, .{
+            .use_local_palette = false,
+            .use_dithering = false,
+            .sink = .{ .memory = out },
+            .parallel = parallel_config,
+            .width = width,
+            .height = height,
+        });
+        defer gif.deinit();
+
+        for (&frames) |*frame| {
+            try gif.addFrame(.{ .bgra_buf = frame, .duration_ms = 40 });
+        }
+        try gif.close();
+    }
+
+    try std.testing.expectEqualStrings("GIF89a", outputs[0].items[0..6]);
+    try std.testing.expectEqual(0x3B, outputs[0].items[outputs[0].items.len - 1]);
+    try std.testing.expectEqualSlices(u8, outputs[0].items, outputs[1].items);
+}
+
+test "Gif – the global palette is built early once max_global_bytes is exceeded" {
+    const allocator = std.testing.allocator;
+    const width = 8;
+    const height = 8;
+    const colors = [_][4]u8{
+        .{ 0, 0, 0, 255 },
+        .{ 248, 0, 0, 255 },
+        .{ 0, 248, 0, 255 },
+        .{ 0, 0, 248, 255 },
+    };
+
+    // Stripes that move down by a row per frame.
+    var frames: [6][width * height * 4]u8 = undefined;
+    for (&frames, 0..) |*frame, n| {
+        for (0..width * height) |i| frame[i * 4 ..][0..4].* = colors[(i / width + n) % colors.len];
+    }
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var gif = try Gif.init(allocator, .{
+        .use_local_palette = false,
+        .use_dithering = false,
+        .max_global_bytes = 2 * frames[0].len,
+        .sink = .{ .memory = &out },
+        .width = width,
+        .height = height,
+    });
+    defer gif.deinit();
+
+    for (&frames) |*frame| try gif.addFrame(.{ .bgra_buf = frame, .duration_ms = 40 });
+    // The palette was built from the first 3 frames, and no frame is kept anymore.
+    try std.testing.expect(gif.shared_palette != null);
+    try std.testing.expectEqual(0, gif.global_frames.items.len);
+    try gif.close();
+
+    try std.testing.expect(out.items[10] & 0x80 != 0);
+    var decoded = try decoder.decode(allocator, out.items, .{});
+    defer decoded.deinit();
+    try std.testing.expectEqual(frames.len, decoded.frames.len);
+    for (&frames, decoded.frames) |*expected, frame| {
+        try std.testing.expectEqualSlices(u8, expected, frame.bgra_buf);
+    }
+}
+
+test "Gif – rate control keeps the size cap with parallel encoding" {
+    const allocator = std.testing.allocator;
+    const width = 32;
+    const height = 32;
+    const max_total = 4000;
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var gif = try Gif.init(allocator, .{
+        .use_transparency = false,
+        .sink = .{ .memory = &out },
+        .parallel = .{ .n_jobs = 4 },
+        .rate_control = .{ .max_total_bytes = max_total },
+        .width = width,
+        .height = height,
+    });
+    defer gif.deinit();
+
+    // Noise barely compresses, so the cap is reached after a few frames.
+    var frame: [width * height * 4]u8 = undefined;
+    var gen = std.rand.DefaultPrng.init(5);
+    for (0..30) |_| {
+        gen.random().bytes(&frame);
+        try gif.addFrame(.{ .bgra_buf = &frame, .duration_ms = 100 });
+    }
+    try gif.close();
+
+    const stats = gif.rateStats().?;
+    try std.testing.expect(stats.frames_dropped_over_budget > 0);
+    try std.testing.expect(out.items.len <= max_total);
+
+    // The time of the frames dropped at the end is in the last frame's delay,
+    // so all 3 seconds are still there.
+    var decoded = try decoder.decode(allocator, out.items, .{});
+    defer decoded.deinit();
+    var total_ms: u64 = 0;
+    for (decoded.frames) |decoded_frame| total_ms += decoded_frame.duration_ms;
+    try std.testing.expectEqual(3000, total_ms);
+}
+
+test "Gif – rate control keeps the size cap when frames grow past the average" {
+    const allocator = std.testing.allocator;
+    const width = 64;
+    const height = 64;
+    const max_total = 8000;
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var gif = try Gif.init(allocator, .{
+        .use_transparency = false,
+        .sink = .{ .memory = &out },
+        .rate_control = .{ .max_total_bytes = max_total, .min_frames_between_changes = 100 },
+        .width = width,
+        .height = height,
+    });
+    defer gif.deinit();
+
+    // Flat frames keep the average small, then noise comes in at several times that size.
+    var frame: [width * height * 4]u8 = undefined;
+    @memset(&frame, 128);
+    for (0..5) |_| try gif.addFrame(.{ .bgra_buf = &frame, .duration_ms = 100 });
+    var gen = std.rand.DefaultPrng.init(9);
+    for (0..5) |_| {
+        gen.random().bytes(&frame);
+        try gif.addFrame(.{ .bgra_buf = &frame, .duration_ms = 100 });
+    }
+    try gif.close();
+
+    const stats = gif.rateStats().?;
+    try std.testing.expect(stats.frames_dropped_over_budget > 0);
+    try std.testing.expectEqual(10, stats.frames_encoded + stats.frames_dropped);
+    try std.testing.expect(out.items.len <= max_total);
+
+    var decoded = try decoder.decode(allocator, out.items, .{});
+    defer decoded.deinit();
+    var total_ms: u64 = 0;
+    for (decoded.frames) |decoded_frame| total_ms += decoded_frame.duration_ms;
+    try std.testing.expectEqual(1000, total_ms);
+}
+
+test "Gif – cgif rejects what only the native encoder does" {
+    var out = std.ArrayList(u8).init(std.testing.allocator);
+    defer out.deinit();
+    const config = GifConfig{ .encoder = .cgif, .sink = .{ .memory = &out }, .width = 4, .height = 4 };
+
+    var parallel_config = config;
+    parallel_config.parallel = .{};
+    try std.testing.expectError(GifError.unsupported_config, Gif.init(std.testing.allocator, parallel_config));
+
+    var lossy_config = config;
+    lossy_config.lossy = 20;
+    try std.testing.expectError(GifError.unsupported_config, Gif.init(std.testing.allocator, lossy_config));
+}
+
+test "Gif – rate control needs local palettes" {
+    var out = std.ArrayList(u8).init(std.testing.allocator);
+    defer out.deinit();
+    try std.testing.expectError(GifError.unsupported_config, Gif.init(std.testing.allocator, .{
+        .use_local_palette = false,
+        .sink = .{ .memory = &out },
+        .rate_control = .{ .max_total_bytes = 1000 },
+        .width = 4,
+        .height = 4,
+    }));
+}
+
+test "Gif – hybrid palettes are reused until the scene changes" {
+    const allocator = std.testing.allocator;
+    const width = 16;
+    const height = 16;
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var gif = try Gif.init(allocator, .{
+        .use_dithering = false,
+        .hybrid_palette = .{},
+        .sink = .{ .memory = &out },
+        .width = width,
+        .height = height,
+    });
+    defer gif.deinit();
+
+    var warm: [width * height * 4]u8 = undefined;
+    var cold: [width * height * 4]u8 = undefined;
+    for (0..width * height) |i| {
+        const shade: u8 = @intCast(i % 64);
+        warm[i * 4 ..][0..4].* = .{ shade, 64, 192 + shade, 255 };
+        cold[i * 4 ..][0..4].* = .{ 192 + shade, 128, shade, 255 };
+    }
+
+    for (0..4) |_| try gif.addFrame(.{ .bgra_buf = &warm, .duration_ms = 100 });
+    for (0..2) |_| try gif.addFrame(.{ .bgra_buf = &cold, .duration_ms = 100 });
+    try gif.close();
+
+    const stats = gif.paletteStats();
+    try std.testing.expectEqual(6, stats.frames);
+    try std.testing.expectEqual(2, stats.palettes_built);
+    try std.testing.expectApproxEqAbs(4.0 / 6.0, stats.reuseRate(), 0.001);
+
+    // The first palette is the global color table.
+    try std.testing.expectEqualStrings("GIF89a", out.items[0..6]);
+    try std.testing.expect(out.items[10] & 0x80 != 0);
+}
+
+test "Gif – palette lag mode" {
+    const allocator = std.testing.allocator;
+    const width = 8;
+    const height = 8;
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var gif = try Gif.init(allocator, .{
+        .use_dithering = false,
+        .palette_lag = true,
+        .sink = .{ .memory = &out },
+        .width = width,
+        .height = height,
+    });
+    defer gif.deinit();
+
+    var frame: [width * height * 4]u8 = undefined;
+    for (0..4) |n| {
+        @memset(&frame, @intCast(n * 60));
+        try gif.addFrame(.{ .bgra_buf = &frame, .duration_ms = 50 });
+    }
+    try gif.close();
+
+    const stats = gif.paletteStats();
+    try std.testing.expectEqual(4, stats.frames);
+    try std.testing.expect(stats.palettes_built >= 1);
+    try std.testing.expectEqual(0x3B, out.items[out.items.len - 1]);
+}
+
+/// Called by CGIF whenever it has encoded bytes to write.
+/// `ctx` is the `SinkWriter` that was set as `pContext` in the GIF's config.
+fn cgifWriteFn(ctx: ?*anyopaque, data: [*c]const u8, len: usize) callconv(.C) c_int {
+    const sink_writer: *SinkWriter = @ptrCast(@alignCast(ctx orelse return cgif.CGIF_EWRITE));
+    sink_writer.writeAll(data[0..len]) catch return cgif.CGIF_EWRITE;
+    return cgif.CGIF_OK;
+}
+
 /// Intialize a cgif gif config struct.
 fn initCGifConfig(
     gif_config: *cgif.CGIF_Config,
-    path: [:0]const u8,
+    sink_writer: *SinkWriter,
     width: usize,
     height: usize,
 ) void {
     // in a c program, this would be a memset(gif_config, 0), but we can't do that in Zig
     gif_config.pGlobalPalette = null;
-    gif_config.pContext = null;
-    gif_config.pWriteFn = null;
     gif_config.attrFlags = 0;
     gif_config.genFlags = 0;
     gif_config.numGlobalPaletteEntries = 0;
     gif_config.numLoops = 0;
 
-    gif_config.path = path.ptr;
+    // CGIF opens `path` itself if we set it. Instead, we route all output
+    // through our own writer so that it can go to any kind of sink.
+    gif_config.path = null;
+    gif_config.pContext = sink_writer;
+    gif_config.pWriteFn = cgifWriteFn;
     gif_config.width = @intCast(width);
     gif_config.height = @intCast(height);
 }
@@ -185,3 +1197,13 @@ pub fn initFrameConfig(conf: *cgif.CGIF_FrameConfig) void {
 
     conf.delay = 0;
 }
+
+test {
+    _ = @import("decoder.zig");
+    _ = @import("lzw.zig");
+    _ = @import("multi.zig");
+    _ = @import("parallel.zig");
+    _ = @import("rate-control.zig");
+    _ = @import("sink.zig");
+    _ = @import("writer.zig");
+}
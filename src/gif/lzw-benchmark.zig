@@ -0,0 +1,145 @@
+const std = @import("std");
+const cgif = @cImport(@cInclude("cgif.h"));
+const quant = @import("quantize");
+const lzw = @import("lzw.zig");
+const writer = @import("writer.zig");
+const bench_frames = @import("bench-frames.zig");
+
+// Compares the throughput and output size of our LZW encoder against cgif's.
+//
+// Usage: lzw-benchmark [<frames.bgra> <width>x<height>]
+//
+// `frames.bgra` is a raw dump of consecutive BGRA frames from a screen recording.
+// Without arguments, synthetic screen-like frames are generated instead.
+// Both encoders receive the exact same quantized frames, and neither of them
+// is allowed to use transparency or crop frames, so only the LZW stage is compared.
+
+const ntimes = 5;
+
+fn countBytes(ctx: ?*anyopaque, _: [*c]const u8, len: usize) callconv(.C) c_int {
+    const nbytes: *usize = @ptrCast(@alignCast(ctx.?));
+    nbytes.* += len;
+    return cgif.CGIF_OK;
+}
+
+/// Encode the frames with cgif, and return the size of the GIF.
+fn encodeWithCGif(frames: []const quant.QuantizedImage, width: usize, height: usize) !usize {
+    var nbytes: usize = 0;
+
+    var config = std.mem.zeroes(cgif.CGIF_Config);
+    config.width = @intCast(width);
+    config.height = @intCast(height);
+    config.attrFlags = @intCast(cgif.CGIF_ATTR_IS_ANIMATED | cgif.CGIF_ATTR_NO_GLOBAL_TABLE);
+    config.pWriteFn = countBytes;
+    config.pContext = &nbytes;
+
+    const gif = cgif.cgif_newgif(&config) orelse return error.gif_make_failed;
+    for (frames) |frame| {
+        var frame_config = std.mem.zeroes(cgif.CGIF_FrameConfig);
+        frame_config.attrFlags = @intCast(cgif.CGIF_FRAME_ATTR_USE_LOCAL_TABLE);
+        frame_config.pImageData = frame.image_buffer.ptr;
+        frame_config.pLocalPalette = frame.color_table.ptr;
+        frame_config.numLocalPaletteEntries = @intCast(frame.color_table.len / 3);
+        frame_config.delay = 2;
+        if (cgif.cgif_addframe(gif, &frame_config) != 0) return error.gif_write_failed;
+    }
+
+    if (cgif.cgif_close(gif) != 0) return error.gif_close_failed;
+    return nbytes;
+}
+
+/// Encode the frames with our own encoder, and return the size of the encoded frames.
+fn encodeNative(
+    out: *std.ArrayList(u8),
+    frames: []const quant.QuantizedImage,
+    width: usize,
+    height: usize,
+    options: lzw.Options,
+    lossy: u16,
+) !usize {
+    out.clearRetainingCapacity();
+    for (frames) |frame| {
+        try writer.encodeFrame(out, .{
+            .indices = frame.image_buffer,
+            .width = width,
+            .height = height,
+            .ncolors = frame.color_table.len / 3,
+        }, .{
+            .delay_cs = 2,
+            .local_palette = frame.color_table,
+            .crop_to_changes = false,
+            .lzw = options,
+            .lossy = lossy,
+        });
+    }
+    return out.items.len;
+}
+
+fn report(name: []const u8, nbytes: usize, elapsed_ns: u64, npixels: usize) void {
+    const seconds = @as(f64, @floatFromInt(elapsed_ns)) / std.time.ns_per_s;
+    const mpx_per_s = @as(f64, @floatFromInt(npixels * ntimes)) / seconds / 1_000_000;
+    std.debug.print("{s: <20} {d: >12} bytes {d: >10.2} Mpx/s\n", .{ name, nbytes, mpx_per_s });
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var width: usize = 800;
+    var height: usize = 600;
+    var frames: [][]u8 = undefined;
+    if (args.len >= 3) {
+        width, height = try bench_frames.parseResolution(args[2]);
+        frames = try bench_frames.loadFrames(allocator, args[1], width, height);
+    } else {
+        frames = try bench_frames.generateFrames(allocator, width, height, 60);
+    }
+    defer bench_frames.freeFrames(allocator, frames);
+
+    const quantized = try allocator.alloc(quant.QuantizedImage, frames.len);
+    defer {
+        for (quantized) |q| q.deinit(allocator);
+        allocator.free(quantized);
+    }
+
+    for (frames, quantized) |frame, *q| {
+        q.* = try quant.quantizeImage(.{
+            .allocator = allocator,
+            .width = width,
+            .height = height,
+            .use_dithering = false,
+        }, frame, .median_cut);
+    }
+
+    const npixels = frames.len * width * height;
+    std.debug.print("{d} frames of {d}x{d}\n", .{ frames.len, width, height });
+
+    var timer = try std.time.Timer.start();
+    var nbytes: usize = 0;
+    for (0..ntimes) |_| {
+        nbytes = try encodeWithCGif(quantized, width, height);
+    }
+    report("cgif", nbytes, timer.read(), npixels);
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    inline for (.{ lzw.ClearPolicy.reset, lzw.ClearPolicy.freeze, lzw.ClearPolicy.adaptive }) |policy| {
+        timer.reset();
+        for (0..ntimes) |_| {
+            nbytes = try encodeNative(&out, quantized, width, height, .{ .clear_policy = policy }, 0);
+        }
+        report("native (" ++ @tagName(policy) ++ ")", nbytes, timer.read(), npixels);
+    }
+
+    inline for (.{ 10, 20, 40 }) |lossy| {
+        timer.reset();
+        for (0..ntimes) |_| {
+            nbytes = try encodeNative(&out, quantized, width, height, .{}, lossy);
+        }
+        report(std.fmt.comptimePrint("native (lossy {d})", .{lossy}), nbytes, timer.read(), npixels);
+    }
+}
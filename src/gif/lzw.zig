@@ -0,0 +1,566 @@
+const std = @import("std");
+
+// The variable-length-code LZW compression used in GIF image data.
+// See: https://www.w3.org/Graphics/GIF/spec-gif89a.txt (Appendix F)
+//
+// An image data stream is a byte with the minimum code size, followed by
+// the compressed codes packed LSB-first into data sub-blocks of at most 255 bytes,
+// and terminated by an empty sub-block.
+
+/// The largest code that can appear in a GIF LZW stream.
+const max_code = 4095;
+/// Codes are never wider than 12 bits.
+const max_code_size = 12;
+
+pub const LzwError = error{
+    invalid_lzw_data,
+    truncated_lzw_data,
+};
+
+/// What the encoder does once all 4096 codes in its dictionary have been assigned.
+pub const ClearPolicy = enum {
+    /// Emit a clear code and start with an empty dictionary right away.
+    /// This is what giflib and cgif do.
+    reset,
+    /// Keep matching strings against the full dictionary forever.
+    /// Works well when the start of an image is representative of the rest of it.
+    freeze,
+    /// Keep using the full dictionary, but clear it once recent input compresses
+    /// noticeably worse than it did while the dictionary was being built.
+    adaptive,
+};
+
+pub const Options = struct {
+    clear_policy: ClearPolicy = .adaptive,
+};
+
+/// For every index of a palette, the other indices whose colors are close enough
+/// that lossy encoding may use them in its place, closest first.
+pub const Neighbors = struct {
+    /// Trying more candidates finds slightly longer strings, but costs a dictionary probe each.
+    pub const max_neighbors = 8;
+
+    count: [256]u8 = [_]u8{0} ** 256,
+    list: [256][max_neighbors]u8 = undefined,
+
+    /// Find the neighbors of each color in `palette` (RGBRGB...) that are at most
+    /// `max_distance` apart (euclidean, in RGB space).
+    /// `exclude` (e.g the transparent index) never has neighbors, nor is it one.
+    pub fn init(palette: []const u8, max_distance: u16, exclude: ?u8) Neighbors {
+        var self = Neighbors{};
+        const ncolors = @min(palette.len / 3, 256);
+        const max_dist_sq = @as(u32, max_distance) * max_distance;
+
+        var dists: [max_neighbors]u32 = undefined;
+        for (0..ncolors) |i| {
+            if (isExcluded(exclude, i)) continue;
+            const a = palette[i * 3 ..][0..3];
+
+            var n: usize = 0;
+            for (0..ncolors) |j| {
+                if (i == j or isExcluded(exclude, j)) continue;
+                const b = palette[j * 3 ..][0..3];
+                const dist = distanceSquared(a, b);
+                if (dist > max_dist_sq) continue;
+                if (n == max_neighbors and dist >= dists[n - 1]) continue;
+
+                // Insertion into the sorted list, dropping the farthest one if it's full.
+                var k = if (n == max_neighbors) n - 1 else n;
+                while (k > 0 and dists[k - 1] > dist) : (k -= 1) {
+                    dists[k] = dists[k - 1];
+                    self.list[i][k] = self.list[i][k - 1];
+                }
+                dists[k] = dist;
+                self.list[i][k] = @intCast(j);
+                n = @min(n + 1, max_neighbors);
+            }
+            self.count[i] = @intCast(n);
+        }
+
+        return self;
+    }
+
+    inline fn isExcluded(exclude: ?u8, index: usize) bool {
+        return if (exclude) |e| e == index else false;
+    }
+
+    pub inline fn of(self: *const Neighbors, index: u8) []const u8 {
+        return self.list[index][0..self.count[index]];
+    }
+
+    inline fn distanceSquared(a: *const [3]u8, b: *const [3]u8) u32 {
+        var sum: u32 = 0;
+        inline for (0..3) |c| {
+            const d = @as(i32, a[c]) - @as(i32, b[c]);
+            sum += @intCast(d * d);
+        }
+        return sum;
+    }
+};
+
+/// Number of input pixels over which the compression ratio is measured
+/// by the `adaptive` clear policy.
+const adaptive_window = 4096;
+
+/// An open-addressing hash table that maps (prefix code, next index) pairs to codes.
+/// Each slot packs the 20 bit key and the 12 bit code into a single u32,
+/// so the whole table is 32KiB and stays resident in L1/L2 while encoding.
+const Dictionary = struct {
+    const nslots = 8192; // at most 4096 entries, so the load factor never exceeds 0.5.
+    const slot_bits = 13;
+    /// A slot with value 0 is empty. No real entry can be 0, since every
+    /// code we insert is larger than the clear and end-of-information codes.
+    const empty: u32 = 0;
+
+    slots: [nslots]u32 = [_]u32{empty} ** nslots,
+
+    inline fn makeKey(prefix: u16, index: u8) u32 {
+        return (@as(u32, prefix) << 8) | index;
+    }
+
+    inline fn hash(key: u32) usize {
+        return (key *% 0x9E3779B1) >> (32 - slot_bits);
+    }
+
+    /// Returns the index of the slot that holds `key`, or of the
+    /// empty slot where `key` should be inserted.
+    inline fn probe(self: *const Dictionary, key: u32) usize {
+        var i = hash(key);
+        while (true) : (i = (i + 1) & (nslots - 1)) {
+            const slot = self.slots[i];
+            if (slot == empty or slot >> 12 == key) return i;
+        }
+    }
+
+    inline fn codeAt(self: *const Dictionary, slot: usize) u16 {
+        return @intCast(self.slots[slot] & max_code);
+    }
+
+    inline fn insertAt(self: *Dictionary, slot: usize, key: u32, code: u16) void {
+        self.slots[slot] = (key << 12) | code;
+    }
+
+    fn reset(self: *Dictionary) void {
+        @memset(&self.slots, empty);
+    }
+};
+
+/// Packs variable-width codes LSB-first into a 64-bit accumulator,
+/// and moves them out into GIF data sub-blocks.
+const BitWriter = struct {
+    const Self = @This();
+
+    out: *std.ArrayList(u8),
+    acc: u64 = 0,
+    nbits: u6 = 0,
+    /// Total number of bits written so far.
+    total_bits: usize = 0,
+
+    block: [255]u8 = undefined,
+    block_len: usize = 0,
+
+    inline fn writeCode(self: *Self, code: u16, size: u5) !void {
+        self.acc |= @as(u64, code) << self.nbits;
+        self.nbits += size;
+        self.total_bits += size;
+
+        // Drain the accumulator 4 bytes at a time.
+        // At most 31 + 12 bits are held at once, so it never overflows.
+        if (self.nbits >= 32) {
+            try self.pushByte(@truncate(self.acc));
+            try self.pushByte(@truncate(self.acc >> 8));
+            try self.pushByte(@truncate(self.acc >> 16));
+            try self.pushByte(@truncate(self.acc >> 24));
+            self.acc >>= 32;
+            self.nbits -= 32;
+        }
+    }
+
+    inline fn pushByte(self: *Self, byte: u8) !void {
+        self.block[self.block_len] = byte;
+        self.block_len += 1;
+        if (self.block_len == self.block.len) {
+            try self.flushBlock();
+        }
+    }
+
+    fn flushBlock(self: *Self) !void {
+        if (self.block_len == 0) return;
+        try self.out.append(@intCast(self.block_len));
+        try self.out.appendSlice(self.block[0..self.block_len]);
+        self.block_len = 0;
+    }
+
+    /// Write out all pending bits, and terminate the sub-block sequence.
+    fn finish(self: *Self) !void {
+        while (self.nbits > 0) {
+            try self.pushByte(@truncate(self.acc));
+            self.acc >>= 8;
+            self.nbits -|= 8;
+        }
+        try self.flushBlock();
+        try self.out.append(0); // block terminator
+    }
+};
+
+/// Returns the smallest LZW minimum code size that can represent `ncolors` indices.
+pub fn minCodeSize(ncolors: usize) u4 {
+    var size: u4 = 2; // GIF doesn't allow anything smaller.
+    while ((@as(usize, 1) << size) < ncolors) : (size += 1) {}
+    return size;
+}
+
+/// LZW-compress a list of color table indices, and append the resulting
+/// image data stream (minimum code size + data sub-blocks) to `out`.
+/// Every index must be smaller than `1 << min_code_size`.
+pub fn encode(
+    out: *std.ArrayList(u8),
+    indices: []const u8,
+    min_code_size: u4,
+    options: Options,
+) !void {
+    try encodeImpl(false, out, indices, min_code_size, options, undefined);
+}
+
+/// Like `encode`, but when a string can't be extended by the next index,
+/// the encoder may extend it with one of the index's `neighbors` instead,
+/// in the style of gifsicle's `--lossy`.
+/// Every pixel of the decoded image is then either exact, or one of its neighbors.
+pub fn encodeLossy(
+    out: *std.ArrayList(u8),
+    indices: []const u8,
+    min_code_size: u4,
+    options: Options,
+    neighbors: *const Neighbors,
+) !void {
+    try encodeImpl(true, out, indices, min_code_size, options, neighbors);
+}
+
+inline fn encodeImpl(
+    comptime lossy: bool,
+    out: *std.ArrayList(u8),
+    indices: []const u8,
+    min_code_size: u4,
+    options: Options,
+    neighbors: *const Neighbors,
+) !void {
+    std.debug.assert(min_code_size >= 2 and min_code_size <= 8);
+
+    const clear_code: u16 = @as(u16, 1) << min_code_size;
+    const eoi_code: u16 = clear_code + 1;
+    const first_code: u16 = clear_code + 2;
+    const initial_code_size: u5 = @as(u5, min_code_size) + 1;
+
+    try out.append(min_code_size);
+
+    var bw = BitWriter{ .out = out };
+    var dict = Dictionary{};
+    var next_code: u16 = first_code;
+    var code_size = initial_code_size;
+
+    // Book-keeping for the adaptive clear policy.
+    // The ratio (bits / pixels) achieved from the last clear until the dictionary filled up
+    // is used as a reference for the ratio achieved by a sliding window of input after that.
+    var ref_bits: usize = 0;
+    var ref_pixels: usize = 0;
+    var clear_bits: usize = 0;
+    var clear_pixel: usize = 0;
+    var window_bits: usize = 0;
+    var window_pixel: usize = 0;
+
+    try bw.writeCode(clear_code, code_size);
+    if (indices.len == 0) {
+        try bw.writeCode(eoi_code, code_size);
+        try bw.finish();
+        return;
+    }
+
+    var prefix: u16 = indices[0];
+    for (indices[1..], 1..) |index, i| {
+        const key = Dictionary.makeKey(prefix, index);
+        const slot = dict.probe(key);
+        if (dict.slots[slot] != Dictionary.empty) {
+            // (prefix, index) is a known string, try to extend it further.
+            prefix = dict.codeAt(slot);
+            continue;
+        }
+
+        if (lossy) {
+            // Try to extend the string with a color that looks nearly the same.
+            // Nothing has been inserted since probing `key`, so `slot` stays valid.
+            const alt_code = for (neighbors.of(index)) |alt| {
+                const alt_slot = dict.probe(Dictionary.makeKey(prefix, alt));
+                if (dict.slots[alt_slot] != Dictionary.empty) break dict.codeAt(alt_slot);
+            } else null;
+
+            if (alt_code) |code| {
+                prefix = code;
+                continue;
+            }
+        }
+
+        try bw.writeCode(prefix, code_size);
+        prefix = index;
+
+        if (next_code <= max_code) {
+            dict.insertAt(slot, key, next_code);
+            next_code += 1;
+            if (next_code > (@as(u32, 1) << code_size) and code_size < max_code_size) {
+                code_size += 1;
+            }
+
+            if (next_code <= max_code) continue;
+
+            // The dictionary just filled up.
+            switch (options.clear_policy) {
+                .reset => {},
+                .freeze => continue,
+                .adaptive => {
+                    ref_bits = bw.total_bits - clear_bits;
+                    ref_pixels = i - clear_pixel;
+                    window_bits = bw.total_bits;
+                    window_pixel = i;
+                    continue;
+                },
+            }
+        } else {
+            // The dictionary is full and frozen.
+            if (options.clear_policy != .adaptive or i - window_pixel < adaptive_window) {
+                continue;
+            }
+
+            // Clear once the recent window needs 12.5% more bits per pixel than the reference.
+            const bits = bw.total_bits - window_bits;
+            const pixels = i - window_pixel;
+            if (bits * ref_pixels * 8 <= ref_bits * pixels * 9) {
+                window_bits = bw.total_bits;
+                window_pixel = i;
+                continue;
+            }
+        }
+
+        try bw.writeCode(clear_code, code_size);
+        dict.reset();
+        next_code = first_code;
+        code_size = initial_code_size;
+        clear_bits = bw.total_bits;
+        clear_pixel = i;
+    }
+
+    try bw.writeCode(prefix, code_size);
+    // The decoder adds one last entry after reading `prefix`, which may widen the codes.
+    if (next_code >= (@as(u32, 1) << code_size) and code_size < max_code_size) {
+        code_size += 1;
+    }
+    try bw.writeCode(eoi_code, code_size);
+    try bw.finish();
+}
+
+/// Decode a GIF image data stream (minimum code size followed by data sub-blocks)
+/// into `out`, which must be large enough to hold all pixels of the image.
+/// Returns the number of bytes of `data` that make up the image data stream.
+pub fn decode(allocator: std.mem.Allocator, data: []const u8, out: []u8) !usize {
+    if (data.len == 0) return LzwError.truncated_lzw_data;
+    const min_code_size = data[0];
+    if (min_code_size == 0 or min_code_size >= max_code_size) {
+        return LzwError.invalid_lzw_data;
+    }
+
+    // Stitch the sub-blocks together into one contiguous stream of codes.
+    var stream = std.ArrayList(u8).init(allocator);
+    defer stream.deinit();
+
+    var pos: usize = 1;
+    while (true) {
+        if (pos >= data.len) return LzwError.truncated_lzw_data;
+        const block_len = data[pos];
+        pos += 1;
+        if (block_len == 0) break;
+        if (pos + block_len > data.len) return LzwError.truncated_lzw_data;
+        try stream.appendSlice(data[pos .. pos + block_len]);
+        pos += block_len;
+    }
+
+    try decodeCodes(stream.items, @intCast(min_code_size), out);
+    return pos;
+}
+
+/// Decode a contiguous stream of LZW codes into `out`.
+fn decodeCodes(codes: []const u8, min_code_size: u4, out: []u8) !void {
+    const clear_code: u16 = @as(u16, 1) << min_code_size;
+    const eoi_code: u16 = clear_code + 1;
+    const initial_code_size: u5 = @as(u5, min_code_size) + 1;
+
+    // Every string in the table is a known string (`prefix`) followed by a single index.
+    var prefix: [max_code + 1]u16 = undefined;
+    var suffix: [max_code + 1]u8 = undefined;
+    var first: [max_code + 1]u8 = undefined; // first index of the string
+    var length: [max_code + 1]u16 = undefined;
+
+    for (0..clear_code) |i| {
+        prefix[i] = 0;
+        suffix[i] = @truncate(i);
+        first[i] = @truncate(i);
+        length[i] = 1;
+    }
+
+    var next_code: u16 = clear_code + 2;
+    var code_size = initial_code_size;
+    var prev: ?u16 = null;
+
+    var acc: u64 = 0;
+    var nbits: u6 = 0;
+    var byte_pos: usize = 0;
+    var out_pos: usize = 0;
+
+    while (out_pos < out.len) {
+        while (nbits < code_size) {
+            // Some encoders omit the end-of-information code.
+            if (byte_pos >= codes.len) return;
+            acc |= @as(u64, codes[byte_pos]) << nbits;
+            nbits += 8;
+            byte_pos += 1;
+        }
+
+        const mask = (@as(u64, 1) << code_size) - 1;
+        const code: u16 = @intCast(acc & mask);
+        acc >>= code_size;
+        nbits -= code_size;
+
+        if (code == clear_code) {
+            next_code = clear_code + 2;
+            code_size = initial_code_size;
+            prev = null;
+            continue;
+        }
+
+        if (code == eoi_code) return;
+
+        if (prev) |p| {
+            if (code > next_code) return LzwError.invalid_lzw_data;
+            if (next_code <= max_code) {
+                // If `code` is the one being defined right now (the KwKwK case),
+                // the string is `prev` followed by its own first index.
+                prefix[next_code] = p;
+                suffix[next_code] = if (code == next_code) first[p] else first[code];
+                first[next_code] = first[p];
+                length[next_code] = length[p] + 1;
+                next_code += 1;
+                if (next_code == (@as(u32, 1) << code_size) and code_size < max_code_size) {
+                    code_size += 1;
+                }
+            }
+        } else if (code >= clear_code) {
+            return LzwError.invalid_lzw_data;
+        }
+
+        // Walk the string backwards from its last index.
+        const len = length[code];
+        var c = code;
+        var j: usize = len;
+        while (j > 0) {
+            j -= 1;
+            if (out_pos + j < out.len) out[out_pos + j] = suffix[c];
+            c = prefix[c];
+        }
+
+        out_pos += len;
+        prev = code;
+    }
+}
+
+const t = std.testing;
+
+fn expectRoundTrip(indices: []const u8, min_code_size: u4, options: Options) !void {
+    var encoded = std.ArrayList(u8).init(t.allocator);
+    defer encoded.deinit();
+    try encode(&encoded, indices, min_code_size, options);
+
+    const decoded = try t.allocator.alloc(u8, indices.len);
+    defer t.allocator.free(decoded);
+
+    const nbytes = try decode(t.allocator, encoded.items, decoded);
+    try t.expectEqual(encoded.items.len, nbytes);
+    try t.expectEqualSlices(u8, indices, decoded);
+}
+
+test "minCodeSize" {
+    try t.expectEqual(2, minCodeSize(1));
+    try t.expectEqual(2, minCodeSize(4));
+    try t.expectEqual(3, minCodeSize(5));
+    try t.expectEqual(8, minCodeSize(256));
+}
+
+test "LZW – encode and decode" {
+    const simple = [_]u8{ 1, 1, 1, 1, 2, 2, 2, 3, 0, 1, 1, 1, 1, 1, 1 };
+    try expectRoundTrip(&simple, 2, .{});
+    try expectRoundTrip(&[_]u8{3}, 2, .{});
+    try expectRoundTrip(&[_]u8{}, 2, .{});
+
+    // Long inputs fill up the dictionary, and exercise every clear policy.
+    const allocator = t.allocator;
+    const pixels = try allocator.alloc(u8, 300 * 200);
+    defer allocator.free(pixels);
+
+    var gen = std.rand.DefaultPrng.init(42);
+    inline for (.{ ClearPolicy.reset, ClearPolicy.freeze, ClearPolicy.adaptive }) |policy| {
+        // noise
+        for (pixels) |*px| px.* = gen.random().int(u8);
+        try expectRoundTrip(pixels, 8, .{ .clear_policy = policy });
+
+        // screen-like content: long runs with a few distinct colors.
+        var color: u8 = 0;
+        for (0.., pixels) |i, *px| {
+            if (gen.random().uintLessThan(usize, 64) == 0) color = gen.random().int(u4);
+            px.* = if (i % 300 < 20) 15 else color;
+        }
+        try expectRoundTrip(pixels, 4, .{ .clear_policy = policy });
+    }
+}
+
+test "LZW – lossy encoding" {
+    // 16 shades of gray, 4 apart.
+    var palette: [16 * 3]u8 = undefined;
+    for (0..16) |i| @memset(palette[i * 3 ..][0..3], @intCast(i * 4));
+
+    // Adjacent shades are 4√3 ≈ 6.9 apart, so every shade has up to two on either side.
+    const neighbors = Neighbors.init(&palette, 14, 15);
+    try t.expectEqualSlices(u8, &[_]u8{ 4, 6, 3, 7 }, neighbors.of(5));
+    try t.expectEqual(0, neighbors.of(15).len);
+    try t.expectEqualSlices(u8, &[_]u8{ 13, 12 }, neighbors.of(14));
+
+    // A gradient with noise on top.
+    const allocator = t.allocator;
+    const pixels = try allocator.alloc(u8, 200 * 100);
+    defer allocator.free(pixels);
+    var gen = std.rand.DefaultPrng.init(1);
+    for (0.., pixels) |i, *px| {
+        const base: u8 = @intCast(1 + (i % 200) / 16);
+        px.* = base + gen.random().uintLessThan(u8, 2);
+    }
+
+    var exact = std.ArrayList(u8).init(allocator);
+    defer exact.deinit();
+    try encode(&exact, pixels, 4, .{});
+
+    var lossy = std.ArrayList(u8).init(allocator);
+    defer lossy.deinit();
+    try encodeLossy(&lossy, pixels, 4, .{}, &neighbors);
+    try t.expect(lossy.items.len < exact.items.len);
+
+    const decoded = try allocator.alloc(u8, pixels.len);
+    defer allocator.free(decoded);
+    _ = try decode(allocator, lossy.items, decoded);
+    for (pixels, decoded) |want, got| {
+        if (want == got) continue;
+        try t.expect(std.mem.indexOfScalar(u8, neighbors.of(want), got) != null);
+    }
+}
+
+test "LZW – decode data from another encoder" {
+    // A 4x1 image with the pixels 1, 1, 2, 2 as written by Pillow.
+    const data = [_]u8{ 0x08, 0x07, 0x00, 0x03, 0x04, 0x10, 0x20, 0x20, 0x20, 0x00 };
+    var out: [4]u8 = undefined;
+    _ = try decode(t.allocator, &data, &out);
+    try t.expectEqualDeep([_]u8{ 1, 1, 2, 2 }, out);
+}
@@ -0,0 +1,361 @@
+const std = @import("std");
+const quant = @import("quantize");
+const resample = @import("resample");
+const gif = @import("gif.zig");
+
+const Gif = gif.Gif;
+const GifFrame = gif.GifFrame;
+const Sink = gif.Sink;
+
+// Encodes one stream of frames into several GIFs at once (renditions),
+// e.g a full size recording, a half size one and a thumbnail.
+//
+// Work that doesn't depend on the rendition is done once per frame: the colors of the
+// full size frame are counted once, and every palette is built from those counts, one per
+// distinct set of palette options. Smaller sizes are box-filtered from the next larger size
+// rather than from the full frame, so each halving only reads a quarter of the pixels of
+// the previous one. Palettes are built on a thread pool while the frame is downscaled,
+// then every rendition maps and encodes its frame as a task of its own.
+
+pub const RenditionConfig = struct {
+    /// How many times the frame is halved in both directions.
+    /// 0 is full size, 1 is half size, 2 is a quarter, and so on.
+    halvings: u3 = 0,
+    ncolors: u16 = 256,
+    use_dithering: bool = true,
+    /// See `GifConfig.use_transparency`.
+    use_transparency: bool = true,
+    palette_order: quant.PaletteOrder = .none,
+    /// See `GifConfig.lossy`.
+    lossy: u16 = 0,
+    sink: Sink,
+};
+
+pub const MultiGifConfig = struct {
+    /// Size of the frames passed to `addFrame`.
+    width: usize,
+    height: usize,
+    /// Must stay alive until the `MultiGif` is freed.
+    renditions: []const RenditionConfig,
+    /// Number of worker threads. 0 spawns one per rendition.
+    n_jobs: usize = 0,
+};
+
+/// Options that decide what a palette looks like.
+/// Renditions that agree on them share a palette.
+const PaletteKey = struct {
+    ncolors: u16,
+    reserve_transparent_index: bool,
+};
+
+const Rendition = struct {
+    gif: Gif,
+    /// Index into `MultiGif.palettes`.
+    palette: usize,
+    /// Set by the task that encoded the rendition's last frame, if it failed.
+    err: ?anyerror = null,
+};
+
+const PaletteSlot = struct {
+    key: PaletteKey,
+    palette: ?quant.Palette = null,
+    err: ?anyerror = null,
+};
+
+pub const MultiGif = struct {
+    const Self = @This();
+
+    /// Must be thread safe, renditions are encoded on worker threads.
+    allocator: std.mem.Allocator,
+    config: MultiGifConfig,
+    pool: std.Thread.Pool,
+    renditions: []Rendition,
+    palettes: []PaletteSlot,
+    /// Color counts of the current full size frame, shared by all palettes.
+    counts: *[quant.color_array_size]u32,
+    /// The current frame at every size below full size: `levels[k]` is halved `k + 1` times.
+    levels: [][]u8,
+    /// `halvers[k]` box-filters the frame into `levels[k]`, from the size above it.
+    halvers: []resample.Resampler,
+
+    pub fn init(allocator: std.mem.Allocator, config: MultiGifConfig) !*Self {
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+
+        self.* = .{
+            .allocator = allocator,
+            .config = config,
+            .pool = undefined,
+            .renditions = undefined,
+            .palettes = undefined,
+            .counts = undefined,
+            .levels = undefined,
+            .halvers = undefined,
+        };
+
+        try self.pool.init(.{
+            .allocator = allocator,
+            .n_jobs = @intCast(if (config.n_jobs == 0) config.renditions.len else config.n_jobs),
+        });
+        errdefer self.pool.deinit();
+
+        self.counts = try allocator.create([quant.color_array_size]u32);
+        errdefer allocator.destroy(self.counts);
+
+        var max_halvings: usize = 0;
+        for (config.renditions) |rendition| {
+            max_halvings = @max(max_halvings, rendition.halvings);
+        }
+
+        self.levels = try allocator.alloc([]u8, max_halvings);
+        errdefer allocator.free(self.levels);
+        self.halvers = try allocator.alloc(resample.Resampler, max_halvings);
+        errdefer allocator.free(self.halvers);
+        var nlevels: usize = 0;
+        errdefer for (self.levels[0..nlevels], self.halvers[0..nlevels]) |level, *halver| {
+            allocator.free(level);
+            halver.deinit();
+        };
+        var width = config.width;
+        var height = config.height;
+        for (self.levels, self.halvers) |*level, *halver| {
+            // Halving runs on this thread, while the pool builds palettes.
+            halver.* = try resample.Resampler.init(allocator, .{
+                .src_width = width,
+                .src_height = height,
+                .dst_width = resample.halfOf(width),
+                .dst_height = resample.halfOf(height),
+                .filter = .box,
+            });
+            errdefer halver.deinit();
+            width = resample.halfOf(width);
+            height = resample.halfOf(height);
+            level.* = try allocator.alloc(u8, width * height * 4);
+            nlevels += 1;
+        }
+
+        var palettes = std.ArrayList(PaletteSlot).init(allocator);
+        errdefer palettes.deinit();
+        self.renditions = try allocator.alloc(Rendition, config.renditions.len);
+        var nrenditions: usize = 0;
+        errdefer {
+            for (self.renditions[0..nrenditions]) |*rendition| rendition.gif.deinit();
+            allocator.free(self.renditions);
+        }
+
+        for (config.renditions, self.renditions) |rendition_config, *rendition| {
+            const key = PaletteKey{
+                .ncolors = rendition_config.ncolors,
+                .reserve_transparent_index = rendition_config.use_transparency,
+            };
+            const palette = for (palettes.items, 0..) |slot, i| {
+                if (std.meta.eql(slot.key, key)) break i;
+            } else blk: {
+                try palettes.append(.{ .key = key });
+                break :blk palettes.items.len - 1;
+            };
+
+            rendition.* = .{
+                .gif = try Gif.init(allocator, .{
+                    .use_dithering = rendition_config.use_dithering,
+                    .palette_order = rendition_config.palette_order,
+                    .use_transparency = rendition_config.use_transparency,
+                    .lossy = rendition_config.lossy,
+                    .sink = rendition_config.sink,
+                    .width = scaledSize(config.width, rendition_config.halvings),
+                    .height = scaledSize(config.height, rendition_config.halvings),
+                }),
+                .palette = palette,
+            };
+            nrenditions += 1;
+        }
+
+        self.palettes = try palettes.toOwnedSlice();
+        return self;
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.pool.deinit();
+        for (self.renditions) |*rendition| rendition.gif.deinit();
+        self.allocator.free(self.renditions);
+        self.freePalettes();
+        self.allocator.free(self.palettes);
+        for (self.levels, self.halvers) |level, *halver| {
+            self.allocator.free(level);
+            halver.deinit();
+        }
+        self.allocator.free(self.levels);
+        self.allocator.free(self.halvers);
+        self.allocator.destroy(self.counts);
+        self.allocator.destroy(self);
+    }
+
+    /// Add a full size BGRA frame to every rendition.
+    pub fn addFrame(self: *Self, frame: GifFrame) !void {
+        quant.countImageColors(.{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = false,
+            .row_stride = frame.row_stride,
+        }, frame.bgra_buf, self.counts);
+
+        var wait_group = std.Thread.WaitGroup{};
+        for (self.palettes) |*slot| {
+            wait_group.start();
+            // If no job could be queued, build the palette on this thread instead.
+            self.pool.spawn(buildPalette, .{ self, slot, &wait_group }) catch
+                buildPalette(self, slot, &wait_group);
+        }
+
+        // Downscale while the palettes are being built.
+        var src = resample.Image{
+            .pixels = frame.bgra_buf,
+            .width = self.config.width,
+            .height = self.config.height,
+            .row_stride = frame.row_stride,
+        };
+        var halve_err: ?anyerror = null;
+        for (self.levels, self.halvers) |level, *halver| {
+            halver.resample(src, level) catch |err| {
+                halve_err = err;
+                break;
+            };
+            src = .{ .pixels = level, .width = halver.config.dst_width, .height = halver.config.dst_height };
+        }
+
+        // Wait for the palettes even on failure, the workers write into them.
+        self.pool.waitAndWork(&wait_group);
+        defer self.freePalettes();
+        if (halve_err) |err| return err;
+        for (self.palettes) |slot| {
+            if (slot.err) |err| return err;
+        }
+
+        wait_group.reset();
+        for (self.renditions, self.config.renditions) |*rendition, rendition_config| {
+            const scaled = GifFrame{
+                .bgra_buf = if (rendition_config.halvings == 0)
+                    frame.bgra_buf
+                else
+                    self.levels[rendition_config.halvings - 1],
+                .duration_ms = frame.duration_ms,
+                .row_stride = if (rendition_config.halvings == 0) frame.row_stride else 0,
+            };
+            wait_group.start();
+            self.pool.spawn(encodeRendition, .{ self, rendition, scaled, &wait_group }) catch
+                encodeRendition(self, rendition, scaled, &wait_group);
+        }
+        self.pool.waitAndWork(&wait_group);
+
+        for (self.renditions) |rendition| {
+            if (rendition.err) |err| return err;
+        }
+    }
+
+    /// Finish every rendition. All of them are closed, even if one fails.
+    pub fn close(self: *Self) !void {
+        var result: anyerror!void = {};
+        for (self.renditions) |*rendition| {
+            rendition.gif.close() catch |err| {
+                result = err;
+            };
+        }
+        return result;
+    }
+
+    /// The GIF of the rendition at `index` in `MultiGifConfig.renditions`.
+    pub fn renditionGif(self: *Self, index: usize) *Gif {
+        return &self.renditions[index].gif;
+    }
+
+    fn freePalettes(self: *Self) void {
+        for (self.palettes) |*slot| {
+            if (slot.palette) |palette| palette.deinit(self.allocator);
+            slot.palette = null;
+        }
+    }
+
+    /// Runs on a worker thread.
+    fn buildPalette(self: *Self, slot: *PaletteSlot, wait_group: *std.Thread.WaitGroup) void {
+        defer wait_group.finish();
+        slot.err = null;
+        slot.palette = quant.buildPaletteFromCounts(.{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = false,
+            .ncolors = slot.key.ncolors,
+            .reserve_transparent_index = slot.key.reserve_transparent_index,
+        }, self.counts) catch |err| blk: {
+            slot.err = err;
+            break :blk null;
+        };
+    }
+
+    /// Runs on a worker thread.
+    fn encodeRendition(
+        self: *Self,
+        rendition: *Rendition,
+        frame: GifFrame,
+        wait_group: *std.Thread.WaitGroup,
+    ) void {
+        defer wait_group.finish();
+        rendition.err = null;
+        const palette = &self.palettes[rendition.palette].palette.?;
+        rendition.gif.addFrameWithPalette(frame, palette) catch |err| {
+            rendition.err = err;
+        };
+    }
+};
+
+fn scaledSize(size: usize, halvings: u3) usize {
+    var scaled = size;
+    for (0..halvings) |_| scaled = resample.halfOf(scaled);
+    return scaled;
+}
+
+const t = std.testing;
+
+test "MultiGif – writes every rendition at its own size" {
+    const allocator = t.allocator;
+    const width = 32;
+    const height = 16;
+
+    var outputs = [_]std.ArrayList(u8){
+        std.ArrayList(u8).init(allocator),
+        std.ArrayList(u8).init(allocator),
+        std.ArrayList(u8).init(allocator),
+    };
+    defer for (&outputs) |*out| out.deinit();
+
+    const renditions = [_]RenditionConfig{
+        .{ .sink = .{ .memory = &outputs[0] } },
+        .{ .halvings = 1, .ncolors = 64, .sink = .{ .memory = &outputs[1] } },
+        .{ .halvings = 2, .ncolors = 64, .sink = .{ .memory = &outputs[2] } },
+    };
+    const multi = try MultiGif.init(allocator, .{
+        .width = width,
+        .height = height,
+        .renditions = &renditions,
+    });
+    defer multi.deinit();
+    // The two smaller renditions share a palette.
+    try t.expectEqual(2, multi.palettes.len);
+
+    var frame: [width * height * 4]u8 = undefined;
+    var gen = std.rand.DefaultPrng.init(11);
+    for (0..5) |_| {
+        for (&frame) |*byte| byte.* = gen.random().int(u8) & 0xE0;
+        try multi.addFrame(.{ .bgra_buf = &frame, .duration_ms = 100 });
+    }
+    try multi.close();
+
+    for (outputs, [_]u16{ 32, 16, 8 }, [_]u16{ 16, 8, 4 }) |out, w, h| {
+        try t.expectEqualStrings("GIF89a", out.items[0..6]);
+        try t.expectEqual(w, std.mem.readInt(u16, out.items[6..8], .little));
+        try t.expectEqual(h, std.mem.readInt(u16, out.items[8..10], .little));
+        try t.expectEqual(0x3B, out.items[out.items.len - 1]);
+    }
+    try t.expectEqual(5, multi.renditionGif(2).nframes);
+}
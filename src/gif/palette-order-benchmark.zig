@@ -0,0 +1,145 @@
+const std = @import("std");
+const quant = @import("quantize");
+const writer = @import("writer.zig");
+const bench_frames = @import("bench-frames.zig");
+
+// Measures how much each palette order shrinks the output, and what sorting costs.
+//
+// Usage: palette-order-benchmark [<frames.bgra> <width>x<height>]...
+//
+// Every `frames.bgra` is a raw dump of consecutive BGRA frames, and together they
+// form the corpus. Without arguments, synthetic screen-like frames are used instead.
+//
+// Besides the size of the GIF, the benchmark reports the size of the raw indices after
+// DEFLATE. LZW only ever matches exact strings of indices, so renaming the indices
+// can't change the GIF's size by much; compressors that exploit numerically close
+// values (like PNG's filters + DEFLATE) are where ordering pays off.
+
+const Clip = struct {
+    frames: [][]u8,
+    width: usize,
+    height: usize,
+};
+
+const Result = struct {
+    reorder_ns: u64 = 0,
+    gif_bytes: usize = 0,
+    deflate_bytes: usize = 0,
+};
+
+fn deflatedSize(indices: []const u8) !usize {
+    var stream = std.io.fixedBufferStream(indices);
+    var counter = std.io.countingWriter(std.io.null_writer);
+    try std.compress.zlib.compress(stream.reader(), counter.writer(), .{});
+    return counter.bytes_written;
+}
+
+fn measure(
+    allocator: std.mem.Allocator,
+    clip: Clip,
+    quantized: []const quant.QuantizedImage,
+    order: quant.PaletteOrder,
+    result: *Result,
+) !void {
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    for (quantized) |original| {
+        // Every order starts from the same palette.
+        var image = quant.QuantizedImage.init(
+            try allocator.dupe(u8, original.color_table),
+            try allocator.dupe(u8, original.image_buffer),
+        );
+        defer image.deinit(allocator);
+
+        var timer = try std.time.Timer.start();
+        quant.reorderImage(&image, order);
+        result.reorder_ns += timer.read();
+
+        out.clearRetainingCapacity();
+        try writer.encodeFrame(&out, .{
+            .indices = image.image_buffer,
+            .width = clip.width,
+            .height = clip.height,
+            .ncolors = image.color_table.len / 3,
+        }, .{ .local_palette = image.color_table, .crop_to_changes = false });
+        result.gif_bytes += out.items.len;
+        result.deflate_bytes += try deflatedSize(image.image_buffer);
+    }
+}
+
+fn percentOf(value: usize, base: usize) f64 {
+    const v: f64 = @floatFromInt(value);
+    const b: f64 = @floatFromInt(base);
+    return (v - b) / b * 100;
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    const allocator = gpa.allocator();
+
+    const args = try std.process.argsAlloc(allocator);
+    defer std.process.argsFree(allocator, args);
+
+    var clips = std.ArrayList(Clip).init(allocator);
+    defer {
+        for (clips.items) |clip| bench_frames.freeFrames(allocator, clip.frames);
+        clips.deinit();
+    }
+
+    if (args.len >= 3) {
+        var i: usize = 1;
+        while (i + 1 < args.len) : (i += 2) {
+            const width, const height = try bench_frames.parseResolution(args[i + 1]);
+            const frames = try bench_frames.loadFrames(allocator, args[i], width, height);
+            try clips.append(.{ .frames = frames, .width = width, .height = height });
+        }
+    } else {
+        const frames = try bench_frames.generateFrames(allocator, 800, 600, 30);
+        try clips.append(.{ .frames = frames, .width = 800, .height = 600 });
+    }
+
+    const orders = [_]quant.PaletteOrder{ .none, .luminance, .frequency, .morton };
+    var results = [_]Result{.{}} ** orders.len;
+
+    var npixels: usize = 0;
+    for (clips.items) |clip| {
+        const quantized = try allocator.alloc(quant.QuantizedImage, clip.frames.len);
+        defer {
+            for (quantized) |q| q.deinit(allocator);
+            allocator.free(quantized);
+        }
+
+        for (clip.frames, quantized) |frame, *q| {
+            q.* = try quant.quantizeImage(.{
+                .allocator = allocator,
+                .width = clip.width,
+                .height = clip.height,
+                .use_dithering = false,
+            }, frame, .median_cut);
+        }
+
+        for (orders, &results) |order, *result| {
+            try measure(allocator, clip, quantized, order, result);
+        }
+        npixels += clip.frames.len * clip.width * clip.height;
+    }
+
+    std.debug.print("{d} pixels in {d} clip(s)\n", .{ npixels, clips.items.len });
+    std.debug.print("{s: <10} {s: >12} {s: >14} {s: >8} {s: >14} {s: >8}\n", .{
+        "order", "reorder ms", "gif bytes", "", "deflate bytes", "",
+    });
+
+    const base = results[0];
+    for (orders, results) |order, result| {
+        const ms = @as(f64, @floatFromInt(result.reorder_ns)) / std.time.ns_per_ms;
+        std.debug.print("{s: <10} {d: >12.2} {d: >14} {d: >7.2}% {d: >14} {d: >7.2}%\n", .{
+            @tagName(order),
+            ms,
+            result.gif_bytes,
+            percentOf(result.gif_bytes, base.gif_bytes),
+            result.deflate_bytes,
+            percentOf(result.deflate_bytes, base.deflate_bytes),
+        });
+    }
+}
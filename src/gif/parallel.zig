@@ -0,0 +1,275 @@
+const std = @import("std");
+const quant = @import("quantize");
+const writer = @import("writer.zig");
+
+const GifWriter = writer.GifWriter;
+
+// The image data of every GIF frame is its own LZW stream, so frames can be
+// compressed in any order as long as they end up in the file in the order they
+// were added. The `ParallelEncoder` compresses frames on a thread pool, each into
+// its own byte buffer, while the thread that submits frames writes the finished
+// buffers out in order.
+//
+// Frames are handed to workers through a ring of slots. A frame's slot is reused
+// only after the frame has been written, so the ring size caps the number of frames
+// in flight, and `max_buffered_bytes` caps how much compressed data may pile up
+// behind a slow frame at the head of the ring.
+
+pub const ParallelConfig = struct {
+    /// Number of worker threads. 0 spawns one per CPU core.
+    n_jobs: usize = 0,
+    /// Maximum number of compressed bytes that may wait in memory to be written.
+    /// `submit` blocks on the oldest frame once this is exceeded.
+    max_buffered_bytes: usize = 32 * 1024 * 1024,
+};
+
+const Slot = struct {
+    /// Encoded bytes of the frame, reused across frames.
+    buf: std.ArrayList(u8),
+    frame: writer.IndexedFrame = undefined,
+    options: writer.FrameOptions = undefined,
+    /// The quantized image that `frame` points into, if the slot owns it.
+    /// It is freed as soon as the frame has been compressed.
+    owned: ?quant.QuantizedImage = null,
+
+    /// Set by the worker once `buf` holds the encoded frame.
+    done: bool = false,
+    err: ?anyerror = null,
+};
+
+pub const ParallelEncoder = struct {
+    const Self = @This();
+
+    /// Must be thread safe, workers allocate from it.
+    allocator: std.mem.Allocator,
+    config: ParallelConfig,
+    pool: std.Thread.Pool,
+    slots: []Slot,
+
+    /// Protects `done`, `err` and `buf` of every slot, and `buffered_bytes`.
+    mutex: std.Thread.Mutex = .{},
+    /// Signaled whenever a worker finishes a frame.
+    frame_done: std.Thread.Condition = .{},
+    /// Compressed bytes that are ready but not written yet.
+    buffered_bytes: usize = 0,
+
+    // Only touched by the submitting thread.
+    /// Sequence number of the next frame to be submitted.
+    next_submit: usize = 0,
+    /// Sequence number of the next frame to be written.
+    next_write: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator, config: ParallelConfig) !*Self {
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+
+        self.* = .{
+            .allocator = allocator,
+            .config = config,
+            .pool = undefined,
+            .slots = undefined,
+        };
+
+        try self.pool.init(.{
+            .allocator = allocator,
+            .n_jobs = if (config.n_jobs == 0) null else @intCast(config.n_jobs),
+        });
+        errdefer self.pool.deinit();
+
+        // Two frames per worker keep everyone busy while the oldest frame is written.
+        const nslots = @max(self.pool.threads.len, 1) * 2;
+        self.slots = try allocator.alloc(Slot, nslots);
+        for (self.slots) |*slot| {
+            slot.* = .{ .buf = std.ArrayList(u8).init(allocator) };
+        }
+
+        return self;
+    }
+
+    /// Wait for all workers to finish, and free all buffers.
+    /// Frames that have not been written by `finish` are dropped.
+    pub fn deinit(self: *Self) void {
+        self.pool.deinit();
+        for (self.slots) |*slot| {
+            slot.buf.deinit();
+            if (slot.owned) |owned| owned.deinit(self.allocator);
+        }
+        self.allocator.free(self.slots);
+        self.allocator.destroy(self);
+    }
+
+    /// Queue a frame for compression, and write every frame that is ready to `gif_writer`.
+    /// `frame.indices` and the palette in `options` must stay alive until the frame is written,
+    /// unless they belong to `owned`, which is then freed by the encoder.
+    /// Blocks while all slots are busy, or too many compressed bytes are waiting.
+    pub fn submit(
+        self: *Self,
+        gif_writer: *GifWriter,
+        frame: writer.IndexedFrame,
+        options: writer.FrameOptions,
+        owned: ?quant.QuantizedImage,
+    ) !void {
+        while (self.next_write < self.next_submit and
+            (self.next_submit - self.next_write >= self.slots.len or
+            self.bufferedBytes() >= self.config.max_buffered_bytes))
+        {
+            try self.writeNext(gif_writer);
+        }
+
+        // The slot is free: its previous frame has been written, and no worker touches it.
+        const slot = &self.slots[self.next_submit % self.slots.len];
+        slot.frame = frame;
+        slot.options = options;
+        slot.owned = owned;
+        slot.done = false;
+        slot.err = null;
+        self.next_submit += 1;
+
+        // If no job could be queued, compress the frame on this thread instead.
+        self.pool.spawn(encodeSlot, .{ self, slot }) catch encodeSlot(self, slot);
+
+        while (self.next_write < self.next_submit and self.isDone(self.next_write)) {
+            try self.writeNext(gif_writer);
+        }
+    }
+
+    /// Wait for all submitted frames, and write them to `gif_writer`.
+    pub fn finish(self: *Self, gif_writer: *GifWriter) !void {
+        while (self.next_write < self.next_submit) {
+            try self.writeNext(gif_writer);
+        }
+    }
+
+    /// Wait for all submitted frames to be compressed, and drop them without writing.
+    /// Used on error paths, before the frames' indices are freed.
+    pub fn discard(self: *Self) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (self.next_write < self.next_submit) : (self.next_write += 1) {
+            const slot = &self.slots[self.next_write % self.slots.len];
+            while (!slot.done) {
+                self.frame_done.wait(&self.mutex);
+            }
+            self.buffered_bytes -= slot.buf.items.len;
+        }
+    }
+
+    /// Wait for the oldest frame in flight to be compressed, and write it.
+    fn writeNext(self: *Self, gif_writer: *GifWriter) !void {
+        const slot = &self.slots[self.next_write % self.slots.len];
+
+        self.mutex.lock();
+        while (!slot.done) {
+            self.frame_done.wait(&self.mutex);
+        }
+        self.buffered_bytes -= slot.buf.items.len;
+        self.mutex.unlock();
+
+        self.next_write += 1;
+        if (slot.err) |err| return err;
+        try gif_writer.writeEncodedFrame(slot.buf.items, slot.options.delay_cs);
+    }
+
+    /// Number of frames submitted but not written yet.
+    pub fn inFlight(self: *const Self) usize {
+        return self.next_submit - self.next_write;
+    }
+
+    /// Bytes that the frames in flight will add to the output: the compressed size
+    /// of those that are done, and `estimate` for each of those still being compressed.
+    pub fn pendingBytes(self: *Self, estimate: usize) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        var bytes = self.buffered_bytes;
+        for (self.next_write..self.next_submit) |seq| {
+            if (!self.slots[seq % self.slots.len].done) bytes += estimate;
+        }
+        return bytes;
+    }
+
+    fn isDone(self: *Self, seq: usize) bool {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.slots[seq % self.slots.len].done;
+    }
+
+    fn bufferedBytes(self: *Self) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.buffered_bytes;
+    }
+
+    /// Runs on a worker thread.
+    fn encodeSlot(self: *Self, slot: *Slot) void {
+        slot.buf.clearRetainingCapacity();
+        const result = writer.encodeFrame(&slot.buf, slot.frame, slot.options);
+        if (slot.owned) |owned| {
+            owned.deinit(self.allocator);
+            slot.owned = null;
+        }
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        result catch |err| {
+            slot.err = err;
+        };
+        slot.done = true;
+        self.buffered_bytes += slot.buf.items.len;
+        self.frame_done.broadcast();
+    }
+};
+
+const t = std.testing;
+const SinkWriter = @import("sink.zig").SinkWriter;
+
+test "ParallelEncoder – output matches serial encoding" {
+    const width = 16;
+    const height = 8;
+    const nframes = 20;
+
+    var gen = std.rand.DefaultPrng.init(7);
+    var frames: [nframes][width * height]u8 = undefined;
+    for (&frames) |*frame| {
+        for (frame) |*index| index.* = gen.random().uintLessThan(u8, 4);
+    }
+    const palette = [_]u8{ 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255 };
+
+    var serial_out = std.ArrayList(u8).init(t.allocator);
+    defer serial_out.deinit();
+    var parallel_out = std.ArrayList(u8).init(t.allocator);
+    defer parallel_out.deinit();
+
+    const serial_sink = try t.allocator.create(SinkWriter);
+    defer t.allocator.destroy(serial_sink);
+    serial_sink.* = try SinkWriter.init(.{ .memory = &serial_out });
+    var serial = GifWriter.init(t.allocator, serial_sink, width, height);
+    defer serial.deinit();
+
+    const parallel_sink = try t.allocator.create(SinkWriter);
+    defer t.allocator.destroy(parallel_sink);
+    parallel_sink.* = try SinkWriter.init(.{ .memory = &parallel_out });
+    var gif_writer = GifWriter.init(t.allocator, parallel_sink, width, height);
+    defer gif_writer.deinit();
+
+    // A tiny byte budget forces `submit` to write frames before all slots fill up.
+    const encoder = try ParallelEncoder.init(t.allocator, .{ .n_jobs = 3, .max_buffered_bytes = 64 });
+    defer encoder.deinit();
+
+    try serial.writeHeader(&palette, 0);
+    try gif_writer.writeHeader(&palette, 0);
+    for (&frames) |*frame| {
+        const options = writer.FrameOptions{ .delay_cs = 4 };
+        try serial.writeFrame(frame, options);
+        try encoder.submit(&gif_writer, .{
+            .indices = frame,
+            .width = width,
+            .height = height,
+            .ncolors = palette.len / 3,
+        }, options, null);
+    }
+    try encoder.finish(&gif_writer);
+    try serial.writeTrailer();
+    try gif_writer.writeTrailer();
+
+    try t.expectEqualSlices(u8, serial_out.items, parallel_out.items);
+}
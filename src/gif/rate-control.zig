@@ -0,0 +1,223 @@
+const std = @import("std");
+
+// Keeps the size of a GIF close to a budget while it is being recorded.
+//
+// The controller steps up and down a ladder of encoder settings, from full quality
+// to heavily reduced, by comparing the bytes written so far against the bytes the
+// budget allows for the animation time seen so far. Each rung trades quality for size
+// with fewer colors, no dithering (dither noise breaks up LZW strings), lossy LZW,
+// and finally dropping frames.
+
+/// Room kept free at the end of the `max_total_bytes` budget, for the trailer and a frame
+/// that carries the time of frames dropped at the end of the recording.
+pub const closing_bytes = 32;
+
+pub const RateControlConfig = struct {
+    /// Average number of bytes one second of animation may take.
+    bytes_per_second: ?usize = null,
+    /// Hard cap on the size of the whole GIF. Once reached, all remaining frames are dropped.
+    /// The controller drops frames ahead of it by the average frame size, and `Gif` drops
+    /// any frame that turns out not to fit, along with all frames after it.
+    max_total_bytes: ?usize = null,
+    /// Expected length of the recording. Together with `max_total_bytes`, this spreads
+    /// the total budget evenly over the recording, in case `bytes_per_second` isn't set.
+    expected_duration_ms: ?u64 = null,
+    /// Minimum number of frames between two changes of settings,
+    /// so that one expensive frame (e.g a scene change) doesn't cause oscillation.
+    min_frames_between_changes: usize = 5,
+};
+
+/// How one frame should be encoded.
+pub const Settings = struct {
+    ncolors: u16,
+    use_dithering: bool,
+    /// See `GifConfig.lossy`.
+    lossy: u16,
+    /// Only one out of this many frames is encoded, the others are dropped.
+    keep_every: u8,
+};
+
+/// From best quality to smallest output.
+pub const ladder = [_]Settings{
+    .{ .ncolors = 256, .use_dithering = true, .lossy = 0, .keep_every = 1 },
+    .{ .ncolors = 256, .use_dithering = false, .lossy = 0, .keep_every = 1 },
+    .{ .ncolors = 128, .use_dithering = false, .lossy = 10, .keep_every = 1 },
+    .{ .ncolors = 64, .use_dithering = false, .lossy = 20, .keep_every = 1 },
+    .{ .ncolors = 64, .use_dithering = false, .lossy = 40, .keep_every = 2 },
+    .{ .ncolors = 32, .use_dithering = false, .lossy = 60, .keep_every = 3 },
+};
+
+/// What the controller decided, and why.
+pub const RateStats = struct {
+    frames_in: usize = 0,
+    frames_encoded: usize = 0,
+    frames_dropped: usize = 0,
+    /// Frames dropped because `max_total_bytes` was (about to be) reached.
+    frames_dropped_over_budget: usize = 0,
+    /// Output size when the last frame was added.
+    bytes_emitted: usize = 0,
+    /// Bytes the budget allowed when the last frame was added, 0 if there is no rate target.
+    bytes_allowed: usize = 0,
+    /// Index into `ladder` of the settings used for the last frame.
+    level: usize = 0,
+    /// Highest index into `ladder` that was used.
+    max_level: usize = 0,
+    /// Number of times the settings were changed.
+    level_changes: usize = 0,
+    /// Number of frames encoded at each level of the ladder.
+    frames_at_level: [ladder.len]usize = [_]usize{0} ** ladder.len,
+
+    /// Count `nframes` frames that were encoded, but didn't fit in `max_total_bytes` after all.
+    pub fn addOverBudget(self: *RateStats, nframes: usize) void {
+        self.frames_encoded -= nframes;
+        self.frames_dropped += nframes;
+        self.frames_dropped_over_budget += nframes;
+    }
+};
+
+pub const Decision = union(enum) {
+    /// Encode the frame with these settings.
+    encode: Settings,
+    /// Drop the frame. Its duration should be added to the next frame that is encoded.
+    drop,
+};
+
+pub const RateController = struct {
+    const Self = @This();
+
+    config: RateControlConfig,
+    stats: RateStats = .{},
+
+    /// Animation time of all frames seen so far.
+    elapsed_ms: u64 = 0,
+    /// Output size when the previous frame was added.
+    prev_bytes: usize = 0,
+    /// Moving average of the size of an encoded frame, in bytes.
+    avg_frame_bytes: usize = 0,
+    frames_since_change: usize = 0,
+    /// Counts frames towards the next one that is kept, when dropping frames.
+    keep_counter: usize = 0,
+    /// Whether the previous frame was encoded, so that `bytes_emitted` reflects it.
+    prev_encoded: bool = false,
+
+    pub fn init(config: RateControlConfig) Self {
+        return .{ .config = config };
+    }
+
+    /// Number of bytes per second the budget allows, if there is a rate target at all.
+    fn targetRate(self: *const Self) ?usize {
+        if (self.config.bytes_per_second) |rate| return rate;
+        const total = self.config.max_total_bytes orelse return null;
+        const duration_ms = self.config.expected_duration_ms orelse return null;
+        return total * std.time.ms_per_s / @max(duration_ms, 1);
+    }
+
+    /// Decide how to encode the next frame, which is shown for `duration_ms`.
+    /// `bytes_emitted` is the size of the output so far.
+    pub fn nextFrame(self: *Self, duration_ms: u64, bytes_emitted: usize) Decision {
+        self.stats.frames_in += 1;
+        self.stats.bytes_emitted = bytes_emitted;
+
+        if (self.prev_encoded) {
+            const frame_bytes = bytes_emitted -| self.prev_bytes;
+            self.avg_frame_bytes = if (self.avg_frame_bytes == 0)
+                frame_bytes
+            else
+                (self.avg_frame_bytes * 7 + frame_bytes) / 8;
+        }
+        self.prev_bytes = bytes_emitted;
+        self.prev_encoded = false;
+
+        if (self.config.max_total_bytes) |max_total| {
+            if (bytes_emitted + self.avg_frame_bytes + closing_bytes > max_total) {
+                self.stats.frames_dropped += 1;
+                self.stats.frames_dropped_over_budget += 1;
+                self.elapsed_ms += duration_ms;
+                return .drop;
+            }
+        }
+
+        if (self.targetRate()) |rate| {
+            // One second of headroom, so that the first frame (which is always drawn in full)
+            // doesn't count as overshooting.
+            const allowed = rate * (self.elapsed_ms + std.time.ms_per_s) / std.time.ms_per_s;
+            self.stats.bytes_allowed = allowed;
+            self.adjustLevel(bytes_emitted, allowed);
+        }
+        self.elapsed_ms += duration_ms;
+
+        const settings = ladder[self.stats.level];
+        self.keep_counter += 1;
+        if (self.keep_counter < settings.keep_every) {
+            self.stats.frames_dropped += 1;
+            return .drop;
+        }
+        self.keep_counter = 0;
+
+        self.prev_encoded = true;
+        self.stats.frames_encoded += 1;
+        self.stats.frames_at_level[self.stats.level] += 1;
+        return .{ .encode = settings };
+    }
+
+    fn adjustLevel(self: *Self, bytes_emitted: usize, allowed: usize) void {
+        self.frames_since_change += 1;
+        if (self.frames_since_change < self.config.min_frames_between_changes) return;
+
+        const level = self.stats.level;
+        if (bytes_emitted > allowed + allowed / 10 and level + 1 < ladder.len) {
+            self.setLevel(level + 1);
+        } else if (bytes_emitted < allowed - allowed / 4 and level > 0) {
+            self.setLevel(level - 1);
+        }
+    }
+
+    fn setLevel(self: *Self, level: usize) void {
+        self.stats.level = level;
+        self.stats.max_level = @max(self.stats.max_level, level);
+        self.stats.level_changes += 1;
+        self.frames_since_change = 0;
+        self.keep_counter = 0;
+    }
+};
+
+const t = std.testing;
+
+/// Feed `nframes` frames of 100ms into `rc`, where an encoded frame at level `l`
+/// takes `sizes[l]` bytes.
+fn simulate(rc: *RateController, nframes: usize, sizes: []const usize) usize {
+    var bytes: usize = 0;
+    for (0..nframes) |_| {
+        switch (rc.nextFrame(100, bytes)) {
+            .encode => bytes += sizes[rc.stats.level],
+            .drop => {},
+        }
+    }
+    return bytes;
+}
+
+test "RateController – converges to the target rate" {
+    var rc = RateController.init(.{ .bytes_per_second = 10_000 });
+    const sizes = [_]usize{ 4000, 3000, 1500, 900, 800, 700 };
+
+    // 30 seconds of animation.
+    const bytes = simulate(&rc, 300, &sizes);
+    try t.expect(bytes <= 330_000);
+    try t.expect(rc.stats.level >= 2);
+    try t.expectEqual(300, rc.stats.frames_in);
+    try t.expectEqual(rc.stats.frames_in, rc.stats.frames_encoded + rc.stats.frames_dropped);
+}
+
+test "RateController – stays at full quality when there is room" {
+    var rc = RateController.init(.{ .bytes_per_second = 1_000_000 });
+    _ = simulate(&rc, 100, &[_]usize{ 1000, 1000, 1000, 1000, 1000, 1000 });
+    try t.expectEqual(0, rc.stats.max_level);
+    try t.expectEqual(100, rc.stats.frames_encoded);
+}
+
+test "RateController – never exceeds the total size" {
+    var rc = RateController.init(.{ .max_total_bytes = 50_000 });
+    const bytes = simulate(&rc, 200, &[_]usize{ 1000, 1000, 1000, 1000, 1000, 1000 });
+    try t.expect(bytes < 50_000);
+    try t.expect(rc.stats.frames_dropped_over_budget > 0);
+}
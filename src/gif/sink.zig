@@ -0,0 +1,148 @@
+const std = @import("std");
+
+/// The destination of an encoded GIF.
+pub const Sink = union(enum) {
+    /// Create (or truncate) a file at this path and write to it.
+    path: [:0]const u8,
+    /// Write into a caller-supplied writer.
+    writer: std.io.AnyWriter,
+    /// Append to a growable in-memory buffer owned by the caller.
+    memory: *std.ArrayList(u8),
+    /// Write to an already open file descriptor, e.g stdout or a pipe.
+    /// The descriptor is not closed when the GIF is closed.
+    fd: std.posix.fd_t,
+};
+
+/// Buffers small writes from the encoder and hands them to a `Sink`
+/// in large blocks.
+pub const SinkWriter = struct {
+    const Self = @This();
+    pub const buffer_size = 64 * 1024;
+
+    pub const Error = anyerror;
+    pub const Writer = std.io.Writer(*Self, Error, write);
+
+    sink: Sink,
+    /// Set if the sink is a path, in which case we own the file.
+    file: ?std.fs.File = null,
+
+    buffer: [buffer_size]u8 = undefined,
+    /// Number of bytes in `buffer` that haven't been handed to the sink yet.
+    end: usize = 0,
+    /// Total number of bytes written to this writer so far.
+    bytes_written: usize = 0,
+
+    pub fn init(sink: Sink) !Self {
+        var self = Self{ .sink = sink };
+        switch (sink) {
+            .path => |path| self.file = try std.fs.cwd().createFileZ(path, .{}),
+            else => {},
+        }
+        return self;
+    }
+
+    pub fn writer(self: *Self) Writer {
+        return .{ .context = self };
+    }
+
+    pub fn write(self: *Self, bytes: []const u8) Error!usize {
+        try self.writeAll(bytes);
+        return bytes.len;
+    }
+
+    pub fn writeAll(self: *Self, bytes: []const u8) Error!void {
+        self.bytes_written += bytes.len;
+
+        // In-memory buffers grow on their own, buffering would only add a copy.
+        if (self.sink == .memory) {
+            try self.sink.memory.appendSlice(bytes);
+            return;
+        }
+
+        if (self.end + bytes.len > buffer_size) {
+            try self.flush();
+        }
+
+        if (bytes.len >= buffer_size) {
+            try self.writeToSink(bytes);
+            return;
+        }
+
+        @memcpy(self.buffer[self.end..][0..bytes.len], bytes);
+        self.end += bytes.len;
+    }
+
+    /// Hand all buffered bytes to the sink.
+    pub fn flush(self: *Self) Error!void {
+        if (self.end == 0) return;
+        try self.writeToSink(self.buffer[0..self.end]);
+        self.end = 0;
+    }
+
+    /// Close the file if we opened one and it is still open, dropping any buffered bytes.
+    /// For error paths, and owners that may be freed before `close` was called.
+    pub fn deinit(self: *Self) void {
+        if (self.file) |file| {
+            file.close();
+            self.file = null;
+        }
+    }
+
+    /// Flush all buffered bytes, and close the file if we opened one.
+    pub fn close(self: *Self) Error!void {
+        const result = self.flush();
+        if (self.file) |file| {
+            file.close();
+            self.file = null;
+        }
+        return result;
+    }
+
+    fn writeToSink(self: *Self, bytes: []const u8) Error!void {
+        switch (self.sink) {
+            .path => try (self.file orelse unreachable).writeAll(bytes),
+            .writer => |w| try w.writeAll(bytes),
+            .memory => |list| try list.appendSlice(bytes),
+            .fd => |fd| {
+                const file = std.fs.File{ .handle = fd };
+                try file.writeAll(bytes);
+            },
+        }
+    }
+};
+
+const t = std.testing;
+test "SinkWriter – memory sink" {
+    var list = std.ArrayList(u8).init(t.allocator);
+    defer list.deinit();
+
+    const sink_writer = try t.allocator.create(SinkWriter);
+    defer t.allocator.destroy(sink_writer);
+    sink_writer.* = try SinkWriter.init(.{ .memory = &list });
+
+    try sink_writer.writer().writeAll("GIF89a");
+    try sink_writer.writer().writeByte(0x3B);
+    try sink_writer.close();
+
+    try t.expectEqualStrings("GIF89a\x3B", list.items);
+    try t.expectEqual(7, sink_writer.bytes_written);
+}
+
+test "SinkWriter – writer sink" {
+    var list = std.ArrayList(u8).init(t.allocator);
+    defer list.deinit();
+
+    const sink_writer = try t.allocator.create(SinkWriter);
+    defer t.allocator.destroy(sink_writer);
+    const list_writer = list.writer();
+    sink_writer.* = try SinkWriter.init(.{ .writer = list_writer.any() });
+
+    const big = [_]u8{0xAB} ** (SinkWriter.buffer_size + 10);
+    try sink_writer.writeAll("abc");
+    try t.expectEqual(0, list.items.len); // still buffered
+    try sink_writer.writeAll(&big);
+    try sink_writer.close();
+
+    try t.expectEqual(big.len + 3, list.items.len);
+    try t.expectEqualStrings("abc", list.items[0..3]);
+}
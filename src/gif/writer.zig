@@ -0,0 +1,321 @@
+const std = @import("std");
+const lzw = @import("lzw.zig");
+const SinkWriter = @import("sink.zig").SinkWriter;
+
+// A GIF89a writer that compresses frames with our own LZW encoder (see lzw.zig).
+// See: https://www.w3.org/Graphics/GIF/spec-gif89a.txt
+//
+// Every frame is first encoded into a self-contained byte buffer
+// (graphic control extension + image descriptor + color table + image data),
+// so that frames can be encoded independently of each other and spliced into
+// the output in order afterwards.
+
+/// What a viewer does with a frame once its delay is over.
+pub const Disposal = enum(u3) {
+    unspecified = 0,
+    /// Leave the frame in place, the next one is drawn on top of it.
+    keep = 1,
+    /// Clear the frame's area to the background color.
+    background = 2,
+    /// Restore whatever was under the frame before it was drawn.
+    previous = 3,
+};
+
+/// A frame made of indices into a color table.
+pub const IndexedFrame = struct {
+    indices: []const u8,
+    width: usize,
+    height: usize,
+    /// Number of entries in the color table that `indices` point into.
+    ncolors: usize,
+    /// The color table that `indices` point into (RGBRGB...).
+    /// Only needed for lossy compression of frames without a local palette.
+    palette: ?[]const u8 = null,
+};
+
+pub const FrameOptions = struct {
+    /// Time to wait before showing the next frame, in hundredths of a second.
+    delay_cs: u16 = 0,
+    /// RGBRGB... color table for this frame only. If `null`, the global table is used.
+    local_palette: ?[]const u8 = null,
+    /// Index that is drawn as transparent, letting the previous frame show through.
+    transparent_index: ?u8 = null,
+    disposal: Disposal = .keep,
+    /// If set, only the smallest rectangle containing all non-transparent pixels is stored.
+    crop_to_changes: bool = true,
+    lzw: lzw.Options = .{},
+    /// If not 0, the largest RGB distance by which a pixel may be off so that
+    /// LZW finds longer strings (see `lzw.encodeLossy`). 0 compresses the frame losslessly.
+    lossy: u16 = 0,
+};
+
+/// A rectangle on the GIF's canvas.
+pub const Rect = struct {
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+};
+
+/// Returns the value of the 3 bit "size of color table" field for a table with `ncolors` entries.
+/// A table with the field set to `n` has `2 ^ (n + 1)` entries.
+fn colorTableSizeField(ncolors: usize) u3 {
+    var nbits: u4 = 1;
+    while ((@as(usize, 1) << nbits) < ncolors) : (nbits += 1) {}
+    return @intCast(nbits - 1);
+}
+
+/// Append a color table, padded with black to a power of two entries.
+fn appendColorTable(out: *std.ArrayList(u8), palette: []const u8) !void {
+    const size_field = colorTableSizeField(palette.len / 3);
+    const table_len = (@as(usize, 1) << (@as(u4, size_field) + 1)) * 3;
+    try out.appendSlice(palette);
+    try out.appendNTimes(0, table_len - palette.len);
+}
+
+inline fn appendU16(out: *std.ArrayList(u8), value: usize) !void {
+    const v: u16 = @intCast(value);
+    try out.append(@truncate(v));
+    try out.append(@truncate(v >> 8));
+}
+
+/// Find the smallest rectangle that contains all pixels other than `trans_index`.
+/// Returns `null` if every pixel is transparent.
+pub fn findChangedRect(frame: IndexedFrame, trans_index: u8) ?Rect {
+    var min_x: usize = frame.width;
+    var max_x: usize = 0;
+    var min_y: usize = frame.height;
+    var max_y: usize = 0;
+
+    for (0..frame.height) |y| {
+        const row = frame.indices[y * frame.width ..][0..frame.width];
+        const first = std.mem.indexOfNone(u8, row, &[_]u8{trans_index}) orelse continue;
+        const last = std.mem.lastIndexOfNone(u8, row, &[_]u8{trans_index}) orelse unreachable;
+
+        min_x = @min(min_x, first);
+        max_x = @max(max_x, last);
+        min_y = @min(min_y, y);
+        max_y = y;
+    }
+
+    if (min_y == frame.height) return null;
+    return .{
+        .x = min_x,
+        .y = min_y,
+        .width = max_x - min_x + 1,
+        .height = max_y - min_y + 1,
+    };
+}
+
+/// Encode a single frame, and append its bytes to `out`.
+pub fn encodeFrame(
+    out: *std.ArrayList(u8),
+    frame: IndexedFrame,
+    options: FrameOptions,
+) !void {
+    std.debug.assert(frame.indices.len == frame.width * frame.height);
+
+    var rect = Rect{ .x = 0, .y = 0, .width = frame.width, .height = frame.height };
+    if (options.crop_to_changes) {
+        if (options.transparent_index) |trans_index| {
+            // A frame without any changes still has to be stored to keep its delay,
+            // so we store a single transparent pixel instead.
+            rect = findChangedRect(frame, trans_index) orelse
+                .{ .x = 0, .y = 0, .width = 1, .height = 1 };
+        }
+    }
+
+    // Graphic control extension.
+    var flags: u8 = @as(u8, @intFromEnum(options.disposal)) << 2;
+    if (options.transparent_index != null) flags |= 1;
+    try out.appendSlice(&[_]u8{ 0x21, 0xF9, 0x04, flags });
+    try appendU16(out, options.delay_cs);
+    try out.append(options.transparent_index orelse 0);
+    try out.append(0); // block terminator
+
+    // Image descriptor.
+    try out.append(0x2C);
+    try appendU16(out, rect.x);
+    try appendU16(out, rect.y);
+    try appendU16(out, rect.width);
+    try appendU16(out, rect.height);
+
+    var ncolors = frame.ncolors;
+    if (options.local_palette) |palette| {
+        ncolors = palette.len / 3;
+        try out.append(0x80 | @as(u8, colorTableSizeField(ncolors)));
+        try appendColorTable(out, palette);
+    } else {
+        try out.append(0);
+    }
+
+    var neighbors: ?lzw.Neighbors = null;
+    if (options.lossy > 0) {
+        if (options.local_palette orelse frame.palette) |palette| {
+            // Transparent pixels show the previous frame, they're never "close" to a color.
+            neighbors = lzw.Neighbors.init(palette, options.lossy, options.transparent_index);
+        }
+    }
+
+    const min_code_size = lzw.minCodeSize(ncolors);
+    if (rect.width == frame.width and rect.height == frame.height) {
+        try encodeIndices(out, frame.indices, min_code_size, options.lzw, &neighbors);
+        return;
+    }
+
+    // Copy the cropped rectangle into a contiguous buffer.
+    const cropped = try out.allocator.alloc(u8, rect.width * rect.height);
+    defer out.allocator.free(cropped);
+    for (0..rect.height) |row| {
+        const src = frame.indices[(rect.y + row) * frame.width + rect.x ..][0..rect.width];
+        @memcpy(cropped[row * rect.width ..][0..rect.width], src);
+    }
+
+    try encodeIndices(out, cropped, min_code_size, options.lzw, &neighbors);
+}
+
+inline fn encodeIndices(
+    out: *std.ArrayList(u8),
+    indices: []const u8,
+    min_code_size: u4,
+    options: lzw.Options,
+    neighbors: *const ?lzw.Neighbors,
+) !void {
+    if (neighbors.*) |*n| {
+        try lzw.encodeLossy(out, indices, min_code_size, options, n);
+    } else {
+        try lzw.encode(out, indices, min_code_size, options);
+    }
+}
+
+/// Writes a GIF file piece by piece into a `SinkWriter`.
+pub const GifWriter = struct {
+    const Self = @This();
+
+    sink_writer: *SinkWriter,
+    width: usize,
+    height: usize,
+    /// Number of entries in the global color table, 0 if there is none.
+    global_ncolors: usize = 0,
+    /// The global color table, which must outlive the writer.
+    global_palette: ?[]const u8 = null,
+    wrote_header: bool = false,
+    /// If set, a frame that would take the output past this many bytes is dropped,
+    /// and so is every frame after it.
+    byte_limit: ?usize = null,
+    /// Number of frames dropped because of `byte_limit`.
+    dropped_frames: usize = 0,
+    /// Total delay of the frames dropped because of `byte_limit`, in hundredths of a second.
+    dropped_cs: u64 = 0,
+    /// Scratch space that frames are encoded into before being written out.
+    frame_buf: std.ArrayList(u8),
+
+    pub fn init(
+        allocator: std.mem.Allocator,
+        sink_writer: *SinkWriter,
+        width: usize,
+        height: usize,
+    ) Self {
+        return .{
+            .sink_writer = sink_writer,
+            .width = width,
+            .height = height,
+            .frame_buf = std.ArrayList(u8).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.frame_buf.deinit();
+    }
+
+    /// Write the GIF header, the logical screen descriptor, the global color table (if any),
+    /// and the NETSCAPE2.0 extension that makes viewers loop the animation.
+    /// `loop_count` of 0 loops forever.
+    pub fn writeHeader(self: *Self, global_palette: ?[]const u8, loop_count: u16) !void {
+        const out = &self.frame_buf;
+        out.clearRetainingCapacity();
+
+        try out.appendSlice("GIF89a");
+        try appendU16(out, self.width);
+        try appendU16(out, self.height);
+
+        // 8 bits of color resolution in the source image.
+        const color_resolution: u8 = 0b111 << 4;
+        if (global_palette) |palette| {
+            self.global_ncolors = palette.len / 3;
+            self.global_palette = palette;
+            try out.append(0x80 | color_resolution | colorTableSizeField(self.global_ncolors));
+            try out.append(0); // background color index
+            try out.append(0); // pixel aspect ratio
+            try appendColorTable(out, palette);
+        } else {
+            try out.appendSlice(&[_]u8{ color_resolution, 0, 0 });
+        }
+
+        try out.appendSlice(&[_]u8{ 0x21, 0xFF, 0x0B });
+        try out.appendSlice("NETSCAPE2.0");
+        try out.appendSlice(&[_]u8{ 0x03, 0x01 });
+        try appendU16(out, loop_count);
+        try out.append(0);
+
+        try self.sink_writer.writeAll(out.items);
+        self.wrote_header = true;
+    }
+
+    /// Encode a frame that covers the entire canvas and write it out.
+    pub fn writeFrame(self: *Self, indices: []const u8, options: FrameOptions) !void {
+        self.frame_buf.clearRetainingCapacity();
+        try encodeFrame(&self.frame_buf, .{
+            .indices = indices,
+            .width = self.width,
+            .height = self.height,
+            .ncolors = self.global_ncolors,
+            .palette = self.global_palette,
+        }, options);
+        try self.writeEncodedFrame(self.frame_buf.items, options.delay_cs);
+    }
+
+    /// Write a frame that was encoded with `encodeFrame`, with a delay of `delay_cs`.
+    pub fn writeEncodedFrame(self: *Self, encoded: []const u8, delay_cs: u16) !void {
+        if (self.byte_limit) |limit| {
+            if (self.dropped_frames > 0 or self.sink_writer.bytes_written + encoded.len > limit) {
+                self.dropped_frames += 1;
+                self.dropped_cs += delay_cs;
+                return;
+            }
+        }
+        try self.sink_writer.writeAll(encoded);
+    }
+
+    pub fn writeTrailer(self: *Self) !void {
+        try self.sink_writer.writeAll(&[_]u8{0x3B});
+    }
+};
+
+const t = std.testing;
+test "findChangedRect" {
+    const T = 9;
+    const indices = [_]u8{
+        T, T, T, T,
+        T, 1, T, T,
+        T, T, 2, T,
+    };
+
+    const frame = IndexedFrame{ .indices = &indices, .width = 4, .height = 3, .ncolors = 10 };
+    try t.expectEqualDeep(Rect{ .x = 1, .y = 1, .width = 2, .height = 2 }, findChangedRect(frame, T).?);
+
+    const blank = [_]u8{T} ** 12;
+    try t.expectEqual(null, findChangedRect(.{
+        .indices = &blank,
+        .width = 4,
+        .height = 3,
+        .ncolors = 10,
+    }, T));
+}
+
+test "colorTableSizeField" {
+    try t.expectEqual(0, colorTableSizeField(1));
+    try t.expectEqual(0, colorTableSizeField(2));
+    try t.expectEqual(1, colorTableSizeField(3));
+    try t.expectEqual(7, colorTableSizeField(256));
+}
@@ -2,9 +2,28 @@ const std = @import("std");
 const objc = @import("objc");
 const c = @cImport(@cInclude("CoreGraphics/CoreGraphics.h"));
 const macos = @import("./mac-os.zig");
+const x11 = @import("./linux-x11.zig");
+const synthetic = @import("./synthetic.zig");
+const y4m = @import("./y4m.zig");
 const png = @import("./png.zig");
+const pipe = @import("./pipe.zig");
+const frame_pool = @import("./frame-pool.zig");
+const downscale = @import("./downscale.zig");
 const builtin = @import("builtin");
 
+pub const PngSequence = png.PngSequence;
+pub const queuePngFrame = png.queuePngFrame;
+pub const PipeSink = pipe.PipeSink;
+pub const PipeSinkConfig = pipe.PipeSinkConfig;
+pub const PipeFormat = pipe.PipeFormat;
+pub const writePipeFrame = pipe.writePipeFrame;
+pub const FramePool = frame_pool.FramePool;
+pub const FramePoolConfig = frame_pool.FramePoolConfig;
+pub const FrameBuffer = frame_pool.FrameBuffer;
+pub const Downscaler = downscale.Downscaler;
+pub const DownscaleConfig = downscale.DownscaleConfig;
+pub const ResampleFilter = downscale.Filter;
+
 // The mental model of the capture system:
 //
 //     +----------+
@@ -60,41 +79,131 @@ pub const Rect = struct {
 const ScreenshotFn = *const (fn (*ICapturer, rect: ?Rect) anyerror!ImageData);
 const StartRecordFn = *const (fn (*ICapturer) anyerror!void);
 const StopRecordFn = *const (fn (*ICapturer) anyerror!void);
+const DestroyFn = *const (fn (*ICapturer) void);
 
 pub const OpaqueFrameHandler = *const fn (*anyopaque, Frame) anyerror!void;
 
+/// Changes every frame before the frame handler gets it, e.g. to scale it down.
+/// `transformFn` takes the frame and returns the one to hand on: either the same one,
+/// or a new one, in which case it gives back the old one (even when it fails).
+pub const FrameTransform = struct {
+    context: *anyopaque,
+    transformFn: *const fn (*anyopaque, *ICapturer, Frame) anyerror!Frame,
+};
+
 pub const CaptureConfig = struct {
     rect: ?Rect,
     screenshotFn: ScreenshotFn,
     startRecordFn: StartRecordFn,
     stopRecordFn: StopRecordFn,
+    destroyFn: DestroyFn,
     onFrameReceived: ?OpaqueFrameHandler,
 };
 
+pub const SyntheticConfig = synthetic.SyntheticConfig;
+pub const SyntheticContent = synthetic.SyntheticContent;
+pub const ReplayConfig = synthetic.ReplayConfig;
+pub const Y4mConfig = y4m.Y4mConfig;
+pub const Y4mCapture = y4m.Y4mCapture;
+
+/// Where the frames of a capturer come from.
+pub const Backend = union(enum) {
+    /// The screen, through the platform's capture API.
+    screen,
+    /// Generated screen-like content. Works without a display.
+    synthetic: SyntheticConfig,
+    /// Raw BGRA frames replayed from a file. Works without a display.
+    replay: ReplayConfig,
+    /// A YUV4MPEG2 video, from a file or stdin.
+    y4m: Y4mConfig,
+};
+
 fn defaultFrameHandler(_: *anyopaque, _: Frame) !void {
     std.debug.panic("No frame handler set. Call 'setFrameHandler'\n", .{});
 }
 
-/// An RGBA Image buffer.
+/// An RGBA Image buffer, or a view of a rectangle of one.
+/// Screenshots are RGBA on every platform, but the frames of a recording are BGRA.
 pub const ImageData = struct {
     /// An buffer containing the frame info as RGBARBGARGBA...
-    /// `data.len = width * height * 4`.
+    /// Row `y` starts at `data[y * stride()]`, and holds `width * 4` bytes.
     data: []u8,
     /// Width of the frame in pixels.
     width: usize,
     /// Height of the frame in pixels.
     height: usize,
+    /// Bytes from the start of one row to the next. 0 means the rows are packed,
+    /// `width * 4` bytes apart, as in the images that capturers deliver.
+    row_stride: usize = 0,
+    /// Position of the top left pixel in the image this is a view of.
+    x: usize = 0,
+    y: usize = 0,
+    /// The pooled buffer that `data` lives in, if it came from a `FramePool`.
+    buffer: ?*FrameBuffer = null,
+
+    /// Give back the pixels: release the pooled buffer, or free `data` if there is none.
+    /// `allocator` is the one of the capturer that made the image.
+    /// Views borrow the pixels of their parent, which is the one to give back.
+    pub fn deinit(self: *const ImageData, allocator: std.mem.Allocator) void {
+        if (self.buffer) |buffer| buffer.release() else allocator.free(self.data);
+    }
+
+    pub fn stride(self: *const ImageData) usize {
+        return if (self.row_stride == 0) self.width * 4 else self.row_stride;
+    }
+
+    /// The pixels of row `y`.
+    pub fn row(self: *const ImageData, y: usize) []u8 {
+        return self.data[y * self.stride() ..][0 .. self.width * 4];
+    }
+
+    /// A rectangle of the image that shares its pixels, without copying them.
+    /// The view stays valid for as long as the image does.
+    pub fn view(self: *const ImageData, rect: DamageRect) ImageData {
+        std.debug.assert(rect.x + rect.width <= self.width and rect.y + rect.height <= self.height);
+        std.debug.assert(rect.width > 0 and rect.height > 0);
+        const image_stride = self.stride();
+        const start = rect.y * image_stride + rect.x * 4;
+        const len = (rect.height - 1) * image_stride + rect.width * 4;
+        return .{
+            .data = self.data[start..][0..len],
+            .width = rect.width,
+            .height = rect.height,
+            .row_stride = image_stride,
+            .x = self.x + rect.x,
+            .y = self.y + rect.y,
+            .buffer = self.buffer,
+        };
+    }
 
     /// Export the frame as a PNG file.
-    pub fn writePng(self: *const ImageData, filepath: [:0]const u8) !void {
-        try png.writeRgbaToPng(self.data, self.width, self.height, filepath);
+    pub fn writePng(self: *const ImageData, allocator: std.mem.Allocator, filepath: [:0]const u8) !void {
+        try png.writeToPng(allocator, self.data, self.width, self.height, self.row_stride, .rgba, filepath, .{});
     }
 };
 
+/// A rectangle of a frame, in pixels from its top left corner.
+pub const DamageRect = struct {
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+};
+
 /// A single frame of a video feed.
 pub const Frame = struct {
     image: ImageData,
     duration_ms: f64,
+    /// The parts of the frame that changed since the previous one, when the capturer knows them.
+    /// `null` means that anything may have changed. Allocated like `image.data`,
+    /// and owned by whoever receives the frame.
+    damage: ?[]const DamageRect = null,
+
+    /// Give back the memory of the frame, once done with it.
+    pub fn deinit(self: *const Frame, allocator: std.mem.Allocator) void {
+        self.image.deinit(allocator);
+        if (self.damage) |damage| allocator.free(damage);
+    }
 };
 
 pub const ICapturer = struct {
@@ -106,6 +215,19 @@ pub const ICapturer = struct {
     startRecordFn: StartRecordFn,
     /// A function pointer to a platform specific function that stops recording the screen.
     stopRecordFn: StopRecordFn,
+    /// A function pointer to a platform specific function that frees the capture object.
+    destroyFn: DestroyFn,
+    /// How often to grab a frame while recording, on platforms that poll the screen (X11),
+    /// and for synthetic and replayed frames.
+    frames_per_second: f64 = 30,
+    /// Only read the parts of the screen that changed, and report them in `Frame.damage`,
+    /// on platforms that can tell (X11 with the DAMAGE extension).
+    incremental: bool = false,
+    /// Where to take the pixel buffers of frames from. With a pool, recording reuses
+    /// a bounded set of buffers instead of allocating one per frame, and waits for
+    /// the consumers to release one when they are all in use.
+    /// Either way, images must be given back with `ImageData.deinit` or `Frame.deinit`.
+    frame_pool: ?*FramePool = null,
 
     // A callback function to call when a frame is received.
     // This is not be set explicitly by the user, rather by the Frametap(T) struct below.
@@ -123,16 +245,59 @@ pub const ICapturer = struct {
             .screenshotFn = config.screenshotFn,
             .startRecordFn = config.startRecordFn,
             .stopRecordFn = config.stopRecordFn,
+            .destroyFn = config.destroyFn,
             .onFrameReceived = config.onFrameReceived orelse defaultFrameHandler,
         };
     }
 
-    /// Create a new capture object.
+    /// A BGRA image for a capturer to fill: from `frame_pool` if there is one,
+    /// or a new allocation.
+    pub fn allocImage(self: *Self, allocator: std.mem.Allocator, width: usize, height: usize) !ImageData {
+        const size = width * height * 4;
+        if (self.frame_pool) |pool| {
+            const buffer = try pool.acquire(size);
+            return ImageData{ .data = buffer.memory[0..size], .width = width, .height = height, .buffer = buffer };
+        }
+        return ImageData{ .data = try allocator.alloc(u8, size), .width = width, .height = height };
+    }
+
+    /// Create a new capture object for the screen.
     pub fn create(
         allocator: std.mem.Allocator,
         rect: ?Rect,
         frametap: *anyopaque,
     ) !*ICapturer {
+        return createWithBackend(allocator, rect, frametap, .screen);
+    }
+
+    /// Create a new capture object that gets its frames from `backend`.
+    pub fn createWithBackend(
+        allocator: std.mem.Allocator,
+        rect: ?Rect,
+        frametap: *anyopaque,
+        backend: Backend,
+    ) !*ICapturer {
+        switch (backend) {
+            .screen => {},
+            .synthetic => |config| {
+                const synthetic_capture = try allocator.create(synthetic.SyntheticCapture);
+                synthetic_capture.* = synthetic.SyntheticCapture.initSynthetic(allocator, config, frametap);
+                return &synthetic_capture.capture;
+            },
+            .replay => |config| {
+                const replay_capture = try allocator.create(synthetic.SyntheticCapture);
+                errdefer allocator.destroy(replay_capture);
+                replay_capture.* = try synthetic.SyntheticCapture.initReplay(allocator, config, frametap);
+                return &replay_capture.capture;
+            },
+            .y4m => |config| {
+                const y4m_capture = try allocator.create(y4m.Y4mCapture);
+                errdefer allocator.destroy(y4m_capture);
+                y4m_capture.* = try y4m.Y4mCapture.init(allocator, config, frametap);
+                return &y4m_capture.capture;
+            },
+        }
+
         if (builtin.os.tag == .macos) {
             var macos_capture = try allocator.create(macos.MacOSScreenCapture);
             macos_capture.* = try macos.MacOSScreenCapture.init(
@@ -143,21 +308,19 @@ pub const ICapturer = struct {
             return &macos_capture.capture;
         }
 
+        if (builtin.os.tag == .linux) {
+            const x11_capture = try allocator.create(x11.X11ScreenCapture);
+            errdefer allocator.destroy(x11_capture);
+            x11_capture.* = try x11.X11ScreenCapture.init(allocator, rect, frametap);
+            return &x11_capture.capture;
+        }
+
         return FrametapError.PlatformNotSupported;
     }
 
+    /// Free a capture object made by `create` or `createWithBackend`.
     pub fn destroy(self: *Self) void {
-        if (builtin.os.tag == .macos) {
-            const macos_capture: *macos.MacOSScreenCapture = @fieldParentPtr(
-                "capture",
-                self,
-            );
-            macos_capture.deinit();
-            macos_capture.allocator.destroy(macos_capture);
-            return;
-        }
-
-        @panic("OS not supported");
+        self.destroyFn(self);
     }
 
     /// Capture a screenshot of the screen.
@@ -186,6 +349,7 @@ pub fn FrameTap(comptime TContext: type) type {
         capture: *ICapturer,
         context: TContext,
         processFrame: FrameHandler,
+        transform: ?FrameTransform = null,
 
         // By default, the frame handle panics and asks the user to explicitly set
         // a callback function to handle the frames.
@@ -195,7 +359,11 @@ pub fn FrameTap(comptime TContext: type) type {
 
         fn onFrameCallback(ptr: *anyopaque, frame: Frame) !void {
             const self: *Self = @ptrCast(@alignCast(ptr));
-            try self.processFrame(self.context, frame);
+            const transformed = if (self.transform) |transform|
+                try transform.transformFn(transform.context, self.capture, frame)
+            else
+                frame;
+            try self.processFrame(self.context, transformed);
         }
 
         /// Set a callback function that will receive and process the frame.
@@ -203,9 +371,25 @@ pub fn FrameTap(comptime TContext: type) type {
             self.processFrame = callback;
         }
 
+        /// Run every frame through `transform` before the callback gets it, or not, with null.
+        pub fn setTransform(self: *Self, transform: ?FrameTransform) void {
+            self.transform = transform;
+        }
+
         pub fn init(allocator: std.mem.Allocator, context: TContext, rect: ?Rect) !*Self {
+            return initWithBackend(allocator, context, rect, .screen);
+        }
+
+        /// Like `init`, with frames that come from `backend` instead of the screen.
+        pub fn initWithBackend(
+            allocator: std.mem.Allocator,
+            context: TContext,
+            rect: ?Rect,
+            backend: Backend,
+        ) !*Self {
             const self = try allocator.create(Self);
-            const capture = try ICapturer.create(allocator, rect, self);
+            errdefer allocator.destroy(self);
+            const capture = try ICapturer.createWithBackend(allocator, rect, self, backend);
             capture.setFrameHandler(&Self.onFrameCallback);
             self.* = Self{
                 .capture = capture,
@@ -225,9 +409,49 @@ pub fn FrameTap(comptime TContext: type) type {
 pub const FrametapError = error{
     ImageCreationFailed,
     PlatformNotSupported,
+    /// Couldn't connect to the display server.
+    DisplayNotFound,
+    /// The screen's pixels aren't stored as 32 bit BGRA or BGRX.
+    UnsupportedPixelFormat,
+    /// The replay file doesn't hold a single frame of the given size.
+    InvalidReplayFile,
+    /// The input isn't a well formed YUV4MPEG2 stream.
+    InvalidY4m,
+    /// The YUV4MPEG2 stream is interlaced, or its chroma format is neither 4:2:0 nor 4:4:4.
+    UnsupportedY4m,
+    /// A frame doesn't have the size the sink was made for.
+    FrameSizeMismatch,
     PNGConvertFailed,
     GifConvertFailed,
     InternalError,
     /// Failed to write to the GIF file.
     GifFlushFailed,
 };
+
+test "ImageData.view shares the pixels of its parent" {
+    var pixels: [4 * 3 * 4]u8 = undefined;
+    for (&pixels, 0..) |*byte, i| byte.* = @intCast(i);
+    const image = ImageData{ .data = &pixels, .width = 4, .height = 3 };
+
+    const view = image.view(.{ .x = 1, .y = 1, .width = 2, .height = 2 });
+    try std.testing.expectEqual(16, view.stride());
+    try std.testing.expectEqualSlices(u8, pixels[20..28], view.row(0));
+    try std.testing.expectEqualSlices(u8, pixels[36..44], view.row(1));
+    try std.testing.expectEqual(36 - 20 + 8, view.data.len);
+
+    const inner = view.view(.{ .x = 1, .y = 1, .width = 1, .height = 1 });
+    try std.testing.expectEqual(2, inner.x);
+    try std.testing.expectEqual(2, inner.y);
+    inner.row(0)[0] = 0xFF;
+    try std.testing.expectEqual(0xFF, pixels[40]);
+}
+
+test {
+    _ = @import("synthetic.zig");
+    _ = @import("y4m.zig");
+    _ = @import("pipe.zig");
+    _ = @import("frame-pool.zig");
+    _ = @import("downscale.zig");
+    _ = @import("yuv.zig");
+    if (builtin.os.tag == .linux) _ = @import("linux-x11.zig");
+}
@@ -0,0 +1,201 @@
+const std = @import("std");
+const core = @import("core.zig");
+const resample = @import("resample");
+
+// Resamples every frame to a fixed size. On a Retina display, the capture has twice the width
+// and height of the rect that was asked for; scaling it back down saves the quantizer and
+// the encoder 3/4 of the work.
+//
+// As a frame transform, it runs before the frame handler gets the frame:
+//
+//     var downscaler = core.Downscaler.init(allocator, .{ .width = 640, .height = 360 });
+//     defer downscaler.deinit();
+//     tap.setTransform(downscaler.transform());
+//
+// That is on the capture thread, and it waits for the frame pool and the resampler's
+// workers. A capture callback that must not wait hands frames on as they are,
+// and the consumer calls `scale` on its own thread instead.
+
+pub const Filter = resample.Filter;
+
+pub const DownscaleConfig = struct {
+    /// Size of the frames handed on. Frames of this size already are handed on as they are.
+    width: usize,
+    height: usize,
+    filter: Filter = .area,
+    /// Number of threads to resample large frames on. 0 spawns one per CPU core.
+    n_jobs: usize = 0,
+};
+
+pub const Downscaler = struct {
+    const Self = @This();
+
+    /// The allocator of the capturer, that the frames come from.
+    allocator: std.mem.Allocator,
+    config: DownscaleConfig,
+    /// Made for the size of the first frame, and made again if the frames change size.
+    resampler: ?resample.Resampler = null,
+
+    pub fn init(allocator: std.mem.Allocator, config: DownscaleConfig) Self {
+        return .{ .allocator = allocator, .config = config };
+    }
+
+    pub fn deinit(self: *Self) void {
+        if (self.resampler) |*resampler| resampler.deinit();
+    }
+
+    /// The transform to give to `FrameTap.setTransform`.
+    /// It points to `self`, which must outlive the recording.
+    pub fn transform(self: *Self) core.FrameTransform {
+        return .{ .context = self, .transformFn = apply };
+    }
+
+    fn apply(ptr: *anyopaque, capture: *core.ICapturer, frame: core.Frame) anyerror!core.Frame {
+        const self: *Self = @ptrCast(@alignCast(ptr));
+        return self.scaleInto(capture, frame);
+    }
+
+    /// Scale `frame` to the configured size, into a new frame allocated with the
+    /// downscaler's allocator, and give `frame` back (even when this fails).
+    /// Frames of the right size are returned as they are.
+    pub fn scale(self: *Self, frame: core.Frame) !core.Frame {
+        return self.scaleInto(null, frame);
+    }
+
+    /// As `scale`, with the new frame from the capturer's pool if there is a capturer.
+    fn scaleInto(self: *Self, capture: ?*core.ICapturer, frame: core.Frame) !core.Frame {
+        const src = frame.image;
+        if (src.width == self.config.width and src.height == self.config.height) return frame;
+        defer frame.deinit(self.allocator);
+
+        const resampler = try self.resamplerFor(src.width, src.height);
+        const width = self.config.width;
+        const height = self.config.height;
+        // As a transform, from the pool too, so a slow consumer still slows down the capture.
+        const image = if (capture) |c|
+            try c.allocImage(self.allocator, width, height)
+        else
+            core.ImageData{ .data = try self.allocator.alloc(u8, width * height * 4), .width = width, .height = height };
+        errdefer image.deinit(self.allocator);
+        try resampler.resample(.{
+            .pixels = src.data,
+            .width = src.width,
+            .height = src.height,
+            .row_stride = src.row_stride,
+        }, image.data);
+
+        return .{
+            .image = image,
+            .duration_ms = frame.duration_ms,
+            .damage = try self.scaleDamage(frame.damage, src.width, src.height),
+        };
+    }
+
+    fn resamplerFor(self: *Self, width: usize, height: usize) !*resample.Resampler {
+        if (self.resampler) |*resampler| {
+            if (resampler.config.src_width == width and resampler.config.src_height == height) {
+                return resampler;
+            }
+            resampler.deinit();
+            self.resampler = null;
+        }
+
+        self.resampler = try resample.Resampler.init(self.allocator, .{
+            .src_width = width,
+            .src_height = height,
+            .dst_width = self.config.width,
+            .dst_height = self.config.height,
+            .filter = self.config.filter,
+            .n_jobs = self.config.n_jobs,
+        });
+        return &self.resampler.?;
+    }
+
+    /// The rectangles of the scaled frame that the damage of the original one reaches.
+    /// They are a pixel wider on every side, since filters blend neighbouring pixels.
+    fn scaleDamage(
+        self: *const Self,
+        damage: ?[]const core.DamageRect,
+        src_width: usize,
+        src_height: usize,
+    ) !?[]const core.DamageRect {
+        const rects = damage orelse return null;
+        const width = self.config.width;
+        const height = self.config.height;
+
+        const scaled = try self.allocator.alloc(core.DamageRect, rects.len);
+        errdefer self.allocator.free(scaled);
+        for (rects, scaled) |rect, *out| {
+            const x0 = (rect.x * width / src_width) -| 1;
+            const y0 = (rect.y * height / src_height) -| 1;
+            const x1 = @min(std.math.divCeil(usize, (rect.x + rect.width) * width, src_width) catch unreachable, width - 1) + 1;
+            const y1 = @min(std.math.divCeil(usize, (rect.y + rect.height) * height, src_height) catch unreachable, height - 1) + 1;
+            out.* = .{ .x = x0, .y = y0, .width = x1 - x0, .height = y1 - y0 };
+        }
+        return scaled;
+    }
+};
+
+const t = std.testing;
+
+test "Downscaler – hands on smaller frames" {
+    const Collector = struct {
+        count: usize = 0,
+
+        fn onFrame(self: *@This(), frame: core.Frame) anyerror!void {
+            defer frame.deinit(t.allocator);
+            try t.expectEqual(32, frame.image.width);
+            try t.expectEqual(18, frame.image.height);
+            try t.expectEqual(32 * 18 * 4, frame.image.data.len);
+            self.count += 1;
+        }
+    };
+
+    var collector = Collector{};
+    const tap = try core.FrameTap(*Collector).initWithBackend(t.allocator, &collector, null, .{
+        .synthetic = .{ .width = 64, .height = 35, .frame_count = 3 },
+    });
+    defer {
+        tap.deinit();
+        t.allocator.destroy(tap);
+    }
+
+    var downscaler = Downscaler.init(t.allocator, .{ .width = 32, .height = 18, .filter = .box });
+    defer downscaler.deinit();
+    tap.setTransform(downscaler.transform());
+    tap.onFrame(Collector.onFrame);
+
+    try tap.capture.begin();
+    try t.expectEqual(3, collector.count);
+}
+
+test "Downscaler – scales frames handed to it" {
+    var downscaler = Downscaler.init(t.allocator, .{ .width = 2, .height = 1, .filter = .box });
+    defer downscaler.deinit();
+
+    const pixels = try t.allocator.alloc(u8, 4 * 2 * 4);
+    @memset(pixels, 100);
+    const frame = try downscaler.scale(.{
+        .image = .{ .data = pixels, .width = 4, .height = 2 },
+        .duration_ms = 20,
+    });
+    defer frame.deinit(t.allocator);
+    try t.expectEqual(2, frame.image.width);
+    try t.expectEqual(1, frame.image.height);
+    try t.expectEqual(20, frame.duration_ms);
+    try t.expectEqualSlices(u8, &[_]u8{100} ** 8, frame.image.data);
+}
+
+test "Downscaler – scales the damage" {
+    var downscaler = Downscaler.init(t.allocator, .{ .width = 50, .height = 50 });
+    defer downscaler.deinit();
+
+    const damage = [_]core.DamageRect{
+        .{ .x = 10, .y = 20, .width = 4, .height = 1 },
+        .{ .x = 0, .y = 0, .width = 100, .height = 100 },
+    };
+    const scaled = (try downscaler.scaleDamage(&damage, 100, 100)).?;
+    defer t.allocator.free(scaled);
+    try t.expectEqual(core.DamageRect{ .x = 4, .y = 9, .width = 4, .height = 3 }, scaled[0]);
+    try t.expectEqual(core.DamageRect{ .x = 0, .y = 0, .width = 50, .height = 50 }, scaled[1]);
+}
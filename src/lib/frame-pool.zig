@@ -0,0 +1,191 @@
+const std = @import("std");
+
+// A fixed set of page aligned pixel buffers that capturers check frames out of, and that
+// consumers give back when they are done with a frame, instead of allocating and freeing
+// a buffer for every frame. A buffer is only (re)allocated when it's too small for a frame,
+// so once every buffer has held a frame, recording doesn't allocate at all.
+// Buffers are reference counted, so that several consumers (or native code and Zig)
+// can hold on to the same frame, and it returns to the pool when the last one lets go.
+// When every buffer is out, `acquire` waits for one to be released: a slow consumer
+// slows down the capture, rather than making it use more memory.
+
+pub const FramePoolConfig = struct {
+    /// Number of buffers. At most this many frames exist at once.
+    capacity: usize = 8,
+};
+
+/// What a buffer holds before its first frame.
+var no_memory: [0]u8 align(std.mem.page_size) = .{};
+
+pub const FrameBuffer = struct {
+    pool: *FramePool,
+    /// The whole buffer. Images use the start of it.
+    memory: []align(std.mem.page_size) u8 = &no_memory,
+    refs: std.atomic.Value(u32) = std.atomic.Value(u32).init(0),
+
+    /// Take another reference to the buffer.
+    pub fn retain(self: *FrameBuffer) void {
+        _ = self.refs.fetchAdd(1, .monotonic);
+    }
+
+    /// Drop a reference to the buffer. The last one puts it back in the pool.
+    pub fn release(self: *FrameBuffer) void {
+        if (self.refs.fetchSub(1, .acq_rel) == 1) self.pool.put(self);
+    }
+};
+
+pub const FramePool = struct {
+    const Self = @This();
+
+    allocator: std.mem.Allocator,
+    buffers: []FrameBuffer,
+    /// Indices of the buffers that are in the pool, as a stack.
+    free: []usize,
+    nfree: usize,
+    mutex: std.Thread.Mutex = .{},
+    released: std.Thread.Condition = .{},
+    /// Number of times a buffer was (re)allocated, to check that recording reuses them.
+    allocations: usize = 0,
+
+    /// The pool is returned by pointer, since its buffers point back to it.
+    pub fn init(allocator: std.mem.Allocator, config: FramePoolConfig) !*Self {
+        std.debug.assert(config.capacity > 0);
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+        const buffers = try allocator.alloc(FrameBuffer, config.capacity);
+        errdefer allocator.free(buffers);
+        const free = try allocator.alloc(usize, config.capacity);
+
+        for (buffers, free, 0..) |*buffer, *index, i| {
+            buffer.* = .{ .pool = self };
+            index.* = i;
+        }
+        self.* = .{
+            .allocator = allocator,
+            .buffers = buffers,
+            .free = free,
+            .nfree = config.capacity,
+        };
+        return self;
+    }
+
+    /// Free the pool and its buffers. Every buffer must have been released.
+    pub fn deinit(self: *Self) void {
+        std.debug.assert(self.nfree == self.buffers.len);
+        for (self.buffers) |buffer| {
+            if (buffer.memory.len > 0) self.allocator.free(buffer.memory);
+        }
+        self.allocator.free(self.buffers);
+        self.allocator.free(self.free);
+        self.allocator.destroy(self);
+    }
+
+    /// Check out a buffer of at least `size` bytes, with one reference.
+    /// Waits for a buffer to be released if they are all out.
+    pub fn acquire(self: *Self, size: usize) !*FrameBuffer {
+        const buffer = blk: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            while (self.nfree == 0) self.released.wait(&self.mutex);
+            break :blk self.pop();
+        };
+        return self.prepare(buffer, size);
+    }
+
+    /// Like `acquire`, but returns null instead of waiting when every buffer is out.
+    pub fn tryAcquire(self: *Self, size: usize) !?*FrameBuffer {
+        const buffer = blk: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            if (self.nfree == 0) return null;
+            break :blk self.pop();
+        };
+        return try self.prepare(buffer, size);
+    }
+
+    /// The buffer whose memory starts at `ptr`, for buffers that went through C code.
+    pub fn fromData(self: *Self, ptr: [*]const u8) ?*FrameBuffer {
+        for (self.buffers) |*buffer| {
+            if (buffer.memory.len > 0 and buffer.memory.ptr == ptr) return buffer;
+        }
+        return null;
+    }
+
+    fn pop(self: *Self) *FrameBuffer {
+        self.nfree -= 1;
+        return &self.buffers[self.free[self.nfree]];
+    }
+
+    fn put(self: *Self, buffer: *FrameBuffer) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.free[self.nfree] = (@intFromPtr(buffer) - @intFromPtr(self.buffers.ptr)) / @sizeOf(FrameBuffer);
+        self.nfree += 1;
+        self.released.signal();
+    }
+
+    /// Make sure the buffer, which nobody else holds, can take `size` bytes.
+    fn prepare(self: *Self, buffer: *FrameBuffer, size: usize) !*FrameBuffer {
+        if (buffer.memory.len < size) {
+            errdefer self.put(buffer);
+            const memory = try self.allocator.alignedAlloc(
+                u8,
+                std.mem.page_size,
+                std.mem.alignForward(usize, size, std.mem.page_size),
+            );
+            if (buffer.memory.len > 0) self.allocator.free(buffer.memory);
+            buffer.memory = memory;
+            _ = @atomicRmw(usize, &self.allocations, .Add, 1, .monotonic);
+        }
+        buffer.refs.store(1, .release);
+        return buffer;
+    }
+};
+
+const t = std.testing;
+
+test "FramePool – reuses buffers once warmed up" {
+    const pool = try FramePool.init(t.allocator, .{ .capacity = 2 });
+    defer pool.deinit();
+
+    for (0..10) |_| {
+        const a = try pool.acquire(1000);
+        const b = try pool.acquire(1000);
+        try t.expect(std.mem.isAligned(@intFromPtr(a.memory.ptr), std.mem.page_size));
+        try t.expect(a.memory.ptr != b.memory.ptr);
+
+        // Every buffer is out.
+        try t.expectEqual(null, try pool.tryAcquire(1000));
+
+        b.retain();
+        b.release();
+        a.release();
+        try t.expectEqual(b, pool.fromData(b.memory.ptr).?);
+        b.release();
+    }
+    try t.expectEqual(2, pool.allocations);
+
+    // A bigger frame needs a bigger buffer.
+    const big = try pool.acquire(2 * std.mem.page_size);
+    defer big.release();
+    try t.expect(big.memory.len >= 2 * std.mem.page_size);
+    try t.expectEqual(3, pool.allocations);
+}
+
+test "FramePool – acquire waits for a release" {
+    const pool = try FramePool.init(t.allocator, .{ .capacity = 1 });
+    defer pool.deinit();
+
+    const held = try pool.acquire(64);
+    const releaser = try std.Thread.spawn(.{}, struct {
+        fn run(buffer: *FrameBuffer) void {
+            std.time.sleep(10 * std.time.ns_per_ms);
+            buffer.release();
+        }
+    }.run, .{held});
+
+    const next = try pool.acquire(64);
+    releaser.join();
+    try t.expectEqual(held, next);
+    next.release();
+}
@@ -0,0 +1,553 @@
+const std = @import("std");
+const core = @import("core.zig");
+const pixel = @import("pixel");
+const x11 = @cImport({
+    @cInclude("X11/Xlib.h");
+    @cInclude("X11/Xutil.h");
+    @cInclude("sys/ipc.h");
+    @cInclude("sys/shm.h");
+    @cInclude("X11/extensions/XShm.h");
+    @cInclude("X11/extensions/Xdamage.h");
+    @cInclude("X11/extensions/Xfixes.h");
+});
+
+const CaptureError = core.FrametapError;
+const Capturer = core.ICapturer;
+const Rect = core.Rect;
+
+// Screen capture on X11 servers (including headless ones, like Xvfb).
+//
+// With the MIT-SHM extension, the server writes the pixels of the root window into
+// a shared memory segment that we map too, so a frame never travels through the socket.
+// Servers without the extension (e.g. over SSH forwarding) fall back to a plain `XGetImage`.
+//
+// X11 doesn't push frames, so recording polls the screen at `ICapturer.frames_per_second`.
+// With `ICapturer.incremental`, the DAMAGE extension tells us which parts of the screen were
+// drawn to since the last frame: only those are read again, into a framebuffer kept across
+// frames, and they are passed along with the frame so later stages can skip the rest.
+
+/// A shared memory XImage. It is only replaced when a larger area is needed:
+/// smaller rectangles are read into the same segment.
+const ShmImage = struct {
+    image: *x11.XImage,
+    info: x11.XShmSegmentInfo,
+    /// Size of the segment in bytes.
+    size: usize,
+
+    fn create(display: *x11.Display, screen: c_int, width: c_uint, height: c_uint) !ShmImage {
+        var self = ShmImage{
+            .image = undefined,
+            .info = std.mem.zeroes(x11.XShmSegmentInfo),
+            .size = 0,
+        };
+        self.image = x11.XShmCreateImage(
+            display,
+            x11.XDefaultVisual(display, screen),
+            @intCast(x11.XDefaultDepth(display, screen)),
+            x11.ZPixmap,
+            null,
+            &self.info,
+            width,
+            height,
+        ) orelse return CaptureError.ImageCreationFailed;
+        errdefer _ = self.image.f.destroy_image.?(self.image);
+
+        self.size = @intCast(self.image.bytes_per_line * self.image.height);
+        self.info.shmid = x11.shmget(x11.IPC_PRIVATE, self.size, x11.IPC_CREAT | 0o600);
+        if (self.info.shmid < 0) return CaptureError.ImageCreationFailed;
+        // Mark the segment for removal right away: it lives on until both sides detach,
+        // and isn't leaked if we crash.
+        defer _ = x11.shmctl(self.info.shmid, x11.IPC_RMID, null);
+
+        // On failure, shmat returns (void *) -1.
+        const addr = x11.shmat(self.info.shmid, null, 0) orelse return CaptureError.ImageCreationFailed;
+        if (@intFromPtr(addr) == std.math.maxInt(usize)) return CaptureError.ImageCreationFailed;
+        errdefer _ = x11.shmdt(addr);
+
+        self.info.shmaddr = @ptrCast(addr);
+        self.image.data = @ptrCast(addr);
+        self.info.readOnly = x11.False;
+        if (x11.XShmAttach(display, &self.info) == 0) return CaptureError.ImageCreationFailed;
+        // The server must have attached the segment before it is removed.
+        _ = x11.XSync(display, x11.False);
+        return self;
+    }
+
+    fn destroy(self: *ShmImage, display: *x11.Display) void {
+        _ = x11.XShmDetach(display, &self.info);
+        _ = x11.XSync(display, x11.False);
+        _ = x11.shmdt(self.info.shmaddr);
+        // For shared memory images, this only frees the XImage struct.
+        _ = self.image.f.destroy_image.?(self.image);
+    }
+};
+
+/// A rectangle of the screen, in pixels.
+const Area = struct {
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+};
+
+/// Tracks the parts of the screen that were drawn to with the DAMAGE extension,
+/// and keeps an up to date copy of the capture area by reading only those parts again.
+const DamageTracker = struct {
+    damage: x11.Damage,
+    /// Receives the damaged region on every frame.
+    parts: x11.XserverRegion,
+    area: Area,
+    framebuf: []u8,
+    /// Whether a frame was returned yet. The first one has no damage, all of it is new.
+    sent_first: bool = false,
+
+    fn init(capture: *X11ScreenCapture, area: Area) !DamageTracker {
+        const framebuf = try capture.allocator.alloc(u8, area.width * area.height * 4);
+        errdefer capture.allocator.free(framebuf);
+
+        capture.mutex.lock();
+        defer capture.mutex.unlock();
+
+        // Start tracking before the first read, so that nothing drawn in between is missed.
+        const damage = x11.XDamageCreate(capture.display, capture.root, x11.XDamageReportNonEmpty);
+        errdefer x11.XDamageDestroy(capture.display, damage);
+        const parts = x11.XFixesCreateRegion(capture.display, null, 0);
+        errdefer x11.XFixesDestroyRegion(capture.display, parts);
+
+        try capture.readArea(area, framebuf, area.width * 4);
+        return .{ .damage = damage, .parts = parts, .area = area, .framebuf = framebuf };
+    }
+
+    fn deinit(self: *DamageTracker, capture: *X11ScreenCapture) void {
+        capture.mutex.lock();
+        defer capture.mutex.unlock();
+        x11.XDamageDestroy(capture.display, self.damage);
+        x11.XFixesDestroyRegion(capture.display, self.parts);
+        capture.allocator.free(self.framebuf);
+    }
+
+    /// Read the parts of the area that changed since the last call, and return a copy
+    /// of the updated framebuffer with the list of those parts (`null` for the first frame).
+    fn nextFrame(self: *DamageTracker, capture: *X11ScreenCapture) !core.Frame {
+        const allocator = capture.allocator;
+        var damage = std.ArrayList(core.DamageRect).init(allocator);
+        errdefer damage.deinit();
+
+        {
+            capture.mutex.lock();
+            defer capture.mutex.unlock();
+            const display = capture.display;
+
+            // The notify events only say that something changed, the region below says what.
+            while (x11.XPending(display) > 0) {
+                var event: x11.XEvent = undefined;
+                _ = x11.XNextEvent(display, &event);
+            }
+
+            x11.XDamageSubtract(display, self.damage, x11.None, self.parts);
+            var nrects: c_int = 0;
+            const rects = x11.XFixesFetchRegion(display, self.parts, &nrects);
+            defer if (rects != null) {
+                _ = x11.XFree(rects);
+            };
+
+            const stride = self.area.width * 4;
+            for (0..@intCast(nrects)) |i| {
+                const rect = clip(rects[i], self.area) orelse continue;
+                const offset = rect.y * stride + rect.x * 4;
+                try capture.readArea(.{
+                    .x = self.area.x + rect.x,
+                    .y = self.area.y + rect.y,
+                    .width = rect.width,
+                    .height = rect.height,
+                }, self.framebuf[offset..], stride);
+                try damage.append(rect);
+            }
+        }
+
+        const image = try capture.capture.allocImage(allocator, self.area.width, self.area.height);
+        errdefer image.deinit(allocator);
+        @memcpy(image.data, self.framebuf);
+        defer self.sent_first = true;
+        if (!self.sent_first) {
+            damage.deinit();
+            return .{ .image = image, .duration_ms = 0, .damage = null };
+        }
+        return .{
+            .image = image,
+            .duration_ms = 0,
+            .damage = try damage.toOwnedSlice(),
+        };
+    }
+
+    /// The part of `rect` (in screen coordinates) inside `area`, relative to `area`.
+    fn clip(rect: x11.XRectangle, area: Area) ?core.DamageRect {
+        const x0 = @max(@as(isize, rect.x), @as(isize, @intCast(area.x)));
+        const y0 = @max(@as(isize, rect.y), @as(isize, @intCast(area.y)));
+        const x1 = @min(@as(isize, rect.x) + rect.width, @as(isize, @intCast(area.x + area.width)));
+        const y1 = @min(@as(isize, rect.y) + rect.height, @as(isize, @intCast(area.y + area.height)));
+        if (x1 <= x0 or y1 <= y0) return null;
+        return .{
+            .x = @as(usize, @intCast(x0)) - area.x,
+            .y = @as(usize, @intCast(y0)) - area.y,
+            .width = @intCast(x1 - x0),
+            .height = @intCast(y1 - y0),
+        };
+    }
+};
+
+pub const X11ScreenCapture = struct {
+    const Self = @This();
+    allocator: std.mem.Allocator,
+    capture: core.ICapturer,
+
+    display: *x11.Display,
+    screen: c_int,
+    root: x11.Window,
+    screen_width: usize,
+    screen_height: usize,
+    has_shm: bool,
+    has_damage: bool,
+    shm_image: ?ShmImage = null,
+    /// Held while talking to the server, so that screenshots can be taken while recording.
+    mutex: std.Thread.Mutex = .{},
+    stop_requested: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    /// Pointer to the user-facing `frametap` struct that contains the user provided
+    /// `onFrame` callback.
+    frametap: *anyopaque,
+
+    /// The part of the screen to grab: `rect` clamped to the screen, or the whole screen.
+    fn area(self: *const Self, rect: ?Rect) Area {
+        const r = rect orelse return .{
+            .x = 0,
+            .y = 0,
+            .width = self.screen_width,
+            .height = self.screen_height,
+        };
+
+        const x = @min(@as(usize, @intFromFloat(@max(r.x, 0))), self.screen_width - 1);
+        const y = @min(@as(usize, @intFromFloat(@max(r.y, 0))), self.screen_height - 1);
+        const width: usize = @intFromFloat(@max(r.width, 1));
+        const height: usize = @intFromFloat(@max(r.height, 1));
+        return .{
+            .x = x,
+            .y = y,
+            .width = @min(width, self.screen_width - x),
+            .height = @min(height, self.screen_height - y),
+        };
+    }
+
+    /// A shared memory image with room for `width` x `height` pixels.
+    fn shmImage(self: *Self, width: usize, height: usize) !*ShmImage {
+        if (self.shm_image) |*shm| {
+            if (shm.size >= width * height * 4) return shm;
+            shm.destroy(self.display);
+            self.shm_image = null;
+        }
+
+        self.shm_image = try ShmImage.create(self.display, self.screen, @intCast(width), @intCast(height));
+        // XShmGetImage finds the segment through the info the image was created with,
+        // which has moved since.
+        const shm = &self.shm_image.?;
+        shm.image.obdata = @ptrCast(&shm.info);
+        return shm;
+    }
+
+    /// Read `rect` of the screen into `dst` as BGRA, with rows starting every `dst_stride` bytes.
+    /// Must be called with `mutex` held.
+    fn readArea(self: *Self, rect: Area, dst: []u8, dst_stride: usize) !void {
+        const all_planes = ~@as(c_ulong, 0);
+        const x: c_int = @intCast(rect.x);
+        const y: c_int = @intCast(rect.y);
+
+        var image: *x11.XImage = undefined;
+        if (self.has_shm) {
+            image = (try self.shmImage(rect.width, rect.height)).image;
+            // The server packs the rows of a request as tightly as it can, so the segment
+            // can hold any rectangle that fits: only the image's geometry has to match.
+            image.width = @intCast(rect.width);
+            image.height = @intCast(rect.height);
+            image.bytes_per_line = @intCast(rect.width * 4);
+            if (x11.XShmGetImage(self.display, self.root, image, x, y, all_planes) == 0) {
+                return CaptureError.ImageCreationFailed;
+            }
+        } else {
+            image = x11.XGetImage(
+                self.display,
+                self.root,
+                x,
+                y,
+                @intCast(rect.width),
+                @intCast(rect.height),
+                all_planes,
+                x11.ZPixmap,
+            ) orelse return CaptureError.ImageCreationFailed;
+        }
+        defer if (!self.has_shm) {
+            _ = image.f.destroy_image.?(image);
+        };
+
+        // 24 and 32 bit visuals store pixels as B, G, R, X on little endian machines.
+        if (image.bits_per_pixel != 32 or image.byte_order != x11.LSBFirst) {
+            return CaptureError.UnsupportedPixelFormat;
+        }
+
+        const row_len = rect.width * 4;
+        const src_stride: usize = @intCast(image.bytes_per_line);
+        const src: [*]const u8 = @ptrCast(image.data);
+        for (0..rect.height) |row| {
+            const dst_row = dst[row * dst_stride ..][0..row_len];
+            @memcpy(dst_row, src[row * src_stride ..][0..row_len]);
+            // The fourth byte is padding, and not necessarily zero.
+            var i: usize = 3;
+            while (i < row_len) : (i += 4) dst_row[i] = 255;
+        }
+    }
+
+    /// Grab an area of the screen into a new BGRA image.
+    fn grab(self: *Self, rect: ?Rect) !core.ImageData {
+        const region = self.area(rect);
+        const image = try self.capture.allocImage(self.allocator, region.width, region.height);
+        errdefer image.deinit(self.allocator);
+
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        try self.readArea(region, image.data, region.width * 4);
+        return image;
+    }
+
+    /// X11 specific screenshot implementation.
+    fn screenshot(ctx: *core.ICapturer, rect: ?Rect) !core.ImageData {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const image = try self.grab(rect orelse ctx.rect);
+        // Screenshots are RGBA, but the server stores BGRX.
+        pixel.swapRedBlueInPlace(image.data);
+        return image;
+    }
+
+    /// Grab frames at the capturer's frame rate until `stopCaptureX11` is called.
+    fn startCaptureX11(ctx: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const frame_ns: u64 = @intFromFloat(@as(f64, std.time.ns_per_s) / @max(ctx.frames_per_second, 0.1));
+
+        // In incremental mode, only the parts that were drawn to are read again.
+        var tracker: ?DamageTracker = null;
+        if (ctx.incremental and self.has_damage) {
+            tracker = try DamageTracker.init(self, self.area(ctx.rect));
+        }
+        defer if (tracker) |*damage| damage.deinit(self);
+
+        var timer = try std.time.Timer.start();
+        var last_frame_ns: ?u64 = null;
+        while (!self.stop_requested.swap(false, .acq_rel)) {
+            const frame_start = timer.read();
+            var frame = if (tracker) |*damage|
+                try damage.nextFrame(self)
+            else
+                core.Frame{ .image = try self.grab(ctx.rect), .duration_ms = 0 };
+            const duration_ns = if (last_frame_ns) |last| frame_start - last else frame_ns;
+            last_frame_ns = frame_start;
+            frame.duration_ms = @as(f64, @floatFromInt(duration_ns)) / std.time.ns_per_ms;
+
+            try ctx.onFrameReceived(self.frametap, frame);
+
+            // Sleep until the next frame is due, minus the time spent on this one.
+            const elapsed = timer.read() - frame_start;
+            if (elapsed < frame_ns) std.time.sleep(frame_ns - elapsed);
+        }
+    }
+
+    /// X11 specific implementation. Makes `startCaptureX11` return after the current frame.
+    fn stopCaptureX11(capturer: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.stop_requested.store(true, .release);
+    }
+
+    /// Connect to the X server named by `$DISPLAY`.
+    pub fn init(
+        allocator: std.mem.Allocator,
+        rect: ?Rect,
+        frametap: *anyopaque,
+    ) CaptureError!X11ScreenCapture {
+        // Screenshots and recording may run on different threads.
+        _ = x11.XInitThreads();
+        const display = x11.XOpenDisplay(null) orelse return CaptureError.DisplayNotFound;
+        const screen = x11.XDefaultScreen(display);
+
+        const conf = core.CaptureConfig{
+            .rect = rect,
+            .screenshotFn = Self.screenshot,
+            .stopRecordFn = Self.stopCaptureX11,
+            .startRecordFn = Self.startCaptureX11,
+            .destroyFn = Self.destroyX11,
+            .onFrameReceived = null,
+        };
+
+        return Self{
+            .allocator = allocator,
+            .capture = Capturer.init(conf),
+            .display = display,
+            .screen = screen,
+            .root = x11.XRootWindow(display, screen),
+            .screen_width = @intCast(x11.XDisplayWidth(display, screen)),
+            .screen_height = @intCast(x11.XDisplayHeight(display, screen)),
+            .has_shm = x11.XShmQueryExtension(display) != 0,
+            .has_damage = hasDamage(display),
+            .frametap = frametap,
+        };
+    }
+
+    fn hasDamage(display: *x11.Display) bool {
+        var event_base: c_int = 0;
+        var error_base: c_int = 0;
+        return x11.XDamageQueryExtension(display, &event_base, &error_base) != 0 and
+            x11.XFixesQueryExtension(display, &event_base, &error_base) != 0;
+    }
+
+    pub fn deinit(self: *X11ScreenCapture) void {
+        if (self.shm_image) |*shm| shm.destroy(self.display);
+        _ = x11.XCloseDisplay(self.display);
+    }
+
+    fn destroyX11(capturer: *Capturer) void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.deinit();
+        self.allocator.destroy(self);
+    }
+};
+
+const t = std.testing;
+
+/// Connect to the X server in `$DISPLAY` (e.g. `Xvfb :99 & DISPLAY=:99 zig build test`),
+/// or skip the test if there is none.
+fn initForTest(frametap: *anyopaque) !X11ScreenCapture {
+    if (std.posix.getenv("DISPLAY") == null) return error.SkipZigTest;
+    return X11ScreenCapture.init(t.allocator, null, frametap) catch |err| switch (err) {
+        CaptureError.DisplayNotFound => error.SkipZigTest,
+        else => err,
+    };
+}
+
+test "X11ScreenCapture – screenshot" {
+    var dummy: u8 = 0;
+    var capture = try initForTest(&dummy);
+    defer capture.deinit();
+
+    const image = try capture.capture.screenshot(.{ .x = 1, .y = 2, .width = 17, .height = 9 });
+    defer t.allocator.free(image.data);
+    try t.expectEqual(17, image.width);
+    try t.expectEqual(9, image.height);
+    try t.expectEqual(17 * 9 * 4, image.data.len);
+    try t.expectEqual(255, image.data[3]);
+
+    // A larger area replaces the shared memory image.
+    const full = try capture.capture.screenshot(null);
+    defer t.allocator.free(full.data);
+    try t.expectEqual(capture.screen_width, full.width);
+    try t.expectEqual(capture.screen_height, full.height);
+}
+
+test "X11ScreenCapture – recording delivers frames until stopped" {
+    const Counter = struct {
+        frames: usize = 0,
+
+        fn onFrame(ptr: *anyopaque, frame: core.Frame) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            t.allocator.free(frame.image.data);
+            self.frames += 1;
+        }
+    };
+
+    var counter = Counter{};
+    var capture = try initForTest(&counter);
+    defer capture.deinit();
+    capture.capture.rect = .{ .x = 0, .y = 0, .width = 32, .height = 32 };
+    capture.capture.frames_per_second = 200;
+    capture.capture.setFrameHandler(&Counter.onFrame);
+
+    const thread = try std.Thread.spawn(.{}, Capturer.begin, .{&capture.capture});
+    std.time.sleep(50 * std.time.ns_per_ms);
+    try capture.capture.end();
+    thread.join();
+    try t.expect(counter.frames > 0);
+}
+
+test "X11ScreenCapture – incremental recording reports what was drawn" {
+    const color = [_]u8{ 0x00, 0x80, 0xFF, 0xFF }; // BGRA
+    const drawn = core.DamageRect{ .x = 10, .y = 20, .width = 30, .height = 40 };
+
+    const Recorder = struct {
+        mutex: std.Thread.Mutex = .{},
+        frames: usize = 0,
+        found: bool = false,
+
+        fn onFrame(ptr: *anyopaque, frame: core.Frame) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            defer t.allocator.free(frame.image.data);
+
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            self.frames += 1;
+            // Only the first frame comes without damage, it's new as a whole.
+            const damage = frame.damage orelse {
+                if (self.frames > 1) return error.MissingDamage;
+                return;
+            };
+            defer t.allocator.free(damage);
+            if (self.frames == 1) return error.UnexpectedDamage;
+            for (damage) |rect| {
+                const covers = rect.x <= drawn.x and rect.y <= drawn.y and
+                    rect.x + rect.width >= drawn.x + drawn.width and
+                    rect.y + rect.height >= drawn.y + drawn.height;
+                const inside = frame.image.data[((drawn.y + 5) * frame.image.width + drawn.x + 5) * 4 ..][0..4];
+                if (covers and std.mem.eql(u8, inside, &color)) self.found = true;
+            }
+        }
+
+        fn framesSoFar(self: *@This()) usize {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            return self.frames;
+        }
+    };
+
+    var recorder = Recorder{};
+    var capture = try initForTest(&recorder);
+    defer capture.deinit();
+    if (!capture.has_damage) return error.SkipZigTest;
+    capture.capture.rect = .{ .x = 0, .y = 0, .width = 64, .height = 64 };
+    capture.capture.frames_per_second = 200;
+    capture.capture.incremental = true;
+    capture.capture.setFrameHandler(&Recorder.onFrame);
+
+    // Draw on the root window from another client.
+    const painter = x11.XOpenDisplay(null) orelse return error.SkipZigTest;
+    defer _ = x11.XCloseDisplay(painter);
+    const screen = x11.XDefaultScreen(painter);
+    const root = x11.XRootWindow(painter, screen);
+    const gc = x11.XCreateGC(painter, root, 0, null);
+    defer _ = x11.XFreeGC(painter, gc);
+    _ = x11.XSetSubwindowMode(painter, gc, x11.IncludeInferiors);
+    _ = x11.XSetForeground(painter, gc, 0xFF8000);
+
+    const thread = try std.Thread.spawn(.{}, Capturer.begin, .{&capture.capture});
+    // If the frame handler fails, recording stops and no frame ever arrives.
+    var waited_ms: usize = 0;
+    while (recorder.framesSoFar() == 0) : (waited_ms += 1) {
+        if (waited_ms == 5000) {
+            capture.capture.end() catch {};
+            thread.join();
+            return error.Timeout;
+        }
+        std.time.sleep(std.time.ns_per_ms);
+    }
+
+    _ = x11.XFillRectangle(painter, root, gc, drawn.x, drawn.y, drawn.width, drawn.height);
+    _ = x11.XSync(painter, x11.False);
+
+    std.time.sleep(100 * std.time.ns_per_ms);
+    try capture.capture.end();
+    thread.join();
+    try t.expect(recorder.found);
+}
@@ -2,6 +2,7 @@ const std = @import("std");
 const core_graphics = @cImport(@cInclude("CoreGraphics/CoreGraphics.h"));
 const objc = @import("objc");
 const core = @import("core.zig");
+const pixel = @import("pixel");
 const screencap = @cImport(@cInclude("screencap.h"));
 
 const CaptureError = core.FrametapError;
@@ -44,7 +45,8 @@ pub const MacOSScreenCapture = struct {
         const framebuf = try self.allocator.alloc(u8, bufsize);
         const c_buf: [*]u8 = image.rgba_buf;
 
-        @memcpy(framebuf, c_buf);
+        // Screenshots are RGBA, but CoreGraphics draws BGRA.
+        pixel.convert(.bgra, .rgba, c_buf[0..bufsize], framebuf);
         return core.ImageData{
             .width = image.width,
             .height = image.height,
@@ -67,13 +69,23 @@ pub const MacOSScreenCapture = struct {
 
         // From the cpature object, we can get a `self` pointer to this struct.
         const self: *Self = @fieldParentPtr("capture", capture);
-        const framebuf = self.allocator.alloc(u8, width * height * 4) catch return;
-        @memcpy(framebuf, @as([*]u8, cframe.image.rgba_buf));
-
-        const image = core.ImageData{
-            .width = width,
-            .height = height,
-            .data = framebuf,
+        const size = width * height * 4;
+
+        // Frames copied into a pooled buffer are handed on as they are: native code
+        // releases its reference once this returns, and the consumer releases the other.
+        const pooled = if (capture.frame_pool) |pool| pool.fromData(cframe.image.rgba_buf) else null;
+        const image = if (pooled) |buffer| blk: {
+            buffer.retain();
+            break :blk core.ImageData{
+                .width = width,
+                .height = height,
+                .data = buffer.memory[0..size],
+                .buffer = buffer,
+            };
+        } else blk: {
+            const copy = capture.allocImage(self.allocator, width, height) catch return;
+            @memcpy(copy.data, @as([*]u8, cframe.image.rgba_buf));
+            break :blk copy;
         };
 
         const frame = core.Frame{
@@ -84,9 +96,28 @@ pub const MacOSScreenCapture = struct {
         capture.onFrameReceived(self.frametap, frame) catch return;
     }
 
+    fn acquireBuffer(size: usize, ctx: ?*anyopaque) callconv(.C) [*c]u8 {
+        const pool: *core.FramePool = @ptrCast(@alignCast(ctx orelse unreachable));
+        const buffer = pool.acquire(size) catch return null;
+        return buffer.memory.ptr;
+    }
+
+    fn releaseBuffer(buf: [*c]u8, ctx: ?*anyopaque) callconv(.C) void {
+        const pool: *core.FramePool = @ptrCast(@alignCast(ctx orelse unreachable));
+        const buffer = pool.fromData(buf) orelse unreachable;
+        buffer.release();
+    }
+
     /// MacOS specific screen capture function.
     fn startCaptureMacOS(ctx: *Capturer) !void {
         const self: *Self = @fieldParentPtr("capture", ctx);
+        if (ctx.frame_pool) |pool| {
+            screencap.set_buffer_allocator(self.capture_c, .{
+                .acquire = &Self.acquireBuffer,
+                .release = &Self.releaseBuffer,
+                .ctx = pool,
+            });
+        }
         var frame_processor: screencap.FrameProcessor = undefined;
         frame_processor.other_data = &self.capture;
         frame_processor.process_fn = &Self.processCFrame;
@@ -116,6 +147,7 @@ pub const MacOSScreenCapture = struct {
             .screenshotFn = Self.screenshot,
             .stopRecordFn = Self.stopCaptureMacOS,
             .startRecordFn = Self.startCaptureMacOS,
+            .destroyFn = Self.destroyMacOS,
             .onFrameReceived = null,
         };
 
@@ -143,4 +175,10 @@ pub const MacOSScreenCapture = struct {
     pub fn deinit(self: MacOSScreenCapture) void {
         _ = screencap.deinit_capture(self.capture_c);
     }
+
+    fn destroyMacOS(capturer: *Capturer) void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.deinit();
+        self.allocator.destroy(self);
+    }
 };
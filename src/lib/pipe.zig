@@ -0,0 +1,248 @@
+const std = @import("std");
+const core = @import("core.zig");
+const yuv = @import("yuv.zig");
+
+const CaptureError = core.FrametapError;
+
+// A frame sink that streams BGRA frames to a file descriptor, e.g. stdout or a named pipe,
+// as YUV4MPEG2 or as raw BGRA, so that a separate process can encode the video:
+//
+//     frametap -r 1280x720 -d 10 --pipe y4m | ffmpeg -f yuv4mpegpipe -i - out.mp4
+//
+// Every frame is converted into one page aligned buffer and leaves in a single large
+// write, straight from the frame handler: frametap never queues frames for the reader.
+// When the reader falls behind, the pipe fills up, and the sink either blocks the capture
+// until there is room again, or drops the frames that don't fit.
+
+pub const PipeFormat = enum {
+    /// YUV4MPEG2, 4:2:0, BT.601 limited range.
+    y4m,
+    /// The frames as they are, 4 bytes per pixel, without a header.
+    bgra,
+};
+
+/// What to do with a frame when the pipe is full.
+pub const WhenFull = enum {
+    /// Wait for the reader, which slows down the capture.
+    block,
+    /// Skip the frame, and count it in `PipeSink.dropped`. Only whole frames are
+    /// skipped: once the first bytes of a frame are in the pipe, the rest is waited for,
+    /// so a write can still block for as long as the reader takes to drain one frame.
+    drop,
+};
+
+pub const PipeSinkConfig = struct {
+    format: PipeFormat = .y4m,
+    /// Size of every frame. Frames of another size are rejected.
+    width: usize,
+    height: usize,
+    /// Frame rate written to the Y4M header, as a fraction.
+    fps_num: u32 = 30,
+    fps_den: u32 = 1,
+    when_full: WhenFull = .block,
+};
+
+pub const PipeSink = struct {
+    const Self = @This();
+    const frame_tag = "FRAME\n";
+
+    allocator: std.mem.Allocator,
+    fd: std.posix.fd_t,
+    config: PipeSinkConfig,
+    /// A whole frame as it's written: for Y4M, the "FRAME" line and the planes.
+    buffer: []align(std.mem.page_size) u8,
+    /// File status flags of `fd` before the sink made it non-blocking, to restore on `deinit`.
+    original_flags: ?usize = null,
+    /// Number of frames skipped because the pipe was full.
+    dropped: usize = 0,
+
+    /// Write the stream header, if the format has one, to `fd`.
+    /// With `.drop`, `fd` is made non-blocking until `deinit`. Its file description
+    /// may be shared with other processes (stdout usually is), which will see that too.
+    pub fn init(allocator: std.mem.Allocator, fd: std.posix.fd_t, config: PipeSinkConfig) !Self {
+        if (config.width == 0 or config.height == 0) return CaptureError.FrameSizeMismatch;
+
+        const size = switch (config.format) {
+            .y4m => frame_tag.len + yuvSize(config.width, config.height),
+            .bgra => config.width * config.height * 4,
+        };
+        const buffer = try allocator.alignedAlloc(u8, std.mem.page_size, size);
+        errdefer allocator.free(buffer);
+
+        var self = Self{
+            .allocator = allocator,
+            .fd = fd,
+            .config = config,
+            .buffer = buffer,
+        };
+
+        if (config.format == .y4m) {
+            @memcpy(buffer[0..frame_tag.len], frame_tag);
+            var header_buf: [128]u8 = undefined;
+            const header = try std.fmt.bufPrint(
+                &header_buf,
+                "YUV4MPEG2 W{d} H{d} F{d}:{d} Ip A1:1 C420jpeg\n",
+                .{ config.width, config.height, config.fps_num, config.fps_den },
+            );
+            _ = try self.send(header, .block);
+        }
+
+        if (config.when_full == .drop) {
+            const flags = try std.posix.fcntl(fd, std.posix.F.GETFL, 0);
+            const nonblock: u32 = @bitCast(std.posix.O{ .NONBLOCK = true });
+            _ = try std.posix.fcntl(fd, std.posix.F.SETFL, flags | nonblock);
+            self.original_flags = flags;
+        }
+        return self;
+    }
+
+    /// Restore the flags of the file descriptor, and free the buffer.
+    /// The file descriptor stays open.
+    pub fn deinit(self: *Self) void {
+        if (self.original_flags) |flags| {
+            _ = std.posix.fcntl(self.fd, std.posix.F.SETFL, flags) catch {};
+        }
+        self.allocator.free(self.buffer);
+    }
+
+    fn yuvSize(width: usize, height: usize) usize {
+        const chroma = yuv.Subsampling.yuv420.chromaSize(width) * yuv.Subsampling.yuv420.chromaSize(height);
+        return width * height + 2 * chroma;
+    }
+
+    /// Write a BGRA frame whose rows start every `row_stride` bytes (0 when they are
+    /// tightly packed). Returns false if the frame was dropped because the pipe was full.
+    /// The frame is written before this returns, so the caller keeps its buffer.
+    /// With `.drop`, a frame is only dropped if none of it could be written; a frame
+    /// that the pipe took part of is finished, blocking until the reader makes room.
+    pub fn writeFrame(self: *Self, image: core.ImageData, row_stride: usize) !bool {
+        const width = self.config.width;
+        const height = self.config.height;
+        if (image.width != width or image.height != height) return CaptureError.FrameSizeMismatch;
+        const stride = if (row_stride == 0) width * 4 else row_stride;
+        if (image.data.len < (height - 1) * stride + width * 4) return CaptureError.FrameSizeMismatch;
+
+        // Don't convert a frame that can't be written anyway.
+        if (self.config.when_full == .drop and !try self.writable()) {
+            self.dropped += 1;
+            return false;
+        }
+
+        const data = switch (self.config.format) {
+            .y4m => blk: {
+                yuv.bgraToPlanes420(image.data, width, height, stride, self.buffer[frame_tag.len..]);
+                break :blk self.buffer;
+            },
+            // Packed frames can go out from the caller's buffer, without a copy.
+            .bgra => if (stride == width * 4) image.data[0 .. width * height * 4] else blk: {
+                for (0..height) |row| {
+                    @memcpy(self.buffer[row * width * 4 ..][0 .. width * 4], image.data[row * stride ..][0 .. width * 4]);
+                }
+                break :blk self.buffer;
+            },
+        };
+
+        if (!try self.send(data, self.config.when_full)) {
+            self.dropped += 1;
+            return false;
+        }
+        return true;
+    }
+
+    /// Whether the reader has made room in the pipe since the last write.
+    fn writable(self: *Self) !bool {
+        var fds = [_]std.posix.pollfd{.{ .fd = self.fd, .events = std.posix.POLL.OUT, .revents = 0 }};
+        return try std.posix.poll(&fds, 0) > 0;
+    }
+
+    /// Write all of `data`. With `.drop`, gives up and returns false if the pipe is full
+    /// before the first byte is written. Once some of it is written, waits for the rest,
+    /// since a partial frame would corrupt the stream.
+    fn send(self: *Self, data: []const u8, when_full: WhenFull) !bool {
+        var written: usize = 0;
+        while (written < data.len) {
+            written += std.posix.write(self.fd, data[written..]) catch |err| switch (err) {
+                error.WouldBlock => {
+                    if (written == 0 and when_full == .drop) return false;
+                    var fds = [_]std.posix.pollfd{.{ .fd = self.fd, .events = std.posix.POLL.OUT, .revents = 0 }};
+                    _ = try std.posix.poll(&fds, -1);
+                    continue;
+                },
+                else => return err,
+            };
+        }
+        return true;
+    }
+};
+
+/// A frame handler that writes every frame to a `PipeSink`:
+///
+///     var tap = try core.FrameTap(*PipeSink).init(allocator, &sink, null);
+///     tap.onFrame(writePipeFrame);
+///
+/// Frames are written synchronously, then given back with the sink's allocator,
+/// which must be the one that the frametap was made with.
+/// Dropped frames are counted in `sink.dropped`.
+pub fn writePipeFrame(sink: *PipeSink, frame: core.Frame) anyerror!void {
+    defer frame.deinit(sink.allocator);
+    _ = try sink.writeFrame(frame.image, frame.image.row_stride);
+}
+
+const t = std.testing;
+
+test "PipeSink – writes a Y4M stream" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    var sink = try PipeSink.init(t.allocator, fds[1], .{ .width = 3, .height = 2, .fps_num = 25 });
+    defer sink.deinit();
+
+    // A white row and a black row.
+    var pixels = [_]u8{255} ** 12 ++ [_]u8{ 0, 0, 0, 255 } ** 3;
+    try t.expect(try sink.writeFrame(.{ .data = &pixels, .width = 3, .height = 2 }, 0));
+
+    const expected = "YUV4MPEG2 W3 H2 F25:1 Ip A1:1 C420jpeg\n" ++
+        "FRAME\n" ++ [_]u8{ 235, 235, 235, 16, 16, 16 } ++ [_]u8{128} ** 4;
+    var out: [expected.len]u8 = undefined;
+    const file = std.fs.File{ .handle = fds[0] };
+    try file.reader().readNoEof(&out);
+    try t.expectEqualSlices(u8, expected, &out);
+}
+
+test "PipeSink – drops whole frames when the reader falls behind" {
+    const fds = try std.posix.pipe();
+    defer std.posix.close(fds[0]);
+    defer std.posix.close(fds[1]);
+
+    const width = 64;
+    const height = 64;
+    var sink = try PipeSink.init(t.allocator, fds[1], .{
+        .format = .bgra,
+        .width = width,
+        .height = height,
+        .when_full = .drop,
+    });
+    defer sink.deinit();
+
+    // Nobody reads, so the pipe fills up after a few frames.
+    var pixels: [width * height * 4]u8 = undefined;
+    var written: usize = 0;
+    for (0..64) |i| {
+        @memset(&pixels, @intCast(i));
+        if (try sink.writeFrame(.{ .data = &pixels, .width = width, .height = height }, 0)) written += 1;
+    }
+    try t.expect(written > 0);
+    try t.expect(sink.dropped > 0);
+    try t.expectEqual(64, written + sink.dropped);
+
+    // The reader gets the frames that were written, whole and in order.
+    const file = std.fs.File{ .handle = fds[0] };
+    var last: ?u8 = null;
+    for (0..written) |_| {
+        try file.reader().readNoEof(&pixels);
+        try t.expect(std.mem.allEqual(u8, &pixels, pixels[0]));
+        if (last) |previous| try t.expect(pixels[0] > previous);
+        last = pixels[0];
+    }
+}
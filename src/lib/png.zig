@@ -1,7 +1,11 @@
 const std = @import("std");
-const stb = @cImport(@cInclude("load_image.h"));
+const zpng = @import("zpng");
+const core = @import("core.zig");
 
-const FrameTapError = @import("core.zig").FrametapError;
+pub const PixelFormat = zpng.PixelFormat;
+pub const EncodeOptions = zpng.EncodeOptions;
+pub const PngSequence = zpng.PngSequence;
+pub const SequenceConfig = zpng.SequenceConfig;
 
 /// Convert an RGBA frame to a PNG file.
 pub fn writeRgbaToPng(
@@ -11,19 +15,49 @@ pub fn writeRgbaToPng(
     height: usize,
     file_path: [:0]const u8,
 ) !void {
-    const rgb = try allocator.alloc(u8, width * height * 3);
-    defer allocator.free(rgb);
+    try writeToPng(allocator, buf, width, height, 0, .rgba, file_path, .{});
+}
 
-    for (width * height) |i| {
-        const rgba_offset = i * 4;
-        const rgb_offset = i * 3;
-        rgb[rgb_offset] = buf[rgba_offset];
-        rgb[rgb_offset + 1] = buf[rgba_offset + 1];
-        rgb[rgb_offset + 2] = buf[rgba_offset + 2];
-    }
+/// Convert a frame of 4 byte pixels to a PNG file, straight from the capture buffer.
+/// Rows start every `row_stride` bytes (0 when they are tightly packed),
+/// so padded buffers from the OS don't need to be copied first.
+/// The rows are filtered and compressed on several threads.
+pub fn writeToPng(
+    allocator: std.mem.Allocator,
+    buf: []const u8,
+    width: usize,
+    height: usize,
+    row_stride: usize,
+    format: PixelFormat,
+    file_path: [:0]const u8,
+    options: EncodeOptions,
+) !void {
+    try zpng.encodeFile(allocator, file_path, .{
+        .pixels = buf,
+        .width = width,
+        .height = height,
+        .row_stride = row_stride,
+        .format = format,
+    }, options);
+}
 
-    const ok = stb.write_image_to_png(file_path.ptr, rgb.ptr, width, height);
-    if (!ok) {
-        return FrameTapError.PNGConvertFailed;
-    }
+/// A `FrameTap` frame handler that queues every frame on a PNG sequence:
+///
+///     const sequence = try PngSequence.init(allocator, .{ .dir_path = "frames" });
+///     const frametap = try FrameTap(*PngSequence).init(allocator, sequence, rect);
+///     frametap.onFrame(queuePngFrame);
+///
+/// The pixels are copied into the sequence, and the frame is given back right away,
+/// with the sequence's allocator: it must be the one that the frametap was made with.
+/// This returns without waiting for the frame to be encoded.
+pub fn queuePngFrame(sequence: *PngSequence, frame: core.Frame) anyerror!void {
+    defer frame.deinit(sequence.allocator);
+    _ = try sequence.addFrame(.{
+        .pixels = frame.image.data,
+        .width = frame.image.width,
+        .height = frame.image.height,
+        .row_stride = frame.image.row_stride,
+        // Recorded frames are BGRA.
+        .format = .bgra,
+    });
 }
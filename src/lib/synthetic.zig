@@ -0,0 +1,366 @@
+const std = @import("std");
+const core = @import("core.zig");
+const pixel = @import("pixel");
+
+const CaptureError = core.FrametapError;
+const Capturer = core.ICapturer;
+const Rect = core.Rect;
+
+// A capturer that doesn't need a display: it either generates screen-like frames,
+// or replays raw BGRA frames (width * height * 4 bytes each, back to back) from a file.
+// Frames are a function of their index alone, and their durations are exactly
+// 1000 / `ICapturer.frames_per_second` ms, so every run delivers the same frames.
+// Without `realtime`, frames are delivered as fast as the frame handler takes them,
+// which makes this the source for benchmarks and regression tests of the encoders.
+
+pub const SyntheticContent = enum {
+    /// Lines of dark glyphs on a light background, scrolling up: like a terminal or an editor.
+    scrolling_text,
+    /// A smooth gradient sliding across the screen.
+    gradient,
+    /// A gradient under per-pixel noise that changes every frame, like camera footage.
+    noise,
+};
+
+pub const SyntheticConfig = struct {
+    content: SyntheticContent = .scrolling_text,
+    width: usize = 1280,
+    height: usize = 720,
+    seed: u64 = 0,
+    /// Number of frames to deliver before `begin` returns. 0 means until `end` is called.
+    frame_count: usize = 0,
+    /// Pace the frames at `ICapturer.frames_per_second` instead of delivering them at once.
+    realtime: bool = false,
+};
+
+pub const ReplayConfig = struct {
+    /// File of raw BGRA frames.
+    path: []const u8,
+    width: usize,
+    height: usize,
+    /// Start over after the last frame, instead of returning from `begin`.
+    loop: bool = false,
+    /// Number of frames to deliver before `begin` returns. 0 means the whole file (once).
+    frame_count: usize = 0,
+    /// Pace the frames at `ICapturer.frames_per_second` instead of delivering them at once.
+    realtime: bool = false,
+};
+
+pub const SyntheticCapture = struct {
+    const Self = @This();
+    allocator: std.mem.Allocator,
+    capture: core.ICapturer,
+
+    source: union(enum) {
+        generated: SyntheticContent,
+        /// The mapped file.
+        replay: []align(std.mem.page_size) const u8,
+    },
+    width: usize,
+    height: usize,
+    seed: u64 = 0,
+    frame_count: usize,
+    loop: bool = false,
+    realtime: bool,
+    /// Index of the next frame.
+    next_frame: usize = 0,
+    stop_requested: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    /// Pointer to the user-facing `frametap` struct that contains the user provided
+    /// `onFrame` callback.
+    frametap: *anyopaque,
+
+    pub fn initSynthetic(
+        allocator: std.mem.Allocator,
+        config: SyntheticConfig,
+        frametap: *anyopaque,
+    ) Self {
+        return Self{
+            .allocator = allocator,
+            .capture = Capturer.init(captureConfig()),
+            .source = .{ .generated = config.content },
+            .width = config.width,
+            .height = config.height,
+            .seed = config.seed,
+            .frame_count = config.frame_count,
+            .realtime = config.realtime,
+            .frametap = frametap,
+        };
+    }
+
+    pub fn initReplay(
+        allocator: std.mem.Allocator,
+        config: ReplayConfig,
+        frametap: *anyopaque,
+    ) !Self {
+        const file = try std.fs.cwd().openFile(config.path, .{});
+        defer file.close();
+
+        const frame_size = config.width * config.height * 4;
+        const size: usize = @intCast(try file.getEndPos());
+        if (frame_size == 0 or size < frame_size) return CaptureError.InvalidReplayFile;
+
+        const data = try std.posix.mmap(
+            null,
+            size,
+            std.posix.PROT.READ,
+            .{ .TYPE = .PRIVATE },
+            file.handle,
+            0,
+        );
+
+        return Self{
+            .allocator = allocator,
+            .capture = Capturer.init(captureConfig()),
+            .source = .{ .replay = data },
+            .width = config.width,
+            .height = config.height,
+            .frame_count = config.frame_count,
+            .loop = config.loop,
+            .realtime = config.realtime,
+            .frametap = frametap,
+        };
+    }
+
+    fn captureConfig() core.CaptureConfig {
+        return .{
+            .rect = null,
+            .screenshotFn = Self.screenshot,
+            .startRecordFn = Self.startCaptureSynthetic,
+            .stopRecordFn = Self.stopCaptureSynthetic,
+            .destroyFn = Self.destroy,
+            .onFrameReceived = null,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        switch (self.source) {
+            .generated => {},
+            .replay => |data| std.posix.munmap(data),
+        }
+    }
+
+    fn destroy(capturer: *Capturer) void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.deinit();
+        self.allocator.destroy(self);
+    }
+
+    /// Number of frames in the replayed file.
+    fn replayFrames(self: *const Self, data: []const u8) usize {
+        return data.len / (self.width * self.height * 4);
+    }
+
+    /// Render or load frame `index` into a new image.
+    fn frameAt(self: *Self, index: usize) !core.ImageData {
+        const image = try self.capture.allocImage(self.allocator, self.width, self.height);
+        const framebuf = image.data;
+        switch (self.source) {
+            .generated => |content| render(content, self.seed, index, self.width, self.height, framebuf),
+            .replay => |data| {
+                const offset = (index % self.replayFrames(data)) * framebuf.len;
+                @memcpy(framebuf, data[offset..][0..framebuf.len]);
+            },
+        }
+        return image;
+    }
+
+    /// The frame that recording would deliver next. Frames always have the configured size,
+    /// so `rect` is ignored.
+    fn screenshot(ctx: *core.ICapturer, _: ?Rect) !core.ImageData {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const image = try self.frameAt(self.next_frame);
+        // Screenshots are RGBA, frames are BGRA.
+        pixel.swapRedBlueInPlace(image.data);
+        return image;
+    }
+
+    fn startCaptureSynthetic(ctx: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const fps = @max(ctx.frames_per_second, 0.1);
+        const frame_ms = 1000 / fps;
+        const frame_ns: u64 = @intFromFloat(std.time.ns_per_s / fps);
+
+        var last_frame = self.frame_count;
+        if (self.source == .replay and !self.loop) {
+            const nframes = self.replayFrames(self.source.replay);
+            last_frame = if (last_frame == 0) nframes else @min(last_frame, nframes);
+        }
+
+        var timer = try std.time.Timer.start();
+        var delivered: u64 = 0;
+        while (!self.stop_requested.swap(false, .acq_rel)) : (delivered += 1) {
+            if (last_frame != 0 and self.next_frame >= last_frame) break;
+
+            const image = try self.frameAt(self.next_frame);
+            self.next_frame += 1;
+            try ctx.onFrameReceived(self.frametap, .{ .image = image, .duration_ms = frame_ms });
+
+            if (self.realtime) {
+                // Sleep until the next frame is due, so that delays don't add up.
+                const due = (delivered + 1) * frame_ns;
+                const now = timer.read();
+                if (now < due) std.time.sleep(due - now);
+            }
+        }
+    }
+
+    /// Makes `startCaptureSynthetic` return before the next frame.
+    fn stopCaptureSynthetic(capturer: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.stop_requested.store(true, .release);
+    }
+};
+
+/// A cheap, well mixed hash of a few integers (the finalizer of splitmix64).
+fn mix(a: u64, b: u64, c: u64) u64 {
+    var z = a *% 0x9E3779B97F4A7C15 +% b *% 0xBF58476D1CE4E5B9 +% c *% 0x94D049BB133111EB;
+    z = (z ^ (z >> 30)) *% 0xBF58476D1CE4E5B9;
+    z = (z ^ (z >> 27)) *% 0x94D049BB133111EB;
+    return z ^ (z >> 31);
+}
+
+/// Draw frame `index` of `content` into `out`, as BGRA.
+pub fn render(
+    content: SyntheticContent,
+    seed: u64,
+    index: usize,
+    width: usize,
+    height: usize,
+    out: []u8,
+) void {
+    std.debug.assert(out.len == width * height * 4);
+    for (0..height) |y| {
+        const row = out[y * width * 4 ..][0 .. width * 4];
+        switch (content) {
+            .scrolling_text => textRow(seed, index, y, row),
+            .gradient, .noise => for (0..width) |x| {
+                const px = row[x * 4 ..][0..4];
+                // Slides two pixels to the left per frame.
+                const u = x + 2 * index;
+                px[0] = @truncate(u);
+                px[1] = @truncate((u + y) / 2);
+                px[2] = @truncate(y);
+                px[3] = 255;
+                if (content == .noise) {
+                    const grain: u8 = @truncate(mix(seed, index, y * width + x) & 31);
+                    for (px[0..3]) |*channel| channel.* = channel.* -| 16 +| grain;
+                }
+            },
+        }
+    }
+}
+
+/// Draw row `y` of the scrolling text: lines of 16 pixels, and glyphs of 5x7 pixels
+/// in 8x16 cells, scrolled up one pixel per frame.
+fn textRow(seed: u64, index: usize, y: usize, row: []u8) void {
+    const background = [4]u8{ 0xF0, 0xF0, 0xF0, 0xFF };
+    const ink = [4]u8{ 0x30, 0x28, 0x20, 0xFF };
+
+    const page_y = y + index;
+    const line = page_y / 16;
+    const glyph_row = page_y % 16;
+    // Every line stops somewhere, like text does. Rows narrower than a cell hold one.
+    const line_len = 1 + mix(seed, line, 0) % @max(row.len / 32, 1);
+
+    for (0..row.len / 4) |x| {
+        const col = x / 8;
+        const glyph_col = x % 8;
+        var is_ink = false;
+        if (col < line_len and glyph_row >= 4 and glyph_row < 11 and glyph_col >= 1 and glyph_col < 6) {
+            const glyph = mix(seed, line, col + 1);
+            // One cell in seven is a space between words.
+            if (glyph % 7 != 0) {
+                const bit: u6 = @intCast((glyph_row - 4) * 5 + glyph_col - 1);
+                is_ink = (glyph >> bit) & 1 == 1;
+            }
+        }
+        row[x * 4 ..][0..4].* = if (is_ink) ink else background;
+    }
+}
+
+const t = std.testing;
+
+test "render – frames depend only on their index" {
+    const width = 40;
+    const height = 24;
+    var a: [width * height * 4]u8 = undefined;
+    var b: [width * height * 4]u8 = undefined;
+
+    for ([_]SyntheticContent{ .scrolling_text, .gradient, .noise }) |content| {
+        render(content, 7, 3, width, height, &a);
+        render(content, 7, 4, width, height, &b);
+        render(content, 7, 3, width, height, &b);
+        try t.expectEqualSlices(u8, &a, &b);
+
+        render(content, 7, 4, width, height, &b);
+        try t.expect(!std.mem.eql(u8, &a, &b));
+    }
+}
+
+test "render – text fits in frames narrower than a glyph cell" {
+    var frame: [3 * 20 * 4]u8 = undefined;
+    for (0..4) |index| render(.scrolling_text, 7, index, 3, 20, &frame);
+}
+
+test "SyntheticCapture – replays a file with exact durations" {
+    const allocator = t.allocator;
+    var tmp = t.tmpDir(.{});
+    defer tmp.cleanup();
+
+    const width = 3;
+    const height = 2;
+    const frame_size = width * height * 4;
+    var frames: [3 * frame_size]u8 = undefined;
+    for (&frames, 0..) |*byte, i| byte.* = @intCast(i / frame_size);
+    try tmp.dir.writeFile2(.{ .sub_path = "frames.bgra", .data = &frames });
+    const path = try tmp.dir.realpathAlloc(allocator, "frames.bgra");
+    defer allocator.free(path);
+
+    const Collector = struct {
+        firsts: [8]u8 = undefined,
+        count: usize = 0,
+        duration_ms: f64 = 0,
+
+        fn onFrame(ptr: *anyopaque, frame: core.Frame) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            defer t.allocator.free(frame.image.data);
+            self.firsts[self.count] = frame.image.data[0];
+            self.count += 1;
+            self.duration_ms = frame.duration_ms;
+        }
+    };
+
+    var collector = Collector{};
+    var capture = try SyntheticCapture.initReplay(allocator, .{
+        .path = path,
+        .width = width,
+        .height = height,
+        .loop = true,
+        .frame_count = 5,
+    }, &collector);
+    defer capture.deinit();
+    capture.capture.frames_per_second = 25;
+    capture.capture.setFrameHandler(&Collector.onFrame);
+
+    try capture.capture.begin();
+    try t.expectEqualSlices(u8, &[_]u8{ 0, 1, 2, 0, 1 }, collector.firsts[0..collector.count]);
+    try t.expectEqual(40, collector.duration_ms);
+}
+
+test "SyntheticCapture – screenshots are RGBA" {
+    const allocator = t.allocator;
+    var tmp = t.tmpDir(.{});
+    defer tmp.cleanup();
+    try tmp.dir.writeFile2(.{ .sub_path = "frame.bgra", .data = &[_]u8{ 1, 2, 3, 4 } });
+    const path = try tmp.dir.realpathAlloc(allocator, "frame.bgra");
+    defer allocator.free(path);
+
+    var dummy: u8 = 0;
+    var capture = try SyntheticCapture.initReplay(allocator, .{ .path = path, .width = 1, .height = 1 }, &dummy);
+    defer capture.deinit();
+
+    const image = try capture.capture.screenshot(null);
+    defer allocator.free(image.data);
+    try t.expectEqualSlices(u8, &[_]u8{ 3, 2, 1, 4 }, image.data);
+}
@@ -0,0 +1,293 @@
+const std = @import("std");
+const core = @import("core.zig");
+const yuv = @import("yuv.zig");
+const pixel = @import("pixel");
+
+const CaptureError = core.FrametapError;
+const Capturer = core.ICapturer;
+const Rect = core.Rect;
+
+// A capturer that reads frames from an uncompressed YUV4MPEG2 stream, e.g. the output of
+// `ffmpeg -i video.mp4 -f yuv4mpegpipe -`.
+// A stream is a header line with the size, frame rate and chroma format, then frames,
+// each a "FRAME" line followed by the Y, U and V planes.
+// See: https://wiki.multimedia.cx/index.php/YUV4MPEG2
+
+pub const Y4mConfig = struct {
+    /// File to read. Null means stdin.
+    path: ?[]const u8 = null,
+    /// Pace the frames at the stream's frame rate instead of delivering them as they are read.
+    realtime: bool = false,
+};
+
+pub const Header = struct {
+    width: usize,
+    height: usize,
+    fps_num: u32 = 25,
+    fps_den: u32 = 1,
+    subsampling: yuv.Subsampling = .yuv420,
+    range: yuv.Range = .limited,
+
+    /// Size of the three planes of a frame, in bytes.
+    pub fn frameSize(self: Header) usize {
+        const chroma = self.subsampling.chromaSize(self.width) * self.subsampling.chromaSize(self.height);
+        return self.width * self.height + 2 * chroma;
+    }
+
+    pub fn frameDurationMs(self: Header) f64 {
+        return 1000 * @as(f64, @floatFromInt(self.fps_den)) / @as(f64, @floatFromInt(self.fps_num));
+    }
+};
+
+/// Parse the header line, without its "\n".
+pub fn parseHeader(line: []const u8) !Header {
+    var tokens = std.mem.tokenizeScalar(u8, line, ' ');
+    const magic = tokens.next() orelse return CaptureError.InvalidY4m;
+    if (!std.mem.eql(u8, magic, "YUV4MPEG2")) return CaptureError.InvalidY4m;
+
+    var width: ?usize = null;
+    var height: ?usize = null;
+    var header = Header{ .width = 0, .height = 0 };
+    while (tokens.next()) |token| {
+        const value = token[1..];
+        switch (token[0]) {
+            'W' => width = std.fmt.parseInt(usize, value, 10) catch return CaptureError.InvalidY4m,
+            'H' => height = std.fmt.parseInt(usize, value, 10) catch return CaptureError.InvalidY4m,
+            'F' => {
+                const colon = std.mem.indexOfScalar(u8, value, ':') orelse return CaptureError.InvalidY4m;
+                header.fps_num = std.fmt.parseInt(u32, value[0..colon], 10) catch return CaptureError.InvalidY4m;
+                header.fps_den = std.fmt.parseInt(u32, value[colon + 1 ..], 10) catch return CaptureError.InvalidY4m;
+                if (header.fps_num == 0 or header.fps_den == 0) return CaptureError.InvalidY4m;
+            },
+            'C' => {
+                // 420jpeg, 420mpeg2 and 420paldv only differ in where chroma samples sit.
+                // Other variants, like 420p10, have more than 8 bits per sample.
+                header.subsampling = if (isOneOf(value, &.{ "420", "420jpeg", "420mpeg2", "420paldv" }))
+                    .yuv420
+                else if (std.mem.eql(u8, value, "444"))
+                    .yuv444
+                else
+                    return CaptureError.UnsupportedY4m;
+            },
+            'I' => if (value.len > 0 and value[0] != 'p' and value[0] != '?') {
+                return CaptureError.UnsupportedY4m;
+            },
+            'X' => if (std.mem.eql(u8, value, "COLORRANGE=FULL")) {
+                header.range = .full;
+            },
+            // Pixel aspect ratio and unknown tags don't matter here.
+            else => {},
+        }
+    }
+
+    header.width = width orelse return CaptureError.InvalidY4m;
+    header.height = height orelse return CaptureError.InvalidY4m;
+    if (header.width == 0 or header.height == 0) return CaptureError.InvalidY4m;
+    return header;
+}
+
+fn isOneOf(value: []const u8, names: []const []const u8) bool {
+    for (names) |name| {
+        if (std.mem.eql(u8, value, name)) return true;
+    }
+    return false;
+}
+
+pub const Y4mCapture = struct {
+    const Self = @This();
+    const Reader = std.io.BufferedReader(64 * 1024, std.fs.File.Reader);
+
+    allocator: std.mem.Allocator,
+    capture: core.ICapturer,
+
+    file: std.fs.File,
+    /// Stdin isn't ours to close.
+    owns_file: bool,
+    reader: Reader,
+    header: Header,
+    /// The planes of the last frame read.
+    planes: []u8,
+    realtime: bool,
+    stop_requested: std.atomic.Value(bool) = std.atomic.Value(bool).init(false),
+
+    /// Pointer to the user-facing `frametap` struct that contains the user provided
+    /// `onFrame` callback.
+    frametap: *anyopaque,
+
+    /// Open the stream and read its header.
+    pub fn init(allocator: std.mem.Allocator, config: Y4mConfig, frametap: *anyopaque) !Self {
+        const file = if (config.path) |path|
+            try std.fs.cwd().openFile(path, .{})
+        else
+            std.io.getStdIn();
+        errdefer if (config.path != null) file.close();
+
+        var reader = Reader{ .unbuffered_reader = file.reader() };
+        var line_buf: [256]u8 = undefined;
+        const line = reader.reader().readUntilDelimiter(&line_buf, '\n') catch
+            return CaptureError.InvalidY4m;
+        const header = try parseHeader(line);
+
+        const planes = try allocator.alloc(u8, header.frameSize());
+        return Self{
+            .allocator = allocator,
+            .capture = Capturer.init(.{
+                .rect = null,
+                .screenshotFn = Self.screenshot,
+                .startRecordFn = Self.startCaptureY4m,
+                .stopRecordFn = Self.stopCaptureY4m,
+                .destroyFn = Self.destroy,
+                .onFrameReceived = null,
+            }),
+            .file = file,
+            .owns_file = config.path != null,
+            .reader = reader,
+            .header = header,
+            .planes = planes,
+            .realtime = config.realtime,
+            .frametap = frametap,
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.allocator.free(self.planes);
+        if (self.owns_file) self.file.close();
+    }
+
+    fn destroy(capturer: *Capturer) void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.deinit();
+        self.allocator.destroy(self);
+    }
+
+    /// Width and height of the frames of a capturer made with the `.y4m` backend.
+    pub fn frameSize(capturer: *Capturer) [2]usize {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        return .{ self.header.width, self.header.height };
+    }
+
+    /// Frame rate of a capturer made with the `.y4m` backend, as numerator and denominator.
+    pub fn frameRate(capturer: *Capturer) [2]u32 {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        return .{ self.header.fps_num, self.header.fps_den };
+    }
+
+    /// Read the next frame, and convert it to a new BGRA image.
+    /// Returns null at the end of the stream.
+    fn nextImage(self: *Self) !?core.ImageData {
+        const reader = self.reader.reader();
+        var line_buf: [256]u8 = undefined;
+        // Frame parameters, if any, follow "FRAME" on the same line.
+        const line = reader.readUntilDelimiter(&line_buf, '\n') catch |err| switch (err) {
+            error.EndOfStream => return null,
+            else => return err,
+        };
+        if (!std.mem.startsWith(u8, line, "FRAME")) return CaptureError.InvalidY4m;
+        reader.readNoEof(self.planes) catch |err| switch (err) {
+            error.EndOfStream => return CaptureError.InvalidY4m,
+            else => return err,
+        };
+
+        const width = self.header.width;
+        const height = self.header.height;
+        const image = try self.capture.allocImage(self.allocator, width, height);
+        yuv.planesToBgra(self.planes, width, height, self.header.subsampling, self.header.range, image.data);
+        return image;
+    }
+
+    /// The next frame of the stream. Frames always have the stream's size, so `rect` is ignored.
+    fn screenshot(ctx: *core.ICapturer, _: ?Rect) !core.ImageData {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const image = (try self.nextImage()) orelse return error.EndOfStream;
+        // Screenshots are RGBA, frames are BGRA.
+        pixel.swapRedBlueInPlace(image.data);
+        return image;
+    }
+
+    /// Deliver the frames of the stream until it ends, or `stopCaptureY4m` is called.
+    fn startCaptureY4m(ctx: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", ctx);
+        const frame_ms = self.header.frameDurationMs();
+        const frame_ns: u64 = @intFromFloat(frame_ms * std.time.ns_per_ms);
+
+        var timer = try std.time.Timer.start();
+        var delivered: u64 = 0;
+        while (!self.stop_requested.swap(false, .acq_rel)) : (delivered += 1) {
+            const image = (try self.nextImage()) orelse break;
+            try ctx.onFrameReceived(self.frametap, .{ .image = image, .duration_ms = frame_ms });
+
+            if (self.realtime) {
+                const due = (delivered + 1) * frame_ns;
+                const now = timer.read();
+                if (now < due) std.time.sleep(due - now);
+            }
+        }
+    }
+
+    /// Makes `startCaptureY4m` return before the next frame.
+    fn stopCaptureY4m(capturer: *Capturer) !void {
+        const self: *Self = @fieldParentPtr("capture", capturer);
+        self.stop_requested.store(true, .release);
+    }
+};
+
+const t = std.testing;
+
+test "parseHeader" {
+    const header = try parseHeader("YUV4MPEG2 W640 H360 F30000:1001 Ip A1:1 C420jpeg XYSCSS=420JPEG");
+    try t.expectEqual(640, header.width);
+    try t.expectEqual(360, header.height);
+    try t.expectEqual(yuv.Subsampling.yuv420, header.subsampling);
+    try t.expectEqual(yuv.Range.limited, header.range);
+    try t.expectApproxEqAbs(33.367, header.frameDurationMs(), 0.001);
+    try t.expectEqual(640 * 360 * 3 / 2, header.frameSize());
+
+    const full = try parseHeader("YUV4MPEG2 W3 H3 F25:1 C444 XCOLORRANGE=FULL");
+    try t.expectEqual(yuv.Subsampling.yuv444, full.subsampling);
+    try t.expectEqual(yuv.Range.full, full.range);
+    try t.expectEqual(27, full.frameSize());
+
+    try t.expectError(CaptureError.InvalidY4m, parseHeader("YUV4MPEG2 W3 F25:1"));
+    try t.expectError(CaptureError.UnsupportedY4m, parseHeader("YUV4MPEG2 W3 H3 C422"));
+    try t.expectError(CaptureError.UnsupportedY4m, parseHeader("YUV4MPEG2 W3 H3 C420p10"));
+    try t.expectEqual(yuv.Subsampling.yuv420, (try parseHeader("YUV4MPEG2 W3 H3 C420mpeg2")).subsampling);
+    try t.expectError(CaptureError.UnsupportedY4m, parseHeader("YUV4MPEG2 W3 H3 It"));
+}
+
+test "Y4mCapture – delivers every frame of a file" {
+    const allocator = t.allocator;
+    var tmp = t.tmpDir(.{});
+    defer tmp.cleanup();
+
+    // Two 3x2 frames in 4:2:0: 6 bytes of luma, then 2 of U and 2 of V.
+    const stream = "YUV4MPEG2 W3 H2 F50:1 C420jpeg XCOLORRANGE=FULL\n" ++
+        "FRAME\n" ++ [_]u8{0} ** 6 ++ [_]u8{128} ** 4 ++
+        "FRAME Ixyz\n" ++ [_]u8{255} ** 6 ++ [_]u8{128} ** 4;
+    try tmp.dir.writeFile2(.{ .sub_path = "in.y4m", .data = stream });
+    const path = try tmp.dir.realpathAlloc(allocator, "in.y4m");
+    defer allocator.free(path);
+
+    const Collector = struct {
+        firsts: [4]u8 = undefined,
+        count: usize = 0,
+        duration_ms: f64 = 0,
+
+        fn onFrame(ptr: *anyopaque, frame: core.Frame) anyerror!void {
+            const self: *@This() = @ptrCast(@alignCast(ptr));
+            defer t.allocator.free(frame.image.data);
+            try t.expectEqual(3 * 2 * 4, frame.image.data.len);
+            self.firsts[self.count] = frame.image.data[0];
+            self.count += 1;
+            self.duration_ms = frame.duration_ms;
+        }
+    };
+
+    var collector = Collector{};
+    var capture = try Y4mCapture.init(allocator, .{ .path = path }, &collector);
+    defer capture.deinit();
+    capture.capture.setFrameHandler(&Collector.onFrame);
+
+    try capture.capture.begin();
+    try t.expectEqualSlices(u8, &[_]u8{ 0, 255 }, collector.firsts[0..collector.count]);
+    try t.expectEqual(20, collector.duration_ms);
+}
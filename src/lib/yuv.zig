@@ -0,0 +1,400 @@
+const std = @import("std");
+
+// Conversion between planar YUV (as in Y4M streams) and BGRA, with the BT.601 matrices
+// in 8.8 fixed point. Rows are converted a vector of pixels at a time, with a scalar
+// tail that computes the very same formulas.
+
+/// How the stream maps luma and chroma to byte values.
+pub const Range = enum {
+    /// Y in 16..235, U and V in 16..240: what video streams use unless they say otherwise.
+    limited,
+    /// Y, U and V in 0..255 (JPEG).
+    full,
+};
+
+/// Chroma resolution relative to luma.
+pub const Subsampling = enum {
+    /// One U and V sample per 2x2 block of pixels.
+    yuv420,
+    /// One U and V sample per pixel.
+    yuv444,
+
+    /// Width or height of a chroma plane, for a luma plane of `size`.
+    pub fn chromaSize(self: Subsampling, size: usize) usize {
+        return switch (self) {
+            .yuv420 => (size + 1) / 2,
+            .yuv444 => size,
+        };
+    }
+};
+
+/// Coefficients of the conversion to RGB, scaled by 256.
+const Coefficients = struct {
+    y_offset: i32,
+    y: i32,
+    r_v: i32,
+    g_u: i32,
+    g_v: i32,
+    b_u: i32,
+};
+
+fn coefficients(range: Range) Coefficients {
+    return switch (range) {
+        .limited => .{ .y_offset = 16, .y = 298, .r_v = 409, .g_u = 100, .g_v = 208, .b_u = 516 },
+        .full => .{ .y_offset = 0, .y = 256, .r_v = 359, .g_u = 88, .g_v = 183, .b_u = 454 },
+    };
+}
+
+const lanes = 16;
+const Bytes = @Vector(lanes, u8);
+const Ints = @Vector(lanes, i32);
+
+/// Shuffle mask that interleaves two vectors of `n` elements: a0 b0 a1 b1 ...
+fn interleaveMask(comptime n: usize) [2 * n]i32 {
+    var mask: [2 * n]i32 = undefined;
+    for (0..n) |i| {
+        mask[2 * i] = @intCast(i);
+        mask[2 * i + 1] = ~@as(i32, @intCast(i));
+    }
+    return mask;
+}
+
+/// Shuffle mask that takes pairs from two vectors of `2n` elements: a0 a1 b0 b1 a2 a3 b2 b3 ...
+fn interleavePairsMask(comptime n: usize) [4 * n]i32 {
+    var mask: [4 * n]i32 = undefined;
+    for (0..n) |i| {
+        mask[4 * i] = @intCast(2 * i);
+        mask[4 * i + 1] = @intCast(2 * i + 1);
+        mask[4 * i + 2] = ~@as(i32, @intCast(2 * i));
+        mask[4 * i + 3] = ~@as(i32, @intCast(2 * i + 1));
+    }
+    return mask;
+}
+
+/// Shuffle mask that repeats every element of a vector twice.
+fn doubleMask(comptime n: usize) [n]i32 {
+    var mask: [n]i32 = undefined;
+    for (0..n) |i| mask[i] = @intCast(i / 2);
+    return mask;
+}
+
+inline fn clampToBytes(v: Ints) Bytes {
+    const clamped = @min(@max(v, @as(Ints, @splat(0))), @as(Ints, @splat(255)));
+    return @intCast(clamped);
+}
+
+inline fn scalarToBgra(c: Coefficients, y: u8, u: u8, v: u8, out: *[4]u8) void {
+    const luma = (@as(i32, y) - c.y_offset) * c.y + 128;
+    const d = @as(i32, u) - 128;
+    const e = @as(i32, v) - 128;
+    out[0] = @intCast(std.math.clamp((luma + c.b_u * d) >> 8, 0, 255));
+    out[1] = @intCast(std.math.clamp((luma - c.g_u * d - c.g_v * e) >> 8, 0, 255));
+    out[2] = @intCast(std.math.clamp((luma + c.r_v * e) >> 8, 0, 255));
+    out[3] = 255;
+}
+
+/// Convert one row of pixels to BGRA. `u` and `v` hold the chroma samples of the row,
+/// one per pixel, or one per two pixels with `.yuv420`. `out` holds 4 bytes per pixel.
+pub fn rowToBgra(
+    y: []const u8,
+    u: []const u8,
+    v: []const u8,
+    subsampling: Subsampling,
+    range: Range,
+    out: []u8,
+) void {
+    std.debug.assert(out.len == y.len * 4);
+    const c = coefficients(range);
+
+    var x: usize = 0;
+    while (x + lanes <= y.len) : (x += lanes) {
+        const luma_bytes: Bytes = y[x..][0..lanes].*;
+        var u_bytes: Bytes = undefined;
+        var v_bytes: Bytes = undefined;
+        switch (subsampling) {
+            .yuv444 => {
+                u_bytes = u[x..][0..lanes].*;
+                v_bytes = v[x..][0..lanes].*;
+            },
+            .yuv420 => {
+                // Every chroma sample covers two pixels.
+                const half: @Vector(lanes / 2, u8) = u[x / 2 ..][0 .. lanes / 2].*;
+                const half_v: @Vector(lanes / 2, u8) = v[x / 2 ..][0 .. lanes / 2].*;
+                u_bytes = @shuffle(u8, half, undefined, doubleMask(lanes));
+                v_bytes = @shuffle(u8, half_v, undefined, doubleMask(lanes));
+            },
+        }
+
+        const luma_wide: Ints = @intCast(luma_bytes);
+        const u_wide: Ints = @intCast(u_bytes);
+        const v_wide: Ints = @intCast(v_bytes);
+        const luma = (luma_wide - @as(Ints, @splat(c.y_offset))) * @as(Ints, @splat(c.y)) +
+            @as(Ints, @splat(128));
+        const d = u_wide - @as(Ints, @splat(128));
+        const e = v_wide - @as(Ints, @splat(128));
+        const eight: @Vector(lanes, u5) = @splat(8);
+
+        const b = clampToBytes((luma + @as(Ints, @splat(c.b_u)) * d) >> eight);
+        const g = clampToBytes((luma - @as(Ints, @splat(c.g_u)) * d - @as(Ints, @splat(c.g_v)) * e) >> eight);
+        const r = clampToBytes((luma + @as(Ints, @splat(c.r_v)) * e) >> eight);
+        const a: Bytes = @splat(255);
+
+        const bg = @shuffle(u8, b, g, interleaveMask(lanes));
+        const ra = @shuffle(u8, r, a, interleaveMask(lanes));
+        const bgra: @Vector(4 * lanes, u8) = @shuffle(u8, bg, ra, interleavePairsMask(lanes));
+        out[x * 4 ..][0 .. 4 * lanes].* = bgra;
+    }
+
+    while (x < y.len) : (x += 1) {
+        const chroma_x = switch (subsampling) {
+            .yuv444 => x,
+            .yuv420 => x / 2,
+        };
+        scalarToBgra(c, y[x], u[chroma_x], v[chroma_x], out[x * 4 ..][0..4]);
+    }
+}
+
+/// Convert a frame of three planes (Y, then U, then V, each without padding) to BGRA.
+pub fn planesToBgra(
+    planes: []const u8,
+    width: usize,
+    height: usize,
+    subsampling: Subsampling,
+    range: Range,
+    out: []u8,
+) void {
+    const chroma_width = subsampling.chromaSize(width);
+    const chroma_height = subsampling.chromaSize(height);
+    const luma_plane = planes[0 .. width * height];
+    const u_plane = planes[width * height ..][0 .. chroma_width * chroma_height];
+    const v_plane = planes[width * height + chroma_width * chroma_height ..][0 .. chroma_width * chroma_height];
+
+    for (0..height) |row| {
+        const chroma_row = switch (subsampling) {
+            .yuv444 => row,
+            .yuv420 => row / 2,
+        };
+        rowToBgra(
+            luma_plane[row * width ..][0..width],
+            u_plane[chroma_row * chroma_width ..][0..chroma_width],
+            v_plane[chroma_row * chroma_width ..][0..chroma_width],
+            subsampling,
+            range,
+            out[row * width * 4 ..][0 .. width * 4],
+        );
+    }
+}
+
+/// BT.601 limited range luma of a pixel.
+inline fn scalarLuma(b: i32, g: i32, r: i32) u8 {
+    return @intCast(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+/// BT.601 limited range chroma of a pixel.
+inline fn scalarChroma(b: i32, g: i32, r: i32) [2]u8 {
+    return .{
+        @intCast(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128),
+        @intCast(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128),
+    };
+}
+
+/// Shuffle mask that picks byte `channel` of every pixel in a vector of BGRA pixels.
+fn channelMask(comptime n: usize, comptime channel: usize) [n]i32 {
+    var mask: [n]i32 = undefined;
+    for (0..n) |i| mask[i] = @intCast(4 * i + channel);
+    return mask;
+}
+
+/// Shuffle mask that picks every other element of a vector, starting at `first`.
+fn everyOtherMask(comptime n: usize, comptime first: usize) [n]i32 {
+    var mask: [n]i32 = undefined;
+    for (0..n) |i| mask[i] = @intCast(2 * i + first);
+    return mask;
+}
+
+const Bgr = struct { b: Ints, g: Ints, r: Ints };
+
+/// Split `lanes` BGRA pixels into their color channels.
+inline fn loadBgr(bgra: []const u8) Bgr {
+    const pixels: @Vector(4 * lanes, u8) = bgra[0 .. 4 * lanes].*;
+    const b: Bytes = @shuffle(u8, pixels, undefined, channelMask(lanes, 0));
+    const g: Bytes = @shuffle(u8, pixels, undefined, channelMask(lanes, 1));
+    const r: Bytes = @shuffle(u8, pixels, undefined, channelMask(lanes, 2));
+    return .{ .b = @intCast(b), .g = @intCast(g), .r = @intCast(r) };
+}
+
+inline fn splat(comptime T: type, value: anytype) T {
+    return @splat(value);
+}
+
+/// Limited range luma of a row of BGRA pixels, one byte per pixel in `out`.
+pub fn bgraRowToLuma(bgra: []const u8, out: []u8) void {
+    std.debug.assert(bgra.len == out.len * 4);
+    const eight: @Vector(lanes, u5) = @splat(8);
+
+    var x: usize = 0;
+    while (x + lanes <= out.len) : (x += lanes) {
+        const px = loadBgr(bgra[x * 4 ..]);
+        const luma = ((splat(Ints, 66) * px.r + splat(Ints, 129) * px.g + splat(Ints, 25) * px.b +
+            splat(Ints, 128)) >> eight) + splat(Ints, 16);
+        out[x..][0..lanes].* = @as(Bytes, @intCast(luma));
+    }
+
+    while (x < out.len) : (x += 1) {
+        const pixel = bgra[x * 4 ..][0..4];
+        out[x] = scalarLuma(pixel[0], pixel[1], pixel[2]);
+    }
+}
+
+/// Limited range chroma of two rows of BGRA pixels, averaged over blocks of 2x2 pixels.
+/// Pass the same row twice for the last row of an image with an odd height.
+/// `u` and `v` hold one sample per two pixels, rounded up.
+pub fn bgraRowsToChroma420(row0: []const u8, row1: []const u8, u: []u8, v: []u8) void {
+    const width = row0.len / 4;
+    std.debug.assert(u.len == (width + 1) / 2 and v.len == u.len);
+    const Half = @Vector(lanes / 2, i32);
+    const eight: @Vector(lanes / 2, u5) = @splat(8);
+    const two: @Vector(lanes / 2, u5) = @splat(2);
+
+    var x: usize = 0;
+    while (x + lanes <= width) : (x += lanes) {
+        const top = loadBgr(row0[x * 4 ..]);
+        const bottom = loadBgr(row1[x * 4 ..]);
+        var averages: [3]Half = undefined;
+        for ([_]Ints{ top.b + bottom.b, top.g + bottom.g, top.r + bottom.r }, 0..) |sum, i| {
+            const pairs = @shuffle(i32, sum, undefined, everyOtherMask(lanes / 2, 0)) +
+                @shuffle(i32, sum, undefined, everyOtherMask(lanes / 2, 1));
+            averages[i] = (pairs + splat(Half, 2)) >> two;
+        }
+        const b, const g, const r = averages;
+
+        const u_wide = ((splat(Half, -38) * r - splat(Half, 74) * g + splat(Half, 112) * b +
+            splat(Half, 128)) >> eight) + splat(Half, 128);
+        const v_wide = ((splat(Half, 112) * r - splat(Half, 94) * g - splat(Half, 18) * b +
+            splat(Half, 128)) >> eight) + splat(Half, 128);
+        u[x / 2 ..][0 .. lanes / 2].* = @as(@Vector(lanes / 2, u8), @intCast(u_wide));
+        v[x / 2 ..][0 .. lanes / 2].* = @as(@Vector(lanes / 2, u8), @intCast(v_wide));
+    }
+
+    while (x < width) : (x += 2) {
+        // The last block of an odd width is a single column.
+        const columns = @min(2, width - x);
+        var sums = [3]i32{ 0, 0, 0 };
+        for (0..columns) |dx| {
+            for (0..3) |channel| {
+                sums[channel] += @as(i32, row0[(x + dx) * 4 + channel]) + row1[(x + dx) * 4 + channel];
+            }
+        }
+        const count: i32 = @intCast(2 * columns);
+        const chroma = scalarChroma(
+            @divTrunc(sums[0] + @divTrunc(count, 2), count),
+            @divTrunc(sums[1] + @divTrunc(count, 2), count),
+            @divTrunc(sums[2] + @divTrunc(count, 2), count),
+        );
+        u[x / 2] = chroma[0];
+        v[x / 2] = chroma[1];
+    }
+}
+
+/// Convert a BGRA image, with rows starting every `stride` bytes, to 4:2:0 Y, U and V planes,
+/// stored one after the other in `planes`.
+pub fn bgraToPlanes420(bgra: []const u8, width: usize, height: usize, stride: usize, planes: []u8) void {
+    const chroma_width = (width + 1) / 2;
+    const chroma_height = (height + 1) / 2;
+    const chroma_size = chroma_width * chroma_height;
+    std.debug.assert(planes.len == width * height + 2 * chroma_size);
+    const u_plane = planes[width * height ..][0..chroma_size];
+    const v_plane = planes[width * height + chroma_size ..][0..chroma_size];
+
+    for (0..height) |row| {
+        const src = bgra[row * stride ..][0 .. width * 4];
+        bgraRowToLuma(src, planes[row * width ..][0..width]);
+        if (row % 2 == 0) {
+            const next = if (row + 1 < height) bgra[(row + 1) * stride ..][0 .. width * 4] else src;
+            bgraRowsToChroma420(
+                src,
+                next,
+                u_plane[row / 2 * chroma_width ..][0..chroma_width],
+                v_plane[row / 2 * chroma_width ..][0..chroma_width],
+            );
+        }
+    }
+}
+
+const t = std.testing;
+
+test "rowToBgra – known colors" {
+    var out: [8]u8 = undefined;
+    // Limited range white and black.
+    rowToBgra(&[_]u8{ 235, 16 }, &[_]u8{ 128, 128 }, &[_]u8{ 128, 128 }, .yuv444, .limited, &out);
+    try t.expectEqualSlices(u8, &[_]u8{ 255, 255, 255, 255, 0, 0, 0, 255 }, &out);
+
+    // Full range red is about Y = 76, U = 85, V = 255.
+    rowToBgra(&[_]u8{ 76, 76 }, &[_]u8{85}, &[_]u8{255}, .yuv420, .full, &out);
+    for (0..2) |i| {
+        try t.expect(out[i * 4] <= 2);
+        try t.expect(out[i * 4 + 1] <= 2);
+        try t.expect(out[i * 4 + 2] >= 253);
+    }
+}
+
+test "rowToBgra – vectors and scalar tail agree" {
+    var gen = std.rand.DefaultPrng.init(21);
+    const width = 3 * lanes + 5;
+    var y: [width]u8 = undefined;
+    var u: [width]u8 = undefined;
+    var v: [width]u8 = undefined;
+    gen.random().bytes(&y);
+    gen.random().bytes(&u);
+    gen.random().bytes(&v);
+
+    for ([_]Subsampling{ .yuv420, .yuv444 }) |subsampling| {
+        for ([_]Range{ .limited, .full }) |range| {
+            var out: [width * 4]u8 = undefined;
+            rowToBgra(&y, &u, &v, subsampling, range, &out);
+
+            const c = coefficients(range);
+            for (0..width) |x| {
+                const chroma_x = if (subsampling == .yuv420) x / 2 else x;
+                var expected: [4]u8 = undefined;
+                scalarToBgra(c, y[x], u[chroma_x], v[chroma_x], &expected);
+                try t.expectEqualSlices(u8, &expected, out[x * 4 ..][0..4]);
+            }
+        }
+    }
+}
+
+test "bgraToPlanes420 – known colors, and vectors agree with the scalar tail" {
+    // Limited range white and black.
+    var out: [2]u8 = undefined;
+    bgraRowToLuma(&[_]u8{ 255, 255, 255, 255, 0, 0, 0, 255 }, &out);
+    try t.expectEqualSlices(u8, &[_]u8{ 235, 16 }, &out);
+
+    var gen = std.rand.DefaultPrng.init(5);
+    const width = 2 * lanes + 3;
+    var rows: [2][width * 4]u8 = undefined;
+    gen.random().bytes(&rows[0]);
+    gen.random().bytes(&rows[1]);
+
+    var luma: [width]u8 = undefined;
+    bgraRowToLuma(&rows[0], &luma);
+    var u: [(width + 1) / 2]u8 = undefined;
+    var v: [(width + 1) / 2]u8 = undefined;
+    bgraRowsToChroma420(&rows[0], &rows[1], &u, &v);
+
+    for (0..width) |x| {
+        const pixel = rows[0][x * 4 ..][0..4];
+        try t.expectEqual(scalarLuma(pixel[0], pixel[1], pixel[2]), luma[x]);
+    }
+    for (0..width / 2) |i| {
+        var sums = [3]i32{ 0, 0, 0 };
+        for (0..2) |row| {
+            for (0..2) |dx| {
+                for (0..3) |channel| sums[channel] += rows[row][(2 * i + dx) * 4 + channel];
+            }
+        }
+        const chroma = scalarChroma(@divTrunc(sums[0] + 2, 4), @divTrunc(sums[1] + 2, 4), @divTrunc(sums[2] + 2, 4));
+        try t.expectEqual(chroma[0], u[i]);
+        try t.expectEqual(chroma[1], v[i]);
+    }
+}
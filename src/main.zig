@@ -7,6 +7,13 @@ const ArgError = error{
     bad_coordinate,
     no_resolution,
     no_duration,
+    bad_synthetic_content,
+    bad_pipe_format,
+    bad_queue_policy,
+    bad_scale,
+    bad_filter,
+    box_needs_half_scale,
+    fps_with_y4m,
 };
 
 pub fn parseCoordinate(resolution_str: []const u8) ![2]usize {
@@ -42,10 +49,37 @@ const CliConfig = struct {
     gif_height: usize,
 
     duration_seconds: f64,
+    frames_per_second: f64 = 30,
     out_path: [:0]const u8,
+    /// Record generated or replayed frames instead of the screen.
+    /// They are delivered as fast as they are encoded, which makes runs reproducible.
+    source: core.Backend = .screen,
+    /// Write the frames to stdout in this format, instead of encoding a GIF.
+    pipe_format: ?core.PipeFormat = null,
+    /// Number of frames that may wait for the encoder, rounded up to a power of two.
+    queue_size: usize = 8,
+    /// What to do with new frames when `queue_size` of them are waiting.
+    queue_policy: ring.FullPolicy = .merge,
+    /// Size of the output, relative to the recorded rectangle.
+    scale: f64 = 1,
+    /// How frames are scaled to the size of the output.
+    filter: core.ResampleFilter = .area,
+
+    /// Size of the output, for frames of `width` by `height` points.
+    pub fn outputSize(self: *const CliConfig, width: usize, height: usize) [2]usize {
+        return .{
+            @max(@as(usize, @intFromFloat(@round(@as(f64, @floatFromInt(width)) * self.scale))), 1),
+            @max(@as(usize, @intFromFloat(@round(@as(f64, @floatFromInt(height)) * self.scale))), 1),
+        };
+    }
 
     pub fn deinit(self: *const CliConfig) void {
         self.allocator.free(self.out_path);
+        switch (self.source) {
+            .replay => |replay| self.allocator.free(replay.path),
+            .y4m => |y4m| if (y4m.path) |path| self.allocator.free(path),
+            else => {},
+        }
     }
 };
 
@@ -56,6 +90,14 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
         \\-d, --duration   <f64>    Set the duration of the GIF (in seconds).
         \\-o, --output     <str>    Set the output filepath (default: out.gif).
         \\-c, --coord      <str>    <x>x<y> Set the top-left coordinates of the capture area (default: 0,0).
+        \\-f, --fps        <f64>    Set the number of frames per second (default: 30).
+        \\-s, --synthetic  <str>    Record generated frames instead of the screen: text, gradient or noise.
+        \\    --replay     <str>    Record raw BGRA frames of the given resolution from a file instead of the screen.
+        \\    --y4m        <str>    Convert a YUV4MPEG2 video from a file, or stdin with "-". Size and frame rate come from the stream.
+        \\    --pipe       <str>    Write the frames to stdout as y4m or bgra, for another program to encode, instead of a GIF.
+        \\    --when-behind <str>   When the encoder falls behind: block, drop-newest, drop-oldest or merge (default: merge).
+        \\    --scale      <f64>    Scale the output down by this factor, e.g. 0.5 for half the width and height (default: 1).
+        \\    --filter     <str>    Scale frames with box (halves only), bilinear or area (default: area).
     );
 
     var diag = clap.Diagnostic{};
@@ -75,8 +117,11 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
         return null;
     }
 
+    const y4m_path = res.args.y4m;
     const resolution = if (res.args.resolution) |res_str|
         try parseCoordinate(res_str)
+    else if (y4m_path != null)
+        .{ 0, 0 } // taken from the stream
     else {
         return ArgError.no_resolution;
     };
@@ -86,10 +131,72 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
     else
         .{ 0, 0 };
 
-    const duration = if (res.args.duration) |dur| dur else {
+    const duration = if (res.args.duration) |dur|
+        dur
+    else if (y4m_path != null)
+        0 // the whole stream
+    else {
         return ArgError.no_duration;
     };
 
+    // A y4m stream has its own frame rate.
+    if (y4m_path != null and res.args.fps != null) return ArgError.fps_with_y4m;
+    const fps = res.args.fps orelse 30;
+    // Synthetic and replayed frames stop by themselves after `duration` seconds worth of frames.
+    const frame_count: usize = @intFromFloat(@max(duration * fps, 1));
+    var source: core.Backend = .screen;
+    if (res.args.synthetic) |name| {
+        const content: core.SyntheticContent = if (std.mem.eql(u8, name, "text"))
+            .scrolling_text
+        else
+            std.meta.stringToEnum(core.SyntheticContent, name) orelse
+                return ArgError.bad_synthetic_content;
+        source = .{ .synthetic = .{
+            .content = content,
+            .width = resolution[0],
+            .height = resolution[1],
+            .frame_count = frame_count,
+        } };
+    } else if (res.args.replay) |path| {
+        source = .{ .replay = .{
+            .path = try allocator.dupe(u8, path),
+            .width = resolution[0],
+            .height = resolution[1],
+            .frame_count = frame_count,
+            .loop = true,
+        } };
+    } else if (y4m_path) |path| {
+        source = .{ .y4m = .{
+            .path = if (std.mem.eql(u8, path, "-")) null else try allocator.dupe(u8, path),
+        } };
+    }
+
+    const pipe_format: ?core.PipeFormat = if (res.args.pipe) |name|
+        std.meta.stringToEnum(core.PipeFormat, name) orelse return ArgError.bad_pipe_format
+    else
+        null;
+
+    var queue_policy: ring.FullPolicy = .merge;
+    if (res.args.@"when-behind") |name| {
+        var buf: [16]u8 = undefined;
+        if (name.len > buf.len) return ArgError.bad_queue_policy;
+        const snake = buf[0..name.len];
+        _ = std.mem.replace(u8, name, "-", "_", snake);
+        queue_policy = std.meta.stringToEnum(ring.FullPolicy, snake) orelse
+            return ArgError.bad_queue_policy;
+    }
+
+    const scale = res.args.scale orelse 1;
+    if (!(scale > 0 and scale <= 1)) return ArgError.bad_scale;
+
+    const filter: core.ResampleFilter = if (res.args.filter) |name|
+        std.meta.stringToEnum(core.ResampleFilter, name) orelse return ArgError.bad_filter
+    else
+        .area;
+    // Box only halves. At a scale of 1, it halves the captures of Retina displays,
+    // and other frames don't need scaling.
+    if (filter == .box and scale != 0.5 and scale != 1) return ArgError.box_needs_half_scale;
+
     const output = res.args.output orelse "out.gif";
     const output_owned = try allocator.dupeZ(u8, output);
 
@@ -100,49 +207,57 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
         .gif_width = resolution[0],
         .gif_height = resolution[1],
         .duration_seconds = duration,
+        .frames_per_second = fps,
         .out_path = output_owned,
+        .source = source,
+        .pipe_format = pipe_format,
+        .queue_policy = queue_policy,
+        .scale = scale,
+        .filter = filter,
     };
 }
 
 const core = @import("frametap");
 const FrameTap = core.FrameTap;
 const zgif = @import("zgif");
-const Queue = @import("util/queue.zig").Queue;
-
-const Thread = std.Thread;
+const ring = @import("util/ring.zig");
+const Ring = ring.Ring;
 
 /// Data shared between the thread that produces frames,
 /// and the one that consumes them.
 const SharedContext = struct {
-    /// A Queue of frames. Producer pushes, consumer pops.
-    unprocessed_frames: *Queue(core.Frame),
-    /// A thread must hold this mutext to acess anything else in the struct
-    mutex: Thread.Mutex = .{},
-    /// Will be posted to when the producer is finished.
-    all_frames_produced: Thread.Semaphore = .{},
-    /// The producer will post to this when a new frame is ready for processing.
-    new_frame_ready: Thread.Semaphore = .{},
+    /// The allocator of the capturer, to give frames back with.
+    allocator: std.mem.Allocator,
+    /// Frames on their way to the encoder. The capture callback pushes, the encoder pops,
+    /// and neither takes a lock.
+    frames: *Ring(core.Frame),
+    /// Frames that didn't fit in `frames`, for the encoder to give back: releasing
+    /// a frame takes the frame pool's lock, which the capture callback must not.
+    discarded: *Ring(core.Frame),
+
+    /// Give back the frames that the capture callback couldn't queue. Called by the encoder.
+    fn releaseDiscarded(self: *SharedContext) void {
+        while (self.discarded.pop()) |frame| frame.deinit(self.allocator);
+    }
 };
 
 const Capturer = FrameTap(*SharedContext);
 
 fn startCapture(ctx: *SharedContext, capturer: *Capturer) !void {
+    // Let the consumer finish, even if the capture fails.
+    defer ctx.frames.close();
     try capturer.capture.begin(); // this will block forever.
-    ctx.mutex.lock();
-    ctx.all_frames_produced.post();
-    ctx.new_frame_ready.post();
-    ctx.mutex.unlock();
 }
 
 fn produceFrame(ctx: *SharedContext, frame: core.Frame) !void {
-    ctx.mutex.lock();
-    try ctx.unprocessed_frames.push(frame);
-    ctx.mutex.unlock();
-    ctx.new_frame_ready.post();
+    // A full ring hands back the frame that it couldn't keep. `discarded` has room
+    // for every buffer of the frame pool, so this push never waits.
+    if (ctx.frames.push(frame)) |dropped| _ = ctx.discarded.push(dropped);
 }
 
 fn consumer(
     ctx: *SharedContext,
+    downscaler: *core.Downscaler, // scales the frames to the size of the gif.
     width: usize, // width of a frame.
     height: usize, // height of a frame.
     out_path: [:0]const u8, // path to write the gif to.
@@ -151,45 +266,119 @@ fn consumer(
     var gif = try zgif.Gif.init(allocator, .{
         .width = width,
         .height = height,
-        .path = out_path,
+        .sink = .{ .path = out_path },
         .use_dithering = true,
+        // Compress frames off this thread, so quantizing the next frame doesn't wait on LZW.
+        .parallel = .{},
     });
 
     defer gif.deinit();
-
-    while (true) {
-        ctx.new_frame_ready.wait();
-        if (ctx.all_frames_produced.timedWait(0)) break else |_| {
-            // If it errors out, then there is nothing to wait on.
-            // This means the producer hasn't called `post` on this semaphore,
-            // because it's not done producing frames yet.
+    defer ctx.releaseDiscarded();
+
+    // Every frame is held back until the next one arrives, so that the time of frames
+    // merged away after the last one can still be added to it.
+    var held: ?core.Frame = null;
+    defer if (held) |frame| frame.deinit(ctx.allocator);
+
+    while (ctx.frames.popWait()) |captured| {
+        ctx.releaseDiscarded();
+        // Scaled here rather than in the capture callback, which must not wait for anything.
+        const frame = try downscaler.scale(captured);
+        const previous = held;
+        held = frame;
+        if (previous) |prev| {
+            // The GIF keeps what it needs, so the buffer can go back to the pool.
+            defer prev.deinit(ctx.allocator);
+            try addGifFrame(&gif, prev, 0);
         }
+    }
 
-        ctx.mutex.lock(); // lock this mutex to access values in ctx.
-        std.debug.assert(!ctx.unprocessed_frames.isEmpty());
-        const frame = try ctx.unprocessed_frames.pop();
-        const duration = frame.duration_ms;
-        ctx.mutex.unlock(); // unlock drop mutex after frame is copied.
-
-        // add frame to GIF.
-        try gif.addFrame(.{
-            .bgra_buf = frame.image.data,
-            .duration_ms = @intFromFloat(duration),
-        });
+    if (held) |last| {
+        held = null;
+        defer last.deinit(ctx.allocator);
+        try addGifFrame(&gif, last, ctx.frames.carriedMs());
     }
 
-    ctx.mutex.lock();
-    defer ctx.mutex.unlock();
+    try gif.close();
+}
 
-    while (!ctx.unprocessed_frames.isEmpty()) {
-        const frame = try ctx.unprocessed_frames.pop();
-        try gif.addFrame(.{
-            .bgra_buf = frame.image.data,
-            .duration_ms = @intFromFloat(frame.duration_ms),
-        });
+fn addGifFrame(gif: *zgif.Gif, frame: core.Frame, extra_ms: f64) !void {
+    try gif.addFrame(.{
+        .bgra_buf = frame.image.data,
+        .duration_ms = @intFromFloat(frame.duration_ms + extra_ms),
+        .row_stride = frame.image.row_stride,
+    });
+}
+
+const PipeContext = struct {
+    allocator: std.mem.Allocator,
+    sink: core.PipeSink,
+};
+
+fn pipeFrame(ctx: *PipeContext, frame: core.Frame) !void {
+    defer frame.deinit(ctx.allocator);
+    _ = try ctx.sink.writeFrame(frame.image, frame.image.row_stride);
+}
+
+fn recordToPipe(capturer: *FrameTap(*PipeContext)) !void {
+    try capturer.capture.begin();
+}
+
+/// Stream the frames to stdout. Frames are written from the capture thread as they arrive,
+/// so a slow reader slows down the capture instead of piling up frames here.
+fn pipeToStdout(allocator: std.mem.Allocator, args: CliConfig, format: core.PipeFormat) !void {
+    const ctx = try allocator.create(PipeContext);
+    defer allocator.destroy(ctx);
+    ctx.allocator = allocator;
+
+    // Frames are written before the next one is captured, so two buffers are enough,
+    // and one more for a frame being scaled down.
+    const pool = try core.FramePool.init(allocator, .{ .capacity = 3 });
+    defer pool.deinit();
+
+    const capturer = try FrameTap(*PipeContext).initWithBackend(allocator, ctx, .{
+        .x = @floatFromInt(args.x),
+        .y = @floatFromInt(args.y),
+        .width = @floatFromInt(args.gif_width),
+        .height = @floatFromInt(args.gif_height),
+    }, args.source);
+    defer capturer.deinit();
+    capturer.capture.frames_per_second = args.frames_per_second;
+    capturer.capture.frame_pool = pool;
+    capturer.onFrame(pipeFrame);
+
+    var width = args.gif_width;
+    var height = args.gif_height;
+    var fps_num: u32 = @intFromFloat(args.frames_per_second * 1000);
+    var fps_den: u32 = 1000;
+    if (args.source == .y4m) {
+        width, height = core.Y4mCapture.frameSize(capturer.capture);
+        fps_num, fps_den = core.Y4mCapture.frameRate(capturer.capture);
     }
+    width, height = args.outputSize(width, height);
 
-    try gif.close();
+    var downscaler = core.Downscaler.init(allocator, .{ .width = width, .height = height, .filter = args.filter });
+    defer downscaler.deinit();
+    capturer.setTransform(downscaler.transform());
+
+    ctx.sink = try core.PipeSink.init(allocator, io.getStdOut().handle, .{
+        .format = format,
+        .width = width,
+        .height = height,
+        .fps_num = fps_num,
+        .fps_den = fps_den,
+    });
+    defer ctx.sink.deinit();
+
+    const producer_thread = try std.Thread.spawn(.{}, recordToPipe, .{capturer});
+    if (args.source == .screen) {
+        const sleep_ns: u64 = @intFromFloat(
+            args.duration_seconds * @as(f64, @floatFromInt(std.time.ns_per_s)),
+        );
+        std.time.sleep(sleep_ns);
+        try capturer.capture.end();
+    }
+    producer_thread.join();
 }
 
 pub fn main() !void {
@@ -207,6 +396,27 @@ pub fn main() !void {
             ArgError.no_duration => {
                 _ = try io.getStdErr().write("Duration is required (e.g -d 10)\n");
             },
+            ArgError.bad_synthetic_content => {
+                _ = try io.getStdErr().write("Synthetic content must be text, gradient or noise\n");
+            },
+            ArgError.bad_pipe_format => {
+                _ = try io.getStdErr().write("Pipe format must be y4m or bgra\n");
+            },
+            ArgError.bad_queue_policy => {
+                _ = try io.getStdErr().write("--when-behind must be block, drop-newest, drop-oldest or merge\n");
+            },
+            ArgError.bad_scale => {
+                _ = try io.getStdErr().write("--scale must be more than 0, and at most 1\n");
+            },
+            ArgError.bad_filter => {
+                _ = try io.getStdErr().write("--filter must be box, bilinear or area\n");
+            },
+            ArgError.box_needs_half_scale => {
+                _ = try io.getStdErr().write("--filter box only halves frames, so --scale must be 0.5 (or 1)\n");
+            },
+            ArgError.fps_with_y4m => {
+                _ = try io.getStdErr().write("--fps can't be used with --y4m, the frame rate comes from the stream\n");
+            },
             else => |e| return e,
         }
 
@@ -216,41 +426,78 @@ pub fn main() !void {
     const args = maybe_args orelse return;
     defer args.deinit();
 
-    const frame_queue = try allocator.create(Queue(core.Frame));
-    frame_queue.* = try Queue(core.Frame).init(allocator);
-    defer {
-        frame_queue.deinit();
-        allocator.destroy(frame_queue);
-    }
+    if (args.pipe_format) |format| return pipeToStdout(allocator, args, format);
+
+    // Frames waiting for the GIF encoder live in these buffers: the ones in the ring,
+    // plus the one being scaled down, the one held back until the next one arrives
+    // (when frames need no scaling), the one being captured, and one held by native code.
+    // Scaled frames are allocated by the encoder thread, so it never waits for the pool.
+    const pool_size = args.queue_size + 4;
+    const pool = try core.FramePool.init(allocator, .{ .capacity = pool_size });
+    defer pool.deinit();
+
+    var frames = try Ring(core.Frame).init(allocator, .{
+        .capacity = args.queue_size,
+        .policy = args.queue_policy,
+    });
+    defer frames.deinit();
+    var discarded = try Ring(core.Frame).init(allocator, .{ .capacity = pool_size });
+    defer discarded.deinit();
 
     const ctx = try allocator.create(SharedContext);
-    ctx.* = SharedContext{ .unprocessed_frames = frame_queue };
+    ctx.* = SharedContext{ .allocator = allocator, .frames = &frames, .discarded = &discarded };
     defer allocator.destroy(ctx);
 
-    const capturer = try Capturer.init(allocator, ctx, .{
+    const capturer = try Capturer.initWithBackend(allocator, ctx, .{
         .x = @floatFromInt(args.x),
         .y = @floatFromInt(args.y),
         .width = @floatFromInt(args.gif_width),
         .height = @floatFromInt(args.gif_height),
-    });
+    }, args.source);
     defer capturer.deinit();
+    capturer.capture.frames_per_second = args.frames_per_second;
+    capturer.capture.frame_pool = pool;
     capturer.onFrame(produceFrame);
 
+    var width = args.gif_width;
+    var height = args.gif_height;
+    if (args.source == .y4m) {
+        width, height = core.Y4mCapture.frameSize(capturer.capture);
+    }
+
+    // The encoder scales frames to the size of the GIF. This also brings the captures
+    // of Retina displays, which have twice the pixels, back to the size of the rect.
+    width, height = args.outputSize(width, height);
+    var downscaler = core.Downscaler.init(allocator, .{ .width = width, .height = height, .filter = args.filter });
+    defer downscaler.deinit();
+
     const producer_thread = try std.Thread.spawn(.{}, startCapture, .{ ctx, capturer });
     const consumer_thread = try std.Thread.spawn(.{}, consumer, .{
         ctx,
-        args.gif_width,
-        args.gif_height,
+        &downscaler,
+        width,
+        height,
         args.out_path,
     });
 
-    const sleep_ns: u64 = @intFromFloat(
-        args.duration_seconds * @as(f64, @floatFromInt(std.time.ns_per_s)),
-    );
+    // Other sources end by themselves after the right number of frames.
+    if (args.source == .screen) {
+        const sleep_ns: u64 = @intFromFloat(
+            args.duration_seconds * @as(f64, @floatFromInt(std.time.ns_per_s)),
+        );
 
-    std.time.sleep(sleep_ns);
+        std.time.sleep(sleep_ns);
 
-    try capturer.capture.end();
+        try capturer.capture.end();
+    }
     producer_thread.join();
     consumer_thread.join();
+
+    const dropped = frames.dropped.load(.monotonic);
+    if (dropped > 0) {
+        std.log.info("the encoder fell behind: {d} frames dropped, at most {d} waiting", .{
+            dropped,
+            frames.high_water.load(.monotonic),
+        });
+    }
 }
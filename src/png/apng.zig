@@ -0,0 +1,651 @@
+const std = @import("std");
+const quant = @import("quantize");
+const zgif = @import("zgif");
+const png = @import("png.zig");
+const pixel = @import("pixel");
+
+const GifFrame = zgif.GifFrame;
+const Sink = zgif.Sink;
+const SinkWriter = zgif.SinkWriter;
+const PngError = png.PngError;
+
+// Writes animated PNGs from the same stream of BGRA frames that `zgif.Gif` takes.
+// See: https://wiki.mozilla.org/APNG_Specification
+//
+// An APNG is a PNG whose image data (IDAT) is the first frame, followed by more frames,
+// each a frame control chunk (fcTL: size, offset, delay, blending) and frame data (fdAT).
+// Like our GIFs, every frame after the first only stores the rectangle that changed.
+// Pixels inside it that didn't change are made fully transparent and the frame is blended
+// over the previous one, so that they compress to long runs of zeroes.
+//
+// The acTL chunk that announces the number of frames comes before any image data,
+// so compressed frames are kept in memory until `close`.
+
+pub const ColorMode = enum {
+    /// 8 bit RGBA, without a color limit.
+    truecolor,
+    /// 8 bit indices into one palette shared by all frames.
+    /// The palette can only be built once every frame has been seen, so frames are
+    /// kept in memory until `close` (up to `max_indexed_bytes`), like GIFs with a global palette.
+    indexed,
+};
+
+pub const ApngConfig = struct {
+    width: usize,
+    height: usize,
+    /// Where the encoded file is written to.
+    sink: Sink,
+    color_mode: ColorMode = .truecolor,
+    /// Number of palette entries in indexed mode.
+    ncolors: u16 = 256,
+    /// Only used in indexed mode.
+    use_dithering: bool = true,
+    /// In indexed mode, the most bytes of frames kept for building the palette. Once there
+    /// are more, the palette is built from them, and later frames are mapped to it as they
+    /// come in instead of being kept.
+    max_indexed_bytes: usize = 256 * 1024 * 1024,
+    /// Only store the rectangle of each frame that changed since the previous frame.
+    crop_to_changes: bool = true,
+    /// Number of times the animation is played, 0 loops forever.
+    loop_count: u32 = 0,
+};
+
+const BlendOp = enum(u8) {
+    /// The frame's pixels replace the canvas.
+    source = 0,
+    /// The frame is alpha-blended over the canvas.
+    over = 1,
+};
+
+/// The part of the canvas that a frame covers.
+const Region = struct {
+    x: usize,
+    y: usize,
+    width: usize,
+    height: usize,
+};
+
+pub const Apng = struct {
+    const Self = @This();
+
+    allocator: std.mem.Allocator,
+    config: ApngConfig,
+    sink_writer: *SinkWriter,
+
+    /// fcTL, IDAT and fdAT chunks of every frame encoded so far.
+    chunks: std.ArrayList(u8),
+    nframes: usize = 0,
+    /// Sequence number of the next fcTL or fdAT chunk.
+    sequence: u32 = 0,
+
+    /// In truecolor mode, the BGRA frame that was added last.
+    canvas: ?[]u8 = null,
+    /// In indexed mode, copies of the frames, which are quantized when the file is closed.
+    indexed_frames: std.ArrayList(GifFrame),
+    /// Size of the pixels in `indexed_frames`.
+    indexed_bytes: usize = 0,
+    /// In indexed mode, the palette shared by all frames once it is built.
+    color_table: ?[]u8 = null,
+    transparent_index: ?u8 = null,
+    /// Set once `max_indexed_bytes` was exceeded, for mapping frames as they're added.
+    palette: ?quant.Palette = null,
+    /// Indices of the frame that was mapped to `palette` last.
+    prev_indices: ?[]u8 = null,
+
+    /// Scratch space for the pixels of the current frame, before and after filtering
+    /// and compression.
+    pixels: std.ArrayList(u8),
+    filtered: std.ArrayList(u8),
+    compressed: std.ArrayList(u8),
+
+    pub fn init(allocator: std.mem.Allocator, config: ApngConfig) !Self {
+        const sink_writer = try allocator.create(SinkWriter);
+        errdefer allocator.destroy(sink_writer);
+        sink_writer.* = try SinkWriter.init(config.sink);
+        errdefer sink_writer.deinit();
+
+        var canvas: ?[]u8 = null;
+        if (config.color_mode == .truecolor) {
+            canvas = try allocator.alloc(u8, config.width * config.height * 4);
+        }
+
+        return .{
+            .allocator = allocator,
+            .config = config,
+            .sink_writer = sink_writer,
+            .chunks = std.ArrayList(u8).init(allocator),
+            .canvas = canvas,
+            .indexed_frames = std.ArrayList(GifFrame).init(allocator),
+            .pixels = std.ArrayList(u8).init(allocator),
+            .filtered = std.ArrayList(u8).init(allocator),
+            .compressed = std.ArrayList(u8).init(allocator),
+        };
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.chunks.deinit();
+        for (self.indexed_frames.items) |frame| {
+            self.allocator.free(frame.bgra_buf);
+        }
+        self.indexed_frames.deinit();
+        if (self.canvas) |canvas| self.allocator.free(canvas);
+        if (self.color_table) |table| self.allocator.free(table);
+        if (self.palette) |palette| palette.deinit(self.allocator);
+        if (self.prev_indices) |indices| self.allocator.free(indices);
+        self.pixels.deinit();
+        self.filtered.deinit();
+        self.compressed.deinit();
+        self.sink_writer.deinit();
+        self.allocator.destroy(self.sink_writer);
+    }
+
+    pub fn addFrames(self: *Self, frames: []const GifFrame) !void {
+        for (frames) |frame| {
+            try self.addFrame(frame);
+        }
+    }
+
+    pub fn addFrame(self: *Self, frame: GifFrame) !void {
+        const width = self.config.width;
+        const height = self.config.height;
+        const stride = if (frame.row_stride == 0) width * 4 else frame.row_stride;
+        std.debug.assert(frame.bgra_buf.len >= (height - 1) * stride + width * 4);
+
+        if (self.config.color_mode == .indexed) {
+            if (self.palette) |*palette| return self.addMappedFrame(frame, palette);
+
+            {
+                const bgra_buf = try zgif.packedCopy(self.allocator, frame, width, height);
+                errdefer self.allocator.free(bgra_buf);
+                try self.indexed_frames.append(.{ .bgra_buf = bgra_buf, .duration_ms = frame.duration_ms });
+                self.indexed_bytes += bgra_buf.len;
+            }
+            if (self.indexed_bytes > self.config.max_indexed_bytes) try self.streamIndexed();
+            return;
+        }
+
+        const canvas = self.canvas orelse unreachable;
+
+        // The first frame is the PNG's default image, which must cover the whole canvas.
+        var region = Region{ .x = 0, .y = 0, .width = width, .height = height };
+        var blend = BlendOp.source;
+        if (self.nframes > 0 and self.config.crop_to_changes) {
+            region = changedRegion(canvas, width * 4, frame.bgra_buf, stride, width, height, 4);
+            // Blending would mix translucent pixels with what's underneath them.
+            if (changesAreOpaque(canvas, frame.bgra_buf, width, stride, region)) blend = .over;
+        }
+
+        self.pixels.clearRetainingCapacity();
+        try self.pixels.ensureTotalCapacity(region.width * region.height * 4);
+        for (region.y..region.y + region.height) |y| {
+            const row = frame.bgra_buf[y * stride + region.x * 4 ..][0 .. region.width * 4];
+            const prev = canvas[(y * width + region.x) * 4 ..][0 .. region.width * 4];
+            const out = self.pixels.addManyAsSliceAssumeCapacity(region.width * 4);
+            pixel.convert(.bgra, .rgba, row, out);
+            if (blend == .over) {
+                // Pixels that didn't change let the previous frame show through.
+                for (0..region.width) |x| {
+                    if (std.mem.eql(u8, row[x * 4 ..][0..4], prev[x * 4 ..][0..4])) @memset(out[x * 4 ..][0..4], 0);
+                }
+            }
+        }
+
+        for (0..height) |y| {
+            @memcpy(canvas[y * width * 4 ..][0 .. width * 4], frame.bgra_buf[y * stride ..][0 .. width * 4]);
+        }
+        try self.appendFrame(self.pixels.items, 4, region, blend, frame.duration_ms, .adaptive);
+    }
+
+    /// Quantize all buffered frames to one palette, and encode them.
+    fn encodeIndexed(self: *Self) !void {
+        const frames = self.indexed_frames.items;
+        if (frames.len == 0) return PngError.no_frames;
+
+        const bgra_bufs = try self.allocator.alloc([]const u8, frames.len);
+        defer self.allocator.free(bgra_bufs);
+        for (frames, bgra_bufs) |frame, *buf| {
+            buf.* = frame.bgra_buf;
+        }
+
+        const quantized = try quant.quantizeFrames(self.indexedConfig(0), bgra_bufs, quant.Quantize.median_cut);
+        defer quantized.deinit();
+
+        // The source frames aren't needed anymore, so free them before compressing.
+        for (frames) |*frame| {
+            self.allocator.free(frame.bgra_buf);
+            frame.bgra_buf = &[_]u8{};
+        }
+
+        self.color_table = try self.allocator.dupe(u8, quantized.color_table);
+        self.transparent_index = quantized.transparent_index;
+
+        for (frames, quantized.frames, 0..) |frame, indices, i| {
+            const prev = if (i > 0) quantized.frames[i - 1] else null;
+            try self.appendIndexedFrame(indices, prev, frame.duration_ms);
+        }
+
+        self.indexed_frames.clearRetainingCapacity();
+        self.indexed_bytes = 0;
+    }
+
+    fn indexedConfig(self: *const Self, row_stride: usize) quant.QuantizerConfig {
+        return .{
+            .allocator = self.allocator,
+            .width = self.config.width,
+            .height = self.config.height,
+            .use_dithering = self.config.use_dithering,
+            .ncolors = self.config.ncolors,
+            .reserve_transparent_index = self.config.crop_to_changes,
+            .row_stride = row_stride,
+        };
+    }
+
+    /// Build the palette from the color counts of the frames kept so far, and encode them.
+    /// Frames added after this are mapped to the palette right away, by `addMappedFrame`.
+    fn streamIndexed(self: *Self) !void {
+        const frames = self.indexed_frames.items;
+        const quant_config = self.indexedConfig(0);
+
+        const counts = try self.allocator.create([quant.color_array_size]u32);
+        defer self.allocator.destroy(counts);
+        const total = try self.allocator.create([quant.color_array_size]u32);
+        defer self.allocator.destroy(total);
+        @memset(total, 0);
+        for (frames) |frame| {
+            quant.countImageColors(quant_config, frame.bgra_buf, counts);
+            for (total, counts) |*sum, count| sum.* +|= count;
+        }
+
+        {
+            const palette = try quant.buildPaletteFromCounts(quant_config, total);
+            errdefer palette.deinit(self.allocator);
+            self.color_table = try self.allocator.dupe(u8, palette.color_table);
+            self.transparent_index = palette.transparent_index;
+            self.palette = palette;
+        }
+
+        for (frames) |*frame| {
+            try self.addMappedFrame(frame.*, &self.palette.?);
+            self.allocator.free(frame.bgra_buf);
+            frame.bgra_buf = &[_]u8{};
+        }
+
+        self.indexed_frames.clearRetainingCapacity();
+        self.indexed_bytes = 0;
+    }
+
+    /// Map a frame to `palette`, and encode it against the frame mapped before it.
+    fn addMappedFrame(self: *Self, frame: GifFrame, palette: *const quant.Palette) !void {
+        const quantized = try quant.mapToPalette(self.indexedConfig(frame.row_stride), palette, frame.bgra_buf);
+        self.allocator.free(quantized.color_table);
+        errdefer self.allocator.free(quantized.image_buffer);
+
+        try self.appendIndexedFrame(quantized.image_buffer, self.prev_indices, frame.duration_ms);
+        if (self.prev_indices) |prev| self.allocator.free(prev);
+        self.prev_indices = quantized.image_buffer;
+    }
+
+    /// Encode a frame of palette indices. Unless it's the first one, only the part
+    /// that differs from `prev` is stored, with the transparent index where nothing changed.
+    fn appendIndexedFrame(self: *Self, indices: []const u8, prev_frame: ?[]const u8, duration_ms: u64) !void {
+        const width = self.config.width;
+        var region = Region{ .x = 0, .y = 0, .width = width, .height = self.config.height };
+        var blend = BlendOp.source;
+        const trans_index = self.transparent_index;
+        const prev_indices = if (trans_index != null) prev_frame else null;
+        // Every palette entry other than the transparent one is opaque, so frames can always be blended.
+        if (prev_indices) |prev| {
+            region = changedRegion(prev, width, indices, width, width, self.config.height, 1);
+            blend = .over;
+        }
+
+        self.pixels.clearRetainingCapacity();
+        try self.pixels.ensureTotalCapacity(region.width * region.height);
+        for (region.y..region.y + region.height) |y| {
+            const start = y * width + region.x;
+            const row = indices[start..][0..region.width];
+            if (blend == .source) {
+                self.pixels.appendSliceAssumeCapacity(row);
+                continue;
+            }
+
+            const prev = prev_indices.?[start..][0..region.width];
+            for (row, prev) |index, prev_index| {
+                self.pixels.appendAssumeCapacity(if (index == prev_index) trans_index.? else index);
+            }
+        }
+
+        // Neighbouring palette indices aren't related, so filters don't help.
+        try self.appendFrame(self.pixels.items, 1, region, blend, duration_ms, .none);
+    }
+
+    /// Filter and compress the pixels of `region`, and append the frame's chunks.
+    fn appendFrame(
+        self: *Self,
+        pixels: []const u8,
+        bpp: usize,
+        region: Region,
+        blend: BlendOp,
+        duration_ms: u64,
+        strategy: png.filter.Strategy,
+    ) !void {
+        self.filtered.clearRetainingCapacity();
+        try png.filter.filterImage(&self.filtered, pixels, region.width * bpp, region.height, bpp, strategy);
+
+        // Room for the sequence number that fdAT chunks start with.
+        self.compressed.clearRetainingCapacity();
+        try self.compressed.appendNTimes(0, 4);
+        try png.deflate(&self.compressed, self.filtered.items);
+
+        var fctl: [26]u8 = undefined;
+        std.mem.writeInt(u32, fctl[0..4], self.sequence, .big);
+        std.mem.writeInt(u32, fctl[4..8], @intCast(region.width), .big);
+        std.mem.writeInt(u32, fctl[8..12], @intCast(region.height), .big);
+        std.mem.writeInt(u32, fctl[12..16], @intCast(region.x), .big);
+        std.mem.writeInt(u32, fctl[16..20], @intCast(region.y), .big);
+        // The delay is a fraction of a second: milliseconds over 1000.
+        std.mem.writeInt(u16, fctl[20..22], @intCast(@min(duration_ms, std.math.maxInt(u16))), .big);
+        std.mem.writeInt(u16, fctl[22..24], 1000, .big);
+        fctl[24] = 0; // dispose op: leave the frame on the canvas
+        fctl[25] = @intFromEnum(blend);
+
+        const writer = self.chunks.writer();
+        try png.writeChunk(writer, "fcTL", &fctl);
+        self.sequence += 1;
+
+        if (self.nframes == 0) {
+            try png.writeChunk(writer, "IDAT", self.compressed.items[4..]);
+        } else {
+            std.mem.writeInt(u32, self.compressed.items[0..4], self.sequence, .big);
+            try png.writeChunk(writer, "fdAT", self.compressed.items);
+            self.sequence += 1;
+        }
+
+        self.nframes += 1;
+    }
+
+    /// Write the file, and close the sink.
+    pub fn close(self: *Self) !void {
+        if (self.config.color_mode == .indexed and self.palette == null) {
+            try self.encodeIndexed();
+        }
+        if (self.nframes == 0) return PngError.no_frames;
+
+        const writer = self.sink_writer.writer();
+        try writer.writeAll(&png.signature);
+
+        const header = png.Header{
+            .width = self.config.width,
+            .height = self.config.height,
+            .color_type = if (self.color_table == null) .truecolor_alpha else .indexed,
+        };
+        try png.writeChunk(writer, "IHDR", &(try header.encode()));
+
+        var actl: [8]u8 = undefined;
+        std.mem.writeInt(u32, actl[0..4], @intCast(self.nframes), .big);
+        std.mem.writeInt(u32, actl[4..8], self.config.loop_count, .big);
+        try png.writeChunk(writer, "acTL", &actl);
+
+        if (self.color_table) |table| {
+            try png.writePalette(writer, table, self.transparent_index);
+        }
+
+        try writer.writeAll(self.chunks.items);
+        try png.writeChunk(writer, "IEND", "");
+        try self.sink_writer.close();
+    }
+};
+
+/// The smallest region that contains every pixel that differs between `prev` and `cur`,
+/// two images with `bpp` bytes per pixel whose rows start `prev_stride` and `cur_stride`
+/// bytes apart. A single pixel if nothing changed, since every frame must store at least one.
+fn changedRegion(
+    prev: []const u8,
+    prev_stride: usize,
+    cur: []const u8,
+    cur_stride: usize,
+    width: usize,
+    height: usize,
+    bpp: usize,
+) Region {
+    const row_len = width * bpp;
+    var min_x: usize = width;
+    var max_x: usize = 0;
+    var min_y: usize = height;
+    var max_y: usize = 0;
+
+    for (0..height) |y| {
+        const a = prev[y * prev_stride ..][0..row_len];
+        const b = cur[y * cur_stride ..][0..row_len];
+        const first = std.mem.indexOfDiff(u8, a, b) orelse continue;
+
+        var last = row_len - 1;
+        while (a[last] == b[last]) last -= 1;
+
+        min_x = @min(min_x, first / bpp);
+        max_x = @max(max_x, last / bpp);
+        min_y = @min(min_y, y);
+        max_y = y;
+    }
+
+    if (min_y == height) return .{ .x = 0, .y = 0, .width = 1, .height = 1 };
+    return .{
+        .x = min_x,
+        .y = min_y,
+        .width = max_x - min_x + 1,
+        .height = max_y - min_y + 1,
+    };
+}
+
+/// Whether every BGRA pixel in `region` that differs between `prev` and `cur` is opaque in `cur`.
+/// `prev` is packed, `width` pixels per row, while the rows of `cur` start `cur_stride` bytes apart.
+fn changesAreOpaque(prev: []const u8, cur: []const u8, width: usize, cur_stride: usize, region: Region) bool {
+    for (region.y..region.y + region.height) |y| {
+        for (region.x..region.x + region.width) |x| {
+            const i = (y * width + x) * 4;
+            const j = y * cur_stride + x * 4;
+            if (cur[j + 3] != 255 and !std.mem.eql(u8, prev[i..][0..4], cur[j..][0..4])) return false;
+        }
+    }
+    return true;
+}
+
+const t = std.testing;
+
+const Chunk = struct {
+    kind: []const u8,
+    data: []const u8,
+};
+
+/// Split a PNG file into its chunks, checking every CRC.
+fn parseChunks(allocator: std.mem.Allocator, file: []const u8) ![]Chunk {
+    try t.expectEqualSlices(u8, &png.signature, file[0..8]);
+    var chunks = std.ArrayList(Chunk).init(allocator);
+    errdefer chunks.deinit();
+
+    var pos: usize = 8;
+    while (pos < file.len) {
+        const len = std.mem.readInt(u32, file[pos..][0..4], .big);
+        const chunk = Chunk{ .kind = file[pos + 4 ..][0..4], .data = file[pos + 8 ..][0..len] };
+        const crc = std.mem.readInt(u32, file[pos + 8 + len ..][0..4], .big);
+        var expected = std.hash.Crc32.init();
+        expected.update(chunk.kind);
+        expected.update(chunk.data);
+        try t.expectEqual(expected.final(), crc);
+        try chunks.append(chunk);
+        pos += 12 + len;
+    }
+    return chunks.toOwnedSlice();
+}
+
+fn testFrames(comptime width: usize, comptime height: usize) [3][width * height * 4]u8 {
+    var frames: [3][width * height * 4]u8 = undefined;
+    for (0..width * height) |i| {
+        const shade: u8 = @intCast(i * 8 % 256);
+        frames[0][i * 4 ..][0..4].* = .{ shade, 255 - shade, 100, 255 };
+    }
+    frames[1] = frames[0];
+    frames[1][(2 * width + 3) * 4 ..][0..4].* = .{ 1, 2, 3, 255 };
+    frames[1][(4 * width + 5) * 4 ..][0..4].* = .{ 1, 2, 3, 255 };
+    frames[2] = frames[1];
+    return frames;
+}
+
+test "Apng – truecolor frames are cropped to the changes" {
+    const allocator = t.allocator;
+    const width = 8;
+    const height = 6;
+    const frames = testFrames(width, height);
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var apng = try Apng.init(allocator, .{ .width = width, .height = height, .sink = .{ .memory = &out } });
+    defer apng.deinit();
+    for (&frames) |*frame| try apng.addFrame(.{ .bgra_buf = frame, .duration_ms = 40 });
+    try apng.close();
+
+    const chunks = try parseChunks(allocator, out.items);
+    defer allocator.free(chunks);
+
+    const types = [_][]const u8{ "IHDR", "acTL", "fcTL", "IDAT", "fcTL", "fdAT", "fcTL", "fdAT", "IEND" };
+    try t.expectEqual(types.len, chunks.len);
+    for (types, chunks) |expected, chunk| try t.expectEqualStrings(expected, chunk.kind);
+
+    try t.expectEqual(@intFromEnum(png.ColorType.truecolor_alpha), chunks[0].data[9]);
+    try t.expectEqual(3, std.mem.readInt(u32, chunks[1].data[0..4], .big));
+
+    // Sequence number, then width, height, x and y of the second frame.
+    const fctl = chunks[4].data;
+    try t.expectEqual(1, std.mem.readInt(u32, fctl[0..4], .big));
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[4..8], .big));
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[8..12], .big));
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[12..16], .big));
+    try t.expectEqual(2, std.mem.readInt(u32, fctl[16..20], .big));
+    try t.expectEqual(@intFromEnum(BlendOp.over), fctl[25]);
+
+    // An unchanged frame stores a single pixel.
+    try t.expectEqual(1, std.mem.readInt(u32, chunks[6].data[4..8], .big));
+
+    var decompressed = std.ArrayList(u8).init(allocator);
+    defer decompressed.deinit();
+    var stream = std.io.fixedBufferStream(chunks[5].data[4..]);
+    try std.compress.zlib.decompress(stream.reader(), decompressed.writer());
+    try t.expectEqual(3 * (1 + 3 * 4), decompressed.items.len);
+}
+
+test "Apng – indexed frames share one palette" {
+    const allocator = t.allocator;
+    const width = 8;
+    const height = 6;
+    const frames = testFrames(width, height);
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var apng = try Apng.init(allocator, .{
+        .width = width,
+        .height = height,
+        .sink = .{ .memory = &out },
+        .color_mode = .indexed,
+        .ncolors = 16,
+        .use_dithering = false,
+    });
+    defer apng.deinit();
+    for (&frames) |*frame| try apng.addFrame(.{ .bgra_buf = frame, .duration_ms = 40 });
+    try apng.close();
+
+    const chunks = try parseChunks(allocator, out.items);
+    defer allocator.free(chunks);
+
+    try t.expectEqual(@intFromEnum(png.ColorType.indexed), chunks[0].data[9]);
+    try t.expectEqualStrings("PLTE", chunks[2].kind);
+    try t.expectEqualStrings("tRNS", chunks[3].kind);
+    // The transparent entry is the last one listed.
+    try t.expectEqual(0, chunks[3].data[chunks[3].data.len - 1]);
+    try t.expectEqualStrings("IEND", chunks[chunks.len - 1].kind);
+}
+
+test "Apng – frames with a row stride encode like packed ones" {
+    const allocator = t.allocator;
+    const width = 8;
+    const height = 6;
+    const stride = (width + 3) * 4;
+    const frames = testFrames(width, height);
+
+    // The same frames, as views into images 3 pixels wider.
+    var wide: [frames.len][stride * height]u8 = undefined;
+    for (&wide, &frames) |*image, *frame| {
+        @memset(image, 0xEE);
+        for (0..height) |y| {
+            @memcpy(image[y * stride ..][0 .. width * 4], frame[y * width * 4 ..][0 .. width * 4]);
+        }
+    }
+
+    for ([_]ColorMode{ .truecolor, .indexed }) |color_mode| {
+        var outputs = [_]std.ArrayList(u8){
+            std.ArrayList(u8).init(allocator),
+            std.ArrayList(u8).init(allocator),
+        };
+        defer for (&outputs) |*out| out.deinit();
+
+        for (&outputs, [_]bool{ false, true }) |*out, strided| {
+            var apng = try Apng.init(allocator, .{
+                .width = width,
+                .height = height,
+                .sink = .{ .memory = out },
+                .color_mode = color_mode,
+                .use_dithering = false,
+            });
+            defer apng.deinit();
+            for (&frames, &wide) |*frame, *image| {
+                const input = if (strided)
+                    GifFrame{ .bgra_buf = image, .duration_ms = 40, .row_stride = stride }
+                else
+                    GifFrame{ .bgra_buf = frame, .duration_ms = 40 };
+                try apng.addFrame(input);
+            }
+            try apng.close();
+        }
+
+        try t.expectEqualSlices(u8, outputs[0].items, outputs[1].items);
+    }
+}
+
+test "Apng – indexed frames past max_indexed_bytes are mapped as they come" {
+    const allocator = t.allocator;
+    const width = 8;
+    const height = 6;
+    const frames = testFrames(width, height);
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+
+    var apng = try Apng.init(allocator, .{
+        .width = width,
+        .height = height,
+        .sink = .{ .memory = &out },
+        .color_mode = .indexed,
+        .use_dithering = false,
+        .max_indexed_bytes = frames[0].len,
+    });
+    defer apng.deinit();
+    for (&frames) |*frame| try apng.addFrame(.{ .bgra_buf = frame, .duration_ms = 40 });
+    try t.expect(apng.palette != null);
+    try t.expectEqual(0, apng.indexed_frames.items.len);
+    try apng.close();
+
+    const chunks = try parseChunks(allocator, out.items);
+    defer allocator.free(chunks);
+
+    const types = [_][]const u8{ "IHDR", "acTL", "PLTE", "tRNS", "fcTL", "IDAT", "fcTL", "fdAT", "fcTL", "fdAT", "IEND" };
+    try t.expectEqual(types.len, chunks.len);
+    for (types, chunks) |expected, chunk| try t.expectEqualStrings(expected, chunk.kind);
+
+    // The second frame only stores the two pixels that changed, and what's between them.
+    const fctl = chunks[6].data;
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[4..8], .big));
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[8..12], .big));
+    try t.expectEqual(3, std.mem.readInt(u32, fctl[12..16], .big));
+    try t.expectEqual(2, std.mem.readInt(u32, fctl[16..20], .big));
+}
@@ -0,0 +1,319 @@
+const std = @import("std");
+const png = @import("png.zig");
+const filter = @import("filter.zig");
+const pixel = @import("pixel");
+
+// Encodes BGRA or RGBA frames (such as screen captures) to truecolor PNGs on several threads,
+// the way pigz parallelizes gzip.
+//
+// The image is cut into bands of rows. Every band is converted, filtered and compressed
+// on its own, and all but the last end with a sync flush: an empty stored block that leaves
+// the output on a byte boundary. The compressed bands are then simply concatenated into one
+// zlib stream, written as one IDAT chunk per band. Every band also checksums its filtered
+// bytes, and the checksums are combined into the Adler-32 of the whole stream.
+// Bands don't share their history with the next one, which costs a little compression
+// at each boundary, so bands are kept large.
+
+pub const PixelFormat = enum { rgba, bgra };
+
+/// Pixels to encode, 4 bytes per pixel.
+pub const Image = struct {
+    pixels: []const u8,
+    width: usize,
+    height: usize,
+    /// Bytes from the start of a row to the start of the next one. 0 means `width * 4`.
+    row_stride: usize = 0,
+    format: PixelFormat = .rgba,
+
+    fn stride(self: *const Image) usize {
+        return if (self.row_stride == 0) self.width * 4 else self.row_stride;
+    }
+};
+
+pub const EncodeOptions = struct {
+    /// Store the alpha channel. Screen captures are opaque, and RGB is a quarter smaller.
+    keep_alpha: bool = false,
+    deflate: std.compress.flate.Options = .{ .level = .fast },
+    /// Roughly how many uncompressed bytes go in a band.
+    band_size: usize = 512 * 1024,
+    /// Pool to compress the bands on. If null, one is created for the call.
+    pool: ?*std.Thread.Pool = null,
+    /// Number of threads of the pool created when `pool` is null. 0 means one per CPU.
+    n_jobs: u32 = 0,
+};
+
+const Band = struct {
+    first_row: usize,
+    nrows: usize,
+    /// Raw DEFLATE blocks.
+    compressed: std.ArrayList(u8),
+    /// Adler-32 of the filtered bytes.
+    adler: u32 = 1,
+    err: ?anyerror = null,
+};
+
+/// Encode `image` as a PNG file written to `writer`.
+pub fn encode(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    image: Image,
+    options: EncodeOptions,
+) !void {
+    if (image.width == 0 or image.height == 0) return png.PngError.empty_image;
+    if (image.stride() < image.width * 4 or
+        image.pixels.len < (image.height - 1) * image.stride() + image.width * 4)
+    {
+        return png.PngError.buffer_too_small;
+    }
+
+    const header = png.Header{
+        .width = image.width,
+        .height = image.height,
+        .color_type = if (options.keep_alpha) .truecolor_alpha else .truecolor,
+    };
+    const ihdr = try header.encode();
+
+    const bpp: usize = if (options.keep_alpha) 4 else 3;
+    const line_len = image.width * bpp + 1;
+    const rows_per_band = @max(options.band_size / line_len, 1);
+    const nbands = (image.height + rows_per_band - 1) / rows_per_band;
+
+    const bands = try allocator.alloc(Band, nbands);
+    defer allocator.free(bands);
+    for (bands, 0..) |*band, i| {
+        const first_row = i * rows_per_band;
+        band.* = .{
+            .first_row = first_row,
+            .nrows = @min(rows_per_band, image.height - first_row),
+            .compressed = std.ArrayList(u8).init(allocator),
+        };
+    }
+    defer for (bands) |band| band.compressed.deinit();
+
+    var own_pool: std.Thread.Pool = undefined;
+    const pool = options.pool orelse blk: {
+        try own_pool.init(.{
+            .allocator = allocator,
+            .n_jobs = if (options.n_jobs == 0) null else options.n_jobs,
+        });
+        break :blk &own_pool;
+    };
+    defer if (options.pool == null) own_pool.deinit();
+
+    var wait_group = std.Thread.WaitGroup{};
+    for (bands) |*band| {
+        const is_last = band == &bands[nbands - 1];
+        wait_group.start();
+        // If no job could be queued, compress the band on this thread instead.
+        pool.spawn(encodeBand, .{ allocator, &image, &options, band, is_last, &wait_group }) catch
+            encodeBand(allocator, &image, &options, band, is_last, &wait_group);
+    }
+    pool.waitAndWork(&wait_group);
+
+    var adler: u32 = 1;
+    for (bands) |band| {
+        if (band.err) |err| return err;
+        adler = adler32Combine(adler, band.adler, band.nrows * line_len);
+    }
+
+    // zlib header: DEFLATE with a 32K window, no preset dictionary.
+    const zlib_header = [_]u8{ 0x78, 0x9C };
+    var zlib_trailer: [4]u8 = undefined;
+    std.mem.writeInt(u32, &zlib_trailer, adler, .big);
+
+    try writer.writeAll(&png.signature);
+    try png.writeChunk(writer, "IHDR", &ihdr);
+    for (bands, 0..) |band, i| {
+        const parts = [_][]const u8{
+            if (i == 0) &zlib_header else "",
+            band.compressed.items,
+            if (i == nbands - 1) &zlib_trailer else "",
+        };
+        try png.writeChunkParts(writer, "IDAT", &parts);
+    }
+    try png.writeChunk(writer, "IEND", "");
+}
+
+/// Encode `image` as a PNG file at `path`.
+pub fn encodeFile(
+    allocator: std.mem.Allocator,
+    path: []const u8,
+    image: Image,
+    options: EncodeOptions,
+) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    var buffered = std.io.bufferedWriter(file.writer());
+    try encode(allocator, buffered.writer(), image, options);
+    try buffered.flush();
+}
+
+/// Runs on a worker thread.
+fn encodeBand(
+    allocator: std.mem.Allocator,
+    image: *const Image,
+    options: *const EncodeOptions,
+    band: *Band,
+    is_last: bool,
+    wait_group: *std.Thread.WaitGroup,
+) void {
+    defer wait_group.finish();
+    encodeBandRows(allocator, image, options, band, is_last) catch |err| {
+        band.err = err;
+    };
+}
+
+fn encodeBandRows(
+    allocator: std.mem.Allocator,
+    image: *const Image,
+    options: *const EncodeOptions,
+    band: *Band,
+    is_last: bool,
+) !void {
+    const bpp: usize = if (options.keep_alpha) 4 else 3;
+    const row_len = image.width * bpp;
+
+    // The previous and current converted rows, a filtered line, and scratch space for the filter.
+    const buf = try allocator.alloc(u8, row_len * 4 + 1);
+    defer allocator.free(buf);
+    var prev = buf[0..row_len];
+    var row = buf[row_len..][0..row_len];
+    const scratch = buf[2 * row_len ..][0..row_len];
+    const line = buf[3 * row_len ..][0 .. row_len + 1];
+
+    // Filters look at the row above, even when it belongs to the previous band.
+    if (band.first_row == 0) {
+        @memset(prev, 0);
+    } else {
+        convertRow(image, band.first_row - 1, options.keep_alpha, prev);
+    }
+
+    var compressor = try std.compress.flate.compressor(band.compressed.writer(), options.deflate);
+    var adler = std.hash.Adler32.init();
+    for (band.first_row..band.first_row + band.nrows) |y| {
+        convertRow(image, y, options.keep_alpha, row);
+        const filter_type = filter.filterRowAdaptive(row, prev, bpp, line[1..], scratch);
+        line[0] = @intFromEnum(filter_type);
+        try compressor.writer().writeAll(line);
+        adler.update(line);
+        std.mem.swap([]u8, &prev, &row);
+    }
+
+    if (is_last) try compressor.finish() else try compressor.flush();
+    band.adler = adler.final();
+}
+
+/// Convert row `y` of `image` to RGB, or RGBA with `keep_alpha`.
+fn convertRow(image: *const Image, y: usize, keep_alpha: bool, out: []u8) void {
+    const src = image.pixels[y * image.stride() ..][0 .. image.width * 4];
+    switch (image.format) {
+        .rgba => if (keep_alpha) @memcpy(out, src) else pixel.convert(.rgba, .rgb, src, out),
+        .bgra => if (keep_alpha) pixel.convert(.bgra, .rgba, src, out) else pixel.convert(.bgra, .rgb, src, out),
+    }
+}
+
+/// The Adler-32 of two pieces of data put together, from the checksum of each
+/// and the length of the second (as zlib's `adler32_combine`).
+fn adler32Combine(adler1: u32, adler2: u32, len2: usize) u32 {
+    const base = 65521;
+    const rem: u32 = @intCast(len2 % base);
+    const a1 = adler1 & 0xFFFF;
+    const b1 = adler1 >> 16;
+    const a2 = adler2 & 0xFFFF;
+    const b2 = adler2 >> 16;
+
+    // a = a1 + a2 - 1, b = b1 + b2 + rem * (a1 - 1), all modulo base.
+    const a = (a1 + a2 + base - 1) % base;
+    const b = (b1 + b2 + @as(u64, rem) * a1 % base + base - rem) % base;
+    return @intCast(b << 16 | a);
+}
+
+const t = std.testing;
+
+test "adler32Combine" {
+    var gen = std.rand.DefaultPrng.init(3);
+    var data: [100_000]u8 = undefined;
+    gen.random().bytes(&data);
+
+    for ([_]usize{ 0, 1, 5000, 65521, 70_000, data.len }) |split| {
+        const combined = adler32Combine(
+            std.hash.Adler32.hash(data[0..split]),
+            std.hash.Adler32.hash(data[split..]),
+            data.len - split,
+        );
+        try t.expectEqual(std.hash.Adler32.hash(&data), combined);
+    }
+}
+
+test "encode – bands decompress to the filtered rows" {
+    const allocator = t.allocator;
+    const width = 7;
+    const height = 9;
+    const stride = width * 4 + 5; // rows are padded
+
+    var gen = std.rand.DefaultPrng.init(11);
+    var pixels: [height * stride]u8 = undefined;
+    gen.random().bytes(&pixels);
+
+    for ([_]PixelFormat{ .rgba, .bgra }) |format| {
+        for ([_]bool{ false, true }) |keep_alpha| {
+            var out = std.ArrayList(u8).init(allocator);
+            defer out.deinit();
+            const image = Image{
+                .pixels = &pixels,
+                .width = width,
+                .height = height,
+                .row_stride = stride,
+                .format = format,
+            };
+            // Two rows per band, so the image takes several IDAT chunks.
+            const bpp: usize = if (keep_alpha) 4 else 3;
+            try encode(allocator, out.writer(), image, .{
+                .keep_alpha = keep_alpha,
+                .band_size = 2 * (width * bpp + 1),
+                .n_jobs = 2,
+            });
+
+            try t.expectEqualSlices(u8, &png.signature, out.items[0..8]);
+            try t.expectEqual(@as(u8, if (keep_alpha) 6 else 2), out.items[8 + 8 + 9]);
+
+            // Gather the IDAT chunks into one zlib stream.
+            var stream = std.ArrayList(u8).init(allocator);
+            defer stream.deinit();
+            var pos: usize = 8;
+            var nidat: usize = 0;
+            while (pos < out.items.len) {
+                const len = std.mem.readInt(u32, out.items[pos..][0..4], .big);
+                if (std.mem.eql(u8, out.items[pos + 4 ..][0..4], "IDAT")) {
+                    try stream.appendSlice(out.items[pos + 8 ..][0..len]);
+                    nidat += 1;
+                }
+                pos += len + 12;
+            }
+            try t.expectEqual(5, nidat);
+
+            var decompressed = std.ArrayList(u8).init(allocator);
+            defer decompressed.deinit();
+            var reader = std.io.fixedBufferStream(stream.items);
+            try std.compress.zlib.decompress(reader.reader(), decompressed.writer());
+
+            const row_len = width * bpp;
+            try t.expectEqual((row_len + 1) * height, decompressed.items.len);
+            var prev = [_]u8{0} ** (width * 4);
+            for (0..height) |y| {
+                const line = decompressed.items[y * (row_len + 1) ..][0 .. row_len + 1];
+                const filter_type: filter.FilterType = @enumFromInt(line[0]);
+                filter.unfilterRow(filter_type, line[1..], prev[0..row_len], bpp);
+
+                var expected: [width * 4]u8 = undefined;
+                convertRow(&image, y, keep_alpha, expected[0..row_len]);
+                try t.expectEqualSlices(u8, expected[0..row_len], line[1..]);
+                // Spot check the swizzle against the source pixels.
+                const src = pixels[y * stride ..][0..4];
+                try t.expectEqual(if (format == .rgba) src[0] else src[2], line[1]);
+                @memcpy(prev[0..row_len], line[1..]);
+            }
+        }
+    }
+}
@@ -0,0 +1,231 @@
+const std = @import("std");
+
+// PNG filters predict every byte of a scanline from its neighbours (the byte `bpp` to the left,
+// the byte above, and the one above-left) and store the difference, which DEFLATE compresses
+// far better than raw pixels on smooth or repetitive images.
+// See: https://www.w3.org/TR/png/#9Filters
+
+pub const FilterType = enum(u8) {
+    none = 0,
+    sub = 1,
+    up = 2,
+    average = 3,
+    paeth = 4,
+};
+
+/// How the filter of every row is chosen.
+pub const Strategy = enum {
+    /// Store rows as they are. Recommended for indexed images, where neighbouring indices
+    /// aren't numerically related.
+    none,
+    /// Try every filter, and keep the one with the smallest sum of absolute differences
+    /// (the heuristic libpng uses).
+    adaptive,
+};
+
+fn paethPredictor(a: u8, b: u8, c: u8) u8 {
+    const p = @as(i16, a) + b - c;
+    const pa = @abs(p - a);
+    const pb = @abs(p - b);
+    const pc = @abs(p - c);
+    if (pa <= pb and pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+const lanes = std.simd.suggestVectorLength(u8) orelse 16;
+const V = @Vector(lanes, u8);
+const Wide = @Vector(lanes, i16);
+
+inline fn load(bytes: []const u8, i: usize) V {
+    return bytes[i..][0..lanes].*;
+}
+
+inline fn store(bytes: []u8, i: usize, v: V) void {
+    bytes[i..][0..lanes].* = v;
+}
+
+/// Floor of (a + b) / 2, without overflowing a byte.
+inline fn average(a: V, b: V) V {
+    return (a & b) + ((a ^ b) >> @splat(1));
+}
+
+/// The Paeth predictor for a whole vector of bytes at once.
+inline fn paethVector(a: V, b: V, c: V) V {
+    const wa: Wide = @intCast(a);
+    const wb: Wide = @intCast(b);
+    const wc: Wide = @intCast(c);
+    // p = a + b - c, so |p - a| = |b - c|, |p - b| = |a - c| and |p - c| = |a + b - 2c|.
+    const pa = @abs(wb - wc);
+    const pb = @abs(wa - wc);
+    const pc = @abs(wa + wb - wc - wc);
+    const no: @Vector(lanes, bool) = @splat(false);
+    const use_a = @select(bool, pa <= pb, pa <= pc, no);
+    const use_b = pb <= pc;
+    return @select(u8, use_a, a, @select(u8, use_b, b, c));
+}
+
+/// Filter `row` with `filter_type` into `out`, which must be as long as `row`.
+/// `prev` is the unfiltered row above, all zeroes for the first row.
+/// `bpp` is the number of bytes per complete pixel (at least 1).
+///
+/// Filtering only reads unfiltered bytes, so every byte of a row can be filtered
+/// independently: each filter handles a vector's worth of bytes at a time.
+pub fn filterRow(filter_type: FilterType, row: []const u8, prev: []const u8, bpp: usize, out: []u8) void {
+    std.debug.assert(row.len == prev.len and row.len == out.len);
+
+    // The first pixel has no left neighbour, which is the same as a neighbour of zeroes.
+    const head = @min(bpp, row.len);
+    for (0..head) |i| {
+        out[i] = switch (filter_type) {
+            .none => row[i],
+            .sub => row[i],
+            .up, .paeth => row[i] -% prev[i],
+            .average => row[i] -% prev[i] / 2,
+        };
+    }
+
+    var i = head;
+    while (i + lanes <= row.len) : (i += lanes) {
+        const x = load(row, i);
+        const b = load(prev, i);
+        store(out, i, switch (filter_type) {
+            .none => x,
+            .sub => x -% load(row, i - bpp),
+            .up => x -% b,
+            .average => x -% average(load(row, i - bpp), b),
+            .paeth => x -% paethVector(load(row, i - bpp), b, load(prev, i - bpp)),
+        });
+    }
+
+    while (i < row.len) : (i += 1) {
+        const a = row[i - bpp];
+        const b = prev[i];
+        out[i] = row[i] -% switch (filter_type) {
+            .none => 0,
+            .sub => a,
+            .up => b,
+            .average => @as(u8, @intCast((@as(u16, a) + b) / 2)),
+            .paeth => paethPredictor(a, b, prev[i - bpp]),
+        };
+    }
+}
+
+/// Sum of the filtered bytes read as signed values, the smaller the better.
+fn cost(filtered: []const u8) u64 {
+    var sum: u64 = 0;
+    var i: usize = 0;
+    while (i + lanes <= filtered.len) : (i += lanes) {
+        const signed: @Vector(lanes, i8) = @bitCast(load(filtered, i));
+        const magnitudes: @Vector(lanes, u16) = @intCast(@abs(signed));
+        sum += @reduce(.Add, magnitudes);
+    }
+    for (filtered[i..]) |byte| {
+        sum += @abs(@as(i8, @bitCast(byte)));
+    }
+    return sum;
+}
+
+/// Filter a row with the filter that gives the smallest `cost`.
+/// `scratch` must be as long as `row`.
+pub fn filterRowAdaptive(row: []const u8, prev: []const u8, bpp: usize, out: []u8, scratch: []u8) FilterType {
+    var best = FilterType.none;
+    filterRow(.none, row, prev, bpp, out);
+    var best_cost = cost(out);
+
+    for ([_]FilterType{ .sub, .up, .average, .paeth }) |filter_type| {
+        filterRow(filter_type, row, prev, bpp, scratch);
+        const c = cost(scratch);
+        if (c < best_cost) {
+            best = filter_type;
+            best_cost = c;
+            @memcpy(out, scratch);
+        }
+    }
+    return best;
+}
+
+/// Filter an image with `height` rows of `row_len` bytes each, and append the result
+/// (a filter type byte followed by the filtered row, for every row) to `out`.
+pub fn filterImage(
+    out: *std.ArrayList(u8),
+    pixels: []const u8,
+    row_len: usize,
+    height: usize,
+    bpp: usize,
+    strategy: Strategy,
+) !void {
+    std.debug.assert(pixels.len >= row_len * height);
+    try out.ensureUnusedCapacity((row_len + 1) * height);
+
+    const allocator = out.allocator;
+    const zeroes = try allocator.alloc(u8, row_len);
+    defer allocator.free(zeroes);
+    @memset(zeroes, 0);
+    const scratch = try allocator.alloc(u8, row_len);
+    defer allocator.free(scratch);
+
+    for (0..height) |y| {
+        const row = pixels[y * row_len ..][0..row_len];
+        const prev = if (y == 0) zeroes else pixels[(y - 1) * row_len ..][0..row_len];
+
+        const start = out.items.len;
+        out.items.len += row_len + 1;
+        const dst = out.items[start + 1 ..][0..row_len];
+        const filter_type = switch (strategy) {
+            .none => blk: {
+                @memcpy(dst, row);
+                break :blk FilterType.none;
+            },
+            .adaptive => filterRowAdaptive(row, prev, bpp, dst, scratch),
+        };
+        out.items[start] = @intFromEnum(filter_type);
+    }
+}
+
+/// Undo `filterRow` in place, like a decoder would.
+pub fn unfilterRow(filter_type: FilterType, row: []u8, prev: []const u8, bpp: usize) void {
+    for (0..row.len) |i| {
+        const a = if (i >= bpp) row[i - bpp] else 0;
+        const c = if (i >= bpp) prev[i - bpp] else 0;
+        row[i] +%= switch (filter_type) {
+            .none => 0,
+            .sub => a,
+            .up => prev[i],
+            .average => @as(u8, @intCast((@as(u16, a) + prev[i]) / 2)),
+            .paeth => paethPredictor(a, prev[i], c),
+        };
+    }
+}
+
+const t = std.testing;
+
+test "filterRow – every filter can be undone" {
+    var gen = std.rand.DefaultPrng.init(9);
+    // Long enough for the vectorized loop, and not a multiple of the vector length.
+    var prev: [4 * lanes + 7]u8 = undefined;
+    var row: [4 * lanes + 7]u8 = undefined;
+    gen.random().bytes(&prev);
+    gen.random().bytes(&row);
+
+    for ([_]usize{ 1, 3, 4 }) |bpp| {
+        for ([_]FilterType{ .none, .sub, .up, .average, .paeth }) |filter_type| {
+            var filtered: [row.len]u8 = undefined;
+            filterRow(filter_type, &row, &prev, bpp, &filtered);
+            unfilterRow(filter_type, &filtered, &prev, bpp);
+            try t.expectEqualSlices(u8, &row, &filtered);
+        }
+    }
+}
+
+test "filterRowAdaptive – picks a cheap filter" {
+    // A horizontal gradient: every byte is its left neighbour plus one.
+    var row: [16]u8 = undefined;
+    for (&row, 0..) |*byte, i| byte.* = @intCast(100 + i);
+    const prev = [_]u8{0} ** 16;
+
+    var out: [16]u8 = undefined;
+    var scratch: [16]u8 = undefined;
+    try t.expectEqual(FilterType.sub, filterRowAdaptive(&row, &prev, 1, &out, &scratch));
+    try t.expectEqualSlices(u8, &([_]u8{100} ++ [_]u8{1} ** 15), &out);
+}
@@ -0,0 +1,141 @@
+const std = @import("std");
+const quant = @import("quantize");
+const png = @import("png.zig");
+
+// Writes a quantized image as a palette-based PNG: a PLTE chunk with the color table,
+// and one index per pixel, packed into 1, 2, 4 or 8 bits depending on the palette size.
+// Compared to expanding the image back to RGB, this stores a third of the bytes
+// (or less) before compression.
+
+/// The smallest bit depth that can index `ncolors` palette entries.
+pub fn bitDepth(ncolors: usize) u8 {
+    if (ncolors <= 2) return 1;
+    if (ncolors <= 4) return 2;
+    if (ncolors <= 16) return 4;
+    return 8;
+}
+
+/// Pack a row of indices into `out`, `bit_depth` bits each, leftmost pixel in the high bits.
+/// `out` must hold `(row.len * bit_depth + 7) / 8` bytes.
+pub fn packRow(row: []const u8, bit_depth: u8, out: []u8) void {
+    if (bit_depth == 8) {
+        @memcpy(out[0..row.len], row);
+        return;
+    }
+
+    const per_byte = 8 / bit_depth;
+    const shift: u3 = @intCast(bit_depth);
+    @memset(out, 0);
+    for (row, 0..) |index, i| {
+        const slot: u3 = @intCast(per_byte - 1 - i % per_byte);
+        out[i / per_byte] |= index << (slot * shift);
+    }
+}
+
+/// Write `image` (of `width` x `height` pixels) as a PNG file to `writer`.
+pub fn writeIndexed(
+    allocator: std.mem.Allocator,
+    writer: anytype,
+    image: *const quant.QuantizedImage,
+    width: usize,
+    height: usize,
+) !void {
+    std.debug.assert(image.image_buffer.len == width * height);
+    const ncolors = image.color_table.len / 3;
+    const bit_depth = bitDepth(ncolors);
+    const row_len = (width * bit_depth + 7) / 8;
+
+    // Neighbouring palette indices aren't related, so every row is stored unfiltered:
+    // a zero filter type byte, then the packed row.
+    const filtered = try allocator.alloc(u8, (row_len + 1) * height);
+    defer allocator.free(filtered);
+    for (0..height) |y| {
+        const line = filtered[y * (row_len + 1) ..][0 .. row_len + 1];
+        line[0] = @intFromEnum(png.filter.FilterType.none);
+        packRow(image.image_buffer[y * width ..][0..width], bit_depth, line[1..]);
+    }
+
+    var compressed = std.ArrayList(u8).init(allocator);
+    defer compressed.deinit();
+    try png.deflate(&compressed, filtered);
+
+    const header = png.Header{
+        .width = width,
+        .height = height,
+        .bit_depth = bit_depth,
+        .color_type = .indexed,
+    };
+
+    try writer.writeAll(&png.signature);
+    try png.writeChunk(writer, "IHDR", &(try header.encode()));
+    try png.writePalette(writer, image.color_table, image.transparent_index);
+    try png.writeChunk(writer, "IDAT", compressed.items);
+    try png.writeChunk(writer, "IEND", "");
+}
+
+/// Write `image` as a PNG file at `path`.
+pub fn writeIndexedFile(
+    allocator: std.mem.Allocator,
+    path: []const u8,
+    image: *const quant.QuantizedImage,
+    width: usize,
+    height: usize,
+) !void {
+    const file = try std.fs.cwd().createFile(path, .{});
+    defer file.close();
+
+    var buffered = std.io.bufferedWriter(file.writer());
+    try writeIndexed(allocator, buffered.writer(), image, width, height);
+    try buffered.flush();
+}
+
+const t = std.testing;
+
+test "packRow" {
+    var out: [2]u8 = undefined;
+    packRow(&[_]u8{ 1, 0, 1, 1, 0, 0, 0, 1, 1 }, 1, &out);
+    try t.expectEqualSlices(u8, &[_]u8{ 0b10110001, 0b10000000 }, &out);
+
+    packRow(&[_]u8{ 3, 0, 2, 1, 2 }, 2, &out);
+    try t.expectEqualSlices(u8, &[_]u8{ 0b11001001, 0b10000000 }, &out);
+
+    packRow(&[_]u8{ 0xA, 0x5, 0xF }, 4, &out);
+    try t.expectEqualSlices(u8, &[_]u8{ 0xA5, 0xF0 }, &out);
+}
+
+test "writeIndexed" {
+    const allocator = t.allocator;
+    var color_table = [_]u8{ 0, 0, 0, 255, 255, 255, 255, 0, 0 };
+    var pixels = [_]u8{
+        0, 1, 2, 0, 1,
+        2, 2, 2, 2, 2,
+    };
+    const image = quant.QuantizedImage.init(&color_table, &pixels);
+
+    var out = std.ArrayList(u8).init(allocator);
+    defer out.deinit();
+    try writeIndexed(allocator, out.writer(), &image, 5, 2);
+
+    try t.expectEqualSlices(u8, &png.signature, out.items[0..8]);
+    // IHDR: bit depth 2 for 3 colors, color type 3.
+    try t.expectEqualStrings("IHDR", out.items[12..16]);
+    try t.expectEqual(2, out.items[16 + 8]);
+    try t.expectEqual(3, out.items[16 + 9]);
+    // PLTE follows IHDR's data and CRC.
+    const plte = 8 + 12 + 13;
+    try t.expectEqual(9, std.mem.readInt(u32, out.items[plte..][0..4], .big));
+    try t.expectEqualStrings("PLTE", out.items[plte + 4 ..][0..4]);
+
+    const idat = plte + 12 + 9;
+    try t.expectEqualStrings("IDAT", out.items[idat + 4 ..][0..4]);
+    const idat_len = std.mem.readInt(u32, out.items[idat..][0..4], .big);
+
+    var decompressed = std.ArrayList(u8).init(allocator);
+    defer decompressed.deinit();
+    var stream = std.io.fixedBufferStream(out.items[idat + 8 ..][0..idat_len]);
+    try std.compress.zlib.decompress(stream.reader(), decompressed.writer());
+    try t.expectEqualSlices(u8, &[_]u8{
+        0, 0b00011000, 0b01000000,
+        0, 0b10101010, 0b10000000,
+    }, decompressed.items);
+}
@@ -0,0 +1,123 @@
+const std = @import("std");
+pub const filter = @import("filter.zig");
+const apng = @import("apng.zig");
+const indexed = @import("indexed.zig");
+const encoder = @import("encoder.zig");
+const sequence = @import("sequence.zig");
+
+// Pieces shared by our PNG and APNG writers.
+// See: https://www.w3.org/TR/png/
+
+pub const Apng = apng.Apng;
+pub const ApngConfig = apng.ApngConfig;
+pub const ApngColorMode = apng.ColorMode;
+pub const writeIndexed = indexed.writeIndexed;
+pub const writeIndexedFile = indexed.writeIndexedFile;
+pub const Image = encoder.Image;
+pub const PixelFormat = encoder.PixelFormat;
+pub const EncodeOptions = encoder.EncodeOptions;
+pub const encode = encoder.encode;
+pub const encodeFile = encoder.encodeFile;
+pub const PngSequence = sequence.PngSequence;
+pub const SequenceConfig = sequence.SequenceConfig;
+
+pub const PngError = error{
+    no_frames,
+    image_too_large,
+    empty_image,
+    buffer_too_small,
+};
+
+pub const signature = [_]u8{ 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+pub const ColorType = enum(u8) {
+    grayscale = 0,
+    truecolor = 2,
+    indexed = 3,
+    grayscale_alpha = 4,
+    truecolor_alpha = 6,
+};
+
+/// Contents of the IHDR chunk.
+pub const Header = struct {
+    width: usize,
+    height: usize,
+    bit_depth: u8 = 8,
+    color_type: ColorType,
+
+    pub fn encode(self: Header) ![13]u8 {
+        if (self.width > std.math.maxInt(u31) or self.height > std.math.maxInt(u31)) {
+            return PngError.image_too_large;
+        }
+
+        var data: [13]u8 = undefined;
+        std.mem.writeInt(u32, data[0..4], @intCast(self.width), .big);
+        std.mem.writeInt(u32, data[4..8], @intCast(self.height), .big);
+        data[8] = self.bit_depth;
+        data[9] = @intFromEnum(self.color_type);
+        data[10] = 0; // compression method: DEFLATE
+        data[11] = 0; // filter method: adaptive, one filter type per row
+        data[12] = 0; // no interlacing
+        return data;
+    }
+};
+
+/// Write a chunk: the length of its data, its type, the data itself and a CRC of type and data.
+pub fn writeChunk(writer: anytype, chunk_type: *const [4]u8, data: []const u8) !void {
+    try writeChunkParts(writer, chunk_type, &[_][]const u8{data});
+}
+
+/// Write a chunk whose data is the concatenation of `parts`, without copying them together.
+pub fn writeChunkParts(writer: anytype, chunk_type: *const [4]u8, parts: []const []const u8) !void {
+    var crc = std.hash.Crc32.init();
+    crc.update(chunk_type);
+    var len: usize = 0;
+    for (parts) |part| {
+        crc.update(part);
+        len += part.len;
+    }
+
+    try writer.writeInt(u32, @intCast(len), .big);
+    try writer.writeAll(chunk_type);
+    for (parts) |part| try writer.writeAll(part);
+    try writer.writeInt(u32, crc.final(), .big);
+}
+
+/// Compress filtered scanlines into a zlib stream (the contents of IDAT chunks), appended to `out`.
+pub fn deflate(out: *std.ArrayList(u8), filtered: []const u8) !void {
+    var stream = std.io.fixedBufferStream(filtered);
+    try std.compress.zlib.compress(stream.reader(), out.writer(), .{});
+}
+
+/// Write the PLTE chunk for an RGBRGB... color table, and a tRNS chunk
+/// if `transparent_index` is set.
+pub fn writePalette(writer: anytype, color_table: []const u8, transparent_index: ?u8) !void {
+    try writeChunk(writer, "PLTE", color_table);
+    if (transparent_index) |trans_index| {
+        // Entries after the last one listed are opaque.
+        var alpha: [256]u8 = undefined;
+        @memset(alpha[0..trans_index], 255);
+        alpha[trans_index] = 0;
+        try writeChunk(writer, "tRNS", alpha[0 .. @as(usize, trans_index) + 1]);
+    }
+}
+
+const t = std.testing;
+
+test "writeChunk" {
+    var out = std.ArrayList(u8).init(t.allocator);
+    defer out.deinit();
+    try writeChunk(out.writer(), "IEND", "");
+    // Every PNG file ends with these 12 bytes.
+    try t.expectEqualSlices(u8, &[_]u8{
+        0, 0, 0, 0, 'I', 'E', 'N', 'D', 0xAE, 0x42, 0x60, 0x82,
+    }, out.items);
+}
+
+test {
+    _ = @import("filter.zig");
+    _ = @import("apng.zig");
+    _ = @import("encoder.zig");
+    _ = @import("indexed.zig");
+    _ = @import("sequence.zig");
+}
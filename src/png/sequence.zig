@@ -0,0 +1,266 @@
+const std = @import("std");
+const encoder = @import("encoder.zig");
+
+// Writes a live stream of frames as numbered PNG files, without making the thread that
+// delivers the frames wait for compression or the disk.
+//
+// Frames are copied into one of a fixed number of slots and encoded on a thread pool,
+// which the encoder also uses to compress the bands of every frame. Once a frame is written,
+// its slot (and buffer) is reused for a later frame. When every slot is busy, the new frame
+// is dropped and counted: a capture that outpaces the disk loses frames instead of memory.
+
+pub const SequenceConfig = struct {
+    /// Directory the files are written to. It must exist.
+    dir_path: []const u8,
+    /// File names are this prefix, followed by the frame number padded to 6 digits.
+    prefix: []const u8 = "frame_",
+    /// Number of frames that can be waiting to be written at once.
+    max_pending: usize = 8,
+    /// Threads that encode frames, 0 means one per CPU.
+    n_jobs: u32 = 0,
+    /// Options for every frame. `pool` is ignored, frames are encoded on the sequence's pool.
+    encode_options: encoder.EncodeOptions = .{},
+};
+
+pub const PngSequence = struct {
+    const Self = @This();
+
+    const Slot = struct {
+        /// Grows to fit the largest frame seen so far.
+        buf: []u8 = &.{},
+        image: encoder.Image = undefined,
+        frame_number: usize = 0,
+    };
+
+    allocator: std.mem.Allocator,
+    config: SequenceConfig,
+    dir: std.fs.Dir,
+    pool: std.Thread.Pool,
+
+    /// Guards everything below.
+    mutex: std.Thread.Mutex = .{},
+    /// Signaled whenever a slot is released.
+    slot_released: std.Thread.Condition = .{},
+    slots: []Slot,
+    /// Indices of the slots that aren't in use, `free[0..nfree]`.
+    free: []usize,
+    nfree: usize,
+    next_frame_number: usize = 0,
+    dropped: usize = 0,
+    /// The first error of a background write.
+    err: ?anyerror = null,
+
+    pub fn init(allocator: std.mem.Allocator, config: SequenceConfig) !*Self {
+        std.debug.assert(config.max_pending > 0);
+
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+
+        var dir = try std.fs.cwd().openDir(config.dir_path, .{});
+        errdefer dir.close();
+
+        const slots = try allocator.alloc(Slot, config.max_pending);
+        errdefer allocator.free(slots);
+        @memset(slots, .{});
+
+        const free = try allocator.alloc(usize, config.max_pending);
+        errdefer allocator.free(free);
+        for (free, 0..) |*index, i| index.* = i;
+
+        self.* = .{
+            .allocator = allocator,
+            .config = config,
+            .dir = dir,
+            .pool = undefined,
+            .slots = slots,
+            .free = free,
+            .nfree = free.len,
+        };
+
+        try self.pool.init(.{
+            .allocator = allocator,
+            .n_jobs = if (config.n_jobs == 0) null else config.n_jobs,
+        });
+        return self;
+    }
+
+    /// Wait for the frames that are still being written, and free everything.
+    pub fn deinit(self: *Self) void {
+        self.flush() catch {};
+        self.pool.deinit();
+        for (self.slots) |slot| self.allocator.free(slot.buf);
+        self.allocator.free(self.slots);
+        self.allocator.free(self.free);
+        self.dir.close();
+        self.allocator.destroy(self);
+    }
+
+    /// Queue a frame to be written as the next file of the sequence.
+    /// The pixels are copied, so the caller can reuse them as soon as this returns.
+    /// Returns false if the frame was dropped because every slot was busy.
+    /// Fails with the error of an earlier write, if there was one.
+    pub fn addFrame(self: *Self, image: encoder.Image) !bool {
+        const slot_index, const frame_number = blk: {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            if (self.err) |err| return err;
+            if (self.nfree == 0) {
+                self.dropped += 1;
+                return false;
+            }
+            self.nfree -= 1;
+            const frame_number = self.next_frame_number;
+            self.next_frame_number += 1;
+            break :blk .{ self.free[self.nfree], frame_number };
+        };
+        errdefer self.releaseSlot(slot_index);
+
+        // Copy the rows without their padding.
+        const slot = &self.slots[slot_index];
+        const row_len = image.width * 4;
+        const size = row_len * image.height;
+        if (slot.buf.len < size) {
+            self.allocator.free(slot.buf);
+            slot.buf = &.{};
+            slot.buf = try self.allocator.alloc(u8, size);
+        }
+        const stride = if (image.row_stride == 0) row_len else image.row_stride;
+        for (0..image.height) |y| {
+            @memcpy(slot.buf[y * row_len ..][0..row_len], image.pixels[y * stride ..][0..row_len]);
+        }
+
+        slot.image = .{
+            .pixels = slot.buf[0..size],
+            .width = image.width,
+            .height = image.height,
+            .format = image.format,
+        };
+        slot.frame_number = frame_number;
+
+        // If no job could be queued, write the frame on this thread instead.
+        self.pool.spawn(writeSlot, .{ self, slot_index }) catch writeSlot(self, slot_index);
+        return true;
+    }
+
+    /// Wait until every queued frame is written.
+    /// Returns the first error of a background write, if there was one.
+    pub fn flush(self: *Self) !void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (self.nfree < self.slots.len) self.slot_released.wait(&self.mutex);
+        if (self.err) |err| return err;
+    }
+
+    /// Number of frames that were dropped because the encoder couldn't keep up.
+    pub fn droppedFrames(self: *Self) usize {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.dropped;
+    }
+
+    fn releaseSlot(self: *Self, slot_index: usize) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        self.free[self.nfree] = slot_index;
+        self.nfree += 1;
+        self.slot_released.broadcast();
+    }
+
+    /// Runs on a worker thread.
+    fn writeSlot(self: *Self, slot_index: usize) void {
+        defer self.releaseSlot(slot_index);
+
+        self.writeFile(&self.slots[slot_index]) catch |err| {
+            self.mutex.lock();
+            defer self.mutex.unlock();
+            if (self.err == null) self.err = err;
+        };
+    }
+
+    fn writeFile(self: *Self, slot: *const Slot) !void {
+        var name_buf: [std.fs.MAX_NAME_BYTES]u8 = undefined;
+        const name = try std.fmt.bufPrint(&name_buf, "{s}{d:0>6}.png", .{
+            self.config.prefix,
+            slot.frame_number,
+        });
+
+        const file = try self.dir.createFile(name, .{});
+        defer file.close();
+
+        var options = self.config.encode_options;
+        options.pool = &self.pool;
+        var buffered = std.io.bufferedWriter(file.writer());
+        try encoder.encode(self.allocator, buffered.writer(), slot.image, options);
+        try buffered.flush();
+    }
+};
+
+const t = std.testing;
+const png = @import("png.zig");
+const filter = @import("filter.zig");
+
+/// The RGB color of the top left pixel of an encoded PNG without alpha.
+fn firstPixel(allocator: std.mem.Allocator, data: []const u8) ![3]u8 {
+    var stream = std.ArrayList(u8).init(allocator);
+    defer stream.deinit();
+    var pos: usize = 8;
+    while (pos < data.len) {
+        const len = std.mem.readInt(u32, data[pos..][0..4], .big);
+        if (std.mem.eql(u8, data[pos + 4 ..][0..4], "IDAT")) try stream.appendSlice(data[pos + 8 ..][0..len]);
+        pos += len + 12;
+    }
+
+    var decompressed = std.ArrayList(u8).init(allocator);
+    defer decompressed.deinit();
+    var reader = std.io.fixedBufferStream(stream.items);
+    try std.compress.zlib.decompress(reader.reader(), decompressed.writer());
+    const line = decompressed.items[0..4];
+    const zeros = [_]u8{0} ** 3;
+    filter.unfilterRow(@enumFromInt(line[0]), line[1..], &zeros, 3);
+    return line[1..4].*;
+}
+
+test "PngSequence – writes numbered files" {
+    const allocator = t.allocator;
+    var tmp = t.tmpDir(.{});
+    defer tmp.cleanup();
+    const dir_path = try tmp.dir.realpathAlloc(allocator, ".");
+    defer allocator.free(dir_path);
+
+    const sequence = try PngSequence.init(allocator, .{
+        .dir_path = dir_path,
+        .max_pending = 2,
+        .n_jobs = 2,
+    });
+    defer sequence.deinit();
+
+    const width = 6;
+    const height = 4;
+    var pixels: [width * height * 4]u8 = undefined;
+    var written: usize = 0;
+    for (0..5) |i| {
+        // BGRA, like the frames of a recording.
+        for (0..width * height) |p| pixels[p * 4 ..][0..4].* = .{ @intCast(i * 40), 10, 200, 255 };
+        const image = encoder.Image{ .pixels = &pixels, .width = width, .height = height, .format = .bgra };
+        if (try sequence.addFrame(image)) written += 1;
+    }
+    try sequence.flush();
+    try t.expectEqual(5, written + sequence.droppedFrames());
+
+    // Frames are numbered in the order they were accepted, without gaps.
+    for (0..written) |i| {
+        var name_buf: [32]u8 = undefined;
+        const name = try std.fmt.bufPrint(&name_buf, "frame_{d:0>6}.png", .{i});
+        const data = try tmp.dir.readFileAlloc(allocator, name, 1 << 20);
+        defer allocator.free(data);
+        try t.expectEqualSlices(u8, &png.signature, data[0..8]);
+    }
+    // Red and blue end up where they belong.
+    const first = try tmp.dir.readFileAlloc(allocator, "frame_000000.png", 1 << 20);
+    defer allocator.free(first);
+    try t.expectEqual([3]u8{ 200, 10, 0 }, try firstPixel(allocator, first));
+
+    // Slots are reused once their frames are written.
+    try t.expect(try sequence.addFrame(.{ .pixels = &pixels, .width = width, .height = height }));
+    try sequence.flush();
+}
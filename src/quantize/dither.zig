@@ -1,6 +1,7 @@
 const quantize = @import("median-cut.zig");
 const q = @import("quantize.zig");
 const std = @import("std");
+const pixel = @import("pixel");
 
 // const Timer = @import("../timer.zig");
 
@@ -27,6 +28,9 @@ pub const QuantizedBuf = struct {
 
 allocator: std.mem.Allocator,
 all_colors: *[color_array_size]QuantizedColor,
+/// If set, nearest colors are looked up here instead of in `all_colors`.
+/// Maps every R5G5B5 color to an index into `color_table`.
+index_map: ?*const [color_array_size]u8 = null,
 /// A contiguous array of colors (RGBRGBRGB...) that are present in the quantized image.
 color_table: []const u8,
 
@@ -45,6 +49,21 @@ pub fn init(
     };
 }
 
+/// Dither against a palette that was built earlier (see `palette.zig`),
+/// for which only the R5G5B5 -> index map is left.
+pub fn initWithMap(
+    allocator: std.mem.Allocator,
+    index_map: *const [color_array_size]u8,
+    color_table: []const u8,
+) Self {
+    return Self{
+        .color_table = color_table,
+        .all_colors = undefined,
+        .index_map = index_map,
+        .allocator = allocator,
+    };
+}
+
 const ErrDiffusion = struct {
     offset: [2]i64,
     factor: f64,
@@ -58,6 +77,10 @@ const floyd_steinberg = [_]ErrDiffusion{
 };
 
 pub inline fn nearestColor(self: *Self, color: [3]u8) u8 {
+    if (self.index_map) |index_map| {
+        return index_map[quantize.colorIndex(color[0], color[1], color[2])];
+    }
+
     const nearest = quantize.getGlobalColor(
         self.all_colors,
         color[0],
@@ -69,18 +92,24 @@ pub inline fn nearestColor(self: *Self, color: [3]u8) u8 {
     return index;
 }
 
+/// Rows of `image` start every `row_stride` bytes, or every `width * 4` bytes if it's 0.
 pub fn ditherBgraImage(
     self: *Self,
     image: []const u8,
     quantized: QuantizedBuf,
     width: usize,
     height: usize,
+    row_stride: usize,
 ) !void {
-    // create a copy of the image to avoid modifying the original.
-    const bgra = try self.allocator.alloc(u8, image.len);
-    defer self.allocator.free(bgra);
+    // Work on a packed RGB copy of the image, which leaves the original as it is,
+    // and puts the channels in the order of the color table.
+    const rgb = try self.allocator.alloc(u8, width * height * 3);
+    defer self.allocator.free(rgb);
 
-    @memcpy(bgra, image);
+    const stride = if (row_stride == 0) width * 4 else row_stride;
+    for (0..height) |row| {
+        pixel.convert(.bgra, .rgb, image[row * stride ..][0 .. width * 4], rgb[row * width * 3 ..][0 .. width * 3]);
+    }
 
     const quantized_buf = quantized.quantized_buf;
 
@@ -88,15 +117,11 @@ pub fn ditherBgraImage(
         for (0..width) |col| {
             const i = row * width + col;
             // 1. replace the pixel with the closest color.
-            const nearest_color_index = self.nearestColor(.{
-                bgra[i * 4 + 2], // r
-                bgra[i * 4 + 1], // g
-                bgra[i * 4 + 0], // b
-            });
+            const nearest_color_index = self.nearestColor(rgb[i * 3 ..][0..3].*);
             quantized_buf[i] = nearest_color_index;
 
             // 2. Find the quantization error for this pixel.
-            const err = quantizationError(bgra, &quantized, i);
+            const err = quantizationError(rgb, &quantized, i);
 
             // 3. Diffuse (spread) the error to the neighboring pixels.
             for (floyd_steinberg) |diff| {
@@ -116,17 +141,10 @@ pub fn ditherBgraImage(
                 const next_col: usize = @intCast(next_col_);
                 const j = next_row * width + next_col;
 
-                const old_b = bgra[j * 4 + 0];
-                const old_g = bgra[j * 4 + 1];
-                const old_r = bgra[j * 4 + 2];
-
-                const new_r = addError(old_r, err[0], factor);
-                const new_g = addError(old_g, err[1], factor);
-                const new_b = addError(old_b, err[2], factor);
-
-                bgra[j * 4 + 0] = new_b;
-                bgra[j * 4 + 1] = new_g;
-                bgra[j * 4 + 2] = new_r;
+                const color = rgb[j * 3 ..][0..3];
+                for (color, err) |*channel, channel_err| {
+                    channel.* = addError(channel.*, channel_err, factor);
+                }
             }
         }
     }
@@ -145,13 +163,13 @@ inline fn addError(color: usize, err: f64, multiplier: f64) u8 {
 }
 
 inline fn quantizationError(
-    bgra: []const u8,
+    rgb: []const u8,
     quantized: *const QuantizedBuf,
     i: usize,
 ) [3]f64 {
-    const b: f64 = @floatFromInt(bgra[i * 4 + 0]);
-    const g: f64 = @floatFromInt(bgra[i * 4 + 1]);
-    const r: f64 = @floatFromInt(bgra[i * 4 + 2]);
+    const r: f64 = @floatFromInt(rgb[i * 3 + 0]);
+    const g: f64 = @floatFromInt(rgb[i * 3 + 1]);
+    const b: f64 = @floatFromInt(rgb[i * 3 + 2]);
 
     const qcolor_table = quantized.color_table;
     const q_image = quantized.quantized_buf;
@@ -225,7 +243,7 @@ test "quantize and dither" {
     try dither.ditherBgraImage(&bgra, .{
         .quantized_buf = &quantized,
         .color_table = &color_table,
-    }, 2, 2);
+    }, 2, 2, 0);
 
     try t.expectEqualDeep([_]u8{ 1, 0, 0, 0 }, quantized);
 }
@@ -5,6 +5,8 @@ const q = @import("quantize.zig");
 const QuantizedImage = q.QuantizedImage;
 const QuantizedFrames = q.QuantizedFrames;
 const QuantizerConfig = q.QuantizerConfig;
+const Palette = q.Palette;
+const Histogram = q.Histogram;
 
 const KDTree = @import("kd-tree.zig").KDTree;
 
@@ -118,6 +120,14 @@ const bits_per_prim_color = 5; // 5 bits per color channel.
 const max_prim_color = 0b11111;
 const shift = 8 - bits_per_prim_color;
 
+/// Given an 8-bit RGB color, returns the index of the nearest color in R5G5B5 space.
+pub inline fn colorIndex(r: usize, g: usize, b: usize) usize {
+    const r_mask = (r >> shift) << (2 * bits_per_prim_color);
+    const g_mask = (g >> shift) << bits_per_prim_color;
+    const b_mask = b >> shift;
+    return r_mask | g_mask | b_mask;
+}
+
 /// Given an 8-bit RGB color,
 /// returns a pointer to the nearest matching color present in the global color array.
 pub inline fn getGlobalColor(
@@ -126,10 +136,7 @@ pub inline fn getGlobalColor(
     g: usize,
     b: usize,
 ) *QuantizedColor {
-    const r_mask = (r >> shift) << (2 * bits_per_prim_color);
-    const g_mask = (g >> shift) << bits_per_prim_color;
-    const b_mask = b >> shift;
-    return &all_colors[r_mask | g_mask | b_mask];
+    return &all_colors[colorIndex(r, g, b)];
 }
 
 /// Quantize a list of raw BGRA frames such that all frames share the same global color table.
@@ -165,7 +172,18 @@ pub fn quantizeBgraFrames(config: QuantizerConfig, bgra_bufs: []const []const u8
 
     // 2. Quantize the histogram to 256 colors.
     const total_px_count = bgra_bufs.len * bgra_bufs[0].len / 4;
-    const color_table = try quantizeHistogram(allocator, &all_colors, total_px_count);
+    const ncolors = if (config.reserve_transparent_index)
+        config.ncolors - 1
+    else
+        config.ncolors;
+
+    const color_table = try quantizeHistogram(
+        allocator,
+        &all_colors,
+        total_px_count,
+        ncolors,
+        config.reserve_transparent_index,
+    );
 
     // 3. Go over each frame in the input, and replace every pixel with an index into
     // the color table.
@@ -190,19 +208,24 @@ pub fn quantizeBgraFrames(config: QuantizerConfig, bgra_bufs: []const []const u8
                 .{ .quantized_buf = quantized_frame, .color_table = color_table },
                 config.width,
                 config.height,
+                0,
             );
         }
 
         quantized_frames[i] = quantized_frame;
     }
 
-    return QuantizedFrames.init(allocator, color_table, quantized_frames);
+    var quantized = try QuantizedFrames.init(allocator, color_table, quantized_frames);
+    if (config.reserve_transparent_index) {
+        quantized.transparent_index = @intCast(color_table.len / 3 - 1);
+    }
+    return quantized;
 }
 
 /// Given a buffer of RGB pixels, quantize the colors in the image to 256 colors.
 pub fn quantizeBgraImage(config: QuantizerConfig, image: []const u8) !QuantizedImage {
-    const n_pixels = image.len / 4;
-    std.debug.assert(image.len % 4 == 0);
+    const n_pixels = config.pixelCount(image);
+    std.debug.assert(config.row_stride != 0 or image.len % 4 == 0);
 
     // Initialize the global color array with all possible colors in the R5G5B5 space.
     var all_colors: [color_array_size]QuantizedColor = undefined;
@@ -217,38 +240,52 @@ pub fn quantizeBgraImage(config: QuantizerConfig, image: []const u8) !QuantizedI
     }
 
     // Sample all colors in the image, and count their frequency.
-    for (0..n_pixels) |i| {
-        const base = i * 4;
+    for (0..config.rowCount()) |row_index| {
+        const row = config.row(image, row_index);
+        for (0..row.len / 4) |i| {
+            const base = i * 4;
 
-        const b = image[base];
-        const g = image[base + 1];
-        const r = image[base + 2];
+            const b = row[base];
+            const g = row[base + 1];
+            const r = row[base + 2];
 
-        const r_mask = @as(usize, r >> shift) << (2 * bits_per_prim_color);
-        const g_mask = @as(usize, g >> shift) << bits_per_prim_color;
-        const b_mask = @as(usize, b >> shift);
+            const r_mask = @as(usize, r >> shift) << (2 * bits_per_prim_color);
+            const g_mask = @as(usize, g >> shift) << bits_per_prim_color;
+            const b_mask = @as(usize, b >> shift);
 
-        const index = r_mask | g_mask | b_mask;
-        all_colors[index].frequency += 1;
+            const index = r_mask | g_mask | b_mask;
+            all_colors[index].frequency += 1;
+        }
     }
 
     const allocator = config.allocator;
+    const ncolors = if (config.reserve_transparent_index)
+        config.ncolors - 1
+    else
+        config.ncolors;
+
     const color_table = try quantizeHistogram(
         allocator,
         &all_colors,
         n_pixels,
-        config.ncolors,
+        ncolors,
+        config.reserve_transparent_index,
     );
 
     // Now go over the input image, and replace each pixel with the index of the partition
     var image_buf = try allocator.alloc(u8, n_pixels);
-    for (0..n_pixels) |i| {
-        const b = image[i * 4];
-        const g = image[i * 4 + 1];
-        const r = image[i * 4 + 2];
-
-        const nearest_color = getGlobalColor(&all_colors, r, g, b);
-        image_buf[i] = nearest_color.index_in_color_table;
+    var out: usize = 0;
+    for (0..config.rowCount()) |row_index| {
+        const row = config.row(image, row_index);
+        for (0..row.len / 4) |i| {
+            const b = row[i * 4];
+            const g = row[i * 4 + 1];
+            const r = row[i * 4 + 2];
+
+            const nearest_color = getGlobalColor(&all_colors, r, g, b);
+            image_buf[out] = nearest_color.index_in_color_table;
+            out += 1;
+        }
     }
 
     if (config.use_dithering) {
@@ -258,19 +295,105 @@ pub fn quantizeBgraImage(config: QuantizerConfig, image: []const u8) !QuantizedI
             .{ .quantized_buf = image_buf, .color_table = color_table },
             config.width,
             config.height,
+            config.row_stride,
         );
     }
 
-    return QuantizedImage.init(color_table, image_buf);
+    var quantized = QuantizedImage.init(color_table, image_buf);
+    if (config.reserve_transparent_index) {
+        // The reserved slot is always the last entry of the table.
+        quantized.transparent_index = @intCast(color_table.len / 3 - 1);
+    }
+    return quantized;
+}
+
+/// Count how often every color of the R5G5B5 space occurs in a BGRA image.
+pub fn countColors(image: []const u8, counts: *[color_array_size]u32) void {
+    @memset(counts, 0);
+    addColors(image, counts);
+}
+
+/// Like `countColors`, for an image whose rows are laid out as `config` says.
+pub fn countImageColors(config: QuantizerConfig, image: []const u8, counts: *[color_array_size]u32) void {
+    @memset(counts, 0);
+    for (0..config.rowCount()) |row_index| addColors(config.row(image, row_index), counts);
+}
+
+fn addColors(pixels: []const u8, counts: *[color_array_size]u32) void {
+    for (0..pixels.len / 4) |i| {
+        const b = pixels[i * 4];
+        const g = pixels[i * 4 + 1];
+        const r = pixels[i * 4 + 2];
+        counts[colorIndex(r, g, b)] += 1;
+    }
+}
+
+/// Build a palette for a BGRA image that other images can be mapped to later (see `palette.zig`).
+pub fn buildPalette(config: QuantizerConfig, image: []const u8) !Palette {
+    std.debug.assert(config.row_stride != 0 or image.len % 4 == 0);
+    const counts = try config.allocator.create([color_array_size]u32);
+    defer config.allocator.destroy(counts);
+
+    countImageColors(config, image, counts);
+    return buildPaletteFromCounts(config, counts);
+}
+
+/// Build a palette from the color counts of an image, as made by `countColors`.
+pub fn buildPaletteFromCounts(config: QuantizerConfig, counts: *const [color_array_size]u32) !Palette {
+    var all_colors: [color_array_size]QuantizedColor = undefined;
+    var n_pixels: usize = 0;
+    for (0.., &all_colors, counts) |i, *color, count| {
+        color.frequency = count;
+        color.index_in_color_table = 0;
+        color.RGB[0] = @truncate(i >> (2 * bits_per_prim_color));
+        color.RGB[1] = @truncate((i >> bits_per_prim_color) & max_prim_color);
+        color.RGB[2] = @truncate(i & max_prim_color);
+        n_pixels += count;
+    }
+
+    const allocator = config.allocator;
+    const ncolors = if (config.reserve_transparent_index)
+        config.ncolors - 1
+    else
+        config.ncolors;
+
+    const color_table = try quantizeHistogram(
+        allocator,
+        &all_colors,
+        n_pixels,
+        ncolors,
+        config.reserve_transparent_index,
+    );
+    errdefer allocator.free(color_table);
+
+    // `quantizeHistogram` points every color in the R5G5B5 space at its nearest entry,
+    // which is all we need to keep around to map more images to this palette.
+    const index_map = try allocator.create([color_array_size]u8);
+    for (&all_colors, index_map) |*color, *index| {
+        index.* = color.index_in_color_table;
+    }
+
+    var palette = Palette{
+        .color_table = color_table,
+        .index_map = index_map,
+        .histogram = Histogram.fromCounts(counts),
+    };
+    if (config.reserve_transparent_index) {
+        palette.transparent_index = @intCast(color_table.len / 3 - 1);
+    }
+    return palette;
 }
 
 /// Given a list of colors with their respective frequencies,
 /// produce a color table with 256 colors that best represent the histogram.
+/// When `reserve_slot` is set, one extra (black) entry is appended to the table
+/// that none of the colors in `all_colors` will point to.
 fn quantizeHistogram(
     allocator: std.mem.Allocator,
     all_colors: *[color_array_size]QuantizedColor,
     n_pixels: usize,
     n_colors: u16,
+    reserve_slot: bool,
 ) ![]u8 {
     // Find all colors in the color table that are used at least once, and chain them.
     var head: *QuantizedColor = undefined;
@@ -310,7 +433,9 @@ fn quantizeHistogram(
         allocator.free(partitions);
     }
 
-    const color_table = try allocator.alloc(u8, partitions.len * 3);
+    const n_entries = if (reserve_slot) partitions.len + 1 else partitions.len;
+    const color_table = try allocator.alloc(u8, n_entries * 3);
+    @memset(color_table, 0);
     for (0.., partitions) |i, partition| {
         if (partition.num_colors == 0) continue;
 
@@ -337,7 +462,8 @@ fn quantizeHistogram(
         color_table[i * 3 + 2] = @intCast((rgb_sum[2] << shift) / partition.num_colors);
     }
 
-    var kdtree = try KDTree.init(allocator, color_table);
+    // The reserved slot (if any) must never be picked as the nearest color.
+    var kdtree = try KDTree.init(allocator, color_table[0 .. partitions.len * 3]);
     defer kdtree.deinit();
 
     for (all_colors) |*color| {
@@ -734,3 +860,68 @@ fn countPixels(partition: *ColorSpace) usize {
     std.debug.assert(color.next == null);
     return count;
 }
+
+test "reserving a transparent slot" {
+    const allocator = std.testing.allocator;
+    const width = 16;
+    const height = 16;
+
+    var bgra: [width * height * 4]u8 = undefined;
+    for (0..width * height) |i| {
+        bgra[i * 4 + 0] = @truncate(i * 7);
+        bgra[i * 4 + 1] = @truncate(i * 3);
+        bgra[i * 4 + 2] = @truncate(i);
+        bgra[i * 4 + 3] = 255;
+    }
+
+    const quantized = try quantizeBgraImage(.{
+        .width = width,
+        .height = height,
+        .use_dithering = false,
+        .allocator = allocator,
+        .ncolors = 16,
+        .reserve_transparent_index = true,
+    }, &bgra);
+    defer quantized.deinit(allocator);
+
+    const trans_index = quantized.transparent_index orelse return error.TestUnexpectedResult;
+    try std.testing.expectEqual(quantized.color_table.len / 3 - 1, trans_index);
+    try std.testing.expect(quantized.color_table.len / 3 <= 16);
+    for (quantized.image_buffer) |index| {
+        try std.testing.expect(index != trans_index);
+    }
+}
+
+test "a view into a larger image quantizes like a packed copy of it" {
+    const allocator = std.testing.allocator;
+    const width = 5;
+    const height = 4;
+    const stride = 9 * 4;
+
+    var gen = std.rand.DefaultPrng.init(17);
+    var parent: [height * stride]u8 = undefined;
+    gen.random().bytes(&parent);
+    var view_packed: [width * height * 4]u8 = undefined;
+    for (0..height) |y| {
+        @memcpy(view_packed[y * width * 4 ..][0 .. width * 4], parent[y * stride + 8 ..][0 .. width * 4]);
+    }
+
+    const config = QuantizerConfig{
+        .width = width,
+        .height = height,
+        .use_dithering = true,
+        .allocator = allocator,
+        .ncolors = 8,
+    };
+    const expected = try quantizeBgraImage(config, &view_packed);
+    defer expected.deinit(allocator);
+
+    var strided = config;
+    strided.row_stride = stride;
+    const view = parent[8 .. (height - 1) * stride + 8 + width * 4];
+    const actual = try quantizeBgraImage(strided, view);
+    defer actual.deinit(allocator);
+
+    try std.testing.expectEqualSlices(u8, expected.color_table, actual.color_table);
+    try std.testing.expectEqualSlices(u8, expected.image_buffer, actual.image_buffer);
+}
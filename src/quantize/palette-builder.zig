@@ -0,0 +1,181 @@
+const std = @import("std");
+const median_cut = @import("median-cut.zig");
+const q = @import("quantize.zig");
+
+const Palette = q.Palette;
+const QuantizerConfig = q.QuantizerConfig;
+const color_array_size = median_cut.color_array_size;
+
+/// Builds palettes on a background thread.
+///
+/// For live capture, building a palette (median cut, kd-tree, inverse map) is the slowest
+/// part of quantizing a frame. With a builder, the caller only counts the colors of frame N
+/// and hands the counts over, then maps frame N to the palette that was built from an
+/// earlier frame. Building the next palette overlaps with mapping and encoding.
+pub const PaletteBuilder = struct {
+    const Self = @This();
+
+    /// Must be thread safe, the builder thread allocates palettes from it.
+    allocator: std.mem.Allocator,
+    thread: std.Thread = undefined,
+
+    /// Protects everything below.
+    mutex: std.Thread.Mutex = .{},
+    /// Signaled when a new request comes in, or the builder should stop.
+    work_available: std.Thread.Condition = .{},
+    /// Signaled when a palette is ready (or building one failed).
+    palette_ready: std.Thread.Condition = .{},
+
+    /// Color counts of the most recent request. Swapped with `working_counts` when picked up.
+    pending_counts: *[color_array_size]u32,
+    pending_config: QuantizerConfig = undefined,
+    has_pending: bool = false,
+    /// Owned by the builder thread while it builds a palette.
+    working_counts: *[color_array_size]u32,
+
+    /// The most recently built palette that hasn't been taken yet.
+    ready: ?Palette = null,
+    err: ?anyerror = null,
+    stop: bool = false,
+    /// Number of palettes built so far.
+    nbuilt: usize = 0,
+
+    pub fn init(allocator: std.mem.Allocator) !*Self {
+        const self = try allocator.create(Self);
+        errdefer allocator.destroy(self);
+
+        const pending_counts = try allocator.create([color_array_size]u32);
+        errdefer allocator.destroy(pending_counts);
+        const working_counts = try allocator.create([color_array_size]u32);
+        errdefer allocator.destroy(working_counts);
+
+        self.* = .{
+            .allocator = allocator,
+            .pending_counts = pending_counts,
+            .working_counts = working_counts,
+        };
+        self.thread = try std.Thread.spawn(.{}, run, .{self});
+        return self;
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.mutex.lock();
+        self.stop = true;
+        self.work_available.signal();
+        self.mutex.unlock();
+        self.thread.join();
+
+        if (self.ready) |palette| palette.deinit(self.allocator);
+        self.allocator.destroy(self.pending_counts);
+        self.allocator.destroy(self.working_counts);
+        self.allocator.destroy(self);
+    }
+
+    /// Ask for a palette to be built from the color counts of a frame (see `median_cut.countColors`).
+    /// The counts are copied. If an older request is still waiting, it is replaced:
+    /// only the newest frame matters for the next palette.
+    pub fn request(self: *Self, config: QuantizerConfig, counts: *const [color_array_size]u32) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        @memcpy(self.pending_counts, counts);
+        self.pending_config = config;
+        self.has_pending = true;
+        self.work_available.signal();
+    }
+
+    /// Take the newest palette if one was built since the last call, without blocking.
+    pub fn take(self: *Self) !?Palette {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        return self.takeLocked();
+    }
+
+    /// Block until a palette is ready, and take it.
+    pub fn wait(self: *Self) !Palette {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+        while (true) {
+            if (try self.takeLocked()) |palette| return palette;
+            self.palette_ready.wait(&self.mutex);
+        }
+    }
+
+    fn takeLocked(self: *Self) !?Palette {
+        if (self.err) |err| {
+            self.err = null;
+            return err;
+        }
+        const palette = self.ready;
+        self.ready = null;
+        return palette;
+    }
+
+    fn run(self: *Self) void {
+        self.mutex.lock();
+        defer self.mutex.unlock();
+
+        while (true) {
+            while (!self.has_pending and !self.stop) {
+                self.work_available.wait(&self.mutex);
+            }
+            if (self.stop) return;
+
+            std.mem.swap(*[color_array_size]u32, &self.pending_counts, &self.working_counts);
+            const config = self.pending_config;
+            self.has_pending = false;
+
+            self.mutex.unlock();
+            const result = median_cut.buildPaletteFromCounts(config, self.working_counts);
+            self.mutex.lock();
+
+            if (result) |palette| {
+                // Nobody took the previous palette in time, this one is newer.
+                if (self.ready) |old| old.deinit(self.allocator);
+                self.ready = palette;
+                self.nbuilt += 1;
+            } else |err| {
+                self.err = err;
+            }
+            self.palette_ready.broadcast();
+        }
+    }
+};
+
+const t = std.testing;
+
+test "PaletteBuilder builds palettes in the background" {
+    const allocator = t.allocator;
+    const builder = try PaletteBuilder.init(allocator);
+    defer builder.deinit();
+
+    var image: [64 * 4]u8 = undefined;
+    for (0..64) |i| {
+        const shade: u8 = @intCast(i * 4);
+        image[i * 4 ..][0..4].* = .{ shade, shade, shade, 255 };
+    }
+
+    const counts = try allocator.create([color_array_size]u32);
+    defer allocator.destroy(counts);
+    median_cut.countColors(&image, counts);
+
+    const config = QuantizerConfig{
+        .allocator = allocator,
+        .width = 8,
+        .height = 8,
+        .use_dithering = false,
+        .ncolors = 8,
+    };
+
+    builder.request(config, counts);
+    const palette = try builder.wait();
+    defer palette.deinit(allocator);
+
+    const expected = try median_cut.buildPalette(config, &image);
+    defer expected.deinit(allocator);
+    try t.expectEqualSlices(u8, expected.color_table, palette.color_table);
+    try t.expectEqualSlices(u8, expected.index_map, palette.index_map);
+
+    // Nothing new was requested.
+    try t.expectEqual(null, try builder.take());
+}
@@ -0,0 +1,193 @@
+const std = @import("std");
+const q = @import("quantize.zig");
+
+const QuantizedImage = q.QuantizedImage;
+const QuantizedFrames = q.QuantizedFrames;
+const Palette = q.Palette;
+
+// The median cut leaves palette entries in whatever order it split the color space,
+// so two similar colors can end up with very different indices.
+// These functions sort a color table, and rewrite the indices that point into it.
+
+pub const PaletteOrder = enum {
+    /// Keep the order produced by the quantizer.
+    none,
+    /// Darkest to brightest.
+    luminance,
+    /// Most used color first.
+    frequency,
+    /// Along a Z-order (Morton) curve through the RGB cube,
+    /// which keeps colors that are close in all three channels close together.
+    morton,
+};
+
+/// Sort the color table of `image` and remap its pixels to match.
+/// The reserved transparent entry (if any) stays where it is.
+pub fn reorderImage(image: *QuantizedImage, order: PaletteOrder) void {
+    if (order == .none) return;
+
+    var counts = [_]usize{0} ** 256;
+    if (order == .frequency) countIndices(image.image_buffer, &counts);
+
+    const lut = sortColorTable(image.color_table, &counts, order, image.transparent_index);
+    remap(image.image_buffer, &lut);
+}
+
+/// Sort the global color table of `frames` and remap the pixels of every frame.
+/// The reserved transparent entry (if any) stays where it is.
+pub fn reorderFrames(frames: *QuantizedFrames, order: PaletteOrder) void {
+    if (order == .none) return;
+
+    var counts = [_]usize{0} ** 256;
+    if (order == .frequency) {
+        for (frames.frames) |frame| countIndices(frame, &counts);
+    }
+
+    const lut = sortColorTable(frames.color_table, &counts, order, frames.transparent_index);
+    for (frames.frames) |frame| {
+        remap(frame, &lut);
+    }
+}
+
+/// Sort the color table of a palette that is shared by several images, and remap its index map.
+/// `indices` is an image that was just mapped to the palette: it is remapped too,
+/// and provides the counts for `.frequency`.
+pub fn reorderPalette(palette: *Palette, order: PaletteOrder, indices: []u8) void {
+    if (order == .none) return;
+
+    var counts = [_]usize{0} ** 256;
+    if (order == .frequency) countIndices(indices, &counts);
+
+    const lut = sortColorTable(palette.color_table, &counts, order, palette.transparent_index);
+    remap(palette.index_map, &lut);
+    remap(indices, &lut);
+}
+
+fn countIndices(indices: []const u8, counts: *[256]usize) void {
+    for (indices) |index| counts[index] += 1;
+}
+
+/// Sort `color_table` in place, and return a table that maps old indices to new ones.
+/// `fixed` is an index that must not move.
+fn sortColorTable(
+    color_table: []u8,
+    counts: *const [256]usize,
+    order: PaletteOrder,
+    fixed: ?u8,
+) [256]u8 {
+    const ncolors = color_table.len / 3;
+    // The transparent slot is always the last one, so we sort everything before it.
+    const nsorted = if (fixed) |f| @min(ncolors, f) else ncolors;
+
+    var keys: [256]u64 = undefined;
+    for (0..nsorted) |i| {
+        const rgb = color_table[i * 3 ..][0..3];
+        keys[i] = switch (order) {
+            .none => i,
+            .luminance => @as(u64, rgb[0]) * 299 + @as(u64, rgb[1]) * 587 + @as(u64, rgb[2]) * 114,
+            // Sorted in descending order.
+            .frequency => std.math.maxInt(u64) - counts[i],
+            .morton => mortonKey(rgb[0], rgb[1], rgb[2]),
+        };
+    }
+
+    // new_to_old[n] is the old index of the color that ends up at index `n`.
+    var new_to_old: [256]u8 = undefined;
+    for (0..256) |i| new_to_old[i] = @truncate(i);
+    const sort_keys: *const [256]u64 = &keys;
+    std.mem.sort(u8, new_to_old[0..nsorted], sort_keys, struct {
+        fn lessThan(k: *const [256]u64, a: u8, b: u8) bool {
+            return k[a] < k[b];
+        }
+    }.lessThan);
+
+    var old_table: [256 * 3]u8 = undefined;
+    @memcpy(old_table[0 .. nsorted * 3], color_table[0 .. nsorted * 3]);
+
+    var lut: [256]u8 = undefined;
+    for (0..256) |i| lut[i] = @truncate(i);
+    for (0..nsorted) |new| {
+        const old = new_to_old[new];
+        @memcpy(color_table[new * 3 ..][0..3], old_table[@as(usize, old) * 3 ..][0..3]);
+        lut[old] = @intCast(new);
+    }
+
+    return lut;
+}
+
+/// Interleave the bits of g, r and b, in that order, most significant first.
+/// Green leads since the eye is most sensitive to it.
+fn mortonKey(r: u8, g: u8, b: u8) u64 {
+    var key: u64 = 0;
+    var bit: u3 = 7;
+    while (true) : (bit -= 1) {
+        key = (key << 3) |
+            (@as(u64, (g >> bit) & 1) << 2) |
+            (@as(u64, (r >> bit) & 1) << 1) |
+            @as(u64, (b >> bit) & 1);
+        if (bit == 0) break;
+    }
+    return key;
+}
+
+/// Replace every index in `indices` with `lut[index]`, in a single pass.
+fn remap(indices: []u8, lut: *const [256]u8) void {
+    // Without a byte gather instruction the lookups themselves can't be vectorized,
+    // but going a vector's width at a time keeps many independent loads in flight
+    // and stores a whole vector at once.
+    const lanes = std.simd.suggestVectorLength(u8) orelse 16;
+
+    var i: usize = 0;
+    while (i + lanes <= indices.len) : (i += lanes) {
+        const chunk: [lanes]u8 = indices[i..][0..lanes].*;
+        var mapped: [lanes]u8 = undefined;
+        inline for (0..lanes) |k| {
+            mapped[k] = lut[chunk[k]];
+        }
+        indices[i..][0..lanes].* = mapped;
+    }
+
+    for (indices[i..]) |*index| {
+        index.* = lut[index.*];
+    }
+}
+
+const t = std.testing;
+
+test "reorderImage – luminance" {
+    var color_table = [_]u8{
+        255, 255, 255, // white
+        0,   0,   0, // black
+        128, 128, 128, // gray
+        0,   0,   0, // transparent
+    };
+    var pixels = [_]u8{ 0, 1, 2, 3, 2, 1, 0 };
+    var image = QuantizedImage.init(&color_table, &pixels);
+    image.transparent_index = 3;
+
+    reorderImage(&image, .luminance);
+    try t.expectEqualSlices(u8, &[_]u8{
+        0,   0,   0,
+        128, 128, 128,
+        255, 255, 255,
+        0,   0,   0,
+    }, &color_table);
+    try t.expectEqualSlices(u8, &[_]u8{ 2, 0, 1, 3, 1, 0, 2 }, &pixels);
+}
+
+test "reorderImage – frequency" {
+    var color_table = [_]u8{ 1, 1, 1, 2, 2, 2, 3, 3, 3 };
+    // Long enough to go through the vectorized part of `remap`.
+    var pixels = [_]u8{ 0, 1, 1, 2, 2, 2 } ** 20;
+    var image = QuantizedImage.init(&color_table, &pixels);
+
+    reorderImage(&image, .frequency);
+    try t.expectEqualSlices(u8, &[_]u8{ 3, 3, 3, 2, 2, 2, 1, 1, 1 }, &color_table);
+    try t.expectEqualSlices(u8, &([_]u8{ 2, 1, 1, 0, 0, 0 } ** 20), &pixels);
+}
+
+test "mortonKey" {
+    try t.expectEqual(0, mortonKey(0, 0, 0));
+    try t.expectEqual(0b111 << 21, mortonKey(0x80, 0x80, 0x80));
+    try t.expect(mortonKey(10, 10, 10) < mortonKey(10, 10, 200));
+}
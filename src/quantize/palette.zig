@@ -0,0 +1,207 @@
+const std = @import("std");
+const median_cut = @import("median-cut.zig");
+const Dither = @import("dither.zig");
+const q = @import("quantize.zig");
+
+const QuantizedImage = q.QuantizedImage;
+const QuantizerConfig = q.QuantizerConfig;
+const color_array_size = median_cut.color_array_size;
+
+// Pieces for reusing one palette across several images.
+// Building a palette (median cut + kd-tree search for every color) is far more
+// expensive than mapping pixels to it, so consecutive frames with similar colors
+// can share a palette, and only pay for the mapping.
+
+/// A coarse color histogram (3 bits per channel), cheap enough to build for every frame
+/// and to compare against the histogram of the image a palette was built from.
+pub const Histogram = struct {
+    const Self = @This();
+
+    const bits_per_channel = 3;
+    const shift = 8 - bits_per_channel;
+    pub const nbins = 1 << (3 * bits_per_channel);
+    /// Only every n-th pixel is counted. Odd, so that it doesn't line up with pixel grids.
+    const sample_step = 3;
+
+    bins: [nbins]u32 = [_]u32{0} ** nbins,
+    nsamples: u32 = 0,
+
+    pub fn fromBgra(bgra: []const u8) Self {
+        var self = Self{};
+        _ = self.addRow(bgra, 0);
+        return self;
+    }
+
+    /// Like `fromBgra`, for an image whose rows are laid out as `config` says.
+    pub fn fromImage(config: QuantizerConfig, image: []const u8) Self {
+        var self = Self{};
+        var first: usize = 0;
+        for (0..config.rowCount()) |row| first = self.addRow(config.row(image, row), first);
+        return self;
+    }
+
+    /// Count every `sample_step`-th pixel of a row, starting at `first`.
+    /// Returns where to start in the next row, to keep the same step across rows.
+    fn addRow(self: *Self, bgra: []const u8, first: usize) usize {
+        const npixels = bgra.len / 4;
+        var i: usize = first;
+        while (i < npixels) : (i += sample_step) {
+            const b: usize = bgra[i * 4] >> shift;
+            const g: usize = bgra[i * 4 + 1] >> shift;
+            const r: usize = bgra[i * 4 + 2] >> shift;
+            self.bins[(r << (2 * bits_per_channel)) | (g << bits_per_channel) | b] += 1;
+            self.nsamples += 1;
+        }
+        return i - npixels;
+    }
+
+    /// Coarsen the R5G5B5 color counts made by `median_cut.countColors`.
+    pub fn fromCounts(counts: *const [color_array_size]u32) Self {
+        var self = Self{};
+        const drop = 5 - bits_per_channel; // bits dropped from every 5 bit channel
+        for (0.., counts) |i, count| {
+            const r = (i >> (10 + drop)) & 0b111;
+            const g = (i >> (5 + drop)) & 0b111;
+            const b = (i >> drop) & 0b111;
+            self.bins[(r << (2 * bits_per_channel)) | (g << bits_per_channel) | b] += count;
+            self.nsamples += count;
+        }
+        return self;
+    }
+
+    /// The fraction of pixels whose color would have to change to turn
+    /// one histogram into the other: 0 if they are identical, 1 if they share no colors.
+    pub fn distance(a: *const Self, b: *const Self) f32 {
+        if (a.nsamples == 0 or b.nsamples == 0) return 1;
+
+        // Compare a / na with b / nb without dividing every bin.
+        const na: u64 = a.nsamples;
+        const nb: u64 = b.nsamples;
+        var sum: u64 = 0;
+        for (a.bins, b.bins) |x, y| {
+            const scaled_x = x * nb;
+            const scaled_y = y * na;
+            sum += if (scaled_x > scaled_y) scaled_x - scaled_y else scaled_y - scaled_x;
+        }
+
+        const total: f64 = @floatFromInt(2 * na * nb);
+        return @floatCast(@as(f64, @floatFromInt(sum)) / total);
+    }
+};
+
+/// A color table, together with the nearest entry for every color of the R5G5B5 space.
+pub const Palette = struct {
+    const Self = @This();
+
+    /// RGBRGB...
+    color_table: []u8,
+    /// Maps an R5G5B5 color (see `median_cut.colorIndex`) to an index into `color_table`.
+    index_map: *[color_array_size]u8,
+    /// Histogram of the image the palette was built from.
+    histogram: Histogram,
+    /// Index of the reserved transparent slot, if one was requested.
+    transparent_index: ?u8 = null,
+
+    pub fn ncolors(self: *const Self) usize {
+        return self.color_table.len / 3;
+    }
+
+    pub fn deinit(self: *const Self, allocator: std.mem.Allocator) void {
+        allocator.free(self.color_table);
+        allocator.destroy(self.index_map);
+    }
+};
+
+/// Map a BGRA image to an existing palette, without building a new one.
+/// The returned image owns a copy of the palette's color table.
+pub fn mapBgraImage(config: QuantizerConfig, palette: *const Palette, image: []const u8) !QuantizedImage {
+    const allocator = config.allocator;
+    const n_pixels = config.pixelCount(image);
+
+    const color_table = try allocator.dupe(u8, palette.color_table);
+    errdefer allocator.free(color_table);
+    const image_buf = try allocator.alloc(u8, n_pixels);
+    errdefer allocator.free(image_buf);
+
+    var out: usize = 0;
+    for (0..config.rowCount()) |row_index| {
+        const row = config.row(image, row_index);
+        for (0..row.len / 4) |i| {
+            const b = row[i * 4];
+            const g = row[i * 4 + 1];
+            const r = row[i * 4 + 2];
+            image_buf[out] = palette.index_map[median_cut.colorIndex(r, g, b)];
+            out += 1;
+        }
+    }
+
+    if (config.use_dithering) {
+        var ditherer = Dither.initWithMap(allocator, palette.index_map, color_table);
+        try ditherer.ditherBgraImage(
+            image,
+            .{ .quantized_buf = image_buf, .color_table = color_table },
+            config.width,
+            config.height,
+            config.row_stride,
+        );
+    }
+
+    var quantized = QuantizedImage.init(color_table, image_buf);
+    quantized.transparent_index = palette.transparent_index;
+    return quantized;
+}
+
+const t = std.testing;
+
+fn solidImage(comptime npixels: usize, bgra: [4]u8) [npixels * 4]u8 {
+    return [_]u8{ bgra[0], bgra[1], bgra[2], bgra[3] } ** npixels;
+}
+
+test "Histogram.distance" {
+    const red = solidImage(30, .{ 0, 0, 255, 255 });
+    const blue = solidImage(30, .{ 255, 0, 0, 255 });
+    var half: [60 * 4]u8 = undefined;
+    @memcpy(half[0..120], &red);
+    @memcpy(half[120..], &blue);
+
+    const h_red = Histogram.fromBgra(&red);
+    const h_blue = Histogram.fromBgra(&blue);
+    const h_half = Histogram.fromBgra(&half);
+
+    try t.expectEqual(0, h_red.distance(&h_red));
+    try t.expectEqual(1, h_red.distance(&h_blue));
+    try t.expectApproxEqAbs(0.5, h_red.distance(&h_half), 0.01);
+}
+
+test "mapBgraImage matches quantizing from scratch" {
+    const allocator = t.allocator;
+    const width = 16;
+    const height = 16;
+
+    var image: [width * height * 4]u8 = undefined;
+    var gen = std.rand.DefaultPrng.init(5);
+    for (0..width * height) |i| {
+        const shade = gen.random().uintLessThan(u8, 8) * 32;
+        image[i * 4 ..][0..4].* = .{ shade, shade / 2, 255 - shade, 255 };
+    }
+
+    const config = QuantizerConfig{
+        .allocator = allocator,
+        .width = width,
+        .height = height,
+        .use_dithering = false,
+        .ncolors = 16,
+        .reserve_transparent_index = true,
+    };
+
+    const palette = try median_cut.buildPalette(config, &image);
+    defer palette.deinit(allocator);
+    const mapped = try mapBgraImage(config, &palette, &image);
+    defer mapped.deinit(allocator);
+    const direct = try median_cut.quantizeBgraImage(config, &image);
+    defer direct.deinit(allocator);
+
+    try t.expectEqualSlices(u8, direct.color_table, mapped.color_table);
+    try t.expectEqualSlices(u8, direct.image_buffer, mapped.image_buffer);
+    try t.expectEqual(direct.transparent_index, mapped.transparent_index);
+}
@@ -1,5 +1,21 @@
 const std = @import("std");
 const median_cut = @import("median-cut.zig");
+const palette_order = @import("palette-order.zig");
+
+pub const PaletteOrder = palette_order.PaletteOrder;
+pub const reorderImage = palette_order.reorderImage;
+pub const reorderFrames = palette_order.reorderFrames;
+pub const reorderPalette = palette_order.reorderPalette;
+
+const palette_reuse = @import("palette.zig");
+pub const Histogram = palette_reuse.Histogram;
+pub const Palette = palette_reuse.Palette;
+pub const mapToPalette = palette_reuse.mapBgraImage;
+pub const PaletteBuilder = @import("palette-builder.zig").PaletteBuilder;
+pub const color_array_size = median_cut.color_array_size;
+pub const countColors = median_cut.countColors;
+pub const countImageColors = median_cut.countImageColors;
+pub const buildPaletteFromCounts = median_cut.buildPaletteFromCounts;
 
 pub const QuantizerConfig = struct {
     width: usize,
@@ -7,6 +23,31 @@ pub const QuantizerConfig = struct {
     use_dithering: bool,
     allocator: std.mem.Allocator,
     ncolors: u16 = 256,
+    /// If true, the last entry of the color table is kept out of the median cut
+    /// and no pixel is mapped to it, so that it can be used as a transparent color.
+    /// The table then has at most `ncolors - 1` usable colors.
+    reserve_transparent_index: bool = false,
+    /// Bytes from the start of one row of the input image to the next, for images that are
+    /// a view into a larger buffer. 0 means the rows are packed, `width * 4` bytes apart.
+    /// Only single image functions (`quantizeImage`, `buildPalette`, `mapToPalette`, ...)
+    /// look at this; frames given to `quantizeFrames` must be packed.
+    row_stride: usize = 0,
+
+    /// Number of pixels in `image`.
+    pub fn pixelCount(self: *const QuantizerConfig, image: []const u8) usize {
+        return if (self.row_stride == 0) image.len / 4 else self.width * self.height;
+    }
+
+    /// Number of rows to walk `image` by with `row`. A packed image is walked as one long row.
+    pub fn rowCount(self: *const QuantizerConfig) usize {
+        return if (self.row_stride == 0) 1 else self.height;
+    }
+
+    /// Row `i` of `image`, out of `rowCount`, as packed BGRA pixels.
+    pub fn row(self: *const QuantizerConfig, image: []const u8, i: usize) []const u8 {
+        if (self.row_stride == 0) return image;
+        return image[i * self.row_stride ..][0 .. self.width * 4];
+    }
 };
 
 /// A single RGB image represented as a list of indices
@@ -17,6 +58,8 @@ pub const QuantizedImage = struct {
     color_table: []u8,
     /// indices into the color table
     image_buffer: []u8,
+    /// Index of the reserved transparent slot in the color table, if one was requested.
+    transparent_index: ?u8 = null,
 
     pub fn init(color_table: []u8, image_buffer: []u8) Self {
         return .{ .color_table = color_table, .image_buffer = image_buffer };
@@ -37,6 +80,8 @@ pub const QuantizedFrames = struct {
     /// A list of frames where each frame is a
     /// list of indices into the color table.
     frames: [][]u8,
+    /// Index of the reserved transparent slot in the color table, if one was requested.
+    transparent_index: ?u8 = null,
 
     /// The allocator used to allocate the color table and the frames.
     allocator: std.mem.Allocator,
@@ -106,6 +151,48 @@ pub fn quantizeBgraImage(
     }
 }
 
+/// Quantize a single BGRA image with all the knobs in `config`.
+pub fn quantizeImage(
+    config: QuantizerConfig,
+    bgra_buf: []const u8,
+    method: Quantize,
+) !QuantizedImage {
+    switch (method) {
+        Quantize.median_cut => {
+            return try median_cut.quantizeBgraImage(config, bgra_buf);
+        },
+        else => std.debug.panic("not implemented!", .{}),
+    }
+}
+
+/// Quantize a list of BGRA frames to one shared color table with all the knobs in `config`.
+pub fn quantizeFrames(
+    config: QuantizerConfig,
+    bgra_bufs: []const []const u8,
+    method: Quantize,
+) !QuantizedFrames {
+    switch (method) {
+        Quantize.median_cut => {
+            return try median_cut.quantizeBgraFrames(config, bgra_bufs);
+        },
+        else => std.debug.panic("not implemented!", .{}),
+    }
+}
+
+/// Build a palette for a BGRA image, which more images can then be mapped to with `mapToPalette`.
+pub fn buildPalette(
+    config: QuantizerConfig,
+    bgra_buf: []const u8,
+    method: Quantize,
+) !Palette {
+    switch (method) {
+        Quantize.median_cut => {
+            return try median_cut.buildPalette(config, bgra_buf);
+        },
+        else => std.debug.panic("not implemented!", .{}),
+    }
+}
+
 /// Reduce the number of colors in an image down to a specific number.
 pub fn reduceColors(
     allocator: std.mem.Allocator,
@@ -125,3 +212,9 @@ pub fn reduceColors(
 
     return try median_cut.quantizeBgraImage(config, bgra_buf);
 }
+
+test {
+    _ = @import("palette.zig");
+    _ = @import("palette-builder.zig");
+    _ = @import("palette-order.zig");
+}
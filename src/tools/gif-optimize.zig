@@ -0,0 +1,232 @@
+const std = @import("std");
+const zgif = @import("zgif");
+const clap = @import("clap");
+
+const io = std.io;
+
+// Shrinks existing GIFs by decoding them and encoding the frames again with our own pipeline:
+// consecutive duplicate frames are merged, unchanged pixels become transparent so that frames
+// are cropped to the area that changed, palettes are reused until the colors change,
+// and LZW can optionally be lossy.
+//
+// The loop count carries over. Transparency doesn't, so inputs with see-through pixels
+// are skipped, and so are those that would come out larger: no output file is left for them.
+
+const ArgError = error{
+    missing_input_path,
+    output_needs_single_input,
+};
+
+/// Configuration options passed from the command line.
+const CliConfig = struct {
+    allocator: std.mem.Allocator,
+    input_paths: []const [:0]const u8,
+    out_path: ?[:0]const u8 = null,
+    lossy: u16 = 0,
+    dither: bool = false,
+
+    pub fn deinit(self: *const CliConfig) void {
+        for (self.input_paths) |path| self.allocator.free(path);
+        self.allocator.free(self.input_paths);
+        if (self.out_path) |path| self.allocator.free(path);
+    }
+};
+
+pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
+    const params = comptime clap.parseParamsComptime(
+        \\-h, --help                Display this message and exit.
+        \\-o, --output     <str>    Set the output filepath, for a single input (default: <input>.min.gif).
+        \\-l, --lossy      <u16>    Allow LZW to use colors this far off, 0 is lossless (default: 0).
+        \\-d, --dither     <u16>    Enable or disable dithering (default: 0).
+        \\<str>...
+    );
+
+    var diag = clap.Diagnostic{};
+
+    const res = clap.parse(clap.Help, &params, clap.parsers.default, .{
+        .diagnostic = &diag,
+        .allocator = allocator,
+    }) catch |err| {
+        // Report useful error and exit
+        diag.report(io.getStdErr().writer(), err) catch {};
+        return err;
+    };
+    defer res.deinit();
+
+    if (res.args.help != 0) {
+        const stderr = std.io.getStdErr().writer();
+        try clap.help(stderr, clap.Help, &params, .{});
+        try stderr.writeAll("\nGIFs with transparent pixels are skipped, as are those that would grow.\n");
+        return null;
+    }
+
+    if (res.positionals.len == 0) return ArgError.missing_input_path;
+    if (res.args.output != null and res.positionals.len > 1) {
+        return ArgError.output_needs_single_input;
+    }
+
+    const input_paths = try allocator.alloc([:0]const u8, res.positionals.len);
+    for (res.positionals, input_paths) |pos, *path| {
+        path.* = try allocator.dupeZ(u8, pos);
+    }
+
+    return CliConfig{
+        .allocator = allocator,
+        .input_paths = input_paths,
+        .out_path = if (res.args.output) |output| try allocator.dupeZ(u8, output) else null,
+        .lossy = res.args.lossy orelse 0,
+        .dither = (res.args.dither orelse 0) > 0,
+    };
+}
+
+const Outcome = enum {
+    written,
+    /// The input shows transparent pixels, which the encoder would turn opaque.
+    skipped_transparent,
+    /// The output was larger than the input, and was deleted.
+    skipped_larger,
+};
+
+const Summary = struct {
+    input_bytes: usize,
+    output_bytes: usize = 0,
+    frames: usize,
+    duplicates: usize = 0,
+    outcome: Outcome,
+};
+
+/// Decode the GIF at `input_path`, and encode it again to `out_path`.
+/// Leaves no file at `out_path` unless the outcome is `.written`.
+pub fn optimize(
+    allocator: std.mem.Allocator,
+    input_path: []const u8,
+    out_path: [:0]const u8,
+    config: *const CliConfig,
+) !Summary {
+    const data = try std.fs.cwd().readFileAlloc(allocator, input_path, std.math.maxInt(usize));
+    defer allocator.free(data);
+
+    const decoded = try zgif.decoder.decode(allocator, data, .{});
+    defer decoded.deinit();
+    if (hasTransparency(decoded.frames)) {
+        return .{ .input_bytes = data.len, .frames = decoded.frames.len, .outcome = .skipped_transparent };
+    }
+
+    var gif = try zgif.Gif.init(allocator, .{
+        .use_dithering = config.dither,
+        .hybrid_palette = .{},
+        .lossy = config.lossy,
+        .parallel = .{},
+        .sink = .{ .path = out_path },
+        .loop_count = decoded.loop_count,
+        .width = decoded.width,
+        .height = decoded.height,
+    });
+    defer gif.deinit();
+    errdefer std.fs.cwd().deleteFile(out_path) catch {};
+
+    // A frame is held back until the next one differs, so that duplicates can extend its delay.
+    var pending: ?zgif.GifFrame = null;
+    var duplicates: usize = 0;
+    for (decoded.frames) |frame| {
+        if (pending) |*prev| {
+            if (std.mem.eql(u8, prev.bgra_buf, frame.bgra_buf)) {
+                prev.duration_ms += frame.duration_ms;
+                duplicates += 1;
+                continue;
+            }
+            try gif.addFrame(prev.*);
+        }
+        pending = frame;
+    }
+    if (pending) |frame| try gif.addFrame(frame);
+    try gif.close();
+
+    const output_bytes: usize = @intCast((try std.fs.cwd().statFile(out_path)).size);
+    const larger = output_bytes > data.len;
+    if (larger) try std.fs.cwd().deleteFile(out_path);
+    return .{
+        .input_bytes = data.len,
+        .output_bytes = output_bytes,
+        .frames = decoded.frames.len,
+        .duplicates = duplicates,
+        .outcome = if (larger) .skipped_larger else .written,
+    };
+}
+
+/// Whether any pixel of `frames` is see-through.
+fn hasTransparency(frames: []const zgif.GifFrame) bool {
+    for (frames) |frame| {
+        var i: usize = 3;
+        while (i < frame.bgra_buf.len) : (i += 4) {
+            if (frame.bgra_buf[i] != 255) return true;
+        }
+    }
+    return false;
+}
+
+pub fn main() !void {
+    var gpa = std.heap.GeneralPurposeAllocator(.{}){};
+    const allocator = gpa.allocator();
+
+    const maybe_config = parseArguments(allocator) catch |err| {
+        switch (err) {
+            ArgError.missing_input_path => {
+                _ = try io.getStdErr().write("Missing input GIF path\n");
+                return;
+            },
+            ArgError.output_needs_single_input => {
+                _ = try io.getStdErr().write("--output can only be used with a single input\n");
+                return;
+            },
+
+            else => return err,
+        }
+    };
+
+    const config = maybe_config orelse return;
+    defer config.deinit();
+
+    for (config.input_paths) |input_path| {
+        const out_path = config.out_path orelse blk: {
+            const stem = if (std.mem.endsWith(u8, input_path, ".gif"))
+                input_path[0 .. input_path.len - 4]
+            else
+                input_path;
+            break :blk try std.fmt.allocPrintZ(allocator, "{s}.min.gif", .{stem});
+        };
+        defer if (config.out_path == null) allocator.free(out_path);
+
+        const summary = optimize(allocator, input_path, out_path, &config) catch |err| {
+            std.debug.print("{s}: {s}\n", .{ input_path, @errorName(err) });
+            continue;
+        };
+
+        switch (summary.outcome) {
+            .written => {},
+            .skipped_transparent => {
+                std.debug.print("{s}: skipped, it has transparent pixels\n", .{input_path});
+                continue;
+            },
+            .skipped_larger => {
+                std.debug.print("{s}: skipped, it would grow from {d} to {d} bytes\n", .{
+                    input_path,
+                    summary.input_bytes,
+                    summary.output_bytes,
+                });
+                continue;
+            },
+        }
+
+        const ratio = @as(f64, @floatFromInt(summary.output_bytes)) /
+            @as(f64, @floatFromInt(@max(summary.input_bytes, 1))) * 100;
+        std.debug.print("{s}: {d} -> {d} bytes ({d:.1}%), {d} frames, {d} duplicates merged\n", .{
+            out_path,
+            summary.input_bytes,
+            summary.output_bytes,
+            ratio,
+            summary.frames,
+            summary.duplicates,
+        });
+    }
+}
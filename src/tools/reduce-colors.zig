@@ -1,5 +1,8 @@
 const std = @import("std");
 const quantize = @import("quantize");
+const zpng = @import("zpng");
+const resample = @import("resample");
+const pixel = @import("pixel");
 const clap = @import("clap");
 // A c wrapper around Sean Barrett's stb_image.h
 const stb = @cImport(@cInclude("load_image.h"));
@@ -9,7 +12,9 @@ const io = std.io;
 const ArgError = error{
     missing_input_path,
     failed_to_load_image,
-    failed_to_write_image,
+    bad_scale,
+    bad_filter,
+    box_needs_half_scale,
 };
 
 const RgbImage = struct {
@@ -31,14 +36,6 @@ const RgbImage = struct {
         };
     }
 
-    pub fn writeToFile(self: *const RgbImage, path: [:0]const u8) !void {
-        // try std.fs.cwd().writeFile("out.rgb", self.rgb);
-        const ok = stb.write_image_to_png(path.ptr, self.rgb.ptr, self.width, self.height);
-        if (!ok) {
-            return ArgError.failed_to_write_image;
-        }
-    }
-
     pub fn deinit(self: *const RgbImage) void {
         stb.free_image(self._c_ptr);
     }
@@ -51,6 +48,17 @@ const CliConfig = struct {
     out_path: [:0]const u8,
     ncolors: u16 = 16,
     dither: bool = false,
+    /// Size of the output, relative to the input image.
+    scale: f64 = 1,
+    filter: resample.Filter = .area,
+
+    /// Size of the output, for an input image of `width` by `height` pixels.
+    pub fn outputSize(self: *const CliConfig, width: usize, height: usize) [2]usize {
+        return .{
+            @max(@as(usize, @intFromFloat(@round(@as(f64, @floatFromInt(width)) * self.scale))), 1),
+            @max(@as(usize, @intFromFloat(@round(@as(f64, @floatFromInt(height)) * self.scale))), 1),
+        };
+    }
 
     pub fn deinit(self: *const CliConfig) void {
         self.allocator.free(self.out_path);
@@ -63,6 +71,8 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
         \\-o, --output     <str>    Set the output filepath (default: out.png).
         \\-n, --ncolors    <u16>    Set the number of colors in the output image (default: 16).
         \\-d, --dither     <u16>    Enable or disable dithering.
+        \\-s, --scale      <f64>    Scale the image down by this factor before reducing its colors (default: 1).
+        \\    --filter     <str>    Scale with box (halves only), bilinear or area (default: area).
         \\<str>...
     );
 
@@ -88,6 +98,15 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
 
     const ncolors = res.args.ncolors orelse 16;
 
+    const scale = res.args.scale orelse 1;
+    if (!(scale > 0 and scale <= 1)) return ArgError.bad_scale;
+
+    const filter: resample.Filter = if (res.args.filter) |name|
+        std.meta.stringToEnum(resample.Filter, name) orelse return ArgError.bad_filter
+    else
+        .area;
+    if (filter == .box and scale != 0.5) return ArgError.box_needs_half_scale;
+
     var img_path: ?[:0]const u8 = null;
     for (res.positionals) |pos| {
         img_path = try allocator.dupeZ(u8, pos);
@@ -102,50 +121,47 @@ pub fn parseArguments(allocator: std.mem.Allocator) !?CliConfig {
         .ncolors = ncolors,
         .img_path = input_path,
         .dither = (res.args.dither orelse 1) > 0,
+        .scale = scale,
+        .filter = filter,
     };
 }
 
+/// Reduce the colors of `image`, scaled to `width` by `height` pixels with `filter`.
+/// The result indexes into a palette of at most `ncolors` colors.
 pub fn doQuantization(
     allocator: std.mem.Allocator,
-    image: *RgbImage,
+    image: *const RgbImage,
+    width: usize,
+    height: usize,
+    filter: resample.Filter,
     ncolors: u16,
     dither: bool,
-) !void {
+) !quantize.QuantizedImage {
     const size = (image.width * image.height);
     const bgra = try allocator.alloc(u8, size * 4);
     defer allocator.free(bgra);
+    pixel.convert(.rgb, .bgra, image.rgb, bgra);
 
-    for (0..size) |i| {
-        const r = image.rgb[i * 3 + 0];
-        const g = image.rgb[i * 3 + 1];
-        const b = image.rgb[i * 3 + 2];
-
-        bgra[i * 4 + 0] = b;
-        bgra[i * 4 + 1] = g;
-        bgra[i * 4 + 2] = r;
-        bgra[i * 4 + 3] = 255;
+    if (width == image.width and height == image.height) {
+        return try quantize.reduceColors(allocator, bgra, width, height, ncolors, dither);
     }
 
-    const q = try quantize.reduceColors(
-        allocator,
-        bgra,
-        image.width,
-        image.height,
-        ncolors,
-        dither,
-    );
-    defer q.deinit(allocator);
-
-    for (0..size) |i| {
-        const ct_index = @as(usize, q.image_buffer[i]) * 3;
-        const r = q.color_table[ct_index + 0];
-        const g = q.color_table[ct_index + 1];
-        const b = q.color_table[ct_index + 2];
-
-        image.rgb[i * 3 + 0] = r;
-        image.rgb[i * 3 + 1] = g;
-        image.rgb[i * 3 + 2] = b;
-    }
+    // Scale down before quantizing, so that the quantizer only sees the pixels that are kept.
+    var resampler = try resample.Resampler.init(allocator, .{
+        .src_width = image.width,
+        .src_height = image.height,
+        .dst_width = width,
+        .dst_height = height,
+        .filter = filter,
+        .n_jobs = 0,
+    });
+    defer resampler.deinit();
+
+    const scaled = try allocator.alloc(u8, width * height * 4);
+    defer allocator.free(scaled);
+    try resampler.resample(.{ .pixels = bgra, .width = image.width, .height = image.height }, scaled);
+
+    return try quantize.reduceColors(allocator, scaled, width, height, ncolors, dither);
 }
 
 pub fn main() !void {
@@ -158,6 +174,18 @@ pub fn main() !void {
                 _ = try io.getStdErr().write("Missing input image path\n");
                 return;
             },
+            ArgError.bad_scale => {
+                _ = try io.getStdErr().write("--scale must be more than 0, and at most 1\n");
+                return;
+            },
+            ArgError.bad_filter => {
+                _ = try io.getStdErr().write("--filter must be box, bilinear or area\n");
+                return;
+            },
+            ArgError.box_needs_half_scale => {
+                _ = try io.getStdErr().write("--filter box only halves the image, so --scale must be 0.5\n");
+                return;
+            },
 
             else => return err,
         }
@@ -178,7 +206,12 @@ pub fn main() !void {
     };
     defer image.deinit();
 
-    try doQuantization(allocator, &image, config.ncolors, config.dither);
-    try image.writeToFile("out.png");
-    std.debug.print("Wrote image with dimensions: {}x{}\n", .{ image.width, image.height });
+    const width, const height = config.outputSize(image.width, image.height);
+
+    const quantized = try doQuantization(allocator, &image, width, height, config.filter, config.ncolors, config.dither);
+    defer quantized.deinit(allocator);
+
+    // The palette goes straight into the PNG, instead of expanding the pixels back to RGB.
+    try zpng.writeIndexedFile(allocator, config.out_path, &quantized, width, height);
+    std.debug.print("Wrote image with dimensions: {}x{}\n", .{ width, height });
 }
@@ -0,0 +1,185 @@
+const std = @import("std");
+
+// Conversions between the pixel layouts that frames go through: BGRA from the capturers,
+// RGBA for screenshots and PNGs with alpha, RGB for PNGs without it and for images
+// loaded from files, and palette indices for quantized images.
+//
+// Every conversion between two byte layouts is one `@shuffle` of 16 pixels at a time,
+// with a mask built at compile time from where each layout keeps its channels. Alpha
+// that the source doesn't have comes out opaque. The pixels past the last multiple of 16
+// are converted one at a time.
+
+pub const Format = enum {
+    rgb,
+    rgba,
+    bgra,
+
+    /// Bytes per pixel.
+    pub fn size(self: Format) usize {
+        return switch (self) {
+            .rgb => 3,
+            .rgba, .bgra => 4,
+        };
+    }
+
+    /// The byte of a pixel that holds red, green, blue and alpha, or null if there is none.
+    fn channels(self: Format) [4]?usize {
+        return switch (self) {
+            .rgb => .{ 0, 1, 2, null },
+            .rgba => .{ 0, 1, 2, 3 },
+            .bgra => .{ 2, 1, 0, 3 },
+        };
+    }
+};
+
+/// Pixels converted per step.
+const lanes = 16;
+
+/// For every byte of `lanes` pixels of `to`, the byte of `lanes` pixels of `from`
+/// that it's copied from, or the first byte of the second vector (255) for missing alpha.
+fn shuffleMask(comptime from: Format, comptime to: Format) [lanes * to.size()]i32 {
+    var mask: [lanes * to.size()]i32 = undefined;
+    const src = from.channels();
+    const dst = to.channels();
+    for (0..lanes) |p| {
+        for (src, dst) |maybe_in, maybe_out| {
+            const out = maybe_out orelse continue;
+            mask[p * to.size() + out] = if (maybe_in) |in| @intCast(p * from.size() + in) else ~@as(i32, 0);
+        }
+    }
+    return mask;
+}
+
+inline fn convertPixel(comptime from: Format, comptime to: Format, src: []const u8, dst: []u8) void {
+    // Read the whole pixel first, in case `dst` is `src`.
+    var in: [4]u8 = .{ 0, 0, 0, 255 };
+    for (from.channels(), 0..) |maybe_in, c| {
+        if (maybe_in) |i| in[c] = src[i];
+    }
+    for (to.channels(), 0..) |maybe_out, c| {
+        if (maybe_out) |o| dst[o] = in[c];
+    }
+}
+
+inline fn convertStep(comptime from: Format, comptime to: Format, src: []const u8, dst: []u8) void {
+    const mask = comptime shuffleMask(from, to);
+    const alpha: @Vector(lanes * from.size(), u8) = @splat(255);
+    const in: @Vector(lanes * from.size(), u8) = src[0 .. lanes * from.size()].*;
+    const out: @Vector(lanes * to.size(), u8) = @shuffle(u8, in, alpha, mask);
+    dst[0 .. lanes * to.size()].* = out;
+}
+
+/// Convert the pixels of `src` from `from` to `to`, into `dst`.
+/// `dst` must have room for as many pixels as `src` holds.
+pub fn convert(comptime from: Format, comptime to: Format, src: []const u8, dst: []u8) void {
+    const npixels = src.len / from.size();
+    std.debug.assert(dst.len >= npixels * to.size());
+
+    var p: usize = 0;
+    while (p + lanes <= npixels) : (p += lanes) {
+        convertStep(from, to, src[p * from.size() ..], dst[p * to.size() ..]);
+    }
+    while (p < npixels) : (p += 1) {
+        convertPixel(from, to, src[p * from.size() ..], dst[p * to.size() ..]);
+    }
+}
+
+/// Convert `npixels` pixels at the start of `pixels` from `from` to `to`, in place.
+/// `pixels` must have room for them in the larger of the two formats.
+pub fn convertInPlace(comptime from: Format, comptime to: Format, pixels: []u8, npixels: usize) void {
+    std.debug.assert(pixels.len >= npixels * @max(from.size(), to.size()));
+
+    // A step only writes over the pixels that it has read, or that were converted already.
+    if (to.size() <= from.size()) return convert(from, to, pixels[0 .. npixels * from.size()], pixels);
+
+    // Growing pixels move to the back, so go from the back: the pixels past the last
+    // whole step, then the steps.
+    var p = npixels;
+    while (p % lanes != 0) {
+        p -= 1;
+        convertPixel(from, to, pixels[p * from.size() ..], pixels[p * to.size() ..]);
+    }
+    while (p > 0) {
+        p -= lanes;
+        convertStep(from, to, pixels[p * from.size() ..], pixels[p * to.size() ..]);
+    }
+}
+
+/// Swap the red and blue channels of 4 byte pixels, turning BGRA into RGBA and back.
+pub fn swapRedBlue(src: []const u8, dst: []u8) void {
+    convert(.bgra, .rgba, src, dst);
+}
+
+/// `swapRedBlue`, in place.
+pub fn swapRedBlueInPlace(pixels: []u8) void {
+    convertInPlace(.bgra, .rgba, pixels, pixels.len / 4);
+}
+
+/// Look up the RGB color of every index of `indices` in `palette`, into `dst`.
+/// `palette` holds RGB triplets, and must have one for every index used.
+pub fn indexedToRgb(indices: []const u8, palette: []const u8, dst: []u8) void {
+    std.debug.assert(dst.len >= indices.len * 3);
+    // Palettes have at most 256 colors, so a 4 byte copy per entry avoids a 3 byte one.
+    var table: [256][4]u8 = undefined;
+    for (0..palette.len / 3) |i| table[i] = .{ palette[i * 3], palette[i * 3 + 1], palette[i * 3 + 2], 255 };
+
+    const last = indices.len -| 1;
+    for (indices[0..last], 0..) |index, i| dst[i * 3 ..][0..4].* = table[index];
+    // The last pixel may be at the very end of `dst`.
+    if (indices.len > 0) dst[last * 3 ..][0..3].* = table[indices[last]][0..3].*;
+}
+
+const t = std.testing;
+
+test "convert – every format pair, whole steps and the rest" {
+    const npixels = 2 * lanes + 5;
+    var rgba: [npixels * 4]u8 = undefined;
+    for (0..npixels) |p| rgba[p * 4 ..][0..4].* = .{ @intCast(p), @intCast(p + 100), @intCast(p + 200 - 55), @intCast(p + 7) };
+    var rgb: [npixels * 3]u8 = undefined;
+    var bgra: [npixels * 4]u8 = undefined;
+
+    convert(.rgba, .bgra, &rgba, &bgra);
+    convert(.bgra, .rgb, &bgra, &rgb);
+    for (0..npixels) |p| {
+        try t.expectEqualSlices(u8, &[_]u8{ rgba[p * 4 + 2], rgba[p * 4 + 1], rgba[p * 4], rgba[p * 4 + 3] }, bgra[p * 4 ..][0..4]);
+        try t.expectEqualSlices(u8, rgba[p * 4 ..][0..3], rgb[p * 3 ..][0..3]);
+    }
+
+    var back: [npixels * 4]u8 = undefined;
+    convert(.rgb, .rgba, &rgb, &back);
+    for (0..npixels) |p| {
+        try t.expectEqualSlices(u8, rgba[p * 4 ..][0..3], back[p * 4 ..][0..3]);
+        try t.expectEqual(255, back[p * 4 + 3]);
+    }
+
+    var rgb_again: [npixels * 3]u8 = undefined;
+    convert(.rgba, .rgb, &rgba, &rgb_again);
+    try t.expectEqualSlices(u8, &rgb, &rgb_again);
+}
+
+test "convertInPlace – shrinking and growing" {
+    const npixels = lanes + 3;
+    var rgb: [npixels * 3]u8 = undefined;
+    for (&rgb, 0..) |*byte, i| byte.* = @intCast(i);
+
+    var expected: [npixels * 4]u8 = undefined;
+    convert(.rgb, .bgra, &rgb, &expected);
+
+    var buf: [npixels * 4]u8 = undefined;
+    @memcpy(buf[0..rgb.len], &rgb);
+    convertInPlace(.rgb, .bgra, &buf, npixels);
+    try t.expectEqualSlices(u8, &expected, &buf);
+
+    convertInPlace(.bgra, .rgb, &buf, npixels);
+    try t.expectEqualSlices(u8, &rgb, buf[0..rgb.len]);
+
+    swapRedBlueInPlace(&expected);
+    for (0..npixels) |p| try t.expectEqualSlices(u8, rgb[p * 3 ..][0..3], expected[p * 4 ..][0..3]);
+}
+
+test "indexedToRgb" {
+    const palette = [_]u8{ 1, 2, 3, 4, 5, 6 };
+    var rgb: [4 * 3]u8 = undefined;
+    indexedToRgb(&[_]u8{ 1, 0, 0, 1 }, &palette, &rgb);
+    try t.expectEqualSlices(u8, &[_]u8{ 4, 5, 6, 1, 2, 3, 1, 2, 3, 4, 5, 6 }, &rgb);
+}
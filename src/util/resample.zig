@@ -0,0 +1,506 @@
+const std = @import("std");
+
+// Resizes BGRA (or RGBA, the channels are treated alike) images, e.g. to bring a Retina
+// capture down to the size of the GIF before it's quantized: every stage after this one
+// pays for each pixel, and a 2x capture has four times as many.
+//
+// `.bilinear` and `.area` are separable: every output pixel is a weighted sum of a few
+// neighbouring input rows, then of a few neighbouring columns of that sum. The weights only
+// depend on the sizes, so a `Resampler` computes them once and reuses them for every frame.
+// The vertical pass works on whole rows, 16 bytes at a time. `.box` only halves images,
+// and averages 2x2 blocks, 8 output pixels at a time.
+//
+// Large frames are cut into bands of output rows, that are resampled on a thread pool.
+
+pub const Filter = enum {
+    /// Average every 2x2 block. Only halves the image: the output must be
+    /// `halfOf` the input, and the last row and column are repeated for odd sizes.
+    box,
+    /// Interpolate between the 4 input pixels nearest to the center of every output pixel.
+    /// Any ratio, but it skips input pixels when shrinking to less than half.
+    bilinear,
+    /// Average the input pixels that every output pixel covers, weighted by how much of them
+    /// it covers. Any ratio, and every input pixel counts. For shrinking.
+    area,
+};
+
+pub const ResampleError = error{
+    empty_image,
+    buffer_too_small,
+    /// The image doesn't have the size that the resampler was made for.
+    size_mismatch,
+    /// `.box` only halves images.
+    unsupported_scale,
+};
+
+/// Pixels to resample, 4 bytes per pixel.
+pub const Image = struct {
+    pixels: []const u8,
+    width: usize,
+    height: usize,
+    /// Bytes from the start of a row to the start of the next one. 0 means `width * 4`.
+    row_stride: usize = 0,
+
+    fn stride(self: *const Image) usize {
+        return if (self.row_stride == 0) self.width * 4 else self.row_stride;
+    }
+
+    fn row(self: *const Image, y: usize) []const u8 {
+        return self.pixels[y * self.stride() ..][0 .. self.width * 4];
+    }
+};
+
+pub const ResamplerConfig = struct {
+    src_width: usize,
+    src_height: usize,
+    dst_width: usize,
+    dst_height: usize,
+    filter: Filter = .area,
+    /// Number of threads to resample on. 1 resamples on the calling thread,
+    /// 0 spawns one per CPU core.
+    n_jobs: usize = 1,
+    /// Roughly how many output pixels go in a band of rows.
+    band_size: usize = 128 * 1024,
+};
+
+/// Half of `n`, rounded up: the size of an image halved with `.box`.
+pub fn halfOf(n: usize) usize {
+    return (n + 1) / 2;
+}
+
+/// Weights are fixed point numbers, out of `one`.
+const weight_bits = 14;
+const one: u16 = 1 << weight_bits;
+/// The vertical pass keeps this many bits of the fraction, so its rows fit in a u16.
+const row_fraction_bits = 8;
+
+/// How every output row (or column) is made of input ones: `ntaps` consecutive
+/// inputs starting at `first[i]`, weighted by `weights[i * ntaps ..][0..ntaps]`.
+const Taps = struct {
+    first: []usize = &.{},
+    weights: []u16 = &.{},
+    ntaps: usize = 0,
+
+    fn init(allocator: std.mem.Allocator, filter: Filter, src_len: usize, dst_len: usize) !Taps {
+        const scale = @as(f64, @floatFromInt(src_len)) / @as(f64, @floatFromInt(dst_len));
+        const max_taps: usize = switch (filter) {
+            .box => unreachable,
+            .bilinear => 2,
+            // The span of an output pixel, plus one for where it starts within the first input.
+            .area => @as(usize, @intFromFloat(@ceil(scale))) + 1,
+        };
+        const ntaps = @min(max_taps, src_len);
+
+        const first = try allocator.alloc(usize, dst_len);
+        errdefer allocator.free(first);
+        const weights = try allocator.alloc(u16, dst_len * ntaps);
+        @memset(weights, 0);
+
+        const one_f: f64 = @floatFromInt(one);
+        for (first, 0..) |*start, i| {
+            const w = weights[i * ntaps ..][0..ntaps];
+            const pos: f64 = @floatFromInt(i);
+            switch (filter) {
+                .box => unreachable,
+                .bilinear => {
+                    const last: f64 = @floatFromInt(src_len - 1);
+                    const center = std.math.clamp((pos + 0.5) * scale - 0.5, 0, last);
+                    const left: usize = @intFromFloat(center);
+                    start.* = @min(left, src_len - ntaps);
+                    const right_weight: u16 = @intFromFloat(@round((center - @floor(center)) * one_f));
+                    w[left - start.*] = one - right_weight;
+                    if (right_weight > 0) w[left - start.* + 1] = right_weight;
+                },
+                .area => {
+                    const lo = pos * scale;
+                    const hi = lo + scale;
+                    start.* = @min(@as(usize, @intFromFloat(lo)), src_len - ntaps);
+                    var total: i32 = 0;
+                    var largest: usize = 0;
+                    for (w, 0..) |*weight, k| {
+                        const j: f64 = @floatFromInt(start.* + k);
+                        const overlap = @max(0, @min(hi, j + 1) - @max(lo, j));
+                        weight.* = @intFromFloat(@round(overlap / scale * one_f));
+                        total += weight.*;
+                        if (weight.* > w[largest]) largest = k;
+                    }
+                    // Rounding leaves the weights a little off: make them add up to exactly one.
+                    w[largest] = @intCast(@as(i32, w[largest]) + one - total);
+                },
+            }
+        }
+
+        return Taps{ .first = first, .weights = weights, .ntaps = ntaps };
+    }
+
+    fn deinit(self: *const Taps, allocator: std.mem.Allocator) void {
+        allocator.free(self.first);
+        allocator.free(self.weights);
+    }
+
+    fn of(self: *const Taps, i: usize) []const u16 {
+        return self.weights[i * self.ntaps ..][0..self.ntaps];
+    }
+};
+
+pub const Resampler = struct {
+    const Self = @This();
+
+    allocator: std.mem.Allocator,
+    config: ResamplerConfig,
+    /// Empty with `.box`.
+    x_taps: Taps = .{},
+    y_taps: Taps = .{},
+    /// Null when resampling on the calling thread.
+    pool: ?*std.Thread.Pool = null,
+    rows_per_band: usize,
+    /// One row of the vertical pass for every band that may run at once.
+    scratch: []u16 = &.{},
+
+    pub fn init(allocator: std.mem.Allocator, config: ResamplerConfig) !Self {
+        if (config.src_width == 0 or config.src_height == 0 or
+            config.dst_width == 0 or config.dst_height == 0)
+        {
+            return ResampleError.empty_image;
+        }
+
+        var self = Self{
+            .allocator = allocator,
+            .config = config,
+            .rows_per_band = @max(config.band_size / config.dst_width, 1),
+        };
+
+        if (config.filter == .box) {
+            if (config.dst_width != halfOf(config.src_width) or config.dst_height != halfOf(config.src_height)) {
+                return ResampleError.unsupported_scale;
+            }
+        } else {
+            self.x_taps = try Taps.init(allocator, config.filter, config.src_width, config.dst_width);
+            errdefer self.x_taps.deinit(allocator);
+            self.y_taps = try Taps.init(allocator, config.filter, config.src_height, config.dst_height);
+        }
+        errdefer self.x_taps.deinit(allocator);
+        errdefer self.y_taps.deinit(allocator);
+
+        const nbands = self.bandCount();
+        if (config.n_jobs != 1 and nbands > 1) {
+            const pool = try allocator.create(std.Thread.Pool);
+            errdefer allocator.destroy(pool);
+            try pool.init(.{
+                .allocator = allocator,
+                .n_jobs = if (config.n_jobs == 0) null else @intCast(config.n_jobs),
+            });
+            self.pool = pool;
+        }
+        errdefer self.deinitPool();
+
+        if (config.filter != .box) {
+            const nrows = if (self.pool == null) 1 else nbands;
+            self.scratch = try allocator.alloc(u16, nrows * config.src_width * 4);
+        }
+        return self;
+    }
+
+    pub fn deinit(self: *Self) void {
+        self.deinitPool();
+        self.x_taps.deinit(self.allocator);
+        self.y_taps.deinit(self.allocator);
+        self.allocator.free(self.scratch);
+    }
+
+    fn deinitPool(self: *Self) void {
+        if (self.pool) |pool| {
+            pool.deinit();
+            self.allocator.destroy(pool);
+        }
+    }
+
+    fn bandCount(self: *const Self) usize {
+        return (self.config.dst_height + self.rows_per_band - 1) / self.rows_per_band;
+    }
+
+    /// Resample `src` into `dst`, which gets `dst_width * dst_height` packed pixels.
+    pub fn resample(self: *Self, src: Image, dst: []u8) !void {
+        const config = &self.config;
+        if (src.width != config.src_width or src.height != config.src_height) {
+            return ResampleError.size_mismatch;
+        }
+        if (src.stride() < src.width * 4 or
+            src.pixels.len < (src.height - 1) * src.stride() + src.width * 4 or
+            dst.len < config.dst_width * config.dst_height * 4)
+        {
+            return ResampleError.buffer_too_small;
+        }
+
+        const nbands = self.bandCount();
+        const pool = self.pool orelse {
+            for (0..nbands) |band| self.resampleBand(&src, dst, band, 0);
+            return;
+        };
+
+        var wait_group = std.Thread.WaitGroup{};
+        for (0..nbands) |band| {
+            wait_group.start();
+            // If no job could be queued, resample the band on this thread instead.
+            pool.spawn(resampleBandJob, .{ self, &src, dst, band, &wait_group }) catch
+                resampleBandJob(self, &src, dst, band, &wait_group);
+        }
+        pool.waitAndWork(&wait_group);
+    }
+
+    /// Runs on a worker thread.
+    fn resampleBandJob(self: *Self, src: *const Image, dst: []u8, band: usize, wait_group: *std.Thread.WaitGroup) void {
+        defer wait_group.finish();
+        self.resampleBand(src, dst, band, band);
+    }
+
+    fn resampleBand(self: *Self, src: *const Image, dst: []u8, band: usize, scratch_index: usize) void {
+        const config = &self.config;
+        const first_row = band * self.rows_per_band;
+        const last_row = @min(first_row + self.rows_per_band, config.dst_height);
+        const dst_row_len = config.dst_width * 4;
+
+        if (config.filter == .box) {
+            for (first_row..last_row) |y| {
+                const row0 = src.row(@min(2 * y, src.height - 1));
+                const row1 = src.row(@min(2 * y + 1, src.height - 1));
+                halveRow(row0, row1, dst[y * dst_row_len ..][0..dst_row_len]);
+            }
+            return;
+        }
+
+        const scratch = self.scratch[scratch_index * src.width * 4 ..][0 .. src.width * 4];
+        for (first_row..last_row) |y| {
+            blendRows(src, self.y_taps.first[y], self.y_taps.of(y), scratch);
+            blendColumns(scratch, &self.x_taps, dst[y * dst_row_len ..][0..dst_row_len]);
+        }
+    }
+};
+
+/// `out` is the weighted sum of the rows of `src` from `first` on, with `row_fraction_bits`
+/// bits of fraction.
+fn blendRows(src: *const Image, first: usize, weights: []const u16, out: []u16) void {
+    const lanes = 16;
+    const Wide = @Vector(lanes, u32);
+    const shift: @Vector(lanes, u5) = @splat(weight_bits - row_fraction_bits);
+    const half: Wide = @splat(1 << (weight_bits - row_fraction_bits - 1));
+
+    var i: usize = 0;
+    while (i + lanes <= out.len) : (i += lanes) {
+        var acc: Wide = @splat(0);
+        for (weights, 0..) |weight, k| {
+            if (weight == 0) continue;
+            const pixels: @Vector(lanes, u8) = src.row(first + k)[i..][0..lanes].*;
+            const wide: Wide = @intCast(pixels);
+            acc += wide * @as(Wide, @splat(weight));
+        }
+        const blended: @Vector(lanes, u16) = @intCast((acc + half) >> shift);
+        out[i..][0..lanes].* = blended;
+    }
+
+    while (i < out.len) : (i += 1) {
+        var acc: u32 = 0;
+        for (weights, 0..) |weight, k| acc += @as(u32, src.row(first + k)[i]) * weight;
+        out[i] = @intCast((acc + (1 << (weight_bits - row_fraction_bits - 1))) >> (weight_bits - row_fraction_bits));
+    }
+}
+
+/// Resample a row made by `blendRows` into `out`, one pixel (4 channels) at a time.
+fn blendColumns(row: []const u16, taps: *const Taps, out: []u8) void {
+    const Wide = @Vector(4, u32);
+    const bits = weight_bits + row_fraction_bits;
+    const shift: @Vector(4, u5) = @splat(bits);
+    const half: Wide = @splat(1 << (bits - 1));
+    const max: Wide = @splat(255);
+
+    for (0..out.len / 4) |x| {
+        var acc: Wide = @splat(0);
+        for (taps.of(x), taps.first[x]..) |weight, column| {
+            const pixel: @Vector(4, u16) = row[column * 4 ..][0..4].*;
+            const wide: Wide = @intCast(pixel);
+            acc += wide * @as(Wide, @splat(weight));
+        }
+        const pixel: @Vector(4, u8) = @intCast(@min((acc + half) >> shift, max));
+        out[x * 4 ..][0..4].* = pixel;
+    }
+}
+
+/// Byte indices of the first and the second pixel of every pair, in 8 pixels.
+const pair_masks = blk: {
+    var even: [32]i32 = undefined;
+    var odd: [32]i32 = undefined;
+    for (0..32) |i| {
+        even[i] = @intCast((i / 4) * 8 + i % 4);
+        odd[i] = even[i] + 4;
+    }
+    break :blk .{ even, odd };
+};
+
+/// Average the 2x2 blocks of two rows into `out`, which is half as wide.
+fn halveRow(row0: []const u8, row1: []const u8, out: []u8) void {
+    const src_width = row0.len / 4;
+    const dst_width = out.len / 4;
+    const pixels = 8; // output pixels per step.
+
+    var x: usize = 0;
+    while (2 * (x + pixels) <= src_width) : (x += pixels) {
+        const a: @Vector(pixels * 8, u8) = row0[x * 8 ..][0 .. pixels * 8].*;
+        const b: @Vector(pixels * 8, u8) = row1[x * 8 ..][0 .. pixels * 8].*;
+        const a_wide: @Vector(pixels * 8, u16) = @intCast(a);
+        const b_wide: @Vector(pixels * 8, u16) = @intCast(b);
+        const sum = a_wide + b_wide;
+        const left = @shuffle(u16, sum, undefined, pair_masks[0]);
+        const right = @shuffle(u16, sum, undefined, pair_masks[1]);
+        const two: @Vector(pixels * 4, u16) = @splat(2);
+        const shift: @Vector(pixels * 4, u4) = @splat(2);
+        const average: @Vector(pixels * 4, u8) = @intCast((left + right + two) >> shift);
+        out[x * 4 ..][0 .. pixels * 4].* = average;
+    }
+
+    // The last few pixels, and the last column of odd widths.
+    while (x < dst_width) : (x += 1) {
+        const x0 = @min(2 * x, src_width - 1) * 4;
+        const x1 = @min(2 * x + 1, src_width - 1) * 4;
+        for (0..4) |c| {
+            const sum = @as(u16, row0[x0 + c]) + row0[x1 + c] + row1[x0 + c] + row1[x1 + c];
+            out[x * 4 + c] = @intCast((sum + 2) / 4);
+        }
+    }
+}
+
+const t = std.testing;
+
+fn randomImage(random: std.Random, pixels: []u8) void {
+    for (pixels) |*byte| byte.* = random.int(u8);
+}
+
+test "Resampler – box halves odd sizes and strided rows" {
+    const width = 37;
+    const height = 9;
+    const stride = width * 4 + 12;
+    var prng = std.rand.DefaultPrng.init(1);
+    var pixels: [height * stride]u8 = undefined;
+    randomImage(prng.random(), &pixels);
+    const src = Image{ .pixels = &pixels, .width = width, .height = height, .row_stride = stride };
+
+    var resampler = try Resampler.init(t.allocator, .{
+        .src_width = width,
+        .src_height = height,
+        .dst_width = halfOf(width),
+        .dst_height = halfOf(height),
+        .filter = .box,
+    });
+    defer resampler.deinit();
+
+    var dst: [halfOf(width) * halfOf(height) * 4]u8 = undefined;
+    try resampler.resample(src, &dst);
+
+    // Every output pixel is the rounded average of its block, with the edges repeated.
+    for (0..halfOf(height)) |y| {
+        for (0..halfOf(width)) |x| {
+            for (0..4) |c| {
+                var sum: u32 = 0;
+                for ([_]usize{ 2 * y, 2 * y + 1 }) |sy| {
+                    for ([_]usize{ 2 * x, 2 * x + 1 }) |sx| {
+                        sum += src.row(@min(sy, height - 1))[@min(sx, width - 1) * 4 + c];
+                    }
+                }
+                try t.expectEqual((sum + 2) / 4, dst[(y * halfOf(width) + x) * 4 + c]);
+            }
+        }
+    }
+
+    try t.expectError(ResampleError.unsupported_scale, Resampler.init(t.allocator, .{
+        .src_width = width,
+        .src_height = height,
+        .dst_width = 10,
+        .dst_height = 3,
+        .filter = .box,
+    }));
+}
+
+test "Resampler – area averages, bilinear interpolates" {
+    // 6x3 pixels, every channel the same: columns 0, 3, 6, ... 15 on every row.
+    var pixels: [6 * 3 * 4]u8 = undefined;
+    for (0..3) |y| {
+        for (0..6) |x| @memset(pixels[(y * 6 + x) * 4 ..][0..4], @intCast(3 * x));
+    }
+    const src = Image{ .pixels = &pixels, .width = 6, .height = 3 };
+
+    // Area, 3:1: the averages of columns 0-2 and 3-5.
+    {
+        var resampler = try Resampler.init(t.allocator, .{ .src_width = 6, .src_height = 3, .dst_width = 2, .dst_height = 1 });
+        defer resampler.deinit();
+        var dst: [2 * 4]u8 = undefined;
+        try resampler.resample(src, &dst);
+        try t.expectEqualSlices(u8, &[_]u8{ 3, 3, 3, 3, 12, 12, 12, 12 }, &dst);
+    }
+
+    // The same size leaves the image as it is, with either filter.
+    for ([_]Filter{ .area, .bilinear }) |filter| {
+        var resampler = try Resampler.init(t.allocator, .{
+            .src_width = 6,
+            .src_height = 3,
+            .dst_width = 6,
+            .dst_height = 3,
+            .filter = filter,
+        });
+        defer resampler.deinit();
+        var dst: [pixels.len]u8 = undefined;
+        try resampler.resample(src, &dst);
+        try t.expectEqualSlices(u8, &pixels, &dst);
+    }
+
+    // Bilinear, 2:1: every output pixel is centered between two columns.
+    {
+        var resampler = try Resampler.init(t.allocator, .{
+            .src_width = 6,
+            .src_height = 3,
+            .dst_width = 3,
+            .dst_height = 3,
+            .filter = .bilinear,
+        });
+        defer resampler.deinit();
+        var dst: [3 * 3 * 4]u8 = undefined;
+        try resampler.resample(src, &dst);
+        for (0..3) |x| try t.expectEqual(@as(u8, @intCast(6 * x + 2)), dst[x * 4]);
+    }
+}
+
+test "Resampler – bands on a thread pool give the same image" {
+    const width = 203;
+    const height = 151;
+    var prng = std.rand.DefaultPrng.init(2);
+    const pixels = try t.allocator.alloc(u8, width * height * 4);
+    defer t.allocator.free(pixels);
+    randomImage(prng.random(), pixels);
+    const src = Image{ .pixels = pixels, .width = width, .height = height };
+
+    for ([_]Filter{ .box, .bilinear, .area }) |filter| {
+        const dst_width = if (filter == .box) halfOf(width) else 67;
+        const dst_height = if (filter == .box) halfOf(height) else 41;
+        var config = ResamplerConfig{
+            .src_width = width,
+            .src_height = height,
+            .dst_width = dst_width,
+            .dst_height = dst_height,
+            .filter = filter,
+        };
+
+        var serial = try Resampler.init(t.allocator, config);
+        defer serial.deinit();
+        config.n_jobs = 4;
+        config.band_size = dst_width * 3;
+        var parallel = try Resampler.init(t.allocator, config);
+        defer parallel.deinit();
+        try t.expect(parallel.pool != null);
+
+        const expected = try t.allocator.alloc(u8, dst_width * dst_height * 4);
+        defer t.allocator.free(expected);
+        const actual = try t.allocator.alloc(u8, dst_width * dst_height * 4);
+        defer t.allocator.free(actual);
+        try serial.resample(src, expected);
+        try parallel.resample(src, actual);
+        try t.expectEqualSlices(u8, expected, actual);
+    }
+}
@@ -0,0 +1,305 @@
+const std = @import("std");
+
+const Atomic = std.atomic.Value;
+const Futex = std.Thread.Futex;
+
+// A bounded queue for exactly one producer thread and one consumer thread, that
+// never takes a lock: the producer only moves `tail`, the consumer only moves `head`,
+// and each one sleeps on a futex when it has to wait for the other.
+// It's meant for handing frames from a capture callback to an encoder, so what
+// happens when the encoder falls behind and the ring is full is up to a `FullPolicy`.
+
+/// What `push` does when the ring is full.
+pub const FullPolicy = enum {
+    /// Wait for the consumer to make room.
+    block,
+    /// Reject the new item.
+    drop_newest,
+    /// Evict the oldest item that the consumer hasn't taken yet, to make room for the new one.
+    drop_oldest,
+    /// Reject the new item, and add its `duration_ms` to the next item that gets in,
+    /// so that the items in the ring still add up to the whole duration.
+    /// Only for items with a `duration_ms` field.
+    merge,
+};
+
+pub const RingError = error{
+    /// `FullPolicy.merge` was asked for items without a `duration_ms` field.
+    merge_needs_duration,
+};
+
+pub const RingConfig = struct {
+    /// Number of items the ring holds. Rounded up to a power of two.
+    capacity: usize = 8,
+    policy: FullPolicy = .block,
+};
+
+pub fn Ring(comptime T: type) type {
+    return struct {
+        const Self = @This();
+        const has_duration = switch (@typeInfo(T)) {
+            .Struct => @hasField(T, "duration_ms"),
+            else => false,
+        };
+
+        allocator: std.mem.Allocator,
+        items: []T,
+        mask: usize,
+        policy: FullPolicy,
+
+        /// Index of the oldest item. Moved by the consumer, and by the producer with `.drop_oldest`.
+        head: Atomic(usize) = Atomic(usize).init(0),
+        /// Index one past the newest item. Only moved by the producer.
+        tail: Atomic(usize) = Atomic(usize).init(0),
+        closed: Atomic(bool) = Atomic(bool).init(false),
+
+        /// Futex words that a waiting side sleeps on, bumped by the other side.
+        pushed: Atomic(u32) = Atomic(u32).init(0),
+        popped: Atomic(u32) = Atomic(u32).init(0),
+        /// Whether a side sleeps, so that the other one only makes a syscall when needed.
+        consumer_waiting: Atomic(bool) = Atomic(bool).init(false),
+        producer_waiting: Atomic(bool) = Atomic(bool).init(false),
+
+        /// Duration of the items rejected with `.merge`, for the next item that gets in.
+        /// Only touched by the producer.
+        carried_ms: f64 = 0,
+
+        /// Number of items that were rejected or evicted because the ring was full.
+        dropped: Atomic(usize) = Atomic(usize).init(0),
+        /// The most items that were ever in the ring at once.
+        high_water: Atomic(usize) = Atomic(usize).init(0),
+
+        pub fn init(allocator: std.mem.Allocator, config: RingConfig) !Self {
+            if (config.policy == .merge and !has_duration) return RingError.merge_needs_duration;
+            const size = try std.math.ceilPowerOfTwo(usize, @max(config.capacity, 1));
+            return Self{
+                .allocator = allocator,
+                .items = try allocator.alloc(T, size),
+                .mask = size - 1,
+                .policy = config.policy,
+            };
+        }
+
+        pub fn deinit(self: *Self) void {
+            self.allocator.free(self.items);
+        }
+
+        pub fn capacity(self: *const Self) usize {
+            return self.items.len;
+        }
+
+        /// Number of items in the ring. Only exact when called from the producer or the consumer
+        /// while the other side is idle.
+        pub fn len(self: *const Self) usize {
+            return self.tail.load(.acquire) -% self.head.load(.acquire);
+        }
+
+        /// Add an item. Called by the producer only.
+        /// Returns the item that didn't make it into the ring, if any: the new one with
+        /// `.drop_newest` and `.merge`, or the evicted oldest one with `.drop_oldest`.
+        /// That item is the caller's to free.
+        pub fn push(self: *Self, item: T) ?T {
+            var new_item = item;
+            var evicted: ?T = null;
+            const tail = self.tail.load(.monotonic);
+
+            while (true) {
+                const head = self.head.load(.acquire);
+                if (tail -% head < self.items.len) break;
+
+                switch (self.policy) {
+                    .block => self.waitForRoom(head),
+                    .drop_newest => {
+                        _ = self.dropped.fetchAdd(1, .monotonic);
+                        return new_item;
+                    },
+                    .merge => {
+                        if (has_duration) self.carried_ms += new_item.duration_ms;
+                        _ = self.dropped.fetchAdd(1, .monotonic);
+                        return new_item;
+                    },
+                    .drop_oldest => {
+                        // Take the oldest item, unless the consumer got to it first.
+                        const oldest = self.items[head & self.mask];
+                        if (self.head.cmpxchgStrong(head, head +% 1, .acq_rel, .acquire) == null) {
+                            _ = self.dropped.fetchAdd(1, .monotonic);
+                            evicted = oldest;
+                            break;
+                        }
+                    },
+                }
+            }
+
+            if (has_duration and self.policy == .merge) {
+                new_item.duration_ms += self.carried_ms;
+                self.carried_ms = 0;
+            }
+
+            self.items[tail & self.mask] = new_item;
+            self.tail.store(tail +% 1, .seq_cst);
+            self.notify(&self.consumer_waiting, &self.pushed);
+
+            const count = tail +% 1 -% self.head.load(.monotonic);
+            if (count > self.high_water.load(.monotonic)) self.high_water.store(count, .monotonic);
+            return evicted;
+        }
+
+        /// Duration of the items rejected with `.merge` after the last one that got in.
+        /// Once `popWait` has returned null, the consumer should add it to the last item it took.
+        pub fn carriedMs(self: *const Self) f64 {
+            std.debug.assert(self.closed.load(.seq_cst));
+            return self.carried_ms;
+        }
+
+        /// Tell the consumer that no more items are coming. Called by the producer only.
+        pub fn close(self: *Self) void {
+            self.closed.store(true, .seq_cst);
+            _ = self.pushed.fetchAdd(1, .seq_cst);
+            Futex.wake(&self.pushed, 1);
+        }
+
+        /// Take the oldest item, or null if the ring is empty. Called by the consumer only.
+        pub fn pop(self: *Self) ?T {
+            while (true) {
+                const head = self.head.load(.acquire);
+                if (head == self.tail.load(.acquire)) return null;
+
+                // With `.drop_oldest`, the producer may evict this item (and reuse its slot)
+                // while it's being read. The read only counts if `head` didn't move meanwhile.
+                const item = self.items[head & self.mask];
+                if (self.head.cmpxchgWeak(head, head +% 1, .seq_cst, .acquire) == null) {
+                    self.notify(&self.producer_waiting, &self.popped);
+                    return item;
+                }
+            }
+        }
+
+        /// Take the oldest item, waiting for one if the ring is empty.
+        /// Returns null once the ring is empty and closed. Called by the consumer only.
+        pub fn popWait(self: *Self) ?T {
+            while (true) {
+                if (self.pop()) |item| return item;
+
+                const seen = self.pushed.load(.seq_cst);
+                self.consumer_waiting.store(true, .seq_cst);
+                defer self.consumer_waiting.store(false, .seq_cst);
+                // Check again now that the producer knows to wake us up.
+                if (self.head.load(.seq_cst) != self.tail.load(.seq_cst)) continue;
+                if (self.closed.load(.seq_cst)) return null;
+                Futex.wait(&self.pushed, seen);
+            }
+        }
+
+        fn waitForRoom(self: *Self, head: usize) void {
+            const seen = self.popped.load(.seq_cst);
+            self.producer_waiting.store(true, .seq_cst);
+            defer self.producer_waiting.store(false, .seq_cst);
+            if (self.head.load(.seq_cst) != head) return;
+            Futex.wait(&self.popped, seen);
+        }
+
+        /// Wake the other side up if it's waiting.
+        fn notify(_: *Self, waiting: *Atomic(bool), word: *Atomic(u32)) void {
+            if (waiting.load(.seq_cst)) {
+                _ = word.fetchAdd(1, .seq_cst);
+                Futex.wake(word, 1);
+            }
+        }
+    };
+}
+
+const t = std.testing;
+
+const Item = struct {
+    id: u32,
+    duration_ms: f64 = 10,
+};
+
+test "Ring – keeps the order, and drops by policy when full" {
+    // Drop the newest.
+    {
+        var ring = try Ring(Item).init(t.allocator, .{ .capacity = 2, .policy = .drop_newest });
+        defer ring.deinit();
+        try t.expectEqual(null, ring.push(.{ .id = 1 }));
+        try t.expectEqual(null, ring.push(.{ .id = 2 }));
+        try t.expectEqual(3, ring.push(.{ .id = 3 }).?.id);
+        try t.expectEqual(1, ring.pop().?.id);
+        try t.expectEqual(null, ring.push(.{ .id = 4 }));
+        try t.expectEqual(2, ring.pop().?.id);
+        try t.expectEqual(4, ring.pop().?.id);
+        try t.expectEqual(null, ring.pop());
+        try t.expectEqual(1, ring.dropped.load(.monotonic));
+        try t.expectEqual(2, ring.high_water.load(.monotonic));
+    }
+
+    // Drop the oldest.
+    {
+        var ring = try Ring(Item).init(t.allocator, .{ .capacity = 2, .policy = .drop_oldest });
+        defer ring.deinit();
+        _ = ring.push(.{ .id = 1 });
+        _ = ring.push(.{ .id = 2 });
+        try t.expectEqual(1, ring.push(.{ .id = 3 }).?.id);
+        try t.expectEqual(2, ring.pop().?.id);
+        try t.expectEqual(3, ring.pop().?.id);
+    }
+
+    // Merge: nothing is lost of the timeline.
+    {
+        var ring = try Ring(Item).init(t.allocator, .{ .capacity = 2, .policy = .merge });
+        defer ring.deinit();
+        _ = ring.push(.{ .id = 1 });
+        _ = ring.push(.{ .id = 2 });
+        try t.expectEqual(3, ring.push(.{ .id = 3 }).?.id);
+        try t.expectEqual(4, ring.push(.{ .id = 4 }).?.id);
+        try t.expectEqual(1, ring.pop().?.id);
+        _ = ring.push(.{ .id = 5 });
+        try t.expectEqual(2, ring.pop().?.id);
+        const merged = ring.pop().?;
+        try t.expectEqual(5, merged.id);
+        try t.expectEqual(30, merged.duration_ms);
+        try t.expectEqual(2, ring.dropped.load(.monotonic));
+
+        // What's rejected after the last item is left for the consumer to add to it.
+        _ = ring.push(.{ .id = 6 });
+        _ = ring.push(.{ .id = 7 });
+        try t.expectEqual(8, ring.push(.{ .id = 8 }).?.id);
+        ring.close();
+        try t.expectEqual(6, ring.popWait().?.id);
+        try t.expectEqual(7, ring.popWait().?.id);
+        try t.expectEqual(null, ring.popWait());
+        try t.expectEqual(10, ring.carriedMs());
+    }
+}
+
+test "Ring – merging needs items with a duration" {
+    try t.expectError(RingError.merge_needs_duration, Ring(u32).init(t.allocator, .{ .policy = .merge }));
+}
+
+test "Ring – a blocking producer and a consumer on two threads" {
+    const count = 100_000;
+    for ([_]FullPolicy{ .block, .drop_oldest }) |policy| {
+        var ring = try Ring(Item).init(t.allocator, .{ .capacity = 4, .policy = policy });
+        defer ring.deinit();
+
+        const producer = try std.Thread.spawn(.{}, struct {
+            fn run(r: *Ring(Item), n: usize) void {
+                for (0..n) |i| _ = r.push(.{ .id = @intCast(i) });
+                r.close();
+            }
+        }.run, .{ &ring, count });
+
+        var received: usize = 0;
+        var last: ?u32 = null;
+        while (ring.popWait()) |item| {
+            if (last) |previous| try t.expect(item.id > previous);
+            last = item.id;
+            received += 1;
+        }
+        producer.join();
+
+        try t.expectEqual(count, received + ring.dropped.load(.monotonic));
+        try t.expectEqual(count - 1, last.?);
+        if (policy == .block) try t.expectEqual(0, ring.dropped.load(.monotonic));
+        try t.expect(ring.high_water.load(.monotonic) <= 4);
+    }
+}